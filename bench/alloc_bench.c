@@ -0,0 +1,369 @@
+/*
+ * alloc_bench: counts the allocations each public operation makes and checks them against checked in budgets.
+ *
+ * Build (Linux, from the repository root):
+ * gcc -O2 -std=c11 -Iinclude -DID3_MALLOC=bench_malloc -DID3_REALLOC=bench_realloc -DID3_FREE=bench_free -include bench/bench_alloc.h
+ *     bench/alloc_bench.c bench/bench_alloc.c source/id3_*.c source/utf.c -pthread -o alloc_bench
+ *
+ * Usage: alloc_bench [-w] [budget_file]
+ * Runs each operation once on a small tag (add_update of every node type, adding and updating, delete, list destroy, id3_write_tag(),
+ * utf8_parse_string()) and prints, as one JSON object, the allocations it made, the bytes they asked for, the peak bytes live during the call
+ * above those live before it, and the bytes it left live (negative if it freed more than it allocated).
+ * Every operation is checked against budget_file (default bench/alloc_budget.txt): one line per operation, "name allocations bytes peak_bytes",
+ * '#' starting a comment. Going over any of the three, or an operation without a budget, fails the run.
+ * -w prints a budget file of the current counts to stdout instead of checking, to update budgets after a deliberate change.
+ * Budgets hold for 64-bit Linux builds without ID3_WITH_ZLIB. Files are written to and removed from the current directory.
+ *
+ * Exit status: 0 if every operation is within its budget, 1 if one is not or an operation failed, 2 on usage or budget file errors.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/id3.h"
+#include "bench_alloc.h"
+
+#ifndef ID3_MALLOC
+#error "build with the counting allocator, see the build line at the top of this file"
+#endif
+
+#define _ALLOC_BENCH_MAX_OPERATIONS 64
+#define _ALLOC_BENCH_FILE_PATH "alloc_bench.mp3"
+#define _ALLOC_BENCH_PICTURE_FILE_PATH "alloc_bench_cover.jpg"
+#define _ALLOC_BENCH_PICTURE_BYTES 4096
+
+/*
+ * Counts of one operation.
+ *
+ * name: Name of the operation, as in the budget file.
+ * counts: What it allocated, see bench_alloc_counts.
+ * is_failed: 1 if the operation itself did not succeed, its counts are then meaningless.
+ */
+typedef struct {
+    const char* name;
+    bench_alloc_counts counts;
+    int is_failed;
+} _alloc_bench_operation;
+
+/*
+ * Operations measured so far.
+ */
+typedef struct {
+    _alloc_bench_operation operations[_ALLOC_BENCH_MAX_OPERATIONS];
+    size_t num_operations;
+} _alloc_bench_state;
+
+// ["PRIVATE" FUNCTIONS] /////////////////////////////////////////////
+
+void _alloc_bench_record(_alloc_bench_state* state, const char* name, int is_succeeded);
+void _alloc_bench_measure_nodes(_alloc_bench_state* state);
+void _alloc_bench_measure_write(_alloc_bench_state* state);
+uint8_t* _alloc_bench_picture_data();
+void _alloc_bench_measure_utf(_alloc_bench_state* state);
+int _alloc_bench_write_file(const char* path, size_t num_bytes);
+int _alloc_bench_check(const _alloc_bench_state* state, const char* budget_path);
+//////////////////////////////////////////////////////////////////////
+
+int main(int argc, char** argv) {
+    int is_writing_budget = 0;
+    int argument = 1;
+
+    if (argument < argc && !strcmp(argv[argument], "-w")) {
+        is_writing_budget = 1;
+        argument++;
+    }
+    if (argument + 1 < argc || (argument < argc && argv[argument][0] == '-')) {
+        fprintf(stderr, "Usage: %s [-w] [budget_file]\n", argv[0]);
+        return 2;
+    }
+
+    const char* budget_path = argument < argc ? argv[argument] : "bench/alloc_budget.txt";
+
+    if (_alloc_bench_write_file(_ALLOC_BENCH_PICTURE_FILE_PATH, _ALLOC_BENCH_PICTURE_BYTES) || _alloc_bench_write_file(_ALLOC_BENCH_FILE_PATH, 65536))
+        return 1;
+
+    _alloc_bench_state state = {.num_operations = 0};
+    _alloc_bench_measure_nodes(&state);
+    _alloc_bench_measure_write(&state);
+    _alloc_bench_measure_utf(&state);
+
+    remove(_ALLOC_BENCH_FILE_PATH);
+    remove(_ALLOC_BENCH_PICTURE_FILE_PATH);
+
+    if (is_writing_budget) {
+        printf("# Allocation budgets checked by bench/alloc_bench.c, for 64-bit Linux builds without ID3_WITH_ZLIB: operation allocations bytes peak_bytes\n"
+               "# An operation allocating more often, more bytes or a higher peak than this fails the run.\n"
+               "# After a deliberate change, regenerate with: ./alloc_bench -w > bench/alloc_budget.txt\n");
+        for (size_t i = 0; i < state.num_operations; i++) {
+            printf("%s %zu %zu %zu\n", state.operations[i].name, state.operations[i].counts.num_allocations, state.operations[i].counts.num_bytes,
+                   state.operations[i].counts.peak_bytes);
+        }
+
+        return 0;
+    }
+
+    printf("{\"benchmark\": \"alloc\", \"results\": [");
+    for (size_t i = 0; i < state.num_operations; i++) {
+        const _alloc_bench_operation* operation = &state.operations[i];
+        printf("%s\n  {\"operation\": \"%s\", \"allocations\": %zu, \"bytes\": %zu, \"peak_bytes\": %zu, \"live_bytes\": %lld}", i > 0 ? "," : "",
+               operation->name, operation->counts.num_allocations, operation->counts.num_bytes, operation->counts.peak_bytes,
+               operation->counts.live_bytes);
+    }
+    printf("\n]}\n");
+
+    return _alloc_bench_check(&state, budget_path);
+}
+
+/*
+ * [INTERNAL FUNCTION]
+ * Records what was allocated since the last bench_alloc_reset() as the counts of an operation.
+ */
+void _alloc_bench_record(_alloc_bench_state* state, const char* name, int is_succeeded) {
+    if (state->num_operations == _ALLOC_BENCH_MAX_OPERATIONS)
+        return;
+
+    state->operations[state->num_operations++] = (_alloc_bench_operation){.name = name, .counts = bench_alloc_read(), .is_failed = !is_succeeded};
+}
+
+/*
+ * [INTERNAL FUNCTION]
+ * Measures adding, updating and deleting a node of each type, and destroying each list, on lists already holding a few nodes.
+ */
+void _alloc_bench_measure_nodes(_alloc_bench_state* state) {
+    id3_text_tag_node* text_tag_list = NULL;
+    id3_comment_tag_node* comment_tag_list = NULL;
+    id3_picture_tag_node* picture_tag_list = NULL;
+    id3_user_tag_list user_tag_list;
+    id3_user_tag_list_init(&user_tag_list);
+
+    id3_text_tag_node_add_update(&text_tag_list, "TPE1", "Artist");
+    id3_text_tag_node_add_update(&text_tag_list, "TALB", "Album");
+    id3_comment_tag_node_add_update(&comment_tag_list, "eng", "", "A comment");
+    id3_user_tag_node_add_update(&user_tag_list, ID3_FRAME_TXXX, "MOOD", "calm");
+    uint8_t* picture_data = _alloc_bench_picture_data();
+
+    bench_alloc_reset();
+    _alloc_bench_record(state, "text_add_update", id3_text_tag_node_add_update(&text_tag_list, "TIT2", "Title") == NODE_ADD_SUCCESS);
+
+    bench_alloc_reset();
+    _alloc_bench_record(state, "text_add_update_long",
+                        id3_text_tag_node_add_update(&text_tag_list, "TIT3", "A subtitle long enough not to be stored inline in its node, 64+ bytes") ==
+                            NODE_ADD_SUCCESS);
+
+    bench_alloc_reset();
+    _alloc_bench_record(state, "text_add_update_existing", id3_text_tag_node_add_update(&text_tag_list, "TIT2", "Another title") == NODE_UPDATE_SUCCESS);
+
+    bench_alloc_reset();
+    _alloc_bench_record(state, "comment_add_update",
+                        id3_comment_tag_node_add_update(&comment_tag_list, "jpn", "lyrics", "夜空に輝く星を見上げて") == NODE_ADD_SUCCESS);
+
+    bench_alloc_reset();
+    _alloc_bench_record(state, "user_add_update", id3_user_tag_node_add_update(&user_tag_list, ID3_FRAME_TXXX, "TEMPO", "slow") == NODE_ADD_SUCCESS);
+
+    bench_alloc_reset();
+    _alloc_bench_record(state, "picture_add_update_file",
+                        id3_picture_tag_node_add_update(&picture_tag_list, "image/jpeg", APIC_TYPE_COVER_FRONT, "", _ALLOC_BENCH_PICTURE_FILE_PATH,
+                                                        NULL, 0) == NODE_ADD_SUCCESS);
+
+    bench_alloc_reset();
+    _alloc_bench_record(state, "picture_add_update_data",
+                        id3_picture_tag_node_add_update(&picture_tag_list, "image/jpeg", APIC_TYPE_COVER_BACK, "", NULL, picture_data,
+                                                        _ALLOC_BENCH_PICTURE_BYTES) == NODE_ADD_SUCCESS);
+
+    bench_alloc_reset();
+    _alloc_bench_record(state, "text_delete", id3_text_tag_node_delete(&text_tag_list, "TIT3") == NODE_DELETE_SUCCESS);
+
+    bench_alloc_reset();
+    _alloc_bench_record(state, "comment_delete", id3_comment_tag_node_delete(&comment_tag_list, "jpn", "lyrics") == NODE_DELETE_SUCCESS);
+
+    bench_alloc_reset();
+    _alloc_bench_record(state, "user_delete", id3_user_tag_node_delete(&user_tag_list, ID3_FRAME_TXXX, "TEMPO") == NODE_DELETE_SUCCESS);
+
+    bench_alloc_reset();
+    _alloc_bench_record(state, "picture_delete", id3_picture_tag_node_delete(&picture_tag_list, APIC_TYPE_COVER_BACK, "") == NODE_DELETE_SUCCESS);
+
+    bench_alloc_reset();
+    id3_text_tag_list_destroy(&text_tag_list);
+    _alloc_bench_record(state, "text_list_destroy", text_tag_list == NULL);
+
+    bench_alloc_reset();
+    id3_comment_tag_list_destroy(&comment_tag_list);
+    _alloc_bench_record(state, "comment_list_destroy", comment_tag_list == NULL);
+
+    bench_alloc_reset();
+    id3_user_tag_list_destroy(&user_tag_list);
+    _alloc_bench_record(state, "user_list_destroy", 1);
+
+    bench_alloc_reset();
+    id3_picture_tag_list_destroy(&picture_tag_list);
+    _alloc_bench_record(state, "picture_list_destroy", picture_tag_list == NULL);
+}
+
+/*
+ * [INTERNAL FUNCTION]
+ * Measures writing a typical tag (a dozen text frames, comments, TXXX frames and two pictures) to a file without a tag, then writing it again.
+ */
+void _alloc_bench_measure_write(_alloc_bench_state* state) {
+    static const char* text_frames[][2] = {{"TIT2", "Title"}, {"TPE1", "Artist"}, {"TALB", "Album"}, {"TRCK", "3/12"}, {"TYER", "2024"},
+                                           {"TCON", "Electronic"}, {"TPE2", "Various Artists"}, {"TCOM", "Composer"}, {"TPOS", "1/2"},
+                                           {"TPUB", "Publisher"}, {"TCOP", "(c) 2024"}, {"TENC", "Encoder"}};
+
+    id3_text_tag_node* text_tag_list = NULL;
+    id3_comment_tag_node* comment_tag_list = NULL;
+    id3_picture_tag_node* picture_tag_list = NULL;
+    id3_user_tag_list user_tag_list;
+    id3_user_tag_list_init(&user_tag_list);
+
+    for (size_t i = 0; i < sizeof(text_frames) / sizeof(text_frames[0]); i++)
+        id3_text_tag_node_add_update(&text_tag_list, (char*)text_frames[i][0], (char*)text_frames[i][1]);
+    id3_comment_tag_node_add_update(&comment_tag_list, "eng", "", "A comment");
+    id3_comment_tag_node_add_update(&comment_tag_list, "jpn", "lyrics", "夜空に輝く星を見上げて、君の名前をそっと呼んだ。");
+    id3_user_tag_node_add_update(&user_tag_list, ID3_FRAME_TXXX, "MOOD", "calm");
+    id3_user_tag_node_add_update(&user_tag_list, ID3_FRAME_TXXX, "TEMPO", "slow");
+    id3_picture_tag_node_add_update(&picture_tag_list, "image/jpeg", APIC_TYPE_COVER_FRONT, "", _ALLOC_BENCH_PICTURE_FILE_PATH, NULL, 0);
+    id3_picture_tag_node_add_update(&picture_tag_list, "image/jpeg", APIC_TYPE_COVER_BACK, "", NULL, _alloc_bench_picture_data(),
+                                    _ALLOC_BENCH_PICTURE_BYTES);
+
+    id3_master_tag_struct master_tag;
+    id3_init_master_tag(&master_tag);
+    master_tag.text_tag_list = &text_tag_list;
+    master_tag.comment_tag_list = &comment_tag_list;
+    master_tag.picture_tag_list = &picture_tag_list;
+    master_tag.user_tag_list = &user_tag_list;
+
+    // the first write encodes every node, the second one finds them encoded and replaces the tag written by the first
+    bench_alloc_reset();
+    _alloc_bench_record(state, "write_tag", id3_write_tag(_ALLOC_BENCH_FILE_PATH, master_tag) == TAG_WRITE_SUCCESS);
+
+    bench_alloc_reset();
+    _alloc_bench_record(state, "write_tag_encoded", id3_write_tag(_ALLOC_BENCH_FILE_PATH, master_tag) == TAG_WRITE_SUCCESS);
+
+    id3_destroy_master_tag(&master_tag);
+}
+
+/*
+ * [INTERNAL FUNCTION]
+ * Measures utf8_parse_string() on short ASCII and CJK strings.
+ */
+void _alloc_bench_measure_utf(_alloc_bench_state* state) {
+    char ascii_string[] = "I walked along the river in the cold December light";
+    char cjk_string[] = "夜空に輝く星を見上げて、君の名前をそっと呼んだ。";
+
+    bench_alloc_reset();
+    utf8_matrix* matrix = utf8_parse_string(ascii_string);
+    _alloc_bench_record(state, "utf8_parse_string_ascii", matrix->outcome == UTF8_PARSE_SUCCESS);
+    utf8_free_matrix(matrix);
+
+    bench_alloc_reset();
+    matrix = utf8_parse_string(cjk_string);
+    _alloc_bench_record(state, "utf8_parse_string_cjk", matrix->outcome == UTF8_PARSE_SUCCESS);
+    utf8_free_matrix(matrix);
+}
+
+/*
+ * [INTERNAL FUNCTION]
+ * Allocates picture data for a node to take ownership of, before the operation measured starts.
+ *
+ * Returns (success): _ALLOC_BENCH_PICTURE_BYTES bytes from ID3_MALLOC()
+ * Returns (failure): NULL, making the operation handed it fail
+ */
+uint8_t* _alloc_bench_picture_data() {
+    uint8_t* picture_data = (uint8_t*)ID3_MALLOC(_ALLOC_BENCH_PICTURE_BYTES);
+
+    for (size_t i = 0; picture_data != NULL && i < _ALLOC_BENCH_PICTURE_BYTES; i++)
+        picture_data[i] = (uint8_t)(i * 31);
+
+    return picture_data;
+}
+
+/*
+ * [INTERNAL FUNCTION]
+ * Writes num_bytes bytes (an MP3 frame sync followed by a pattern) to path.
+ *
+ * Returns: 0 on success, 1 on failure (reported to stderr)
+ */
+int _alloc_bench_write_file(const char* path, size_t num_bytes) {
+    FILE* file_ptr = fopen(path, "wb");
+    if (file_ptr == NULL) {
+        fprintf(stderr, "%s: could not be created\n", path);
+        return 1;
+    }
+
+    int is_write_failed = 0;
+    for (size_t i = 0; i < num_bytes && !is_write_failed; i++)
+        is_write_failed = fputc(i == 0 ? 0xFF : i == 1 ? 0xFB : (int)(i * 7 & 0xFF), file_ptr) == EOF;
+
+    if (fclose(file_ptr) != 0 || is_write_failed) {
+        fprintf(stderr, "%s: could not be written\n", path);
+        return 1;
+    }
+
+    return 0;
+}
+
+/*
+ * [INTERNAL FUNCTION]
+ * Checks every operation against its budget, reporting failed operations, those over budget and those without one to stderr.
+ *
+ * Returns: 0 if every operation is within its budget, 1 if not, 2 if the budget file cannot be read
+ */
+int _alloc_bench_check(const _alloc_bench_state* state, const char* budget_path) {
+    FILE* budget_file = fopen(budget_path, "r");
+    if (budget_file == NULL) {
+        fprintf(stderr, "%s: could not be opened\n", budget_path);
+        return 2;
+    }
+
+    int is_budgeted[_ALLOC_BENCH_MAX_OPERATIONS] = {0};
+    int is_over_budget = 0;
+    char line[256];
+    unsigned int line_number = 0;
+
+    while (fgets(line, sizeof(line), budget_file) != NULL) {
+        line_number++;
+
+        char name[64];
+        size_t max_allocations, max_bytes, max_peak_bytes;
+        char* comment = strchr(line, '#');
+        if (comment != NULL)
+            *comment = '\0';
+        if (strspn(line, " \t\r\n") == strlen(line))
+            continue;
+
+        if (sscanf(line, "%63s %zu %zu %zu", name, &max_allocations, &max_bytes, &max_peak_bytes) != 4) {
+            fprintf(stderr, "%s:%u: expected \"name allocations bytes peak_bytes\"\n", budget_path, line_number);
+            fclose(budget_file);
+            return 2;
+        }
+
+        for (size_t i = 0; i < state->num_operations; i++) {
+            const _alloc_bench_operation* operation = &state->operations[i];
+            if (strcmp(name, operation->name) != 0)
+                continue;
+
+            is_budgeted[i] = 1;
+            if (operation->counts.num_allocations > max_allocations || operation->counts.num_bytes > max_bytes ||
+                operation->counts.peak_bytes > max_peak_bytes) {
+                fprintf(stderr, "Over budget: %s made %zu allocations of %zu bytes peaking at %zu, budget is %zu, %zu, %zu\n", name,
+                        operation->counts.num_allocations, operation->counts.num_bytes, operation->counts.peak_bytes, max_allocations, max_bytes,
+                        max_peak_bytes);
+                is_over_budget = 1;
+            }
+        }
+    }
+
+    fclose(budget_file);
+
+    for (size_t i = 0; i < state->num_operations; i++) {
+        if (state->operations[i].is_failed) {
+            fprintf(stderr, "Failed: %s\n", state->operations[i].name);
+            is_over_budget = 1;
+        } else if (!is_budgeted[i]) {
+            fprintf(stderr, "No budget: %s\n", state->operations[i].name);
+            is_over_budget = 1;
+        }
+    }
+
+    return is_over_budget;
+}
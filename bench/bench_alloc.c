@@ -0,0 +1,109 @@
+#include <pthread.h>
+#include <stdlib.h>
+
+#include "bench_alloc.h"
+
+// Every allocation starts with its size, kept in a prefix large enough not to misalign what follows.
+typedef union {
+    size_t bytes;
+    max_align_t alignment;
+} _bench_alloc_prefix;
+
+static pthread_mutex_t _bench_alloc_mutex = PTHREAD_MUTEX_INITIALIZER;
+static size_t _bench_alloc_num_allocations = 0;
+static size_t _bench_alloc_num_bytes = 0;
+static long long _bench_alloc_live_bytes = 0;
+static long long _bench_alloc_base_bytes = 0;
+static long long _bench_alloc_peak_bytes = 0;
+
+// ["PRIVATE" FUNCTIONS] /////////////////////////////////////////////
+
+void _bench_alloc_count(size_t requested_bytes, long long live_bytes_change);
+//////////////////////////////////////////////////////////////////////
+
+// malloc(), counted.
+void* bench_malloc(size_t bytes) {
+    _bench_alloc_prefix* prefix = (_bench_alloc_prefix*)malloc(sizeof(_bench_alloc_prefix) + bytes);
+    if (prefix == NULL)
+        return NULL;
+
+    prefix->bytes = bytes;
+    _bench_alloc_count(bytes, (long long)bytes);
+
+    return prefix + 1;
+}
+
+// realloc(), counted as one allocation of bytes.
+void* bench_realloc(void* pointer, size_t bytes) {
+    if (pointer == NULL)
+        return bench_malloc(bytes);
+
+    _bench_alloc_prefix* prefix = (_bench_alloc_prefix*)pointer - 1;
+    size_t old_bytes = prefix->bytes;
+
+    prefix = (_bench_alloc_prefix*)realloc(prefix, sizeof(_bench_alloc_prefix) + bytes);
+    if (prefix == NULL)
+        return NULL;
+
+    prefix->bytes = bytes;
+    _bench_alloc_count(bytes, (long long)bytes - (long long)old_bytes);
+
+    return prefix + 1;
+}
+
+// free(), of memory from bench_malloc() or bench_realloc() only.
+void bench_free(void* pointer) {
+    if (pointer == NULL)
+        return;
+
+    _bench_alloc_prefix* prefix = (_bench_alloc_prefix*)pointer - 1;
+
+    pthread_mutex_lock(&_bench_alloc_mutex);
+    _bench_alloc_live_bytes -= (long long)prefix->bytes;
+    pthread_mutex_unlock(&_bench_alloc_mutex);
+
+    free(prefix);
+}
+
+/*
+ * Starts counting afresh, from what is live now.
+ *
+ * Usage:
+ * bench_alloc_reset();
+ * ... operation to measure ...
+ * bench_alloc_counts counts = bench_alloc_read();
+ */
+void bench_alloc_reset() {
+    pthread_mutex_lock(&_bench_alloc_mutex);
+    _bench_alloc_num_allocations = 0;
+    _bench_alloc_num_bytes = 0;
+    _bench_alloc_base_bytes = _bench_alloc_live_bytes;
+    _bench_alloc_peak_bytes = _bench_alloc_live_bytes;
+    pthread_mutex_unlock(&_bench_alloc_mutex);
+}
+
+// Counts since the last bench_alloc_reset(), see bench_alloc_counts.
+bench_alloc_counts bench_alloc_read() {
+    pthread_mutex_lock(&_bench_alloc_mutex);
+    bench_alloc_counts counts = {.num_allocations = _bench_alloc_num_allocations,
+                                 .num_bytes = _bench_alloc_num_bytes,
+                                 .peak_bytes = (size_t)(_bench_alloc_peak_bytes - _bench_alloc_base_bytes),
+                                 .live_bytes = _bench_alloc_live_bytes - _bench_alloc_base_bytes};
+    pthread_mutex_unlock(&_bench_alloc_mutex);
+
+    return counts;
+}
+
+/*
+ * [INTERNAL FUNCTION]
+ * Counts one allocation of requested_bytes, which changed the bytes live by live_bytes_change.
+ */
+void _bench_alloc_count(size_t requested_bytes, long long live_bytes_change) {
+    pthread_mutex_lock(&_bench_alloc_mutex);
+    _bench_alloc_num_allocations++;
+    _bench_alloc_num_bytes += requested_bytes;
+    _bench_alloc_live_bytes += live_bytes_change;
+    if (_bench_alloc_live_bytes > _bench_alloc_peak_bytes)
+        _bench_alloc_peak_bytes = _bench_alloc_live_bytes;
+    pthread_mutex_unlock(&_bench_alloc_mutex);
+}
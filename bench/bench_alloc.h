@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stddef.h>
+
+/*
+ * Counting allocator for the benchmarks, plugged into the library through ID3_MALLOC, ID3_REALLOC and ID3_FREE (see id3_alloc.h):
+ * -DID3_MALLOC=bench_malloc -DID3_REALLOC=bench_realloc -DID3_FREE=bench_free -include bench/bench_alloc.h ... bench/bench_alloc.c
+ * Thread safe, counts allocations made from every thread.
+ *
+ * num_allocations: bench_malloc() and bench_realloc() calls since the last bench_alloc_reset().
+ * num_bytes: Bytes requested by those calls.
+ * peak_bytes: Most bytes live at once since the last bench_alloc_reset(), above those live when it was called.
+ * live_bytes: Bytes live now, above those live when bench_alloc_reset() was last called (negative if some of those were freed since).
+ */
+typedef struct {
+    size_t num_allocations;
+    size_t num_bytes;
+    size_t peak_bytes;
+    long long live_bytes;
+} bench_alloc_counts;
+
+void* bench_malloc(size_t bytes);
+void* bench_realloc(void* pointer, size_t bytes);
+void bench_free(void* pointer);
+void bench_alloc_reset();
+bench_alloc_counts bench_alloc_read();
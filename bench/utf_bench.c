@@ -0,0 +1,314 @@
+/*
+ * utf_bench: times the utf module's kernels over a fixed corpus and counts the allocations they make.
+ *
+ * Build (Linux, from the repository root):
+ * gcc -O2 -std=c11 -Iinclude -DID3_MALLOC=bench_malloc -DID3_REALLOC=bench_realloc -DID3_FREE=bench_free -include bench/bench_alloc.h
+ *     bench/utf_bench.c bench/bench_alloc.c source/utf.c -pthread -o utf_bench
+ *
+ * Usage: utf_bench [corpus]
+ * Runs utf8_contains_multibyte_sequence(), utf8_validate(), utf8_to_utf16_bytes(), utf8_to_utf16_le(), utf8_to_utf16_be() and utf8_parse_string()
+ * over every corpus (ascii, latin1, cjk, emoji, mixed), or only the one given, at every size from 8 B to 1 MiB. Each corpus repeats its seed text
+ * up to the size, cut at a character boundary and filled up with spaces. Each run repeats the call over about 16 MiB of input, after one
+ * untimed call.
+ *
+ * Prints one JSON object, {"benchmark": "utf", "results": [...]}, with for each function, corpus and size:
+ * ns_per_byte, ns_per_call, allocations_per_call and allocated_bytes_per_call.
+ *
+ * Exit status: 0, 1 if a function failed on the corpus, 2 on usage errors.
+ */
+
+// clock_gettime() is POSIX
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../include/utf.h"
+#include "bench_alloc.h"
+
+#ifndef ID3_MALLOC
+#error "build with the counting allocator, see the build line at the top of this file"
+#endif
+
+#define _BENCH_BYTES_PER_RUN (16 * 1024 * 1024)
+
+/*
+ * Seed text of a corpus, repeated up to each size.
+ *
+ * name: Name of the corpus in the results.
+ * seed: UTF-8 text, at most 4 byte characters (emoji become UTF-16 surrogate pairs).
+ */
+typedef struct {
+    const char* name;
+    const char* seed;
+} _utf_bench_corpus;
+
+static const _utf_bench_corpus _UTF_BENCH_CORPORA[] = {
+    {"ascii", "I walked along the river in the cold December light, humming the songs we used to know. "},
+    {"latin1", "Café déjà vu, naïve façade à l'été; crème brûlée, Ærøskøbing smørrebrød, señor niño über alles. "},
+    {"cjk", "夜空に輝く星を見上げて、君の名前をそっと呼んだ。月亮代表我的心，你问我爱你有多深。사랑해요 "},
+    {"emoji", "🎵🎶🎸🥁🎤🎧🌙🔥💖🎹😀🚀"},
+    {"mixed", "Love song ラブソング 情歌 canción d'été 🎵 (live, 2019) 第三章 🔥 "},
+};
+
+static const size_t _UTF_BENCH_SIZES[] = {8, 64, 512, 4096, 65536, 1048576};
+
+/*
+ * A function measured: calls it once on string (num_bytes long, without its null terminator), releasing whatever it returns.
+ * utf16_scratch is at least 2 * num_bytes + 2 bytes, for functions writing into a caller supplied buffer.
+ *
+ * Returns: 0 on success, 1 if the function failed
+ */
+typedef int (*_utf_bench_call)(char* string, size_t num_bytes, uint8_t* utf16_scratch);
+
+// Keeps the compiler from discarding calls whose results go unused.
+static volatile unsigned int _utf_bench_sink = 0;
+
+// ["PRIVATE" FUNCTIONS] /////////////////////////////////////////////
+
+char* _utf_bench_fill(const char* seed, size_t num_bytes);
+int _utf_bench_run(const char* function_name, _utf_bench_call call, const char* corpus_name, char* string, size_t num_bytes, uint8_t* utf16_scratch,
+                   int is_first_result);
+uint64_t _utf_bench_now_ns();
+int _utf_bench_contains_multibyte_sequence(char* string, size_t num_bytes, uint8_t* utf16_scratch);
+int _utf_bench_validate(char* string, size_t num_bytes, uint8_t* utf16_scratch);
+int _utf_bench_to_utf16_bytes(char* string, size_t num_bytes, uint8_t* utf16_scratch);
+int _utf_bench_to_utf16_le(char* string, size_t num_bytes, uint8_t* utf16_scratch);
+int _utf_bench_to_utf16_be(char* string, size_t num_bytes, uint8_t* utf16_scratch);
+int _utf_bench_parse_string(char* string, size_t num_bytes, uint8_t* utf16_scratch);
+//////////////////////////////////////////////////////////////////////
+
+static const struct {
+    const char* name;
+    _utf_bench_call call;
+} _UTF_BENCH_FUNCTIONS[] = {
+    {"utf8_contains_multibyte_sequence", _utf_bench_contains_multibyte_sequence},
+    {"utf8_validate", _utf_bench_validate},
+    {"utf8_to_utf16_bytes", _utf_bench_to_utf16_bytes},
+    {"utf8_to_utf16_le", _utf_bench_to_utf16_le},
+    {"utf8_to_utf16_be", _utf_bench_to_utf16_be},
+    {"utf8_parse_string", _utf_bench_parse_string},
+};
+
+#define _UTF_BENCH_COUNT(array) (sizeof(array) / sizeof((array)[0]))
+
+int main(int argc, char** argv) {
+    const char* only_corpus = argc > 1 ? argv[1] : NULL;
+    int is_corpus_known = only_corpus == NULL;
+
+    for (size_t i = 0; i < _UTF_BENCH_COUNT(_UTF_BENCH_CORPORA); i++) {
+        if (only_corpus != NULL && strcmp(only_corpus, _UTF_BENCH_CORPORA[i].name) == 0)
+            is_corpus_known = 1;
+    }
+    if (argc > 2 || !is_corpus_known) {
+        fprintf(stderr, "Usage: %s [ascii|latin1|cjk|emoji|mixed]\n", argv[0]);
+        return 2;
+    }
+
+    size_t largest_size = _UTF_BENCH_SIZES[_UTF_BENCH_COUNT(_UTF_BENCH_SIZES) - 1];
+    uint8_t* utf16_scratch = (uint8_t*)malloc(2 * largest_size + 2);
+    if (utf16_scratch == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    int is_failed = 0;
+    int is_first_result = 1;
+
+    printf("{\"benchmark\": \"utf\", \"results\": [");
+
+    for (size_t i = 0; i < _UTF_BENCH_COUNT(_UTF_BENCH_CORPORA) && !is_failed; i++) {
+        if (only_corpus != NULL && strcmp(only_corpus, _UTF_BENCH_CORPORA[i].name) != 0)
+            continue;
+
+        for (size_t j = 0; j < _UTF_BENCH_COUNT(_UTF_BENCH_SIZES) && !is_failed; j++) {
+            char* string = _utf_bench_fill(_UTF_BENCH_CORPORA[i].seed, _UTF_BENCH_SIZES[j]);
+            if (string == NULL) {
+                fprintf(stderr, "Out of memory\n");
+                is_failed = 1;
+                break;
+            }
+
+            for (size_t k = 0; k < _UTF_BENCH_COUNT(_UTF_BENCH_FUNCTIONS) && !is_failed; k++) {
+                is_failed = _utf_bench_run(_UTF_BENCH_FUNCTIONS[k].name, _UTF_BENCH_FUNCTIONS[k].call, _UTF_BENCH_CORPORA[i].name, string,
+                                           _UTF_BENCH_SIZES[j], utf16_scratch, is_first_result);
+                is_first_result = 0;
+            }
+
+            free(string);
+        }
+    }
+
+    printf("\n]}\n");
+
+    free(utf16_scratch);
+
+    return is_failed;
+}
+
+/*
+ * [INTERNAL FUNCTION]
+ * Repeats seed up to num_bytes, cutting it at a character boundary and filling what is left with spaces.
+ *
+ * Returns (success): the string, null terminated, to be freed with free()
+ * Returns (failure): NULL if out of memory
+ */
+char* _utf_bench_fill(const char* seed, size_t num_bytes) {
+    char* string = (char*)malloc(num_bytes + 1);
+    if (string == NULL)
+        return NULL;
+
+    size_t seed_bytes = strlen(seed);
+    size_t filled_bytes = 0;
+
+    while (filled_bytes < num_bytes) {
+        size_t copied_bytes = seed_bytes < num_bytes - filled_bytes ? seed_bytes : num_bytes - filled_bytes;
+        memcpy(string + filled_bytes, seed, copied_bytes);
+        filled_bytes += copied_bytes;
+    }
+
+    // back off continuation bytes (10xxxxxx) and the lead byte they follow if the last character was cut
+    size_t cut_bytes = num_bytes;
+    size_t character_start = num_bytes;
+    while (character_start > 0 && ((unsigned char)string[character_start - 1] & 0xC0) == 0x80)
+        character_start--;
+    if (character_start > 0 && ((unsigned char)string[character_start - 1] & 0x80)) {
+        unsigned char lead_byte = (unsigned char)string[character_start - 1];
+        size_t character_bytes = lead_byte >= 0xF0 ? 4 : lead_byte >= 0xE0 ? 3 : 2;
+        if (num_bytes - (character_start - 1) < character_bytes)
+            cut_bytes = character_start - 1;
+    }
+
+    memset(string + cut_bytes, ' ', num_bytes - cut_bytes);
+    string[num_bytes] = '\0';
+
+    return string;
+}
+
+/*
+ * [INTERNAL FUNCTION]
+ * Times call over string and prints its result, preceded by a comma unless is_first_result.
+ *
+ * Returns: 0 on success, 1 if call failed
+ */
+int _utf_bench_run(const char* function_name, _utf_bench_call call, const char* corpus_name, char* string, size_t num_bytes, uint8_t* utf16_scratch,
+                   int is_first_result) {
+    size_t num_calls = _BENCH_BYTES_PER_RUN / num_bytes;
+    if (num_calls == 0)
+        num_calls = 1;
+
+    // warms up caches and lazily set up state, e.g. the SIMD dispatch
+    if (call(string, num_bytes, utf16_scratch) != 0) {
+        fprintf(stderr, "%s failed on %s (%zu bytes)\n", function_name, corpus_name, num_bytes);
+        return 1;
+    }
+
+    bench_alloc_reset();
+    uint64_t start_ns = _utf_bench_now_ns();
+
+    for (size_t i = 0; i < num_calls; i++)
+        call(string, num_bytes, utf16_scratch);
+
+    uint64_t elapsed_ns = _utf_bench_now_ns() - start_ns;
+    bench_alloc_counts counts = bench_alloc_read();
+
+    printf("%s\n  {\"function\": \"%s\", \"corpus\": \"%s\", \"bytes\": %zu, \"calls\": %zu, \"ns_per_byte\": %.4f, \"ns_per_call\": %.1f, "
+           "\"allocations_per_call\": %.2f, \"allocated_bytes_per_call\": %.1f}",
+           is_first_result ? "" : ",", function_name, corpus_name, num_bytes, num_calls, (double)elapsed_ns / ((double)num_calls * num_bytes),
+           (double)elapsed_ns / num_calls, (double)counts.num_allocations / num_calls, (double)counts.num_bytes / num_calls);
+
+    return 0;
+}
+
+/*
+ * [INTERNAL FUNCTION]
+ * Reads the monotonic clock.
+ */
+uint64_t _utf_bench_now_ns() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+}
+
+/*
+ * [INTERNAL FUNCTION]
+ * The functions measured, see _utf_bench_call.
+ */
+int _utf_bench_contains_multibyte_sequence(char* string, size_t num_bytes, uint8_t* utf16_scratch) {
+    (void)num_bytes;
+    (void)utf16_scratch;
+
+    _utf_bench_sink += utf8_contains_multibyte_sequence(string);
+
+    return 0;
+}
+
+int _utf_bench_validate(char* string, size_t num_bytes, uint8_t* utf16_scratch) {
+    (void)num_bytes;
+    (void)utf16_scratch;
+
+    utf8_validation validation;
+    if (utf8_validate(string, &validation) != UTF8_PARSE_SUCCESS)
+        return 1;
+
+    _utf_bench_sink += validation.utf16_bytes;
+
+    return 0;
+}
+
+int _utf_bench_to_utf16_bytes(char* string, size_t num_bytes, uint8_t* utf16_scratch) {
+    unsigned int utf16_bytes;
+    if (utf8_to_utf16_bytes(string, utf16_scratch, (unsigned int)(2 * num_bytes + 2), UTF16_LITTLE_ENDIAN, &utf16_bytes) != UTF16_PARSE_SUCCESS)
+        return 1;
+
+    _utf_bench_sink += utf16_bytes;
+
+    return 0;
+}
+
+int _utf_bench_to_utf16_le(char* string, size_t num_bytes, uint8_t* utf16_scratch) {
+    (void)num_bytes;
+    (void)utf16_scratch;
+
+    uint16_t* utf16_string;
+    unsigned int utf16_length;
+    if (utf8_to_utf16_le(string, &utf16_string, &utf16_length) != UTF16_PARSE_SUCCESS)
+        return 1;
+
+    _utf_bench_sink += utf16_length;
+    ID3_FREE(utf16_string);
+
+    return 0;
+}
+
+int _utf_bench_to_utf16_be(char* string, size_t num_bytes, uint8_t* utf16_scratch) {
+    (void)num_bytes;
+    (void)utf16_scratch;
+
+    uint16_t* utf16_string;
+    unsigned int utf16_length;
+    if (utf8_to_utf16_be(string, &utf16_string, &utf16_length) != UTF16_PARSE_SUCCESS)
+        return 1;
+
+    _utf_bench_sink += utf16_length;
+    ID3_FREE(utf16_string);
+
+    return 0;
+}
+
+int _utf_bench_parse_string(char* string, size_t num_bytes, uint8_t* utf16_scratch) {
+    (void)num_bytes;
+    (void)utf16_scratch;
+
+    utf8_matrix* matrix = utf8_parse_string(string);
+    if (matrix->outcome != UTF8_PARSE_SUCCESS)
+        return 1;
+
+    _utf_bench_sink += matrix->num_chars;
+    utf8_free_matrix(matrix);
+
+    return 0;
+}
@@ -0,0 +1,725 @@
+/*
+ * write_bench: times writing tags to a reproducible synthetic corpus of fake MP3 files, through each write mode of the library.
+ *
+ * Build (Linux, from the repository root):
+ * gcc -O2 -std=c11 -Iinclude bench/write_bench.c source/id3_*.c source/utf.c -pthread -o write_bench
+ *
+ * Usage: write_bench [-d corpus_directory] [-n files] [-s seed] [-a max_audio_mib] [-f max_frames] [-p max_picture_kib] [-r runs]
+ *                    [-o results.json] [-b baseline.json] [-t threshold_percent]
+ * The corpus (default: 8 files in ./write_bench_corpus, seed 1) is generated afresh on every run: file i gets 1 MiB to max_audio_mib (default 4)
+ * of random audio behind MP3 frame syncs, a tag of 5 to max_frames (default 500) text, COMM and TXXX frames, and a cover of 0 to max_picture_kib
+ * (default 1024) KiB, kept both as a picture file next to it and in memory. Every size is drawn from the seed, the same options give the same corpus.
+ * The library only ever writes the tag (see id3_write_tag()), so as id3_retag does, each file is written as its tag followed by its audio,
+ * appended from an untagged copy of it on the thread that wrote the tag. The audio is not synced to disk.
+ *
+ * Modes timed, all over every file of the corpus:
+ * - write_tag: id3_write_tag(), cover read from its file.
+ * - write_tag_memory: id3_write_tag(), cover borrowed from memory.
+ * - write_tag_read_optimized_crc: write_tag_memory with ID3_FRAME_LAYOUT_READ_OPTIMIZED and the CRC extended header.
+ * - write_tag_with_base: id3_write_tag_with_base(), album-wide frames in a base tag, cover from memory.
+ * - write_tag_buffered: id3_write_tag_buffered() through an ID3_BATCH_IO_BUFFER_BYTES buffer, cover from memory.
+ * - batch_write: id3_batch_write() on every online processor, cover from memory.
+ * id3_tag_builder_write() and id3_context_write() are id3_write_tag() and id3_write_tag_with_base() of a builder's tag, they are not timed apart.
+ * Each mode is timed with a cold page cache (corpus files synced and dropped with POSIX_FADV_DONTNEED first) and a warm one, runs times
+ * (default 3) each, keeping the median. Tags are built before the clock starts, encoding them and appending the audio are part of the time.
+ *
+ * Prints one JSON object to standard output, or results.json if given, with ms_per_file and mib_per_s (corpus bytes over time) per mode and cache.
+ * If a baseline (an earlier output with the same corpus options) is given, a mode and cache whose ms_per_file grew by more than
+ * threshold_percent (default 10) is reported as a regression. bench/write_baseline.json is a baseline of the default corpus on one machine,
+ * times only compare on the same machine: take a new one with -o before comparing elsewhere.
+ *
+ * Exit status: 0, 1 on regressions or if a write failed, 2 on usage or corpus errors.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../include/id3.h"
+
+#define _WRITE_BENCH_MIN_AUDIO_BYTES (1024 * 1024)
+#define _WRITE_BENCH_MIN_FRAMES 5
+#define _WRITE_BENCH_MP3_FRAME_BYTES 417  // 128 kbit/s at 44.1 kHz
+#define _WRITE_BENCH_PATH_BYTES 512
+
+#define _WRITE_BENCH_MODE_WRITE_TAG 0
+#define _WRITE_BENCH_MODE_WRITE_TAG_MEMORY 1
+#define _WRITE_BENCH_MODE_READ_OPTIMIZED_CRC 2
+#define _WRITE_BENCH_MODE_WITH_BASE 3
+#define _WRITE_BENCH_MODE_BUFFERED 4
+#define _WRITE_BENCH_MODE_BATCH 5
+#define _WRITE_BENCH_NUM_MODES 6
+
+static const char* _WRITE_BENCH_MODE_NAMES[_WRITE_BENCH_NUM_MODES] = {"write_tag", "write_tag_memory", "write_tag_read_optimized_crc",
+                                                                      "write_tag_with_base", "write_tag_buffered", "batch_write"};
+
+// Text frames every tag starts with, before its COMM and TXXX frames.
+static const uint32_t _WRITE_BENCH_TEXT_FRAMES[] = {ID3_FRAME_TIT2, ID3_FRAME_TPE1, ID3_FRAME_TALB, ID3_FRAME_TRCK, ID3_FRAME_TYER,
+                                                    ID3_FRAME_TCON, ID3_FRAME_TPE2, ID3_FRAME_TCOM, ID3_FRAME_TPOS, ID3_FRAME_TPUB,
+                                                    ID3_FRAME_TCOP, ID3_FRAME_TENC, ID3_FRAME_TBPM, ID3_FRAME_TKEY, ID3_FRAME_TLAN};
+
+// Pieces text values are made of, mostly ASCII, some of them needing ISO-8859-1 or UTF-16.
+static const char* _WRITE_BENCH_WORDS[] = {"night", "drive", "river", "summer", "echo", "glass", "velvet", "signal", "harbor", "neon",
+                                           "café", "déjà vu", "Motörhead", "夜空", "情歌", "🎵"};
+
+/*
+ * One file of the corpus.
+ *
+ * file_path, audio_file_path, picture_file_path: The fake MP3 file, its audio without a tag and its cover.
+ * picture_bytes: The cover in memory, num_picture_bytes long, NULL if the file has no cover.
+ * num_frames: Frames of its tag, cover not included.
+ * frames_seed: Seed the values of its frames are drawn from.
+ * num_file_bytes: Size of the file once tagged, as of the last write.
+ * is_audio_failed: Set if the audio could not be appended to the tag on the last write.
+ */
+typedef struct {
+    char file_path[_WRITE_BENCH_PATH_BYTES];
+    char audio_file_path[_WRITE_BENCH_PATH_BYTES];
+    char picture_file_path[_WRITE_BENCH_PATH_BYTES];
+    uint8_t* picture_bytes;
+    unsigned int num_picture_bytes;
+    unsigned int num_frames;
+    uint64_t frames_seed;
+    size_t num_file_bytes;
+    int is_audio_failed;
+} _write_bench_file;
+
+// ["PRIVATE" FUNCTIONS] /////////////////////////////////////////////
+
+void _write_bench_usage(const char* program_name);
+uint64_t _write_bench_random(uint64_t* state);
+uint64_t _write_bench_random_between(uint64_t* state, uint64_t min, uint64_t max);
+int _write_bench_generate(_write_bench_file* files, size_t num_files, const char* directory, uint64_t seed, size_t max_audio_bytes,
+                          unsigned int max_frames, size_t max_picture_bytes);
+int _write_bench_write_random_file(const char* path, uint64_t* state, size_t num_bytes, int is_mp3);
+unsigned int _write_bench_build_tag(id3_tag_builder* builder, const _write_bench_file* file, int is_picture_in_memory);
+void _write_bench_random_text(uint64_t* state, char* text, size_t text_bytes);
+int _write_bench_run(_write_bench_file* files, size_t num_files, id3_tag_builder* builders, const id3_base_tag* base_tag, int mode,
+                     int is_cold, uint64_t* elapsed_ns);
+int _write_bench_append_audio(_write_bench_file* file);
+void _write_bench_on_job_done(const id3_batch_job* job, size_t job_index, void* user_data);
+void _write_bench_drop_cache(const char* path);
+size_t _write_bench_file_bytes(const char* path);
+uint64_t _write_bench_now_ns();
+int _write_bench_compare(const char* baseline_path, const char* corpus, const double* ms_per_file, double threshold_percent);
+int _write_bench_compare_u64(const void* a, const void* b);
+//////////////////////////////////////////////////////////////////////
+
+int main(int argc, char** argv) {
+    const char* directory = "write_bench_corpus";
+    size_t num_files = 8;
+    uint64_t seed = 1;
+    size_t max_audio_mib = 4;
+    unsigned int max_frames = 500;
+    size_t max_picture_kib = 1024;
+    unsigned int num_runs = 3;
+    const char* output_path = NULL;
+    const char* baseline_path = NULL;
+    double threshold_percent = 10;
+    int option;
+
+    while ((option = getopt(argc, argv, "d:n:s:a:f:p:r:o:b:t:h")) != -1) {
+        switch (option) {
+            case 'd':
+                directory = optarg;
+                break;
+            case 'n':
+                num_files = (size_t)strtoul(optarg, NULL, 10);
+                break;
+            case 's':
+                seed = (uint64_t)strtoull(optarg, NULL, 10);
+                break;
+            case 'a':
+                max_audio_mib = (size_t)strtoul(optarg, NULL, 10);
+                break;
+            case 'f':
+                max_frames = (unsigned int)strtoul(optarg, NULL, 10);
+                break;
+            case 'p':
+                max_picture_kib = (size_t)strtoul(optarg, NULL, 10);
+                break;
+            case 'r':
+                num_runs = (unsigned int)strtoul(optarg, NULL, 10);
+                break;
+            case 'o':
+                output_path = optarg;
+                break;
+            case 'b':
+                baseline_path = optarg;
+                break;
+            case 't':
+                threshold_percent = strtod(optarg, NULL);
+                break;
+            default:
+                _write_bench_usage(argv[0]);
+                return option == 'h' ? 0 : 2;
+        }
+    }
+
+    if (optind < argc || num_files == 0 || num_runs == 0 || max_audio_mib == 0 || max_frames < _WRITE_BENCH_MIN_FRAMES) {
+        _write_bench_usage(argv[0]);
+        return 2;
+    }
+
+    char corpus[256];
+    snprintf(corpus, sizeof(corpus), "files=%zu seed=%llu audio=1-%zuMiB frames=%u-%u picture=0-%zuKiB runs=%u", num_files,
+             (unsigned long long)seed, max_audio_mib, _WRITE_BENCH_MIN_FRAMES, max_frames, max_picture_kib, num_runs);
+
+    _write_bench_file* files = (_write_bench_file*)calloc(num_files, sizeof(_write_bench_file));
+    id3_tag_builder* builders = (id3_tag_builder*)malloc(num_files * sizeof(id3_tag_builder));
+    if (files == NULL || builders == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return 2;
+    }
+
+    fprintf(stderr, "Generating %s in %s\n", corpus, directory);
+    if (_write_bench_generate(files, num_files, directory, seed, max_audio_mib * 1024 * 1024, max_frames, max_picture_kib * 1024))
+        return 2;
+
+    for (size_t i = 0; i < num_files; i++)
+        id3_tag_builder_init(&builders[i]);
+
+    // frames every track of an album shares, for write_tag_with_base
+    id3_tag_builder album_builder;
+    id3_tag_builder_init(&album_builder);
+    const id3_text_frame_value album_frames[] = {{ID3_FRAME_TALB, "Synthetic Album"}, {ID3_FRAME_TPE2, "Various Artists"},
+                                                 {ID3_FRAME_TCON, "Electronic"}, {ID3_FRAME_TYER, "2024"},
+                                                 {ID3_FRAME_TPUB, "Write Bench Records"}, {ID3_FRAME_TCOP, "(c) 2024 Write Bench"}};
+    id3_base_tag base_tag;
+    if (id3_tag_builder_add_text_frames(&album_builder, album_frames, sizeof(album_frames) / sizeof(album_frames[0])) != NODE_ADD_SUCCESS ||
+        id3_base_tag_create(&base_tag, album_builder.master_tag) != TAG_CREATE_SUCCESS) {
+        fprintf(stderr, "Could not create the base tag\n");
+        return 2;
+    }
+    id3_tag_builder_release(&album_builder);
+
+    uint64_t* run_elapsed_ns = (uint64_t*)malloc(num_runs * sizeof(uint64_t));
+    double ms_per_file[_WRITE_BENCH_NUM_MODES * 2];
+    double mib_per_s[_WRITE_BENCH_NUM_MODES * 2];
+    int is_failed = run_elapsed_ns == NULL;
+
+    for (int mode = 0; mode < _WRITE_BENCH_NUM_MODES && !is_failed; mode++) {
+        for (int is_cold = 1; is_cold >= 0 && !is_failed; is_cold--) {
+            // an untimed run first, which also leaves every file tagged as in every timed run
+            uint64_t warm_up_ns;
+            is_failed = _write_bench_run(files, num_files, builders, &base_tag, mode, is_cold, &warm_up_ns);
+
+            for (unsigned int run = 0; run < num_runs && !is_failed; run++)
+                is_failed = _write_bench_run(files, num_files, builders, &base_tag, mode, is_cold, &run_elapsed_ns[run]);
+            if (is_failed)
+                break;
+
+            qsort(run_elapsed_ns, num_runs, sizeof(uint64_t), _write_bench_compare_u64);
+            uint64_t median_ns = run_elapsed_ns[num_runs / 2];
+
+            size_t corpus_bytes = 0;
+            for (size_t i = 0; i < num_files; i++)
+                corpus_bytes += files[i].num_file_bytes;
+
+            int result = mode * 2 + !is_cold;
+            ms_per_file[result] = (double)median_ns / 1e6 / (double)num_files;
+            mib_per_s[result] = median_ns == 0 ? 0 : (double)corpus_bytes / (1024.0 * 1024.0) / ((double)median_ns / 1e9);
+
+            fprintf(stderr, "%-28s %-4s %9.3f ms/file %9.1f MiB/s\n", _WRITE_BENCH_MODE_NAMES[mode], is_cold ? "cold" : "warm", ms_per_file[result],
+                    mib_per_s[result]);
+        }
+    }
+
+    int exit_status = is_failed;
+
+    if (!is_failed) {
+        FILE* output = output_path == NULL ? stdout : fopen(output_path, "w");
+        if (output == NULL) {
+            fprintf(stderr, "%s: %s\n", output_path, strerror(errno));
+            return 2;
+        }
+
+        // one result per line, read back as such by _write_bench_compare()
+        fprintf(output, "{\"benchmark\": \"write\", \"corpus\": \"%s\", \"results\": [\n", corpus);
+        for (int result = 0; result < _WRITE_BENCH_NUM_MODES * 2; result++) {
+            fprintf(output, "  {\"mode\": \"%s\", \"cache\": \"%s\", \"ms_per_file\": %.4f, \"mib_per_s\": %.2f}%s\n",
+                    _WRITE_BENCH_MODE_NAMES[result / 2], result % 2 ? "warm" : "cold", ms_per_file[result], mib_per_s[result],
+                    result + 1 < _WRITE_BENCH_NUM_MODES * 2 ? "," : "");
+        }
+        fprintf(output, "]}\n");
+
+        if (output != stdout)
+            fclose(output);
+
+        if (baseline_path != NULL) {
+            int comparison = _write_bench_compare(baseline_path, corpus, ms_per_file, threshold_percent);
+            if (comparison != 0)
+                exit_status = comparison;
+        }
+    }
+
+    for (size_t i = 0; i < num_files; i++) {
+        id3_tag_builder_release(&builders[i]);
+        free(files[i].picture_bytes);
+    }
+    id3_base_tag_destroy(&base_tag);
+    free(run_elapsed_ns);
+    free(builders);
+    free(files);
+
+    return exit_status;
+}
+
+/*
+ * [INTERNAL FUNCTION]
+ * Prints the usage line to stderr.
+ */
+void _write_bench_usage(const char* program_name) {
+    fprintf(stderr,
+            "Usage: %s [-d corpus_directory] [-n files] [-s seed] [-a max_audio_mib] [-f max_frames] [-p max_picture_kib] [-r runs]\n"
+            "       [-o results.json] [-b baseline.json] [-t threshold_percent]\n",
+            program_name);
+}
+
+/*
+ * [INTERNAL FUNCTION]
+ * xorshift64*, so that a seed gives the same corpus on every platform.
+ *
+ * Returns: the next number of state, which must not be 0
+ */
+uint64_t _write_bench_random(uint64_t* state) {
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+
+    return *state * 0x2545F4914F6CDD1Dull;
+}
+
+/*
+ * [INTERNAL FUNCTION]
+ * Returns: a number from min to max, both included
+ */
+uint64_t _write_bench_random_between(uint64_t* state, uint64_t min, uint64_t max) {
+    if (max <= min)
+        return min;
+
+    return min + _write_bench_random(state) % (max - min + 1);
+}
+
+/*
+ * [INTERNAL FUNCTION]
+ * Writes the corpus to directory (created if missing), replacing files left by earlier runs, and fills in files.
+ *
+ * Returns: 0 on success, 1 on failure (reported to stderr)
+ */
+int _write_bench_generate(_write_bench_file* files, size_t num_files, const char* directory, uint64_t seed, size_t max_audio_bytes,
+                          unsigned int max_frames, size_t max_picture_bytes) {
+    if (mkdir(directory, 0755) != 0 && errno != EEXIST) {
+        fprintf(stderr, "%s: %s\n", directory, strerror(errno));
+        return 1;
+    }
+
+    for (size_t i = 0; i < num_files; i++) {
+        // one stream per file, so that a file does not change with the sizes of those before it
+        uint64_t state = (seed + 1) * 0x9E3779B97F4A7C15ull + i;
+        if (state == 0)
+            state = 1;
+
+        _write_bench_file* file = &files[i];
+        snprintf(file->file_path, sizeof(file->file_path), "%s/track_%03zu.mp3", directory, i);
+        snprintf(file->audio_file_path, sizeof(file->audio_file_path), "%s/audio_%03zu.mp3", directory, i);
+        snprintf(file->picture_file_path, sizeof(file->picture_file_path), "%s/cover_%03zu.jpg", directory, i);
+
+        size_t num_audio_bytes = (size_t)_write_bench_random_between(&state, _WRITE_BENCH_MIN_AUDIO_BYTES, max_audio_bytes);
+        file->num_frames = (unsigned int)_write_bench_random_between(&state, _WRITE_BENCH_MIN_FRAMES, max_frames);
+        file->num_picture_bytes = (unsigned int)_write_bench_random_between(&state, 0, max_picture_bytes);
+        file->frames_seed = _write_bench_random(&state) | 1;
+
+        if (_write_bench_write_random_file(file->audio_file_path, &state, num_audio_bytes, 1) ||
+            _write_bench_write_random_file(file->picture_file_path, &state, file->num_picture_bytes, 0))
+            return 1;
+
+        if (file->num_picture_bytes > 0) {
+            file->picture_bytes = (uint8_t*)malloc(file->num_picture_bytes);
+            FILE* picture_file_ptr = fopen(file->picture_file_path, "rb");
+            size_t read_bytes = 0;
+            if (file->picture_bytes != NULL && picture_file_ptr != NULL)
+                read_bytes = fread(file->picture_bytes, 1, file->num_picture_bytes, picture_file_ptr);
+            if (picture_file_ptr != NULL)
+                fclose(picture_file_ptr);
+
+            if (read_bytes != file->num_picture_bytes) {
+                fprintf(stderr, "%s: could not be read back\n", file->picture_file_path);
+                return 1;
+            }
+        }
+
+        file->num_file_bytes = num_audio_bytes;
+    }
+
+    return 0;
+}
+
+/*
+ * [INTERNAL FUNCTION]
+ * Writes num_bytes random bytes to path, with an MP3 frame sync every _WRITE_BENCH_MP3_FRAME_BYTES if is_mp3,
+ * and a JPEG start of image marker at the start otherwise.
+ *
+ * Returns: 0 on success, 1 on failure (reported to stderr)
+ */
+int _write_bench_write_random_file(const char* path, uint64_t* state, size_t num_bytes, int is_mp3) {
+    FILE* file_ptr = fopen(path, "wb");
+    if (file_ptr == NULL) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        return 1;
+    }
+
+    uint8_t chunk[64 * _WRITE_BENCH_MP3_FRAME_BYTES];
+    size_t written_bytes = 0;
+    int is_write_failed = 0;
+
+    while (written_bytes < num_bytes && !is_write_failed) {
+        for (size_t i = 0; i < sizeof(chunk); i += sizeof(uint64_t)) {
+            uint64_t random_bytes = _write_bench_random(state);
+            memcpy(chunk + i, &random_bytes, sizeof(chunk) - i < sizeof(uint64_t) ? sizeof(chunk) - i : sizeof(uint64_t));
+        }
+
+        if (is_mp3) {
+            // MPEG-1 layer III, 128 kbit/s, 44.1 kHz, no CRC
+            for (size_t i = 0; i < sizeof(chunk); i += _WRITE_BENCH_MP3_FRAME_BYTES) {
+                chunk[i] = 0xFF;
+                chunk[i + 1] = 0xFB;
+                chunk[i + 2] = 0x90;
+                chunk[i + 3] = 0x64;
+            }
+        } else if (written_bytes == 0 && sizeof(chunk) >= 2) {
+            chunk[0] = 0xFF;
+            chunk[1] = 0xD8;
+        }
+
+        size_t chunk_bytes = num_bytes - written_bytes < sizeof(chunk) ? num_bytes - written_bytes : sizeof(chunk);
+        is_write_failed = fwrite(chunk, 1, chunk_bytes, file_ptr) != chunk_bytes;
+        written_bytes += chunk_bytes;
+    }
+
+    if (fclose(file_ptr) != 0 || is_write_failed) {
+        fprintf(stderr, "%s: could not be written\n", path);
+        return 1;
+    }
+
+    return 0;
+}
+
+/*
+ * [INTERNAL FUNCTION]
+ * Builds the tag of a file into an empty builder: text frames first, then COMM and TXXX frames up to num_frames, then the cover if any.
+ * The same file always gets the same values.
+ *
+ * Returns (success): NODE_ADD_SUCCESS
+ * Returns (failure): see the *_add_update_in_arena() functions
+ */
+unsigned int _write_bench_build_tag(id3_tag_builder* builder, const _write_bench_file* file, int is_picture_in_memory) {
+    id3_master_tag_struct* master_tag = &builder->master_tag;
+    uint64_t state = file->frames_seed;
+    size_t num_text_frames = sizeof(_WRITE_BENCH_TEXT_FRAMES) / sizeof(_WRITE_BENCH_TEXT_FRAMES[0]);
+    char value[256];
+    char description[32];
+    unsigned int outcome = NODE_ADD_SUCCESS;
+
+    for (unsigned int i = 0; i < file->num_frames && outcome == NODE_ADD_SUCCESS; i++) {
+        _write_bench_random_text(&state, value, sizeof(value));
+
+        if (i < num_text_frames) {
+            outcome = id3_text_tag_node_add_update_by_id(master_tag->text_tag_list, master_tag->arena, _WRITE_BENCH_TEXT_FRAMES[i], value);
+        } else if (i % 4 == 0) {
+            snprintf(description, sizeof(description), "note %u", i);
+            outcome = id3_comment_tag_node_add_update_in_arena(master_tag->comment_tag_list, master_tag->arena, "eng", description, value);
+        } else {
+            snprintf(description, sizeof(description), "bench %u", i);
+            outcome = id3_user_tag_node_add_update_in_arena(master_tag->user_tag_list, master_tag->arena, ID3_FRAME_TXXX, description, value);
+        }
+    }
+
+    if (outcome != NODE_ADD_SUCCESS || file->num_picture_bytes == 0)
+        return outcome;
+
+    if (is_picture_in_memory)
+        return id3_picture_tag_node_add_update_borrowed(master_tag->picture_tag_list, master_tag->arena, "image/jpeg", APIC_TYPE_COVER_FRONT, "",
+                                                        file->picture_bytes, file->num_picture_bytes);
+
+    return id3_picture_tag_node_add_update_in_arena(master_tag->picture_tag_list, master_tag->arena, "image/jpeg", APIC_TYPE_COVER_FRONT, "",
+                                                    (char*)file->picture_file_path, NULL, 0);
+}
+
+/*
+ * [INTERNAL FUNCTION]
+ * Writes 1 to 8 random words, null terminated, into text.
+ */
+void _write_bench_random_text(uint64_t* state, char* text, size_t text_bytes) {
+    size_t num_words = (size_t)_write_bench_random_between(state, 1, 8);
+    size_t num_vocabulary = sizeof(_WRITE_BENCH_WORDS) / sizeof(_WRITE_BENCH_WORDS[0]);
+    size_t text_length = 0;
+
+    text[0] = '\0';
+    for (size_t i = 0; i < num_words; i++) {
+        // mostly ASCII words, the last few (Latin-1 and beyond) a quarter of the time
+        uint64_t pick = _write_bench_random(state);
+        size_t word = (pick & 3) ? (size_t)((pick >> 2) % (num_vocabulary - 6)) : (size_t)((pick >> 2) % num_vocabulary);
+
+        int printed = snprintf(text + text_length, text_bytes - text_length, "%s%s", i > 0 ? " " : "", _WRITE_BENCH_WORDS[word]);
+        if (printed < 0 || (size_t)printed >= text_bytes - text_length) {
+            text[text_length] = '\0';
+            break;
+        }
+        text_length += (size_t)printed;
+    }
+}
+
+/*
+ * [INTERNAL FUNCTION]
+ * Builds the tag of every file, then writes them all through mode, timing the writes only.
+ *
+ * Returns: 0 on success, 1 if a tag could not be built or written (reported to stderr)
+ */
+int _write_bench_run(_write_bench_file* files, size_t num_files, id3_tag_builder* builders, const id3_base_tag* base_tag, int mode,
+                     int is_cold, uint64_t* elapsed_ns) {
+    int is_picture_in_memory = mode != _WRITE_BENCH_MODE_WRITE_TAG;
+    int is_failed = 0;
+
+    for (size_t i = 0; i < num_files && !is_failed; i++) {
+        id3_tag_builder_reset(&builders[i]);
+
+        if (_write_bench_build_tag(&builders[i], &files[i], is_picture_in_memory) != NODE_ADD_SUCCESS) {
+            fprintf(stderr, "%s: could not build its tag\n", files[i].file_path);
+            is_failed = 1;
+        }
+
+        if (mode == _WRITE_BENCH_MODE_READ_OPTIMIZED_CRC) {
+            builders[i].master_tag.frame_layout = ID3_FRAME_LAYOUT_READ_OPTIMIZED;
+            builders[i].master_tag.is_crc_enabled = 1;
+        } else {
+            builders[i].master_tag.frame_layout = ID3_FRAME_LAYOUT_LIST_ORDER;
+            builders[i].master_tag.is_crc_enabled = 0;
+        }
+
+        if (is_cold) {
+            _write_bench_drop_cache(files[i].file_path);
+            _write_bench_drop_cache(files[i].audio_file_path);
+            _write_bench_drop_cache(files[i].picture_file_path);
+        }
+    }
+
+    if (is_failed)
+        return 1;
+
+    id3_batch_job* jobs = NULL;
+    char* io_buffer = NULL;
+
+    if (mode == _WRITE_BENCH_MODE_BATCH) {
+        jobs = (id3_batch_job*)malloc(num_files * sizeof(id3_batch_job));
+        if (jobs == NULL)
+            return 1;
+
+        for (size_t i = 0; i < num_files; i++)
+            jobs[i] = (id3_batch_job){.file_path = files[i].file_path, .base_tag = NULL, .master_tag = builders[i].master_tag, .outcome = 0};
+    } else if (mode == _WRITE_BENCH_MODE_BUFFERED) {
+        io_buffer = (char*)malloc(ID3_BATCH_IO_BUFFER_BYTES);
+        if (io_buffer == NULL)
+            return 1;
+    }
+
+    uint64_t start_ns = _write_bench_now_ns();
+
+    if (mode == _WRITE_BENCH_MODE_BATCH) {
+        id3_batch_options options;
+        id3_batch_options_init(&options);
+        options.on_job_done = _write_bench_on_job_done;
+        options.user_data = files;
+        id3_batch_write(jobs, num_files, &options);
+    } else {
+        for (size_t i = 0; i < num_files && !is_failed; i++) {
+            unsigned int outcome;
+
+            if (mode == _WRITE_BENCH_MODE_WITH_BASE)
+                outcome = id3_write_tag_with_base(files[i].file_path, base_tag, builders[i].master_tag);
+            else if (mode == _WRITE_BENCH_MODE_BUFFERED)
+                outcome = id3_write_tag_buffered(files[i].file_path, NULL, builders[i].master_tag, io_buffer, ID3_BATCH_IO_BUFFER_BYTES);
+            else
+                outcome = id3_write_tag(files[i].file_path, builders[i].master_tag);
+
+            if (outcome != TAG_WRITE_SUCCESS) {
+                fprintf(stderr, "%s: write failed (%u)\n", files[i].file_path, outcome);
+                is_failed = 1;
+            }
+
+            files[i].is_audio_failed = outcome == TAG_WRITE_SUCCESS && _write_bench_append_audio(&files[i]);
+        }
+    }
+
+    *elapsed_ns = _write_bench_now_ns() - start_ns;
+
+    for (size_t i = 0; jobs != NULL && i < num_files; i++) {
+        if (jobs[i].outcome != TAG_WRITE_SUCCESS) {
+            fprintf(stderr, "%s: write failed (%u)\n", jobs[i].file_path, jobs[i].outcome);
+            is_failed = 1;
+        }
+    }
+
+    for (size_t i = 0; i < num_files; i++) {
+        if (files[i].is_audio_failed) {
+            fprintf(stderr, "%s: could not append its audio\n", files[i].file_path);
+            is_failed = 1;
+        }
+
+        files[i].num_file_bytes = _write_bench_file_bytes(files[i].file_path);
+    }
+
+    free(jobs);
+    free(io_buffer);
+
+    return is_failed;
+}
+
+/*
+ * [INTERNAL FUNCTION]
+ * Appends the untagged audio of a file to the tag just written to it.
+ *
+ * Returns: 0 on success, 1 on failure
+ */
+int _write_bench_append_audio(_write_bench_file* file) {
+    static _Thread_local char copy_buffer[ID3_BATCH_IO_BUFFER_BYTES];
+
+    FILE* audio_file_ptr = fopen(file->audio_file_path, "rb");
+    FILE* file_ptr = fopen(file->file_path, "ab");
+    int is_copied = audio_file_ptr != NULL && file_ptr != NULL;
+
+    size_t read_bytes;
+    while (is_copied && (read_bytes = fread(copy_buffer, 1, sizeof(copy_buffer), audio_file_ptr)) > 0)
+        is_copied = fwrite(copy_buffer, 1, read_bytes, file_ptr) == read_bytes;
+    is_copied = is_copied && !ferror(audio_file_ptr);
+
+    if (audio_file_ptr != NULL)
+        fclose(audio_file_ptr);
+    if (file_ptr != NULL && fclose(file_ptr) != 0)
+        is_copied = 0;
+
+    return !is_copied;
+}
+
+/*
+ * [INTERNAL FUNCTION]
+ * on_job_done of batch_write, appends the audio of each file on the worker that wrote its tag.
+ */
+void _write_bench_on_job_done(const id3_batch_job* job, size_t job_index, void* user_data) {
+    _write_bench_file* file = &((_write_bench_file*)user_data)[job_index];
+
+    file->is_audio_failed = job->outcome == TAG_WRITE_SUCCESS && _write_bench_append_audio(file);
+}
+
+/*
+ * [INTERNAL FUNCTION]
+ * Writes back and evicts a file from the page cache, so that it is next read from disk. Best effort, failures are ignored.
+ */
+void _write_bench_drop_cache(const char* path) {
+    int fd = open(path, O_RDONLY);
+    if (fd == -1)
+        return;
+
+    // dirty pages are not evicted, write them back first
+    fdatasync(fd);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+}
+
+/*
+ * [INTERNAL FUNCTION]
+ * Returns: size of a file, 0 if it cannot be found
+ */
+size_t _write_bench_file_bytes(const char* path) {
+    struct stat file_stat;
+    if (stat(path, &file_stat) != 0)
+        return 0;
+
+    return (size_t)file_stat.st_size;
+}
+
+/*
+ * [INTERNAL FUNCTION]
+ * Reads the monotonic clock.
+ */
+uint64_t _write_bench_now_ns() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+}
+
+/*
+ * [INTERNAL FUNCTION]
+ * Compares ms_per_file with a baseline written by an earlier run over the same corpus, reporting every regression to stderr.
+ *
+ * Returns: 0 if nothing regressed, 1 on regressions, 2 if the baseline cannot be read or was taken over another corpus
+ */
+int _write_bench_compare(const char* baseline_path, const char* corpus, const double* ms_per_file, double threshold_percent) {
+    FILE* baseline_file = fopen(baseline_path, "r");
+    if (baseline_file == NULL) {
+        fprintf(stderr, "%s: %s\n", baseline_path, strerror(errno));
+        return 2;
+    }
+
+    char line[512];
+    int is_same_corpus = 0;
+    int num_compared = 0;
+    int num_regressions = 0;
+
+    while (fgets(line, sizeof(line), baseline_file) != NULL) {
+        char corpus_quoted[300];
+        snprintf(corpus_quoted, sizeof(corpus_quoted), "\"corpus\": \"%s\"", corpus);
+        if (strstr(line, corpus_quoted) != NULL)
+            is_same_corpus = 1;
+
+        char mode_name[64];
+        char cache[8];
+        double baseline_ms_per_file;
+        if (sscanf(line, " {\"mode\": \"%63[^\"]\", \"cache\": \"%7[^\"]\", \"ms_per_file\": %lf", mode_name, cache, &baseline_ms_per_file) != 3)
+            continue;
+
+        for (int mode = 0; mode < _WRITE_BENCH_NUM_MODES; mode++) {
+            if (strcmp(mode_name, _WRITE_BENCH_MODE_NAMES[mode]) != 0)
+                continue;
+
+            int result = mode * 2 + (strcmp(cache, "warm") == 0);
+            num_compared++;
+
+            if (ms_per_file[result] > baseline_ms_per_file * (1 + threshold_percent / 100)) {
+                fprintf(stderr, "Regression: %s (%s) %.3f ms/file, baseline %.3f ms/file (+%.1f%%)\n", mode_name, cache, ms_per_file[result],
+                        baseline_ms_per_file, (ms_per_file[result] / baseline_ms_per_file - 1) * 100);
+                num_regressions++;
+            }
+        }
+    }
+
+    fclose(baseline_file);
+
+    if (!is_same_corpus || num_compared == 0) {
+        fprintf(stderr, "%s: not a baseline of this corpus (%s)\n", baseline_path, corpus);
+        return 2;
+    }
+
+    fprintf(stderr, "%d of %d results regressed beyond %.1f%%\n", num_regressions, num_compared, threshold_percent);
+
+    return num_regressions > 0;
+}
+
+/*
+ * [INTERNAL FUNCTION]
+ * qsort() comparison of two uint64_t.
+ */
+int _write_bench_compare_u64(const void* a, const void* b) {
+    uint64_t value_a = *(const uint64_t*)a;
+    uint64_t value_b = *(const uint64_t*)b;
+
+    return (value_a > value_b) - (value_a < value_b);
+}
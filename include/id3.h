@@ -1,6 +1,18 @@
 #pragma once
 
+#include "id3_alloc.h"
+#include "id3_arena.h"
+#include "id3_base_tag.h"
+#include "id3_batch.h"
+#include "id3_builder.h"
+#include "id3_context.h"
+#include "id3_crc32.h"
+#include "id3_frames.h"
+#include "id3_picture_cache.h"
 #include "id3_process.h"
+#include "id3_read.h"
+#include "id3_stats.h"
+#include "id3_trace.h"
 #include "id3_write.h"
 
 // (Attempts to) adhere to specifications outlined in https://id3.org/id3v2.3.0.
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <stdlib.h>
+
+/*
+ * Every allocation the library makes goes through ID3_MALLOC(), ID3_REALLOC() and ID3_FREE(), which default to malloc(), realloc() and free().
+ * Define all three when building the library to route its memory to another allocator, or to count allocations, bytes and peak usage
+ * per operation (e.g. -DID3_MALLOC=counting_malloc -DID3_REALLOC=counting_realloc -DID3_FREE=counting_free -include counting_alloc.h).
+ * - They are called from whichever thread uses the library (see id3_context), they must be thread safe if the library is used from several threads.
+ * - Memory handed to the library (ID3_PICTURE_DATA_OWNED picture data, id3_shared_picture_create()) is released with ID3_FREE(), allocate it with ID3_MALLOC().
+ * - Memory handed out by the library (utf8_to_utf16_le(), utf8_to_utf16_be()) comes from ID3_MALLOC(), release it with ID3_FREE().
+ * - zlib (ID3_WITH_ZLIB) allocates on its own, id3_arena chunks count as single allocations however many nodes they hold.
+ */
+#if defined(ID3_MALLOC) || defined(ID3_REALLOC) || defined(ID3_FREE)
+#if !defined(ID3_MALLOC) || !defined(ID3_REALLOC) || !defined(ID3_FREE)
+#error "ID3_MALLOC, ID3_REALLOC and ID3_FREE must be defined together"
+#endif
+#else
+#define ID3_MALLOC(bytes) malloc(bytes)
+#define ID3_REALLOC(pointer, bytes) realloc(pointer, bytes)
+#define ID3_FREE(pointer) free(pointer)
+#endif
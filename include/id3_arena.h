@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct id3_arena_chunk id3_arena_chunk;
+typedef struct id3_arena id3_arena;
+
+#include "id3_alloc.h"
+
+/*
+ * A single block of memory handed out by an id3_arena.
+ *
+ * next: Next chunk in the arena, chunks are kept even after a reset so they can be handed out again.
+ * capacity: Usable bytes in data.
+ * used: Bytes already handed out from data.
+ */
+struct id3_arena_chunk {
+    struct id3_arena_chunk* next;
+    size_t capacity;
+    size_t used;
+    max_align_t data[];
+};
+
+/*
+ * Bump allocator used to back every node of a tag with a handful of large allocations.
+ * Memory handed out by an arena is never freed individually, only all at once by id3_arena_reset() or id3_arena_release().
+ *
+ * head: First chunk owned by the arena.
+ * current: Chunk that allocations are currently being served from.
+ * chunk_bytes: Default capacity of a newly allocated chunk. Larger requests get a chunk of their own size.
+ */
+struct id3_arena {
+    id3_arena_chunk* head;
+    id3_arena_chunk* current;
+    size_t chunk_bytes;
+};
+
+#define ID3_ARENA_DEFAULT_CHUNK_BYTES 4096
+
+void id3_arena_init(id3_arena* arena, size_t chunk_bytes);
+void* id3_arena_alloc(id3_arena* arena, size_t bytes);
+int id3_arena_reserve(id3_arena* arena, size_t bytes);
+void id3_arena_reset(id3_arena* arena);
+void id3_arena_release(id3_arena* arena);
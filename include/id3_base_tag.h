@@ -0,0 +1,55 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct id3_base_tag_frame id3_base_tag_frame;
+typedef struct id3_base_tag id3_base_tag;
+
+#include "id3_frames.h"
+#include "id3_process.h"
+#include "id3_write.h"
+
+/*
+ * Index entry of a single frame of a base tag, holding what is needed to tell whether an overlay frame replaces it.
+ *
+ * frame_id: Fourcc of the frame (see id3_frames.h).
+ * language: Language of a COMM frame, empty otherwise.
+ * picture_type: Picture type of an APIC frame, 0 otherwise.
+ * description: UTF-8 short content description of a COMM frame or description of an APIC, TXXX or WXXX frame, NULL otherwise.
+ * offset: Offset of the frame (starting with its 10 byte header) in id3_base_tag.frames.
+ * num_bytes: Size of the frame including its 10 byte header.
+ */
+struct id3_base_tag_frame {
+    uint32_t frame_id;
+    char language[4];
+    uint8_t picture_type;
+    char* description;
+    unsigned int offset;
+    unsigned int num_bytes;
+};
+
+/*
+ * A set of frames serialized once, exactly as they will appear in file, to be shared by many tags.
+ * Frames common to every track of an album go into a base tag, id3_write_tag_with_base() then copies them into each file
+ * alongside the track's own frames (the overlay), which replace base frames with the same key.
+ * - A base tag is never modified after id3_base_tag_create(), it can be shared between threads as long as it is not destroyed.
+ * - Keys are the same as those used by the *_add_update() functions: frame ID for text frames,
+ *   language and short content description for COMM frames, picture type (and description) for APIC frames,
+ *   frame ID and description for TXXX and WXXX frames.
+ *
+ * frames: All frames back to back, frames_bytes long.
+ * frame_index: One entry per frame, in the order the frames appear in frames.
+ */
+struct id3_base_tag {
+    uint8_t* frames;
+    unsigned int frames_bytes;
+    id3_base_tag_frame* frame_index;
+    unsigned int num_frames;
+};
+
+unsigned int id3_base_tag_create(id3_base_tag* base_tag, id3_master_tag_struct master_tag_collection);
+int id3_base_tag_frame_is_overridden(const id3_base_tag_frame* frame, id3_master_tag_struct overlay_tag_collection);
+void id3_base_tag_destroy(id3_base_tag* base_tag);
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct id3_batch_job id3_batch_job;
+typedef struct id3_batch_options id3_batch_options;
+
+#include "id3_base_tag.h"
+#include "id3_process.h"
+#include "id3_write.h"
+
+// Size of the stdio buffer each batch worker writes files through.
+#define ID3_BATCH_IO_BUFFER_BYTES (256 * 1024)
+
+/*
+ * One file to be tagged by id3_batch_write().
+ *
+ * file_path: File to write the tag to.
+ * base_tag: Base tag to write the tag on top of (see id3_write_tag_with_base()), NULL for none.
+ * master_tag: Tag to write, it must not share lists with the master tag of any other job.
+ * outcome: Set by id3_batch_write(), see id3_write_tag(), or TAG_WRITE_CANCELLED if the job was never started.
+ */
+struct id3_batch_job {
+    char* file_path;
+    const id3_base_tag* base_tag;
+    id3_master_tag_struct master_tag;
+    unsigned int outcome;
+};
+
+/*
+ * num_threads: Threads to run jobs on, the calling thread included. 0 uses one per online processor.
+ * cancel: If not NULL, setting it to non-zero (from any thread) stops jobs from being started, jobs already running finish.
+ * on_job_done: If not NULL, called after each job that was run, on the thread that ran it. Calls can happen concurrently.
+ * user_data: Passed as is to on_job_done.
+ */
+struct id3_batch_options {
+    unsigned int num_threads;
+    const atomic_int* cancel;
+    void (*on_job_done)(const id3_batch_job* job, size_t job_index, void* user_data);
+    void* user_data;
+};
+
+void id3_batch_options_init(id3_batch_options* options);
+unsigned int id3_batch_write(id3_batch_job* jobs, size_t num_jobs, const id3_batch_options* options);
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct id3_tag_builder id3_tag_builder;
+typedef struct id3_text_frame_value id3_text_frame_value;
+
+#include "id3_arena.h"
+#include "id3_frames.h"
+#include "id3_process.h"
+#include "id3_write.h"
+
+/*
+ * Owns the tag lists of a tag and the arena backing them, so that one builder can be reused for file after file.
+ * id3_tag_builder_reset() keeps every chunk of the arena, once the builder has seen its largest tag, tagging further files allocates nothing.
+ * - master_tag points at the lists and arena of the builder itself, so a builder must not be copied or moved after id3_tag_builder_init().
+ * - The lists can be used with any *_add_update_in_arena() function as long as builder->master_tag.arena is passed as the arena.
+ */
+struct id3_tag_builder {
+    id3_arena arena;
+    id3_text_tag_node* text_tag_list;
+    id3_comment_tag_node* comment_tag_list;
+    id3_picture_tag_node* picture_tag_list;
+    id3_user_tag_list user_tag_list;
+    id3_master_tag_struct master_tag;
+};
+
+// A (frame ID, value) pair for id3_tag_builder_add_text_frames(). frame_id is a fourcc such as ID3_FRAME_TALB.
+struct id3_text_frame_value {
+    uint32_t frame_id;
+    const char* value;
+};
+
+void id3_tag_builder_init(id3_tag_builder* builder);
+int id3_tag_builder_reserve(id3_tag_builder* builder, size_t num_frames);
+unsigned int id3_tag_builder_add_text_frames(id3_tag_builder* builder, const id3_text_frame_value* frames, size_t num_frames);
+unsigned int id3_tag_builder_write(id3_tag_builder* builder, char* file_path);
+void id3_tag_builder_reset(id3_tag_builder* builder);
+void id3_tag_builder_release(id3_tag_builder* builder);
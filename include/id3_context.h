@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct id3_context id3_context;
+
+#include "id3_base_tag.h"
+#include "id3_builder.h"
+#include "id3_picture_cache.h"
+#include "id3_process.h"
+#include "id3_stats.h"
+#include "id3_write.h"
+
+/*
+ * Everything one thread needs to tag file after file: a builder holding the tag being built and a picture cache.
+ * The library keeps no mutable global state, all of it lives in objects owned by the caller, so threads that each use
+ * their own context (or their own lists, arenas, builders and caches) can tag files concurrently without any locking.
+ *
+ * Thread safety:
+ * - A context, and everything reachable from it, must only be used by one thread at a time.
+ * - An id3_base_tag can be read by any number of threads at once (e.g. passed to id3_context_write() by every worker),
+ *   as long as it is not destroyed while in use.
+ * - An id3_shared_picture can be referenced from tags of different threads, its reference count is atomic.
+ * - Different threads must not write to the same file at the same time.
+ * - utf8_set_locale(), utf8_unset_locale(), utf8_set_cp() and utf8_unset_cp() change process wide settings,
+ *   call them before starting or after joining any other thread. No tagging function depends on them.
+ * - id3_trace_start() and id3_trace_stop() (builds with ID3_ENABLE_TRACING only) are process wide too, see id3_trace.h.
+ *
+ * builder: Tag currently being built, its lists and arena can be used with any *_add_update() function.
+ * picture_cache: Picture files loaded by id3_context_add_picture_file(), kept across files.
+ * stats: Statistics on the tags written through the context, only collected once enabled with id3_context_enable_stats().
+ *        Unlike the rest of the context, stats can be read from other threads (see id3_stats.h).
+ */
+struct id3_context {
+    id3_tag_builder builder;
+    id3_picture_cache picture_cache;
+    id3_stats stats;
+};
+
+void id3_context_init(id3_context* context, size_t picture_cache_memory_cap_bytes);
+unsigned int id3_context_add_picture_file(id3_context* context, char* mime_type, uint8_t picture_type, char* description, const char* picture_file_path);
+unsigned int id3_context_write(id3_context* context, char* file_path, const id3_base_tag* base_tag);
+void id3_context_enable_stats(id3_context* context, int is_enabled);
+void id3_context_release(id3_context* context);
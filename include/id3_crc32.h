@@ -0,0 +1,13 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * CRC-32 (ISO 3309, the one used by zlib, PNG and the ID3v2.3 extended header).
+ * - Portable slice-by-8 everywhere, folded with carry-less multiplication on x86-64 processors that have PCLMULQDQ (checked at run time),
+ *   and done with the CRC32 instructions on ARMv8 builds that enable them (e.g. -march=armv8-a+crc).
+ * - Keeps no state of its own, any number of threads can use it at once.
+ */
+
+uint32_t id3_crc32(uint32_t crc, const void* bytes, size_t num_bytes);
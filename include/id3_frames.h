@@ -0,0 +1,141 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+typedef struct id3_frame_info id3_frame_info;
+
+// Packs a four character frame ID into an integer, first character in the most significant byte (same order as written to file).
+#define ID3_FOURCC(a, b, c, d) (((uint32_t)(a) << 24) | ((uint32_t)(b) << 16) | ((uint32_t)(c) << 8) | (uint32_t)(d))
+
+// What a frame holds, and therefore which node type (if any) represents it.
+#define ID3_FRAME_CATEGORY_TEXT 0       // Text information frames, id3_text_tag_node
+#define ID3_FRAME_CATEGORY_USER_TEXT 1  // TXXX
+#define ID3_FRAME_CATEGORY_URL 2        // URL link frames
+#define ID3_FRAME_CATEGORY_USER_URL 3   // WXXX
+#define ID3_FRAME_CATEGORY_COMMENT 4    // COMM, id3_comment_tag_node
+#define ID3_FRAME_CATEGORY_PICTURE 5    // APIC, id3_picture_tag_node
+#define ID3_FRAME_CATEGORY_BINARY 6     // Everything else, structured binary content
+
+// How the text inside a frame is encoded.
+#define ID3_FRAME_ENCODING_NONE 0        // No text, or text without an encoding byte
+#define ID3_FRAME_ENCODING_SELECTABLE 1  // Leading encoding byte, ISO-8859-1 or UTF-16
+#define ID3_FRAME_ENCODING_ISO_8859_1 2  // Always ISO-8859-1, no encoding byte (URLs)
+
+// What has to differ between two frames with the same ID for both to be allowed in one tag.
+#define ID3_FRAME_KEY_NONE 0                  // Only one frame of its kind per tag
+#define ID3_FRAME_KEY_DESCRIPTION 1           // Content description
+#define ID3_FRAME_KEY_LANGUAGE 2              // Language
+#define ID3_FRAME_KEY_LANGUAGE_DESCRIPTION 3  // Language and content description
+#define ID3_FRAME_KEY_PICTURE 4               // Picture type and description
+#define ID3_FRAME_KEY_OWNER 5                 // Owner identifier, email or symbol
+#define ID3_FRAME_KEY_CONTENT 6               // Whole frame content
+
+/*
+ * Every frame declared by ID3v2.3 (https://id3.org/id3v2.3.0#Declared_ID3v2_frames).
+ * X(name, fourcc characters..., category, encoding, uniqueness key)
+ */
+#define ID3_FRAME_LIST(X)                                                                                                      \
+    X(AENC, 'A', 'E', 'N', 'C', ID3_FRAME_CATEGORY_BINARY, ID3_FRAME_ENCODING_NONE, ID3_FRAME_KEY_OWNER)                       \
+    X(APIC, 'A', 'P', 'I', 'C', ID3_FRAME_CATEGORY_PICTURE, ID3_FRAME_ENCODING_SELECTABLE, ID3_FRAME_KEY_PICTURE)              \
+    X(COMM, 'C', 'O', 'M', 'M', ID3_FRAME_CATEGORY_COMMENT, ID3_FRAME_ENCODING_SELECTABLE, ID3_FRAME_KEY_LANGUAGE_DESCRIPTION) \
+    X(COMR, 'C', 'O', 'M', 'R', ID3_FRAME_CATEGORY_BINARY, ID3_FRAME_ENCODING_SELECTABLE, ID3_FRAME_KEY_CONTENT)               \
+    X(ENCR, 'E', 'N', 'C', 'R', ID3_FRAME_CATEGORY_BINARY, ID3_FRAME_ENCODING_NONE, ID3_FRAME_KEY_OWNER)                       \
+    X(EQUA, 'E', 'Q', 'U', 'A', ID3_FRAME_CATEGORY_BINARY, ID3_FRAME_ENCODING_NONE, ID3_FRAME_KEY_NONE)                        \
+    X(ETCO, 'E', 'T', 'C', 'O', ID3_FRAME_CATEGORY_BINARY, ID3_FRAME_ENCODING_NONE, ID3_FRAME_KEY_NONE)                        \
+    X(GEOB, 'G', 'E', 'O', 'B', ID3_FRAME_CATEGORY_BINARY, ID3_FRAME_ENCODING_SELECTABLE, ID3_FRAME_KEY_DESCRIPTION)           \
+    X(GRID, 'G', 'R', 'I', 'D', ID3_FRAME_CATEGORY_BINARY, ID3_FRAME_ENCODING_NONE, ID3_FRAME_KEY_OWNER)                       \
+    X(IPLS, 'I', 'P', 'L', 'S', ID3_FRAME_CATEGORY_BINARY, ID3_FRAME_ENCODING_SELECTABLE, ID3_FRAME_KEY_NONE)                  \
+    X(LINK, 'L', 'I', 'N', 'K', ID3_FRAME_CATEGORY_BINARY, ID3_FRAME_ENCODING_NONE, ID3_FRAME_KEY_CONTENT)                     \
+    X(MCDI, 'M', 'C', 'D', 'I', ID3_FRAME_CATEGORY_BINARY, ID3_FRAME_ENCODING_NONE, ID3_FRAME_KEY_NONE)                        \
+    X(MLLT, 'M', 'L', 'L', 'T', ID3_FRAME_CATEGORY_BINARY, ID3_FRAME_ENCODING_NONE, ID3_FRAME_KEY_NONE)                        \
+    X(OWNE, 'O', 'W', 'N', 'E', ID3_FRAME_CATEGORY_BINARY, ID3_FRAME_ENCODING_SELECTABLE, ID3_FRAME_KEY_NONE)                  \
+    X(PRIV, 'P', 'R', 'I', 'V', ID3_FRAME_CATEGORY_BINARY, ID3_FRAME_ENCODING_NONE, ID3_FRAME_KEY_CONTENT)                     \
+    X(PCNT, 'P', 'C', 'N', 'T', ID3_FRAME_CATEGORY_BINARY, ID3_FRAME_ENCODING_NONE, ID3_FRAME_KEY_NONE)                        \
+    X(POPM, 'P', 'O', 'P', 'M', ID3_FRAME_CATEGORY_BINARY, ID3_FRAME_ENCODING_NONE, ID3_FRAME_KEY_OWNER)                       \
+    X(POSS, 'P', 'O', 'S', 'S', ID3_FRAME_CATEGORY_BINARY, ID3_FRAME_ENCODING_NONE, ID3_FRAME_KEY_NONE)                        \
+    X(RBUF, 'R', 'B', 'U', 'F', ID3_FRAME_CATEGORY_BINARY, ID3_FRAME_ENCODING_NONE, ID3_FRAME_KEY_NONE)                        \
+    X(RVAD, 'R', 'V', 'A', 'D', ID3_FRAME_CATEGORY_BINARY, ID3_FRAME_ENCODING_NONE, ID3_FRAME_KEY_NONE)                        \
+    X(RVRB, 'R', 'V', 'R', 'B', ID3_FRAME_CATEGORY_BINARY, ID3_FRAME_ENCODING_NONE, ID3_FRAME_KEY_NONE)                        \
+    X(SYLT, 'S', 'Y', 'L', 'T', ID3_FRAME_CATEGORY_BINARY, ID3_FRAME_ENCODING_SELECTABLE, ID3_FRAME_KEY_LANGUAGE_DESCRIPTION)  \
+    X(SYTC, 'S', 'Y', 'T', 'C', ID3_FRAME_CATEGORY_BINARY, ID3_FRAME_ENCODING_NONE, ID3_FRAME_KEY_NONE)                        \
+    X(TALB, 'T', 'A', 'L', 'B', ID3_FRAME_CATEGORY_TEXT, ID3_FRAME_ENCODING_SELECTABLE, ID3_FRAME_KEY_NONE)                    \
+    X(TBPM, 'T', 'B', 'P', 'M', ID3_FRAME_CATEGORY_TEXT, ID3_FRAME_ENCODING_SELECTABLE, ID3_FRAME_KEY_NONE)                    \
+    X(TCOM, 'T', 'C', 'O', 'M', ID3_FRAME_CATEGORY_TEXT, ID3_FRAME_ENCODING_SELECTABLE, ID3_FRAME_KEY_NONE)                    \
+    X(TCON, 'T', 'C', 'O', 'N', ID3_FRAME_CATEGORY_TEXT, ID3_FRAME_ENCODING_SELECTABLE, ID3_FRAME_KEY_NONE)                    \
+    X(TCOP, 'T', 'C', 'O', 'P', ID3_FRAME_CATEGORY_TEXT, ID3_FRAME_ENCODING_SELECTABLE, ID3_FRAME_KEY_NONE)                    \
+    X(TDAT, 'T', 'D', 'A', 'T', ID3_FRAME_CATEGORY_TEXT, ID3_FRAME_ENCODING_SELECTABLE, ID3_FRAME_KEY_NONE)                    \
+    X(TDLY, 'T', 'D', 'L', 'Y', ID3_FRAME_CATEGORY_TEXT, ID3_FRAME_ENCODING_SELECTABLE, ID3_FRAME_KEY_NONE)                    \
+    X(TENC, 'T', 'E', 'N', 'C', ID3_FRAME_CATEGORY_TEXT, ID3_FRAME_ENCODING_SELECTABLE, ID3_FRAME_KEY_NONE)                    \
+    X(TEXT, 'T', 'E', 'X', 'T', ID3_FRAME_CATEGORY_TEXT, ID3_FRAME_ENCODING_SELECTABLE, ID3_FRAME_KEY_NONE)                    \
+    X(TFLT, 'T', 'F', 'L', 'T', ID3_FRAME_CATEGORY_TEXT, ID3_FRAME_ENCODING_SELECTABLE, ID3_FRAME_KEY_NONE)                    \
+    X(TIME, 'T', 'I', 'M', 'E', ID3_FRAME_CATEGORY_TEXT, ID3_FRAME_ENCODING_SELECTABLE, ID3_FRAME_KEY_NONE)                    \
+    X(TIT1, 'T', 'I', 'T', '1', ID3_FRAME_CATEGORY_TEXT, ID3_FRAME_ENCODING_SELECTABLE, ID3_FRAME_KEY_NONE)                    \
+    X(TIT2, 'T', 'I', 'T', '2', ID3_FRAME_CATEGORY_TEXT, ID3_FRAME_ENCODING_SELECTABLE, ID3_FRAME_KEY_NONE)                    \
+    X(TIT3, 'T', 'I', 'T', '3', ID3_FRAME_CATEGORY_TEXT, ID3_FRAME_ENCODING_SELECTABLE, ID3_FRAME_KEY_NONE)                    \
+    X(TKEY, 'T', 'K', 'E', 'Y', ID3_FRAME_CATEGORY_TEXT, ID3_FRAME_ENCODING_SELECTABLE, ID3_FRAME_KEY_NONE)                    \
+    X(TLAN, 'T', 'L', 'A', 'N', ID3_FRAME_CATEGORY_TEXT, ID3_FRAME_ENCODING_SELECTABLE, ID3_FRAME_KEY_NONE)                    \
+    X(TLEN, 'T', 'L', 'E', 'N', ID3_FRAME_CATEGORY_TEXT, ID3_FRAME_ENCODING_SELECTABLE, ID3_FRAME_KEY_NONE)                    \
+    X(TMED, 'T', 'M', 'E', 'D', ID3_FRAME_CATEGORY_TEXT, ID3_FRAME_ENCODING_SELECTABLE, ID3_FRAME_KEY_NONE)                    \
+    X(TOAL, 'T', 'O', 'A', 'L', ID3_FRAME_CATEGORY_TEXT, ID3_FRAME_ENCODING_SELECTABLE, ID3_FRAME_KEY_NONE)                    \
+    X(TOFN, 'T', 'O', 'F', 'N', ID3_FRAME_CATEGORY_TEXT, ID3_FRAME_ENCODING_SELECTABLE, ID3_FRAME_KEY_NONE)                    \
+    X(TOLY, 'T', 'O', 'L', 'Y', ID3_FRAME_CATEGORY_TEXT, ID3_FRAME_ENCODING_SELECTABLE, ID3_FRAME_KEY_NONE)                    \
+    X(TOPE, 'T', 'O', 'P', 'E', ID3_FRAME_CATEGORY_TEXT, ID3_FRAME_ENCODING_SELECTABLE, ID3_FRAME_KEY_NONE)                    \
+    X(TORY, 'T', 'O', 'R', 'Y', ID3_FRAME_CATEGORY_TEXT, ID3_FRAME_ENCODING_SELECTABLE, ID3_FRAME_KEY_NONE)                    \
+    X(TOWN, 'T', 'O', 'W', 'N', ID3_FRAME_CATEGORY_TEXT, ID3_FRAME_ENCODING_SELECTABLE, ID3_FRAME_KEY_NONE)                    \
+    X(TPE1, 'T', 'P', 'E', '1', ID3_FRAME_CATEGORY_TEXT, ID3_FRAME_ENCODING_SELECTABLE, ID3_FRAME_KEY_NONE)                    \
+    X(TPE2, 'T', 'P', 'E', '2', ID3_FRAME_CATEGORY_TEXT, ID3_FRAME_ENCODING_SELECTABLE, ID3_FRAME_KEY_NONE)                    \
+    X(TPE3, 'T', 'P', 'E', '3', ID3_FRAME_CATEGORY_TEXT, ID3_FRAME_ENCODING_SELECTABLE, ID3_FRAME_KEY_NONE)                    \
+    X(TPE4, 'T', 'P', 'E', '4', ID3_FRAME_CATEGORY_TEXT, ID3_FRAME_ENCODING_SELECTABLE, ID3_FRAME_KEY_NONE)                    \
+    X(TPOS, 'T', 'P', 'O', 'S', ID3_FRAME_CATEGORY_TEXT, ID3_FRAME_ENCODING_SELECTABLE, ID3_FRAME_KEY_NONE)                    \
+    X(TPUB, 'T', 'P', 'U', 'B', ID3_FRAME_CATEGORY_TEXT, ID3_FRAME_ENCODING_SELECTABLE, ID3_FRAME_KEY_NONE)                    \
+    X(TRCK, 'T', 'R', 'C', 'K', ID3_FRAME_CATEGORY_TEXT, ID3_FRAME_ENCODING_SELECTABLE, ID3_FRAME_KEY_NONE)                    \
+    X(TRDA, 'T', 'R', 'D', 'A', ID3_FRAME_CATEGORY_TEXT, ID3_FRAME_ENCODING_SELECTABLE, ID3_FRAME_KEY_NONE)                    \
+    X(TRSN, 'T', 'R', 'S', 'N', ID3_FRAME_CATEGORY_TEXT, ID3_FRAME_ENCODING_SELECTABLE, ID3_FRAME_KEY_NONE)                    \
+    X(TRSO, 'T', 'R', 'S', 'O', ID3_FRAME_CATEGORY_TEXT, ID3_FRAME_ENCODING_SELECTABLE, ID3_FRAME_KEY_NONE)                    \
+    X(TSIZ, 'T', 'S', 'I', 'Z', ID3_FRAME_CATEGORY_TEXT, ID3_FRAME_ENCODING_SELECTABLE, ID3_FRAME_KEY_NONE)                    \
+    X(TSRC, 'T', 'S', 'R', 'C', ID3_FRAME_CATEGORY_TEXT, ID3_FRAME_ENCODING_SELECTABLE, ID3_FRAME_KEY_NONE)                    \
+    X(TSSE, 'T', 'S', 'S', 'E', ID3_FRAME_CATEGORY_TEXT, ID3_FRAME_ENCODING_SELECTABLE, ID3_FRAME_KEY_NONE)                    \
+    X(TYER, 'T', 'Y', 'E', 'R', ID3_FRAME_CATEGORY_TEXT, ID3_FRAME_ENCODING_SELECTABLE, ID3_FRAME_KEY_NONE)                    \
+    X(TXXX, 'T', 'X', 'X', 'X', ID3_FRAME_CATEGORY_USER_TEXT, ID3_FRAME_ENCODING_SELECTABLE, ID3_FRAME_KEY_DESCRIPTION)        \
+    X(UFID, 'U', 'F', 'I', 'D', ID3_FRAME_CATEGORY_BINARY, ID3_FRAME_ENCODING_NONE, ID3_FRAME_KEY_OWNER)                       \
+    X(USER, 'U', 'S', 'E', 'R', ID3_FRAME_CATEGORY_BINARY, ID3_FRAME_ENCODING_SELECTABLE, ID3_FRAME_KEY_LANGUAGE)              \
+    X(USLT, 'U', 'S', 'L', 'T', ID3_FRAME_CATEGORY_BINARY, ID3_FRAME_ENCODING_SELECTABLE, ID3_FRAME_KEY_LANGUAGE_DESCRIPTION)  \
+    X(WCOM, 'W', 'C', 'O', 'M', ID3_FRAME_CATEGORY_URL, ID3_FRAME_ENCODING_ISO_8859_1, ID3_FRAME_KEY_CONTENT)                  \
+    X(WCOP, 'W', 'C', 'O', 'P', ID3_FRAME_CATEGORY_URL, ID3_FRAME_ENCODING_ISO_8859_1, ID3_FRAME_KEY_NONE)                     \
+    X(WOAF, 'W', 'O', 'A', 'F', ID3_FRAME_CATEGORY_URL, ID3_FRAME_ENCODING_ISO_8859_1, ID3_FRAME_KEY_NONE)                     \
+    X(WOAR, 'W', 'O', 'A', 'R', ID3_FRAME_CATEGORY_URL, ID3_FRAME_ENCODING_ISO_8859_1, ID3_FRAME_KEY_CONTENT)                  \
+    X(WOAS, 'W', 'O', 'A', 'S', ID3_FRAME_CATEGORY_URL, ID3_FRAME_ENCODING_ISO_8859_1, ID3_FRAME_KEY_NONE)                     \
+    X(WORS, 'W', 'O', 'R', 'S', ID3_FRAME_CATEGORY_URL, ID3_FRAME_ENCODING_ISO_8859_1, ID3_FRAME_KEY_NONE)                     \
+    X(WPAY, 'W', 'P', 'A', 'Y', ID3_FRAME_CATEGORY_URL, ID3_FRAME_ENCODING_ISO_8859_1, ID3_FRAME_KEY_NONE)                     \
+    X(WPUB, 'W', 'P', 'U', 'B', ID3_FRAME_CATEGORY_URL, ID3_FRAME_ENCODING_ISO_8859_1, ID3_FRAME_KEY_NONE)                     \
+    X(WXXX, 'W', 'X', 'X', 'X', ID3_FRAME_CATEGORY_USER_URL, ID3_FRAME_ENCODING_SELECTABLE, ID3_FRAME_KEY_DESCRIPTION)
+
+// ID3_FRAME_TALB, ID3_FRAME_APIC, ... hold the fourcc of each frame, usable as switch cases.
+#define _ID3_FRAME_ID_ENUM(name, a, b, c, d, category, encoding, key) ID3_FRAME_##name = ID3_FOURCC(a, b, c, d),
+enum id3_frame_id {
+    ID3_FRAME_LIST(_ID3_FRAME_ID_ENUM)
+    ID3_FRAME_INVALID = 0
+};
+#undef _ID3_FRAME_ID_ENUM
+
+/*
+ * Registry entry describing a frame.
+ *
+ * frame_id: fourcc of the frame (ID3_FRAME_*).
+ * name: Frame ID as a null terminated string.
+ * category: ID3_FRAME_CATEGORY_* constant.
+ * encoding: ID3_FRAME_ENCODING_* constant.
+ * key: ID3_FRAME_KEY_* constant.
+ */
+struct id3_frame_info {
+    uint32_t frame_id;
+    char name[5];
+    uint8_t category;
+    uint8_t encoding;
+    uint8_t key;
+};
+
+uint32_t id3_frame_id_from_string(const char* frame_name);
+const id3_frame_info* id3_frame_lookup(uint32_t frame_id);
+void id3_frame_id_to_bytes(uint32_t frame_id, uint8_t* frame_id_bytes);
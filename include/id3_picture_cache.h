@@ -0,0 +1,82 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct id3_picture_cache_entry id3_picture_cache_entry;
+typedef struct id3_picture_cache_stats id3_picture_cache_stats;
+typedef struct id3_picture_cache id3_picture_cache;
+
+#include "id3_arena.h"
+#include "id3_process.h"
+
+#define ID3_PICTURE_CACHE_BUCKETS 64
+
+/*
+ * A picture file loaded by an id3_picture_cache.
+ *
+ * path: Path the picture was loaded from.
+ * file_device, file_inode, file_mtime_ns, file_bytes: Identity of the file when it was loaded, the entry is reloaded if any of these change.
+ * content_hash: FNV-1a hash of the picture data, used to find identical pictures loaded from other paths.
+ * picture: Loaded picture data, the cache holds one reference to it. Entries with identical content share the same picture.
+ * is_memory_counted: Whether this entry's picture counts towards memory_bytes of the cache, only one entry per picture does.
+ */
+struct id3_picture_cache_entry {
+    char* path;
+    uint64_t file_device;
+    uint64_t file_inode;
+    int64_t file_mtime_ns;
+    unsigned int file_bytes;
+    uint64_t content_hash;
+    id3_shared_picture* picture;
+    int is_memory_counted;
+
+    struct id3_picture_cache_entry* bucket_next;
+    struct id3_picture_cache_entry* content_bucket_next;
+    struct id3_picture_cache_entry* lru_prev;
+    struct id3_picture_cache_entry* lru_next;
+};
+
+/*
+ * hits: Lookups served from an entry without reading the file.
+ * misses: Lookups that had to read the file.
+ * content_hits: Misses whose data turned out identical to an already cached picture and now share its memory.
+ * evictions: Entries dropped to stay under the memory cap.
+ * memory_bytes: Bytes of picture data currently held by the cache.
+ */
+struct id3_picture_cache_stats {
+    unsigned long long hits;
+    unsigned long long misses;
+    unsigned long long content_hits;
+    unsigned long long evictions;
+    size_t memory_bytes;
+};
+
+/*
+ * Loads each unique picture file once and hands out id3_shared_picture references to it (see id3_picture_tag_node_add_update_shared()).
+ * Entries are keyed by path and checked against the file's device, inode, modification time and size on every lookup,
+ * pictures with identical content share a single buffer whatever path they were loaded from.
+ * - Scope a cache to a batch of writes, or keep one for the whole process. A cache is not thread safe.
+ * - Least recently used entries are evicted once the picture data held exceeds memory_cap_bytes. Tags still referencing
+ *   an evicted picture keep it alive, so actual usage can exceed the cap while they exist.
+ * - On platforms without inodes (Windows), entries are checked by modification time and size only.
+ * - Modification times are compared to the nanosecond (st_mtim), except on Windows where stat() only gives whole seconds.
+ *
+ * buckets: Hash table of entries by path.
+ * content_buckets: Hash table of the same entries by content_hash.
+ * lru_head, lru_tail: Entries from most to least recently used.
+ */
+struct id3_picture_cache {
+    id3_picture_cache_entry* buckets[ID3_PICTURE_CACHE_BUCKETS];
+    id3_picture_cache_entry* content_buckets[ID3_PICTURE_CACHE_BUCKETS];
+    id3_picture_cache_entry* lru_head;
+    id3_picture_cache_entry* lru_tail;
+    size_t memory_cap_bytes;
+    id3_picture_cache_stats stats;
+};
+
+void id3_picture_cache_init(id3_picture_cache* cache, size_t memory_cap_bytes);
+id3_shared_picture* id3_picture_cache_get(id3_picture_cache* cache, const char* picture_file_path);
+unsigned int id3_picture_tag_node_add_update_cached(id3_picture_tag_node** head, id3_arena* arena, id3_picture_cache* cache,
+                                                    char* mime_type, uint8_t picture_type, char* description, const char* picture_file_path);
+void id3_picture_cache_destroy(id3_picture_cache* cache);
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <stdatomic.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -8,53 +9,156 @@
 typedef struct id3_text_tag_node id3_text_tag_node;
 typedef struct id3_comment_tag_node id3_comment_tag_node;
 typedef struct id3_picture_tag_node id3_picture_tag_node;
+typedef struct id3_user_tag_node id3_user_tag_node;
+typedef struct id3_user_tag_list id3_user_tag_list;
 typedef struct id3_master_tag_struct id3_master_tag_struct;
+typedef struct id3_shared_picture id3_shared_picture;
 
+#include "id3_arena.h"
+#include "id3_frames.h"
+#include "id3_stats.h"
 #include "utf.h"
 #include "id3_write.h"
 
-// num_id3_bytes will take into account size after UTF8-fication and the null byte at the end.
+// Strings and encoded payloads shorter than these are stored inside the node instead of in their own allocation.
+#define ID3_NODE_INLINE_STRING_BYTES 24
+#define ID3_NODE_INLINE_PAYLOAD_BYTES 32
+
+/*
+ * Each node keeps its frame content in payload exactly as it will be written to file (encoding byte, BOM, text and terminators).
+ * Adding or updating a node only marks it as dirty, the payload is encoded once when the tag is sized or written (see id3_*_tag_list_encode()),
+ * writing a frame is then a single copy.
+ * - payload either points to payload_inline or to its own allocation, always read it through payload.
+ * - While is_dirty is set, payload of text and comment nodes holds the pending UTF-8 value as given instead, and num_id3_bytes and is_utf8 are stale.
+ * - num_id3_bytes is the size of the frame content, not including the 10 byte frame header.
+ * - is_utf8 is 1 if text in the payload is encoded as UTF-16, 0 if ISO-8859-1 (used whenever every codepoint is U+00FF or less).
+ * - Only fields used to look nodes up are kept as UTF-8, other text can be recovered with the *_get_*() functions.
+ * - compressed_payload of text and comment nodes holds the frame content compressed with zlib, preceded by its 4 byte decompressed size,
+ *   once id3_*_tag_list_compress() found compressing it worthwhile, NULL otherwise. compressed_bytes includes the 4 byte size.
+ *   It is dropped whenever the payload is encoded again, payload itself is never compressed.
+ */
+
+// frame_id is tag_name as a fourcc (see id3_frames.h). Read the text back with id3_text_tag_node_get_value().
 struct id3_text_tag_node {
     char tag_name[5];
-    char* tag_value;
+    uint32_t frame_id;
+    uint8_t* payload;
+    uint8_t payload_inline[ID3_NODE_INLINE_PAYLOAD_BYTES];
     unsigned int num_id3_bytes;
+    uint8_t* compressed_payload;
+    unsigned int compressed_bytes;
     int is_utf8;
-    uint16_t* tag_value_utf16;
+    int is_dirty;
+    id3_arena* arena;
 
     struct id3_text_tag_node* next;
 };
 
+// short_content_description either points to short_content_description_inline or to its own allocation, always read it through the pointer.
+// Read the comment back with id3_comment_tag_node_get_comment().
 struct id3_comment_tag_node {
     char language[4];
     char* short_content_description;
-    char* comment;
+    char short_content_description_inline[ID3_NODE_INLINE_STRING_BYTES];
+    uint8_t* payload;
+    uint8_t payload_inline[ID3_NODE_INLINE_PAYLOAD_BYTES];
     unsigned int num_id3_bytes;
+    uint8_t* compressed_payload;
+    unsigned int compressed_bytes;
     int is_utf8;
-    uint16_t* short_content_description_utf16;
-    uint16_t* comment_utf16;
+    int is_dirty;
+    id3_arena* arena;
 
     struct id3_comment_tag_node* next;
 };
 
+// frame_id is ID3_FRAME_TXXX or ID3_FRAME_WXXX, description (see short_content_description of id3_comment_tag_node) is the node's key within its list.
+// description_hash is the hash of frame_id and description the list's index is keyed by. prev and next keep the order nodes were added in,
+// next_in_bucket chains nodes sharing an index bucket. Read the value back with id3_user_tag_node_get_value().
+struct id3_user_tag_node {
+    uint32_t frame_id;
+    char* description;
+    char description_inline[ID3_NODE_INLINE_STRING_BYTES];
+    uint32_t description_hash;
+    uint8_t* payload;
+    uint8_t payload_inline[ID3_NODE_INLINE_PAYLOAD_BYTES];
+    unsigned int num_id3_bytes;
+    uint8_t* compressed_payload;
+    unsigned int compressed_bytes;
+    int is_utf8;
+    int is_dirty;
+    id3_arena* arena;
+
+    struct id3_user_tag_node* prev;
+    struct id3_user_tag_node* next;
+    struct id3_user_tag_node* next_in_bucket;
+};
+
+// User defined text (TXXX) and URL (WXXX) frames, written in the order they were added from head to tail.
+// Tags can carry hundreds of these, so nodes are also indexed by frame ID and description in a hash table, making every lookup, update and delete O(1).
+// buckets (num_buckets long, a power of two) comes from ID3_MALLOC() even for nodes in an arena, id3_user_tag_list_destroy() frees it.
+struct id3_user_tag_list {
+    id3_user_tag_node* head;
+    id3_user_tag_node* tail;
+    id3_user_tag_node** buckets;
+    unsigned int num_buckets;
+    unsigned int num_nodes;
+};
+
+// payload holds everything up to the picture data, which is payload_bytes long. num_id3_bytes also includes the picture data.
+// picture_data_ownership (ID3_PICTURE_DATA_*) decides what happens to picture_binary_data when the node lets go of it,
+// shared_picture is the id3_shared_picture that picture_binary_data belongs to if it is ID3_PICTURE_DATA_SHARED, NULL otherwise.
+// picture_file_bytes is the size of the file at picture_file_path when the node was last sized, the picture data written is exactly that long.
 struct id3_picture_tag_node {
     char* mime_type;
     uint8_t picture_type;
     char* description;
+    uint8_t* payload;
+    uint8_t payload_inline[ID3_NODE_INLINE_PAYLOAD_BYTES];
+    unsigned int payload_bytes;
     unsigned int num_id3_bytes;
     int is_utf8;
-    uint16_t* description_utf16;
     int is_picture_stored_as_file;
     char* picture_file_path;
     uint8_t* picture_binary_data;
     unsigned int picture_binary_data_bytes;
+    uint8_t picture_data_ownership;
+    id3_shared_picture* shared_picture;
+    unsigned int picture_file_bytes;
+    int is_dirty;
+    id3_arena* arena;
 
     struct id3_picture_tag_node* next;
 };
 
+// Picture data shared by many picture nodes, freed along with data once the last reference to it is released.
+struct id3_shared_picture {
+    uint8_t* data;
+    unsigned int data_bytes;
+    atomic_uint reference_count;
+};
+
+// user_tag_list: TXXX and WXXX frames, unlike the other lists it points to the list itself rather than to its head.
+// compression_threshold_bytes: Text, comment and user frames whose content is at least this long are compressed with zlib when that makes them smaller,
+// 0 to never compress. Only honoured when the library is built with ID3_WITH_ZLIB (and linked with zlib), frames are never compressed otherwise.
+// stats: Statistics to update while sizing and writing the tag (see id3_stats.h), NULL to collect none.
+// frame_layout: ID3_FRAME_LAYOUT_LIST_ORDER, or ID3_FRAME_LAYOUT_READ_OPTIMIZED so that readers stopping early (see id3_read.h) find what they want
+// in the first few hundred bytes: frames listed in leading_frame_ids come first in that order, then every other frame smallest first, pictures last.
+// Base frames kept by id3_write_tag_with_base() are placed the same way. leading_frame_ids (num_leading_frame_ids long) NULL for the default,
+// TIT2, TPE1, TALB, TRCK, TPOS, TYER, TCON, TPE2, TLEN.
+// is_crc_enabled: Non-zero to write an extended header holding the CRC-32 of the frames (see id3_crc32.h), checked by id3_reader when reading every frame.
 struct id3_master_tag_struct {
     id3_text_tag_node** text_tag_list;
     id3_comment_tag_node** comment_tag_list;
     id3_picture_tag_node** picture_tag_list;
+    id3_user_tag_list* user_tag_list;
+    id3_arena* arena;
+    unsigned int compression_threshold_bytes;
+    id3_stats* stats;
+    unsigned int frame_layout;
+    const uint32_t* leading_frame_ids;
+    unsigned int num_leading_frame_ids;
+    int is_crc_enabled;
 };
 
 // has anyone heard of oop?
@@ -74,6 +178,18 @@ struct id3_master_tag_struct {
 #define TAG_CREATE_SUCCESS 109
 #define TAG_UPDATE_SUCCESS 110
 #define TAG_INVALID_VALUE 111
+#define TAG_ENCODE_SUCCESS 112
+#define TAG_WRITE_SUCCESS 113
+#define TAG_FILE_ERROR 114
+#define TAG_WRITE_CANCELLED 115
+#define TAG_READ_FRAME 116
+#define TAG_READ_NEED_MORE 117
+#define TAG_READ_SUCCESS 118
+#define TAG_CRC_MISMATCH 119
+
+#define ID3_PICTURE_DATA_BORROWED 0  // never freed by the node
+#define ID3_PICTURE_DATA_OWNED 1     // freed with ID3_FREE() by the node
+#define ID3_PICTURE_DATA_SHARED 2    // part of an id3_shared_picture, the node holds a reference to it
 
 #define APIC_TYPE_OTHER 0x00
 #define APIC_TYPE_FILE_ICON 0x01
@@ -98,11 +214,41 @@ struct id3_master_tag_struct {
 #define APIC_TYPE_PUBLISHER_STUDIO_LOGOTYPE 0x14
 
 unsigned int id3_text_tag_node_add_update(id3_text_tag_node** head, char* tag_name, char* tag_value);
+unsigned int id3_text_tag_node_add_update_in_arena(id3_text_tag_node** head, id3_arena* arena, char* tag_name, char* tag_value);
+unsigned int id3_text_tag_node_add_update_by_id(id3_text_tag_node** head, id3_arena* arena, uint32_t frame_id, const char* tag_value);
+unsigned int id3_text_tag_node_get_value(id3_text_tag_node* node, char* tag_value, unsigned int tag_value_bytes);
 unsigned int id3_text_tag_node_delete(id3_text_tag_node** head, char* tag_name);
 void id3_text_tag_list_destroy(id3_text_tag_node** head);
+unsigned int id3_text_tag_list_encode(id3_text_tag_node** head, id3_stats* stats);
+unsigned int id3_text_tag_list_compress(id3_text_tag_node** head, unsigned int threshold_bytes);
 unsigned int id3_comment_tag_node_add_update(id3_comment_tag_node** head, char* language, char* short_content_description, char* comment);
+unsigned int id3_comment_tag_node_add_update_in_arena(id3_comment_tag_node** head, id3_arena* arena, char* language, char* short_content_description, char* comment);
+unsigned int id3_comment_tag_node_get_comment(id3_comment_tag_node* node, char* comment, unsigned int comment_bytes);
 unsigned int id3_comment_tag_node_delete(id3_comment_tag_node** head, char* language, char* short_content_description);
 void id3_comment_tag_list_destroy(id3_comment_tag_node** head);
+unsigned int id3_comment_tag_list_encode(id3_comment_tag_node** head, id3_stats* stats);
+unsigned int id3_comment_tag_list_compress(id3_comment_tag_node** head, unsigned int threshold_bytes);
+unsigned int id3_user_tag_node_add_update(id3_user_tag_list* list, uint32_t frame_id, char* description, char* value);
+unsigned int id3_user_tag_node_add_update_in_arena(id3_user_tag_list* list, id3_arena* arena, uint32_t frame_id, char* description, char* value);
+id3_user_tag_node* id3_user_tag_node_find(const id3_user_tag_list* list, uint32_t frame_id, const char* description);
+unsigned int id3_user_tag_node_get_value(id3_user_tag_node* node, char* value, unsigned int value_bytes);
+unsigned int id3_user_tag_node_delete(id3_user_tag_list* list, uint32_t frame_id, const char* description);
+void id3_user_tag_list_init(id3_user_tag_list* list);
+void id3_user_tag_list_reset(id3_user_tag_list* list);
+void id3_user_tag_list_destroy(id3_user_tag_list* list);
+unsigned int id3_user_tag_list_encode(id3_user_tag_list* list, id3_stats* stats);
+unsigned int id3_user_tag_list_compress(id3_user_tag_list* list, unsigned int threshold_bytes);
 unsigned int id3_picture_tag_node_add_update(id3_picture_tag_node** head, char* mime_type, uint8_t picture_type, char* description,char* picture_file_path, uint8_t* picture_binary_data, unsigned int picture_binary_data_bytes);
+unsigned int id3_picture_tag_node_add_update_in_arena(id3_picture_tag_node** head, id3_arena* arena, char* mime_type, uint8_t picture_type, char* description,
+                                                      char* picture_file_path, uint8_t* picture_binary_data, unsigned int picture_binary_data_bytes);
+unsigned int id3_picture_tag_node_add_update_borrowed(id3_picture_tag_node** head, id3_arena* arena, char* mime_type, uint8_t picture_type, char* description,
+                                                      uint8_t* picture_binary_data, unsigned int picture_binary_data_bytes);
+unsigned int id3_picture_tag_node_add_update_shared(id3_picture_tag_node** head, id3_arena* arena, char* mime_type, uint8_t picture_type, char* description,
+                                                    id3_shared_picture* shared_picture);
+id3_shared_picture* id3_shared_picture_create(uint8_t* data, unsigned int data_bytes);
+void id3_shared_picture_retain(id3_shared_picture* shared_picture);
+void id3_shared_picture_release(id3_shared_picture* shared_picture);
 unsigned int id3_picture_tag_node_delete(id3_picture_tag_node** head, uint8_t picture_type, char* description);
 void id3_picture_tag_list_destroy(id3_picture_tag_node** head);
+void id3_picture_tag_list_release_data(id3_picture_tag_node** head);
+unsigned int id3_picture_tag_list_encode(id3_picture_tag_node** head, id3_stats* stats);
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct id3_read_frame id3_read_frame;
+typedef struct id3_reader id3_reader;
+
+#include "id3_frames.h"
+#include "id3_process.h"
+
+// Most frame IDs an id3_reader can look for.
+#define ID3_READ_MAX_FRAME_IDS 64
+
+/*
+ * A frame returned by id3_reader_next().
+ *
+ * frame_id: Fourcc of the frame (see id3_frames.h).
+ * flags: The 2 flag bytes of its header read big endian, e.g. ID3_FRAME_FLAG_COMPRESSION.
+ * content: Frame content as stored (i.e. compressed if compressed), content_bytes long, points into the bytes given to id3_reader_next().
+ */
+struct id3_read_frame {
+    uint32_t frame_id;
+    uint16_t flags;
+    const uint8_t* content;
+    unsigned int content_bytes;
+};
+
+/*
+ * Reads the frames of an ID3v2.3 tag from the start of a file as it arrives, asking for more bytes only when it needs them.
+ * Meant for files fetched piece by piece (e.g. HTTP range requests): with is_early_exit, reading stops as soon as every frame
+ * looked for is found, which for tags written with ID3_FRAME_LAYOUT_READ_OPTIMIZED is within the first few hundred bytes.
+ * - Frames not looked for are skipped by their header, their content is never needed except to reach the frames after them.
+ * - Unsynchronised tags are not supported.
+ * - If the extended header holds a CRC (see is_crc_enabled of id3_master_tag_struct), it is checked once the last frame is passed,
+ *   unless is_early_exit is set. Skipped frames are then needed in full, to be checksummed.
+ *
+ * frame_ids: Frames to return, num_frame_ids (up to ID3_READ_MAX_FRAME_IDS) long. NULL to return every frame.
+ * found_mask: Bit i set once a frame_ids[i] frame was returned.
+ * offset: Offset in the file of the next frame header, 0 until the tag header is read.
+ * tag_end: Offset in the file right after the tag.
+ * frames_end: Offset in the file right after the last frame, where padding starts.
+ * is_crc_checked: Whether the tag has a CRC that is being checked, expected_crc being that CRC and crc that of the frames passed so far.
+ */
+struct id3_reader {
+    const uint32_t* frame_ids;
+    unsigned int num_frame_ids;
+    int is_early_exit;
+    uint64_t found_mask;
+    unsigned int offset;
+    unsigned int tag_end;
+    unsigned int frames_end;
+    int is_crc_checked;
+    uint32_t expected_crc;
+    uint32_t crc;
+    int is_done;
+};
+
+unsigned int id3_reader_init(id3_reader* reader, const uint32_t* frame_ids, unsigned int num_frame_ids, int is_early_exit);
+unsigned int id3_reader_next(id3_reader* reader, const uint8_t* bytes, size_t num_bytes, id3_read_frame* frame, size_t* bytes_needed);
+unsigned int id3_read_tag(const char* file_path, const uint32_t* frame_ids, unsigned int num_frame_ids, int is_early_exit,
+                          void (*on_frame)(const id3_read_frame* frame, void* user_data), void* user_data, size_t* bytes_read);
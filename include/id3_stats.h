@@ -0,0 +1,73 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+typedef struct id3_stats id3_stats;
+typedef struct id3_stats_snapshot id3_stats_snapshot;
+
+/*
+ * Counters kept by an id3_stats, X(name) for each.
+ *
+ * tags_written: Tags written to a file in full.
+ * text_frames_encoded, comment_frames_encoded, user_frames_encoded, picture_frames_encoded: Dirty nodes encoded, per frame type.
+ * utf16_frames_encoded: Frames among those encoded whose text had to be transcoded to UTF-16 (instead of being stored as ISO-8859-1).
+ * files_opened: Files opened, tag files and picture files streamed into them.
+ * write_calls: Write calls issued to stdio.
+ * header_bytes_written: Bytes of ID3v2 headers and frame headers written.
+ * text_bytes_written: Bytes of text, comment and user (TXXX, WXXX) frame content written, as stored (i.e. compressed if compressed).
+ * picture_bytes_written: Bytes of picture frame content written.
+ * base_bytes_written: Bytes of base tag frames copied (see id3_base_tag.h).
+ * encode_ns: Nanoseconds spent encoding (and compressing) dirty nodes.
+ * size_ns: Nanoseconds spent sizing tags, once their nodes are encoded.
+ * picture_copy_ns: Nanoseconds spent writing picture data, reading picture files included.
+ * write_ns: Nanoseconds spent in id3_write_tag() and its variants, everything above included.
+ */
+#define ID3_STATS_COUNTERS(X) \
+    X(tags_written)           \
+    X(text_frames_encoded)    \
+    X(comment_frames_encoded) \
+    X(user_frames_encoded)    \
+    X(picture_frames_encoded) \
+    X(utf16_frames_encoded)   \
+    X(files_opened)           \
+    X(write_calls)            \
+    X(header_bytes_written)   \
+    X(text_bytes_written)     \
+    X(picture_bytes_written)  \
+    X(base_bytes_written)     \
+    X(encode_ns)              \
+    X(size_ns)                \
+    X(picture_copy_ns)        \
+    X(write_ns)
+
+/*
+ * Statistics on where the library spends its time and what it writes, see ID3_STATS_COUNTERS for the counters.
+ * Collected by the library for master tags whose stats member points to one (see id3_context_enable_stats()), never otherwise.
+ * - Counters are updated atomically (relaxed), tags written by several threads can share one id3_stats, and it can be read from any thread.
+ * - Times come from a monotonic clock.
+ */
+#define _ID3_STATS_ATOMIC_COUNTER(name) atomic_ullong name;
+struct id3_stats {
+    ID3_STATS_COUNTERS(_ID3_STATS_ATOMIC_COUNTER)
+};
+#undef _ID3_STATS_ATOMIC_COUNTER
+
+// Values of every counter of an id3_stats at one point in time.
+#define _ID3_STATS_SNAPSHOT_COUNTER(name) unsigned long long name;
+struct id3_stats_snapshot {
+    ID3_STATS_COUNTERS(_ID3_STATS_SNAPSHOT_COUNTER)
+};
+#undef _ID3_STATS_SNAPSHOT_COUNTER
+
+// Adds amount to a counter of stats, if stats is not NULL.
+#define ID3_STATS_ADD(stats, counter, amount)                                                                \
+    do {                                                                                                      \
+        if ((stats) != NULL)                                                                                  \
+            atomic_fetch_add_explicit(&(stats)->counter, (unsigned long long)(amount), memory_order_relaxed); \
+    } while (0)
+
+void id3_stats_init(id3_stats* stats);
+void id3_stats_read(id3_stats* stats, id3_stats_snapshot* snapshot);
+void id3_stats_reset(id3_stats* stats, id3_stats_snapshot* snapshot);
+uint64_t id3_stats_clock_ns();
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stdint.h>
+
+// Spans kept per thread between id3_trace_start() and id3_trace_stop(), once a thread records more its oldest spans are overwritten.
+#ifndef ID3_TRACE_RING_EVENTS
+#define ID3_TRACE_RING_EVENTS 16384
+#endif
+
+/*
+ * Trace hooks, recording how long each tag operation takes as Chrome trace-event JSON (open it in chrome://tracing or ui.perfetto.dev).
+ * Only built with ID3_ENABLE_TRACING defined. Without it ID3_TRACE_SPAN() is just its statement and id3_trace_start() fails,
+ * with it tracing costs a relaxed atomic load per span until started.
+ * - Each thread records into its own ring buffer, created the first time it records, so threads never wait on each other while tracing.
+ * - Unlike everything else in the library, tracing is process wide: call id3_trace_start() and id3_trace_stop() while no other thread is
+ *   tagging, spans recorded by every thread in between end up in the same file.
+ *
+ * Spans recorded: text_add_update, comment_add_update, user_add_update, picture_add_update, write_tag, size_tag, file_open, write_text_tag,
+ * write_comment_tag, write_user_tag, write_picture_tag, picture_copy, file_close.
+ */
+#ifdef ID3_ENABLE_TRACING
+#define ID3_TRACE_SPAN(name, statement)                       \
+    do {                                                      \
+        uint64_t _id3_trace_start_ns = id3_trace_begin();     \
+        statement;                                            \
+        id3_trace_end(name, _id3_trace_start_ns);             \
+    } while (0)
+#else
+#define ID3_TRACE_SPAN(name, statement) \
+    do {                                \
+        statement;                      \
+    } while (0)
+#endif
+
+int id3_trace_start(const char* json_file_path);
+int id3_trace_stop();
+uint64_t id3_trace_begin();
+void id3_trace_end(const char* name, uint64_t start_ns);
@@ -4,11 +4,21 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "id3_base_tag.h"
+#include "id3_frames.h"
 #include "id3_process.h"
 
-#define _TAG_NAME_USER_TEXT "TXXX"
-#define _TAG_NAME_COMMENT "COMM"
-#define _TAG_NAME_PICTURE "APIC"
+// Frame header flags (https://id3.org/id3v2.3.0#Frame_header_flags), as the 2 flag bytes read big endian.
+#define ID3_FRAME_FLAG_COMPRESSION 0x0080  // frame content is zlib compressed, preceded by its 4 byte decompressed size
 
-void id3_write_tag(char* file_path, id3_master_tag_struct master_tag_collection);
+// Order frames are written in, see frame_layout of id3_master_tag_struct.
+#define ID3_FRAME_LAYOUT_LIST_ORDER 0      // base frames, then text, comment, user and picture frames, each in list order
+#define ID3_FRAME_LAYOUT_READ_OPTIMIZED 1  // leading frames first, then smaller frames before larger ones, pictures last
+
+unsigned int id3_master_tag_size(id3_master_tag_struct master_tag_collection, unsigned int* tag_bytes);
+unsigned int id3_write_tag(char* file_path, id3_master_tag_struct master_tag_collection);
+unsigned int id3_write_tag_with_base(char* file_path, const id3_base_tag* base_tag, id3_master_tag_struct overlay_tag_collection);
+unsigned int id3_write_tag_buffered(char* file_path, const id3_base_tag* base_tag, id3_master_tag_struct overlay_tag_collection, char* io_buffer, size_t io_buffer_bytes);
 void id3_init_master_tag(id3_master_tag_struct* master_tag_collection);
+void id3_destroy_master_tag(id3_master_tag_struct* master_tag_collection);
+void id3_frame_header_to_bytes(uint8_t* frame_header, uint32_t frame_id, unsigned int frame_size, uint16_t frame_flags);
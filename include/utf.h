@@ -5,7 +5,12 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
+
+#ifdef _WIN32
 #include <windows.h>
+#endif
+
+#include "id3_alloc.h"
 
 // <3 mojibake 4evr
 
@@ -17,35 +22,71 @@
 #define UTF16_PARSE_SUCCESS 4
 #define UTF16_PARSE_UTF8_MALFORMED 5
 #define UTF16_PARSE_NO_MEM 6
+#define UTF16_PARSE_BUFFER_TOO_SMALL 7
+
+#define ISO_PARSE_SUCCESS 8
+#define ISO_PARSE_UTF8_MALFORMED 9
+#define ISO_PARSE_UNREPRESENTABLE 10
+#define ISO_PARSE_BUFFER_TOO_SMALL 11
+
+#define UTF16_LITTLE_ENDIAN 0
+#define UTF16_BIG_ENDIAN 1
 
 /*
- * Struct which holds a utf8 string in a matrix. Useful for when you need to iterate over each character in a utf8 string.
+ * Struct which holds a utf8 string along with where each of its characters starts. Useful for when you need to iterate over each character in a utf8 string.
  *
  * outcome: Outcome of the parse operation. See utf_8.h for possible outcomes.
- * string_matrix: Matrix of UTF8 characters. Iterate over this num_chars times to retrieve each utf8 character. New lines occupy 1 byte (\n, not \r\n).
- * WARNING: Do not attempt to access string_matrix if outcome is not UTF8_PARSE_SUCCESS, as it will result in undefined behavior.
- * num_chars: Total number of characters in string_matrix.
- * num_bytes: Sum of bytes in all string_matrix values, not including null terminators in each matrix value.
+ * string: Copy of the parsed string, null terminated. New lines occupy 1 byte (\n, not \r\n).
+ * char_offsets: Offset in string of each character, num_chars + 1 entries long, the last one being num_bytes.
+ * Iterate num_chars times with utf8_matrix_char_at() or utf8_matrix_copy_char() to retrieve each utf8 character.
+ * WARNING: Do not attempt to access string or char_offsets if outcome is not UTF8_PARSE_SUCCESS, as it will result in undefined behavior.
+ * Failed matrices are shared by every caller and every thread, never modify one.
+ * num_chars: Total number of characters in string.
+ * num_bytes: Length of string in bytes, not including its null terminator.
  */
 typedef struct {
     unsigned int outcome;
-    char** string_matrix;
+    char* string;
+    uint32_t* char_offsets;
     unsigned int num_chars;
     unsigned int num_bytes;
 } utf8_matrix;
 
+/*
+ * Struct filled in by utf8_validate().
+ *
+ * num_bytes: Length of the string in bytes, not including its null terminator.
+ * utf16_bytes: Bytes the string takes up once converted to UTF-16, without BOM or null terminator.
+ * max_codepoint: Largest codepoint above U+007F in the string, 0 if the string is ASCII only.
+ * If it is U+00FF or less, the string can be converted to ISO-8859-1 (Latin-1) with utf8_to_iso_8859_1(), taking up utf16_bytes / 2 bytes.
+ */
+typedef struct {
+    unsigned int num_bytes;
+    unsigned int utf16_bytes;
+    uint32_t max_codepoint;
+} utf8_validation;
+
 // [UTF-8]
 
 void utf8_set_locale();
 void utf8_unset_locale();
-void utf8_get_cp();
-void utf8_set_cp();
-void utf8_unset_cp();
+unsigned int utf8_set_cp();
+void utf8_unset_cp(unsigned int default_code_page);
 utf8_matrix* utf8_parse_string(char* string);
+const char* utf8_matrix_char_at(const utf8_matrix* matrix_instance, unsigned int index, unsigned int* char_bytes);
+unsigned int utf8_matrix_copy_char(const utf8_matrix* matrix_instance, unsigned int index, char* output);
 void utf8_free_matrix(utf8_matrix* metadata);
+int utf8_validate(const char* string, utf8_validation* validation);
 
 // [UTF-16]
 
 int utf8_contains_multibyte_sequence(char *string);
+int utf8_to_utf16_bytes(const char* utf8_input_string, uint8_t* utf16_output_bytes, unsigned int utf16_output_capacity, int byte_order, unsigned int* utf16_output_length);
 int utf8_to_utf16_le(const char* utf8_input_string, uint16_t** utf16_output_string, unsigned int* utf16_computed_length);
 int utf8_to_utf16_be(const char* utf8_input_string, uint16_t** utf16_output_string, unsigned int* utf16_computed_length);
+unsigned int utf16_le_to_utf8(const uint8_t* utf16_input_bytes, char* utf8_output_string, unsigned int utf8_output_bytes);
+unsigned int iso_8859_1_to_utf8(const char* iso_input_string, char* utf8_output_string, unsigned int utf8_output_bytes);
+
+// [ISO-8859-1]
+
+int utf8_to_iso_8859_1(const char* utf8_input_string, uint8_t* iso_output_bytes, unsigned int iso_output_capacity, unsigned int* iso_output_length);
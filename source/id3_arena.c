@@ -0,0 +1,142 @@
+#include "../include/id3_arena.h"
+
+#define _ARENA_ALIGNMENT (sizeof(max_align_t))
+
+// ["PRIVATE" FUNCTIONS] /////////////////////////////////////////////
+
+id3_arena_chunk* _arena_new_chunk(size_t capacity);
+//////////////////////////////////////////////////////////////////////
+
+/*
+ * Initialises an arena. No memory is allocated until the first call to id3_arena_alloc().
+ * - chunk_bytes of 0 selects ID3_ARENA_DEFAULT_CHUNK_BYTES.
+ *
+ * Usage:
+ * id3_arena arena;
+ * id3_arena_init(&arena, 0);
+ */
+void id3_arena_init(id3_arena* arena, size_t chunk_bytes) {
+    arena->head = NULL;
+    arena->current = NULL;
+    arena->chunk_bytes = chunk_bytes != 0 ? chunk_bytes : ID3_ARENA_DEFAULT_CHUNK_BYTES;
+}
+
+/*
+ * Hands out bytes of memory from an arena, aligned for any type.
+ * - Chunks left over from a previous id3_arena_reset() are reused before any new chunk is allocated.
+ * - Returned memory is uninitialised and must not be passed to free().
+ *
+ * Returns (success): pointer to memory
+ * Returns (failure): NULL
+ */
+void* id3_arena_alloc(id3_arena* arena, size_t bytes) {
+    // round up so that the next allocation stays aligned
+    bytes = (bytes + _ARENA_ALIGNMENT - 1) & ~(_ARENA_ALIGNMENT - 1);
+
+    // walk forward through the current chunk and any reusable chunks after it
+    while (arena->current != NULL) {
+        if (arena->current->capacity - arena->current->used >= bytes) {
+            void* allocated = (unsigned char*)arena->current->data + arena->current->used;
+            arena->current->used += bytes;
+            return allocated;
+        }
+
+        if (arena->current->next == NULL)
+            break;
+        arena->current = arena->current->next;
+    }
+
+    id3_arena_chunk* new_chunk = _arena_new_chunk(bytes > arena->chunk_bytes ? bytes : arena->chunk_bytes);
+    if (new_chunk == NULL)
+        return NULL;
+
+    if (arena->current == NULL)
+        arena->head = new_chunk;
+    else
+        arena->current->next = new_chunk;
+    arena->current = new_chunk;
+
+    new_chunk->used = bytes;
+    return new_chunk->data;
+}
+
+/*
+ * Makes sure an arena holds at least bytes of unused memory, allocating a single chunk for the shortfall if needed.
+ * - Only unused memory in the current chunk and the chunks after it counts, allocations are still served in order,
+ *   so the tail of a chunk too small for the next allocation is skipped. Reserve a little extra to make up for that.
+ *
+ * Usage:
+ * id3_arena_reserve(&arena, 64 * 1024); // the next 64KB of allocations (about) will not call malloc()
+ *
+ * Returns (success): 1
+ * Returns (failure): 0
+ */
+int id3_arena_reserve(id3_arena* arena, size_t bytes) {
+    size_t unused_bytes = 0;
+    id3_arena_chunk* last_chunk = arena->current;
+
+    for (id3_arena_chunk* iter_chunk = arena->current; iter_chunk != NULL; iter_chunk = iter_chunk->next) {
+        unused_bytes += iter_chunk->capacity - iter_chunk->used;
+        last_chunk = iter_chunk;
+    }
+
+    if (unused_bytes >= bytes)
+        return 1;
+
+    size_t shortfall = bytes - unused_bytes;
+    id3_arena_chunk* new_chunk = _arena_new_chunk(shortfall > arena->chunk_bytes ? shortfall : arena->chunk_bytes);
+    if (new_chunk == NULL)
+        return 0;
+
+    if (last_chunk == NULL) {
+        arena->head = new_chunk;
+        arena->current = new_chunk;
+    } else {
+        last_chunk->next = new_chunk;
+    }
+
+    return 1;
+}
+
+/*
+ * Marks all memory in an arena as unused while keeping its chunks for the next round of allocations.
+ * - Any pointer previously handed out by the arena is invalid afterwards.
+ */
+void id3_arena_reset(id3_arena* arena) {
+    for (id3_arena_chunk* iter_chunk = arena->head; iter_chunk != NULL; iter_chunk = iter_chunk->next)
+        iter_chunk->used = 0;
+
+    arena->current = arena->head;
+}
+
+/*
+ * Frees every chunk owned by an arena. The arena can be used again afterwards, as if freshly initialised.
+ */
+void id3_arena_release(id3_arena* arena) {
+    id3_arena_chunk* iter_chunk = arena->head;
+
+    while (iter_chunk != NULL) {
+        id3_arena_chunk* free_chunk = iter_chunk;
+        iter_chunk = iter_chunk->next;
+        ID3_FREE(free_chunk);
+    }
+
+    arena->head = NULL;
+    arena->current = NULL;
+}
+
+/*
+ * [INTERNAL FUNCTION]
+ * Allocates a chunk able to hold capacity bytes.
+ */
+id3_arena_chunk* _arena_new_chunk(size_t capacity) {
+    id3_arena_chunk* new_chunk = (id3_arena_chunk*)ID3_MALLOC(sizeof(id3_arena_chunk) + capacity);
+    if (new_chunk == NULL)
+        return NULL;
+
+    new_chunk->next = NULL;
+    new_chunk->capacity = capacity;
+    new_chunk->used = 0;
+
+    return new_chunk;
+}
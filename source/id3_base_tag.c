@@ -0,0 +1,266 @@
+#include "../include/id3_base_tag.h"
+
+#define _FRAME_HEADER_LENGTH 10
+
+// ["PRIVATE" FUNCTIONS] /////////////////////////////////////////////
+
+unsigned int _base_tag_count_frames(id3_master_tag_struct master_tag_collection);
+uint8_t* _base_tag_copy_frame(uint8_t* write_ptr, uint32_t frame_id, uint16_t frame_flags, const uint8_t* payload, unsigned int payload_bytes, unsigned int num_id3_bytes);
+unsigned int _base_tag_read_picture_file(uint8_t* write_ptr, const char* picture_file_path, unsigned int picture_file_bytes);
+char* _base_tag_strdup(const char* string);
+//////////////////////////////////////////////////////////////////////
+
+/*
+ * Serializes every frame referenced by a id3_master_tag_struct into a base tag (see id3_base_tag.h).
+ * - Nodes are encoded (and compressed) first as id3_write_tag() would, picture files are read into the base tag once.
+ * - The lists are left as they are and can be destroyed right after, the base tag holds copies of everything it needs.
+ * - If the operation fails, base_tag is left empty and can be passed to id3_base_tag_destroy() regardless.
+ *
+ * Usage:
+ * id3_base_tag album_tag;
+ * id3_base_tag_create(&album_tag, album_tag_collection); // TALB, TPE2, TCON, TYER, cover APIC...
+ * for each track:
+ *     id3_write_tag_with_base(track_path, &album_tag, track_tag_collection); // TIT2, TRCK...
+ * id3_base_tag_destroy(&album_tag);
+ *
+ * Returns (success): TAG_CREATE_SUCCESS
+ * Returns (failure): NODE_FILE_ERROR, NODE_MEMORY_ERROR, see id3_master_tag_size()
+ */
+unsigned int id3_base_tag_create(id3_base_tag* base_tag, id3_master_tag_struct master_tag_collection) {
+    *base_tag = (id3_base_tag){.frames = NULL, .frames_bytes = 0, .frame_index = NULL, .num_frames = 0};
+
+    unsigned int frames_bytes = 0;
+    unsigned int size_outcome = id3_master_tag_size(master_tag_collection, &frames_bytes);
+    if (size_outcome != TAG_ENCODE_SUCCESS)
+        return size_outcome;
+
+    unsigned int num_frames = _base_tag_count_frames(master_tag_collection);
+
+    base_tag->frames = (uint8_t*)ID3_MALLOC(frames_bytes > 0 ? frames_bytes : 1);
+    base_tag->frame_index = (id3_base_tag_frame*)ID3_MALLOC((num_frames > 0 ? num_frames : 1) * sizeof(id3_base_tag_frame));
+    // every description starts out NULL for id3_base_tag_destroy()
+    if (base_tag->frame_index != NULL)
+        memset(base_tag->frame_index, 0, (num_frames > 0 ? num_frames : 1) * sizeof(id3_base_tag_frame));
+    base_tag->num_frames = num_frames;
+
+    // malloc check
+    if (base_tag->frames == NULL || base_tag->frame_index == NULL) {
+        id3_base_tag_destroy(base_tag);
+        return NODE_MEMORY_ERROR;
+    }
+
+    uint8_t* write_ptr = base_tag->frames;
+    id3_base_tag_frame* index_ptr = base_tag->frame_index;
+
+    if (master_tag_collection.text_tag_list != NULL) {
+        for (id3_text_tag_node* iter_node = *(master_tag_collection.text_tag_list); iter_node != NULL; iter_node = iter_node->next, index_ptr++) {
+            *index_ptr = (id3_base_tag_frame){.frame_id = iter_node->frame_id, .offset = write_ptr - base_tag->frames};
+            if (iter_node->compressed_payload != NULL)
+                write_ptr = _base_tag_copy_frame(write_ptr, iter_node->frame_id, ID3_FRAME_FLAG_COMPRESSION, iter_node->compressed_payload, iter_node->compressed_bytes, iter_node->compressed_bytes);
+            else
+                write_ptr = _base_tag_copy_frame(write_ptr, iter_node->frame_id, 0, iter_node->payload, iter_node->num_id3_bytes, iter_node->num_id3_bytes);
+            index_ptr->num_bytes = (write_ptr - base_tag->frames) - index_ptr->offset;
+        }
+    }
+
+    if (master_tag_collection.comment_tag_list != NULL) {
+        for (id3_comment_tag_node* iter_node = *(master_tag_collection.comment_tag_list); iter_node != NULL; iter_node = iter_node->next, index_ptr++) {
+            *index_ptr = (id3_base_tag_frame){.frame_id = ID3_FRAME_COMM, .offset = write_ptr - base_tag->frames};
+            memcpy(index_ptr->language, iter_node->language, sizeof(index_ptr->language));
+            index_ptr->description = _base_tag_strdup(iter_node->short_content_description);
+            if (index_ptr->description == NULL) {
+                id3_base_tag_destroy(base_tag);
+                return NODE_MEMORY_ERROR;
+            }
+
+            if (iter_node->compressed_payload != NULL)
+                write_ptr = _base_tag_copy_frame(write_ptr, ID3_FRAME_COMM, ID3_FRAME_FLAG_COMPRESSION, iter_node->compressed_payload, iter_node->compressed_bytes, iter_node->compressed_bytes);
+            else
+                write_ptr = _base_tag_copy_frame(write_ptr, ID3_FRAME_COMM, 0, iter_node->payload, iter_node->num_id3_bytes, iter_node->num_id3_bytes);
+            index_ptr->num_bytes = (write_ptr - base_tag->frames) - index_ptr->offset;
+        }
+    }
+
+    if (master_tag_collection.user_tag_list != NULL) {
+        for (id3_user_tag_node* iter_node = master_tag_collection.user_tag_list->head; iter_node != NULL; iter_node = iter_node->next, index_ptr++) {
+            *index_ptr = (id3_base_tag_frame){.frame_id = iter_node->frame_id, .offset = write_ptr - base_tag->frames};
+            index_ptr->description = _base_tag_strdup(iter_node->description);
+            if (index_ptr->description == NULL) {
+                id3_base_tag_destroy(base_tag);
+                return NODE_MEMORY_ERROR;
+            }
+
+            if (iter_node->compressed_payload != NULL)
+                write_ptr = _base_tag_copy_frame(write_ptr, iter_node->frame_id, ID3_FRAME_FLAG_COMPRESSION, iter_node->compressed_payload, iter_node->compressed_bytes, iter_node->compressed_bytes);
+            else
+                write_ptr = _base_tag_copy_frame(write_ptr, iter_node->frame_id, 0, iter_node->payload, iter_node->num_id3_bytes, iter_node->num_id3_bytes);
+            index_ptr->num_bytes = (write_ptr - base_tag->frames) - index_ptr->offset;
+        }
+    }
+
+    if (master_tag_collection.picture_tag_list != NULL) {
+        for (id3_picture_tag_node* iter_node = *(master_tag_collection.picture_tag_list); iter_node != NULL; iter_node = iter_node->next, index_ptr++) {
+            *index_ptr = (id3_base_tag_frame){.frame_id = ID3_FRAME_APIC, .picture_type = iter_node->picture_type, .offset = write_ptr - base_tag->frames, .num_bytes = _FRAME_HEADER_LENGTH + iter_node->num_id3_bytes};
+            index_ptr->description = _base_tag_strdup(iter_node->description);
+            if (index_ptr->description == NULL) {
+                id3_base_tag_destroy(base_tag);
+                return NODE_MEMORY_ERROR;
+            }
+
+            write_ptr = _base_tag_copy_frame(write_ptr, ID3_FRAME_APIC, 0, iter_node->payload, iter_node->payload_bytes, iter_node->num_id3_bytes);
+
+            // the picture data comes right after the payload
+            unsigned int picture_bytes = iter_node->num_id3_bytes - iter_node->payload_bytes;
+            if (iter_node->is_picture_stored_as_file) {
+                if (_base_tag_read_picture_file(write_ptr, iter_node->picture_file_path, picture_bytes) != TAG_CREATE_SUCCESS) {
+                    id3_base_tag_destroy(base_tag);
+                    return NODE_FILE_ERROR;
+                }
+            } else {
+                memcpy(write_ptr, iter_node->picture_binary_data, picture_bytes);
+            }
+            write_ptr += picture_bytes;
+        }
+    }
+
+    base_tag->frames_bytes = frames_bytes;
+
+    return TAG_CREATE_SUCCESS;
+}
+
+/*
+ * Checks whether a frame of a base tag is replaced by a frame of an overlay, i.e. whether a node with the same key exists in it.
+ * - The rules are those of the *_add_update() functions, e.g. an APIC frame of type APIC_TYPE_FILE_ICON is replaced by any other of the same type.
+ * - TXXX and WXXX frames are looked up through the overlay list's index, in constant time.
+ *
+ * Returns: 1 if the overlay replaces frame, 0 otherwise
+ */
+int id3_base_tag_frame_is_overridden(const id3_base_tag_frame* frame, id3_master_tag_struct overlay_tag_collection) {
+    if (frame->frame_id == ID3_FRAME_COMM) {
+        if (overlay_tag_collection.comment_tag_list == NULL)
+            return 0;
+
+        for (id3_comment_tag_node* iter_node = *(overlay_tag_collection.comment_tag_list); iter_node != NULL; iter_node = iter_node->next) {
+            if (!strcmp(iter_node->language, frame->language) && !strcmp(iter_node->short_content_description, frame->description))
+                return 1;
+        }
+
+        return 0;
+    }
+
+    if (frame->frame_id == ID3_FRAME_TXXX || frame->frame_id == ID3_FRAME_WXXX) {
+        if (overlay_tag_collection.user_tag_list == NULL)
+            return 0;
+
+        return id3_user_tag_node_find(overlay_tag_collection.user_tag_list, frame->frame_id, frame->description) != NULL;
+    }
+
+    if (frame->frame_id == ID3_FRAME_APIC) {
+        if (overlay_tag_collection.picture_tag_list == NULL)
+            return 0;
+
+        int is_file_icon = frame->picture_type == APIC_TYPE_FILE_ICON || frame->picture_type == APIC_TYPE_OTHER_FILE_ICON;
+        for (id3_picture_tag_node* iter_node = *(overlay_tag_collection.picture_tag_list); iter_node != NULL; iter_node = iter_node->next) {
+            if (iter_node->picture_type == frame->picture_type && (is_file_icon || !strcmp(iter_node->description, frame->description)))
+                return 1;
+        }
+
+        return 0;
+    }
+
+    if (overlay_tag_collection.text_tag_list == NULL)
+        return 0;
+
+    for (id3_text_tag_node* iter_node = *(overlay_tag_collection.text_tag_list); iter_node != NULL; iter_node = iter_node->next) {
+        if (iter_node->frame_id == frame->frame_id)
+            return 1;
+    }
+
+    return 0;
+}
+
+/*
+ * Frees everything held by a base tag, leaving it empty.
+ */
+void id3_base_tag_destroy(id3_base_tag* base_tag) {
+    if (base_tag->frame_index != NULL) {
+        for (unsigned int i = 0; i < base_tag->num_frames; i++)
+            ID3_FREE(base_tag->frame_index[i].description);
+    }
+
+    ID3_FREE(base_tag->frames);
+    ID3_FREE(base_tag->frame_index);
+
+    *base_tag = (id3_base_tag){.frames = NULL, .frames_bytes = 0, .frame_index = NULL, .num_frames = 0};
+}
+
+/*
+ * [INTERNAL FUNCTION]
+ * Counts the nodes of every list referenced by a id3_master_tag_struct.
+ */
+unsigned int _base_tag_count_frames(id3_master_tag_struct master_tag_collection) {
+    unsigned int num_frames = 0;
+
+    if (master_tag_collection.text_tag_list != NULL)
+        for (id3_text_tag_node* iter_node = *(master_tag_collection.text_tag_list); iter_node != NULL; iter_node = iter_node->next) num_frames++;
+    if (master_tag_collection.comment_tag_list != NULL)
+        for (id3_comment_tag_node* iter_node = *(master_tag_collection.comment_tag_list); iter_node != NULL; iter_node = iter_node->next) num_frames++;
+    if (master_tag_collection.picture_tag_list != NULL)
+        for (id3_picture_tag_node* iter_node = *(master_tag_collection.picture_tag_list); iter_node != NULL; iter_node = iter_node->next) num_frames++;
+    if (master_tag_collection.user_tag_list != NULL)
+        num_frames += master_tag_collection.user_tag_list->num_nodes;
+
+    return num_frames;
+}
+
+/*
+ * [INTERNAL FUNCTION]
+ * Writes a frame header with frame_flags followed by payload_bytes of payload, num_id3_bytes being the frame size stated in the header.
+ *
+ * Returns: write_ptr advanced past the payload
+ */
+uint8_t* _base_tag_copy_frame(uint8_t* write_ptr, uint32_t frame_id, uint16_t frame_flags, const uint8_t* payload, unsigned int payload_bytes, unsigned int num_id3_bytes) {
+    id3_frame_header_to_bytes(write_ptr, frame_id, num_id3_bytes, frame_flags);
+    write_ptr += _FRAME_HEADER_LENGTH;
+
+    memcpy(write_ptr, payload, payload_bytes);
+    return write_ptr + payload_bytes;
+}
+
+/*
+ * [INTERNAL FUNCTION]
+ * Reads exactly picture_file_bytes of the file at picture_file_path into write_ptr.
+ *
+ * Returns (success): TAG_CREATE_SUCCESS
+ * Returns (failure): NODE_FILE_ERROR if the file cannot be opened or has shrunk since its size was looked up
+ */
+unsigned int _base_tag_read_picture_file(uint8_t* write_ptr, const char* picture_file_path, unsigned int picture_file_bytes) {
+    FILE* picture_file_ptr;
+    picture_file_ptr = fopen(picture_file_path, "rb");
+
+    if (picture_file_ptr == NULL)
+        return NODE_FILE_ERROR;
+
+    size_t read_bytes = fread(write_ptr, 1, picture_file_bytes, picture_file_ptr);
+    fclose(picture_file_ptr);
+
+    return read_bytes == picture_file_bytes ? TAG_CREATE_SUCCESS : NODE_FILE_ERROR;
+}
+
+/*
+ * [INTERNAL FUNCTION]
+ * Copies a string into its own allocation.
+ *
+ * Returns (success): pointer to the copy
+ * Returns (failure): NULL
+ */
+char* _base_tag_strdup(const char* string) {
+    size_t string_bytes = strlen(string) + 1;
+
+    char* copy = (char*)ID3_MALLOC(string_bytes);
+    if (copy == NULL)
+        return NULL;
+
+    memcpy(copy, string, string_bytes);
+    return copy;
+}
@@ -0,0 +1,259 @@
+#include <pthread.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "../include/id3_batch.h"
+
+// Bytes of padding after each worker's range, so that taking a job from it never contends with its neighbours' ranges.
+#define _BATCH_CACHE_LINE_BYTES 64
+
+/*
+ * A thread of an id3_batch_write() call.
+ *
+ * range: Jobs still queued on this worker, [begin, end) packed as (begin << 32) | end. The worker takes jobs from the
+ *        front of its range, idle workers steal the back half of it. Both are a single compare and swap.
+ * range_padding: Keeps the next worker's range on another cache line.
+ * io_buffer: Scratch stdio buffer, ID3_BATCH_IO_BUFFER_BYTES long, NULL if it could not be allocated.
+ */
+typedef struct {
+    _Atomic uint64_t range;
+    char range_padding[_BATCH_CACHE_LINE_BYTES];
+    pthread_t thread;
+    int is_thread_started;
+    char* io_buffer;
+    struct _batch_shared* shared;
+    unsigned int index;
+} _batch_worker;
+
+/*
+ * State shared by every worker of an id3_batch_write() call.
+ */
+struct _batch_shared {
+    id3_batch_job* jobs;
+    const id3_batch_options* options;
+    _batch_worker* workers;
+    unsigned int num_workers;
+};
+
+// ["PRIVATE" FUNCTIONS] /////////////////////////////////////////////
+
+unsigned int _batch_default_num_threads();
+uint64_t _batch_range_pack(uint32_t begin, uint32_t end);
+int _batch_take(_batch_worker* worker, uint32_t* job_index);
+int _batch_steal(_batch_worker* thief);
+int _batch_is_cancelled(const id3_batch_options* options);
+void* _batch_worker_run(void* worker_ptr);
+//////////////////////////////////////////////////////////////////////
+
+/*
+ * Fills in default batch options: one thread per online processor, no cancellation and no callback.
+ *
+ * Usage:
+ * id3_batch_options options;
+ * id3_batch_options_init(&options);
+ * options.cancel = &cancel_flag;
+ */
+void id3_batch_options_init(id3_batch_options* options) {
+    *options = (id3_batch_options){.num_threads = 0, .cancel = NULL, .on_job_done = NULL, .user_data = NULL};
+}
+
+/*
+ * Writes the tags of num_jobs jobs to their files in parallel, storing each job's result in its outcome.
+ * Jobs are split evenly between the threads up front, threads that run out steal half of the remaining jobs of another,
+ * so a few slow files (large pictures, slow disks) do not hold the rest up. Each thread writes through its own stdio buffer.
+ * - options may be NULL for defaults (see id3_batch_options_init()).
+ * - See id3_context for what may be shared between jobs. Two jobs must not write to the same file.
+ * - Returns once every started job has finished. Master tags are left as they are, destroy them afterwards.
+ * - num_jobs must fit in 32 bits.
+ *
+ * Usage:
+ * id3_batch_job jobs[2] = {{.file_path = "01.mp3", .base_tag = &album_tag, .master_tag = track_tags[0]},
+ *                          {.file_path = "02.mp3", .base_tag = &album_tag, .master_tag = track_tags[1]}};
+ * id3_batch_write(jobs, 2, NULL);
+ *
+ * Returns (success): TAG_WRITE_SUCCESS if every job succeeded
+ * Returns (failure): TAG_WRITE_CANCELLED if cancelled before every job was started, else the outcome of the first job (in array order) that failed,
+ *                    NODE_MEMORY_ERROR if the workers could not be allocated, TAG_INVALID_VALUE if num_jobs is too large
+ */
+unsigned int id3_batch_write(id3_batch_job* jobs, size_t num_jobs, const id3_batch_options* options) {
+    id3_batch_options default_options;
+    if (options == NULL) {
+        id3_batch_options_init(&default_options);
+        options = &default_options;
+    }
+
+    if (num_jobs > UINT32_MAX)
+        return TAG_INVALID_VALUE;
+
+    for (size_t i = 0; i < num_jobs; i++)
+        jobs[i].outcome = TAG_WRITE_CANCELLED;
+
+    unsigned int num_workers = options->num_threads != 0 ? options->num_threads : _batch_default_num_threads();
+    if (num_workers > num_jobs)
+        num_workers = num_jobs > 0 ? (unsigned int)num_jobs : 1;
+
+    _batch_worker* workers = (_batch_worker*)ID3_MALLOC(num_workers * sizeof(_batch_worker));
+
+    // malloc check
+    if (workers == NULL)
+        return NODE_MEMORY_ERROR;
+
+    struct _batch_shared shared = {.jobs = jobs, .options = options, .workers = workers, .num_workers = num_workers};
+
+    for (unsigned int i = 0; i < num_workers; i++) {
+        uint32_t begin = (uint32_t)(num_jobs * i / num_workers);
+        uint32_t end = (uint32_t)(num_jobs * (i + 1) / num_workers);
+
+        atomic_init(&workers[i].range, _batch_range_pack(begin, end));
+        workers[i].is_thread_started = 0;
+        workers[i].io_buffer = (char*)ID3_MALLOC(ID3_BATCH_IO_BUFFER_BYTES);
+        workers[i].shared = &shared;
+        workers[i].index = i;
+    }
+
+    // the calling thread is worker 0, the jobs of a thread that failed to start get stolen by the others
+    for (unsigned int i = 1; i < num_workers; i++)
+        workers[i].is_thread_started = pthread_create(&workers[i].thread, NULL, _batch_worker_run, &workers[i]) == 0;
+
+    _batch_worker_run(&workers[0]);
+
+    for (unsigned int i = 1; i < num_workers; i++) {
+        if (workers[i].is_thread_started)
+            pthread_join(workers[i].thread, NULL);
+    }
+
+    for (unsigned int i = 0; i < num_workers; i++)
+        ID3_FREE(workers[i].io_buffer);
+    ID3_FREE(workers);
+
+    unsigned int batch_outcome = TAG_WRITE_SUCCESS;
+    for (size_t i = 0; i < num_jobs; i++) {
+        if (jobs[i].outcome == TAG_WRITE_CANCELLED)
+            return TAG_WRITE_CANCELLED;
+        if (batch_outcome == TAG_WRITE_SUCCESS && jobs[i].outcome != TAG_WRITE_SUCCESS)
+            batch_outcome = jobs[i].outcome;
+    }
+
+    return batch_outcome;
+}
+
+/*
+ * [INTERNAL FUNCTION]
+ * Number of online processors, at least 1.
+ */
+unsigned int _batch_default_num_threads() {
+#ifdef _WIN32
+    SYSTEM_INFO system_info;
+    GetSystemInfo(&system_info);
+    long num_processors = (long)system_info.dwNumberOfProcessors;
+#else
+    long num_processors = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+
+    return num_processors > 0 ? (unsigned int)num_processors : 1;
+}
+
+/*
+ * [INTERNAL FUNCTION]
+ * Packs a job range into the representation stored in _batch_worker.range.
+ */
+uint64_t _batch_range_pack(uint32_t begin, uint32_t end) {
+    return ((uint64_t)begin << 32) | end;
+}
+
+/*
+ * [INTERNAL FUNCTION]
+ * Takes the job at the front of a worker's own range.
+ *
+ * Returns (success): 1, job_index set
+ * Returns (failure): 0 if the range is empty
+ */
+int _batch_take(_batch_worker* worker, uint32_t* job_index) {
+    uint64_t range = atomic_load_explicit(&worker->range, memory_order_relaxed);
+
+    for (;;) {
+        uint32_t begin = (uint32_t)(range >> 32);
+        uint32_t end = (uint32_t)range;
+
+        if (begin >= end)
+            return 0;
+
+        if (atomic_compare_exchange_weak_explicit(&worker->range, &range, _batch_range_pack(begin + 1, end), memory_order_relaxed, memory_order_relaxed)) {
+            *job_index = begin;
+            return 1;
+        }
+    }
+}
+
+/*
+ * [INTERNAL FUNCTION]
+ * Moves the back half (rounded up) of another worker's range into thief's own, now empty, range.
+ * Victims are tried in turn starting from the worker after thief.
+ *
+ * Returns (success): 1
+ * Returns (failure): 0 if every other worker's range is empty, i.e. no job is left to start
+ */
+int _batch_steal(_batch_worker* thief) {
+    struct _batch_shared* shared = thief->shared;
+
+    for (unsigned int offset = 1; offset < shared->num_workers; offset++) {
+        _batch_worker* victim = &shared->workers[(thief->index + offset) % shared->num_workers];
+        uint64_t range = atomic_load_explicit(&victim->range, memory_order_relaxed);
+
+        for (;;) {
+            uint32_t begin = (uint32_t)(range >> 32);
+            uint32_t end = (uint32_t)range;
+
+            if (begin >= end)
+                break;
+
+            uint32_t middle = begin + (end - begin) / 2;
+            if (atomic_compare_exchange_weak_explicit(&victim->range, &range, _batch_range_pack(begin, middle), memory_order_relaxed, memory_order_relaxed)) {
+                atomic_store_explicit(&thief->range, _batch_range_pack(middle, end), memory_order_relaxed);
+                return 1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * [INTERNAL FUNCTION]
+ * Whether the batch has been cancelled.
+ */
+int _batch_is_cancelled(const id3_batch_options* options) {
+    return options->cancel != NULL && atomic_load_explicit(options->cancel, memory_order_relaxed) != 0;
+}
+
+/*
+ * [INTERNAL FUNCTION]
+ * Runs jobs, own ones first then stolen ones, until none are left or the batch is cancelled.
+ */
+void* _batch_worker_run(void* worker_ptr) {
+    _batch_worker* worker = (_batch_worker*)worker_ptr;
+    struct _batch_shared* shared = worker->shared;
+    const id3_batch_options* options = shared->options;
+    uint32_t job_index;
+
+    while (!_batch_is_cancelled(options)) {
+        if (!_batch_take(worker, &job_index)) {
+            if (!_batch_steal(worker))
+                break;
+            continue;
+        }
+
+        id3_batch_job* job = &shared->jobs[job_index];
+        job->outcome = id3_write_tag_buffered(job->file_path, job->base_tag, job->master_tag, worker->io_buffer,
+                                              worker->io_buffer != NULL ? ID3_BATCH_IO_BUFFER_BYTES : 0);
+
+        if (options->on_job_done != NULL)
+            options->on_job_done(job, job_index, options->user_data);
+    }
+
+    return NULL;
+}
@@ -0,0 +1,88 @@
+#include "../include/id3_builder.h"
+
+#define _BUILDER_MAX(a, b) ((a) > (b) ? (a) : (b))
+
+// Arena bytes set aside per frame by id3_tag_builder_reserve(): the largest node, plus room for a value that does not fit inline.
+#define _BUILDER_NODE_BYTES _BUILDER_MAX(sizeof(id3_picture_tag_node), _BUILDER_MAX(sizeof(id3_comment_tag_node), sizeof(id3_user_tag_node)))
+#define _BUILDER_BYTES_PER_FRAME (_BUILDER_NODE_BYTES + 2 * sizeof(max_align_t) + ID3_NODE_INLINE_PAYLOAD_BYTES)
+
+/*
+ * Initialises a builder with empty lists and an empty arena. No memory is allocated until the first frame is added.
+ *
+ * Usage:
+ * id3_tag_builder builder;
+ * id3_tag_builder_init(&builder);
+ */
+void id3_tag_builder_init(id3_tag_builder* builder) {
+    id3_arena_init(&builder->arena, 0);
+    builder->text_tag_list = NULL;
+    builder->comment_tag_list = NULL;
+    builder->picture_tag_list = NULL;
+    id3_user_tag_list_init(&builder->user_tag_list);
+
+    id3_init_master_tag(&builder->master_tag);
+    builder->master_tag.text_tag_list = &builder->text_tag_list;
+    builder->master_tag.comment_tag_list = &builder->comment_tag_list;
+    builder->master_tag.picture_tag_list = &builder->picture_tag_list;
+    builder->master_tag.user_tag_list = &builder->user_tag_list;
+    builder->master_tag.arena = &builder->arena;
+}
+
+/*
+ * Sets aside enough memory for num_frames more frames in a single allocation, so that adding them does not call malloc().
+ * - The estimate covers frames whose values take up to a few dozen bytes, longer values may still need more memory.
+ * - Memory reserved is kept across id3_tag_builder_reset(), reserving for the largest expected tag once is enough.
+ *
+ * Returns (success): 1
+ * Returns (failure): 0
+ */
+int id3_tag_builder_reserve(id3_tag_builder* builder, size_t num_frames) {
+    return id3_arena_reserve(&builder->arena, num_frames * _BUILDER_BYTES_PER_FRAME);
+}
+
+/*
+ * Adds or updates text frames from an array of (frame ID, value) pairs, in order, as id3_text_tag_node_add_update() would.
+ * - Stops at the first pair that fails, the pairs before it stay added.
+ *
+ * Usage:
+ * id3_text_frame_value frames[] = {{ID3_FRAME_TALB, "Selection 3"}, {ID3_FRAME_TRCK, "3/12"}};
+ * id3_tag_builder_add_text_frames(&builder, frames, sizeof(frames) / sizeof(frames[0]));
+ *
+ * Returns (success): NODE_ADD_SUCCESS (also if some pairs updated existing frames)
+ * Returns (failure): see id3_text_tag_node_add_update()
+ */
+unsigned int id3_tag_builder_add_text_frames(id3_tag_builder* builder, const id3_text_frame_value* frames, size_t num_frames) {
+    for (size_t i = 0; i < num_frames; i++) {
+        unsigned int add_outcome = id3_text_tag_node_add_update_by_id(&builder->text_tag_list, &builder->arena, frames[i].frame_id, frames[i].value);
+        if (add_outcome != NODE_ADD_SUCCESS && add_outcome != NODE_UPDATE_SUCCESS)
+            return add_outcome;
+    }
+
+    return NODE_ADD_SUCCESS;
+}
+
+/*
+ * Writes the tag held by a builder to a file, see id3_write_tag().
+ *
+ * Returns: see id3_write_tag()
+ */
+unsigned int id3_tag_builder_write(id3_tag_builder* builder, char* file_path) {
+    return id3_write_tag(file_path, builder->master_tag);
+}
+
+/*
+ * Empties a builder for the next file, keeping all of its memory for reuse.
+ * - Picture binary data handed to the builder is released according to its ownership (see ID3_PICTURE_DATA_OWNED).
+ */
+void id3_tag_builder_reset(id3_tag_builder* builder) {
+    id3_destroy_master_tag(&builder->master_tag);
+}
+
+/*
+ * Empties a builder and frees all of its memory. The builder can be used again afterwards, as if freshly initialised.
+ */
+void id3_tag_builder_release(id3_tag_builder* builder) {
+    id3_destroy_master_tag(&builder->master_tag);
+    id3_user_tag_list_destroy(&builder->user_tag_list);
+    id3_arena_release(&builder->arena);
+}
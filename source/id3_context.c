@@ -0,0 +1,67 @@
+#include "../include/id3_context.h"
+
+/*
+ * Initialises a context with an empty builder and an empty picture cache, see id3_picture_cache_init() for memory_cap_bytes.
+ * A context must not be copied or moved afterwards (see id3_tag_builder).
+ *
+ * Usage (on each worker thread):
+ * id3_context context;
+ * id3_context_init(&context, 64 * 1024 * 1024);
+ * for each file:
+ *     id3_text_tag_node_add_update_by_id(&context.builder.text_tag_list, &context.builder.arena, ID3_FRAME_TIT2, title);
+ *     id3_context_add_picture_file(&context, "image/jpeg", APIC_TYPE_COVER_FRONT, "", cover_path);
+ *     id3_context_write(&context, file_path, &album_tag);
+ * id3_context_release(&context);
+ */
+void id3_context_init(id3_context* context, size_t picture_cache_memory_cap_bytes) {
+    id3_tag_builder_init(&context->builder);
+    id3_picture_cache_init(&context->picture_cache, picture_cache_memory_cap_bytes);
+    id3_stats_init(&context->stats);
+}
+
+/*
+ * Adds or updates a picture frame of the tag being built, its picture file being read through the context's picture cache.
+ *
+ * Returns: see id3_picture_tag_node_add_update_cached()
+ */
+unsigned int id3_context_add_picture_file(id3_context* context, char* mime_type, uint8_t picture_type, char* description, const char* picture_file_path) {
+    return id3_picture_tag_node_add_update_cached(&context->builder.picture_tag_list, &context->builder.arena, &context->picture_cache,
+                                                  mime_type, picture_type, description, picture_file_path);
+}
+
+/*
+ * Writes the tag being built to a file, on top of base_tag if not NULL (see id3_write_tag_with_base()), then empties it for the next file.
+ * - The tag is emptied whether or not the write succeeds.
+ *
+ * Returns: see id3_write_tag_with_base()
+ */
+unsigned int id3_context_write(id3_context* context, char* file_path, const id3_base_tag* base_tag) {
+    unsigned int write_outcome = id3_write_tag_with_base(file_path, base_tag, context->builder.master_tag);
+    id3_tag_builder_reset(&context->builder);
+
+    return write_outcome;
+}
+
+/*
+ * Starts (is_enabled non-zero) or stops collecting statistics on the tags written through a context into context->stats.
+ * Counters are kept while collection is stopped, see id3_stats_reset() to clear them.
+ *
+ * Usage:
+ * id3_context_enable_stats(&context, 1);
+ * ...
+ * id3_stats_snapshot snapshot;
+ * id3_stats_read(&context.stats, &snapshot);
+ */
+void id3_context_enable_stats(id3_context* context, int is_enabled) {
+    context->builder.master_tag.stats = is_enabled ? &context->stats : NULL;
+}
+
+/*
+ * Frees everything held by a context. The context can be used again afterwards, as if freshly initialised with the same picture cache memory cap.
+ * Statistics, and whether they are collected, are kept.
+ */
+void id3_context_release(id3_context* context) {
+    id3_tag_builder_release(&context->builder);
+    id3_picture_cache_destroy(&context->picture_cache);
+    id3_picture_cache_init(&context->picture_cache, context->picture_cache.memory_cap_bytes);
+}
@@ -0,0 +1,66 @@
+#include "../include/id3_frames.h"
+
+#define _ID3_FRAME_ID_LENGTH 4
+
+// Position of each frame within _frame_registry.
+#define _FRAME_INDEX_ENUM(name, a, b, c, d, category, encoding, key) _FRAME_INDEX_##name,
+enum _frame_index {
+    ID3_FRAME_LIST(_FRAME_INDEX_ENUM)
+    _NUM_FRAMES
+};
+#undef _FRAME_INDEX_ENUM
+
+#define _FRAME_REGISTRY_ENTRY(name, a, b, c, d, category, encoding, key) {ID3_FRAME_##name, #name, category, encoding, key},
+static const id3_frame_info _frame_registry[_NUM_FRAMES] = {
+    ID3_FRAME_LIST(_FRAME_REGISTRY_ENTRY)};
+#undef _FRAME_REGISTRY_ENTRY
+
+/*
+ * Converts a frame ID string such as "TALB" into its fourcc (ID3_FRAME_TALB).
+ * - Only checks that the string is exactly 4 characters long, use id3_frame_lookup() to check if the frame exists.
+ *
+ * Returns (success): fourcc of frame_name
+ * Returns (failure): ID3_FRAME_INVALID
+ */
+uint32_t id3_frame_id_from_string(const char* frame_name) {
+    for (int i = 0; i < _ID3_FRAME_ID_LENGTH; i++) {
+        if (frame_name[i] == '\0')
+            return ID3_FRAME_INVALID;
+    }
+    if (frame_name[_ID3_FRAME_ID_LENGTH] != '\0')
+        return ID3_FRAME_INVALID;
+
+    return ID3_FOURCC((unsigned char)frame_name[0], (unsigned char)frame_name[1], (unsigned char)frame_name[2], (unsigned char)frame_name[3]);
+}
+
+/*
+ * Finds the registry entry of a frame. The switch below compiles into a jump table or binary search over integers.
+ *
+ * Usage:
+ * const id3_frame_info* frame_info = id3_frame_lookup(id3_frame_id_from_string("TALB"));
+ * if (frame_info != NULL && frame_info->category == ID3_FRAME_CATEGORY_TEXT) ...
+ *
+ * Returns (success): pointer to the registry entry
+ * Returns (failure): NULL if frame_id is not an ID3v2.3 frame
+ */
+const id3_frame_info* id3_frame_lookup(uint32_t frame_id) {
+#define _FRAME_LOOKUP_CASE(name, a, b, c, d, category, encoding, key) \
+    case ID3_FRAME_##name:                                             \
+        return &_frame_registry[_FRAME_INDEX_##name];
+
+    switch (frame_id) {
+        ID3_FRAME_LIST(_FRAME_LOOKUP_CASE)
+        default:
+            return NULL;
+    }
+
+#undef _FRAME_LOOKUP_CASE
+}
+
+// Writes the 4 bytes of a frame ID in file order into frame_id_bytes.
+void id3_frame_id_to_bytes(uint32_t frame_id, uint8_t* frame_id_bytes) {
+    frame_id_bytes[0] = (frame_id >> 24) & 0xFF;
+    frame_id_bytes[1] = (frame_id >> 16) & 0xFF;
+    frame_id_bytes[2] = (frame_id >> 8) & 0xFF;
+    frame_id_bytes[3] = frame_id & 0xFF;
+}
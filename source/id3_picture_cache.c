@@ -0,0 +1,337 @@
+// st_mtim is POSIX
+#define _POSIX_C_SOURCE 200809L
+
+#include <sys/stat.h>
+
+#include "../include/id3_picture_cache.h"
+
+#define _FNV_OFFSET_BASIS 0xCBF29CE484222325ULL
+#define _FNV_PRIME 0x100000001B3ULL
+
+// ["PRIVATE" FUNCTIONS] /////////////////////////////////////////////
+
+uint64_t _picture_cache_hash(const uint8_t* data, size_t data_bytes);
+id3_picture_cache_entry** _picture_cache_bucket(id3_picture_cache* cache, const char* picture_file_path);
+id3_picture_cache_entry** _picture_cache_content_bucket(id3_picture_cache* cache, uint64_t content_hash);
+int64_t _picture_cache_file_mtime_ns(const struct stat* picture_file_stat);
+id3_shared_picture* _picture_cache_find_content(id3_picture_cache* cache, uint64_t content_hash, const uint8_t* data, unsigned int data_bytes);
+uint8_t* _picture_cache_read_file(const char* picture_file_path, unsigned int file_bytes);
+void _picture_cache_lru_unlink(id3_picture_cache* cache, id3_picture_cache_entry* entry);
+void _picture_cache_lru_push_front(id3_picture_cache* cache, id3_picture_cache_entry* entry);
+void _picture_cache_remove(id3_picture_cache* cache, id3_picture_cache_entry* entry);
+//////////////////////////////////////////////////////////////////////
+
+/*
+ * Initialises an empty picture cache.
+ * - memory_cap_bytes of 0 means no cap.
+ *
+ * Usage:
+ * id3_picture_cache cache;
+ * id3_picture_cache_init(&cache, 64 * 1024 * 1024);
+ */
+void id3_picture_cache_init(id3_picture_cache* cache, size_t memory_cap_bytes) {
+    for (int i = 0; i < ID3_PICTURE_CACHE_BUCKETS; i++) {
+        cache->buckets[i] = NULL;
+        cache->content_buckets[i] = NULL;
+    }
+
+    cache->lru_head = NULL;
+    cache->lru_tail = NULL;
+    cache->memory_cap_bytes = memory_cap_bytes;
+    cache->stats = (id3_picture_cache_stats){.hits = 0, .misses = 0, .content_hits = 0, .evictions = 0, .memory_bytes = 0};
+}
+
+/*
+ * Gets the picture stored at picture_file_path, reading the file only if it is not cached or has changed since it was cached.
+ * - The caller receives its own reference, release it with id3_shared_picture_release() once done.
+ *
+ * Usage:
+ * id3_shared_picture* cover = id3_picture_cache_get(&cache, "./folder.jpg");
+ * if (cover != NULL) {
+ *     id3_picture_tag_node_add_update_shared(&picture_tag_list, NULL, "image/jpeg", APIC_TYPE_COVER_FRONT, "", cover);
+ *     id3_shared_picture_release(cover);
+ * }
+ *
+ * Returns (success): pointer to the picture
+ * Returns (failure): NULL if the file cannot be read or memory runs out
+ */
+id3_shared_picture* id3_picture_cache_get(id3_picture_cache* cache, const char* picture_file_path) {
+    id3_picture_cache_entry** bucket = _picture_cache_bucket(cache, picture_file_path);
+    id3_picture_cache_entry* entry = *bucket;
+
+    while (entry != NULL && strcmp(entry->path, picture_file_path))
+        entry = entry->bucket_next;
+
+    struct stat picture_file_stat;
+    if (stat(picture_file_path, &picture_file_stat) != 0 || !S_ISREG(picture_file_stat.st_mode)) {
+        if (entry != NULL)
+            _picture_cache_remove(cache, entry);
+        return NULL;
+    }
+
+    if (entry != NULL) {
+        if (entry->file_device == (uint64_t)picture_file_stat.st_dev && entry->file_inode == (uint64_t)picture_file_stat.st_ino &&
+            entry->file_mtime_ns == _picture_cache_file_mtime_ns(&picture_file_stat) && entry->file_bytes == (unsigned int)picture_file_stat.st_size) {
+            cache->stats.hits++;
+
+            _picture_cache_lru_unlink(cache, entry);
+            _picture_cache_lru_push_front(cache, entry);
+
+            id3_shared_picture_retain(entry->picture);
+            return entry->picture;
+        }
+
+        // the file changed since it was cached
+        _picture_cache_remove(cache, entry);
+    }
+
+    cache->stats.misses++;
+
+    unsigned int file_bytes = (unsigned int)picture_file_stat.st_size;
+    uint8_t* data = _picture_cache_read_file(picture_file_path, file_bytes);
+    if (data == NULL)
+        return NULL;
+
+    entry = (id3_picture_cache_entry*)ID3_MALLOC(sizeof(id3_picture_cache_entry));
+    char* path = (char*)ID3_MALLOC(strlen(picture_file_path) + 1);
+
+    // malloc check
+    if (entry == NULL || path == NULL) {
+        ID3_FREE(entry);
+        ID3_FREE(path);
+        ID3_FREE(data);
+        return NULL;
+    }
+
+    strcpy(path, picture_file_path);
+    *entry = (id3_picture_cache_entry){.path = path, .file_device = (uint64_t)picture_file_stat.st_dev, .file_inode = (uint64_t)picture_file_stat.st_ino,
+                                       .file_mtime_ns = _picture_cache_file_mtime_ns(&picture_file_stat), .file_bytes = file_bytes,
+                                       .content_hash = _picture_cache_hash(data, file_bytes), .picture = NULL, .is_memory_counted = 0,
+                                       .bucket_next = NULL, .content_bucket_next = NULL, .lru_prev = NULL, .lru_next = NULL};
+
+    // identical content loaded from another path shares that path's buffer
+    entry->picture = _picture_cache_find_content(cache, entry->content_hash, data, file_bytes);
+    if (entry->picture != NULL) {
+        cache->stats.content_hits++;
+        id3_shared_picture_retain(entry->picture);
+        ID3_FREE(data);
+    } else {
+        entry->picture = id3_shared_picture_create(data, file_bytes);
+        if (entry->picture == NULL) {
+            ID3_FREE(entry);
+            ID3_FREE(path);
+            ID3_FREE(data);
+            return NULL;
+        }
+
+        entry->is_memory_counted = 1;
+        cache->stats.memory_bytes += file_bytes;
+    }
+
+    entry->bucket_next = *bucket;
+    *bucket = entry;
+
+    id3_picture_cache_entry** content_bucket = _picture_cache_content_bucket(cache, entry->content_hash);
+    entry->content_bucket_next = *content_bucket;
+    *content_bucket = entry;
+
+    _picture_cache_lru_push_front(cache, entry);
+
+    // evict from the least recently used end, never the entry just added
+    while (cache->memory_cap_bytes != 0 && cache->stats.memory_bytes > cache->memory_cap_bytes && cache->lru_tail != entry) {
+        cache->stats.evictions++;
+        _picture_cache_remove(cache, cache->lru_tail);
+    }
+
+    id3_shared_picture_retain(entry->picture);
+    return entry->picture;
+}
+
+/*
+ * Same as id3_picture_tag_node_add_update_shared(), with the picture taken from a picture cache.
+ * - Unlike id3_picture_tag_node_add_update(), the picture file is read (if not already cached) right away.
+ *
+ * Usage:
+ * id3_picture_tag_node_add_update_cached(&picture_tag_list, NULL, &cache, "image/jpeg", APIC_TYPE_COVER_FRONT, "", "./folder.jpg");
+ *
+ * Returns (success): NODE_ADD_SUCCESS, NODE_UPDATE_SUCCESS
+ * Returns (failure): NODE_FILE_ERROR, NODE_INVALID_TAG_VALUE, NODE_MEMORY_ERROR
+ */
+unsigned int id3_picture_tag_node_add_update_cached(id3_picture_tag_node** head, id3_arena* arena, id3_picture_cache* cache,
+                                                    char* mime_type, uint8_t picture_type, char* description, const char* picture_file_path) {
+    id3_shared_picture* picture = id3_picture_cache_get(cache, picture_file_path);
+    if (picture == NULL)
+        return NODE_FILE_ERROR;
+
+    unsigned int add_outcome = id3_picture_tag_node_add_update_shared(head, arena, mime_type, picture_type, description, picture);
+    id3_shared_picture_release(picture);
+
+    return add_outcome;
+}
+
+/*
+ * Drops every entry of a picture cache. Pictures still referenced by tags stay alive until those release them.
+ * The cache is empty afterwards and can be used again, its stats are kept.
+ */
+void id3_picture_cache_destroy(id3_picture_cache* cache) {
+    while (cache->lru_tail != NULL)
+        _picture_cache_remove(cache, cache->lru_tail);
+}
+
+/*
+ * [INTERNAL FUNCTION]
+ * 64 bit FNV-1a hash of data_bytes of data.
+ */
+uint64_t _picture_cache_hash(const uint8_t* data, size_t data_bytes) {
+    uint64_t hash = _FNV_OFFSET_BASIS;
+
+    for (size_t i = 0; i < data_bytes; i++) {
+        hash ^= data[i];
+        hash *= _FNV_PRIME;
+    }
+
+    return hash;
+}
+
+/*
+ * [INTERNAL FUNCTION]
+ * Finds the bucket that entries for picture_file_path belong to.
+ */
+id3_picture_cache_entry** _picture_cache_bucket(id3_picture_cache* cache, const char* picture_file_path) {
+    uint64_t path_hash = _picture_cache_hash((const uint8_t*)picture_file_path, strlen(picture_file_path));
+
+    return &cache->buckets[path_hash % ID3_PICTURE_CACHE_BUCKETS];
+}
+
+/*
+ * [INTERNAL FUNCTION]
+ * Finds the content bucket that entries whose picture data hashes to content_hash belong to.
+ */
+id3_picture_cache_entry** _picture_cache_content_bucket(id3_picture_cache* cache, uint64_t content_hash) {
+    return &cache->content_buckets[content_hash % ID3_PICTURE_CACHE_BUCKETS];
+}
+
+/*
+ * [INTERNAL FUNCTION]
+ * Modification time of a file in nanoseconds, only to the second where struct stat has no st_mtim (Windows).
+ */
+int64_t _picture_cache_file_mtime_ns(const struct stat* picture_file_stat) {
+#ifdef _WIN32
+    return (int64_t)picture_file_stat->st_mtime * 1000000000;
+#else
+    return (int64_t)picture_file_stat->st_mtim.tv_sec * 1000000000 + (int64_t)picture_file_stat->st_mtim.tv_nsec;
+#endif
+}
+
+/*
+ * [INTERNAL FUNCTION]
+ * Looks for a cached picture whose data is identical to data.
+ *
+ * Returns (success): pointer to the picture, no reference is taken
+ * Returns (failure): NULL
+ */
+id3_shared_picture* _picture_cache_find_content(id3_picture_cache* cache, uint64_t content_hash, const uint8_t* data, unsigned int data_bytes) {
+    for (id3_picture_cache_entry* iter_entry = *_picture_cache_content_bucket(cache, content_hash); iter_entry != NULL; iter_entry = iter_entry->content_bucket_next) {
+        if (iter_entry->content_hash == content_hash && iter_entry->picture->data_bytes == data_bytes &&
+            !memcmp(iter_entry->picture->data, data, data_bytes))
+            return iter_entry->picture;
+    }
+
+    return NULL;
+}
+
+/*
+ * [INTERNAL FUNCTION]
+ * Reads exactly file_bytes of the file at picture_file_path into its own allocation.
+ *
+ * Returns (success): pointer to the data
+ * Returns (failure): NULL
+ */
+uint8_t* _picture_cache_read_file(const char* picture_file_path, unsigned int file_bytes) {
+    FILE* picture_file_ptr;
+    picture_file_ptr = fopen(picture_file_path, "rb");
+
+    if (picture_file_ptr == NULL)
+        return NULL;
+
+    uint8_t* data = (uint8_t*)ID3_MALLOC(file_bytes > 0 ? file_bytes : 1);
+    if (data == NULL || fread(data, 1, file_bytes, picture_file_ptr) != file_bytes) {
+        ID3_FREE(data);
+        fclose(picture_file_ptr);
+        return NULL;
+    }
+
+    fclose(picture_file_ptr);
+
+    return data;
+}
+
+/*
+ * [INTERNAL FUNCTION]
+ * Takes an entry out of the LRU list.
+ */
+void _picture_cache_lru_unlink(id3_picture_cache* cache, id3_picture_cache_entry* entry) {
+    if (entry->lru_prev != NULL)
+        entry->lru_prev->lru_next = entry->lru_next;
+    else
+        cache->lru_head = entry->lru_next;
+
+    if (entry->lru_next != NULL)
+        entry->lru_next->lru_prev = entry->lru_prev;
+    else
+        cache->lru_tail = entry->lru_prev;
+
+    entry->lru_prev = NULL;
+    entry->lru_next = NULL;
+}
+
+/*
+ * [INTERNAL FUNCTION]
+ * Makes an entry the most recently used.
+ */
+void _picture_cache_lru_push_front(id3_picture_cache* cache, id3_picture_cache_entry* entry) {
+    entry->lru_prev = NULL;
+    entry->lru_next = cache->lru_head;
+
+    if (cache->lru_head != NULL)
+        cache->lru_head->lru_prev = entry;
+    else
+        cache->lru_tail = entry;
+
+    cache->lru_head = entry;
+}
+
+/*
+ * [INTERNAL FUNCTION]
+ * Drops an entry from the cache, releasing the cache's reference to its picture.
+ * - If other entries share the picture, one of them takes over counting its memory.
+ */
+void _picture_cache_remove(id3_picture_cache* cache, id3_picture_cache_entry* entry) {
+    id3_picture_cache_entry** bucket = _picture_cache_bucket(cache, entry->path);
+    while (*bucket != entry)
+        bucket = &(*bucket)->bucket_next;
+    *bucket = entry->bucket_next;
+
+    id3_picture_cache_entry** content_bucket = _picture_cache_content_bucket(cache, entry->content_hash);
+    while (*content_bucket != entry)
+        content_bucket = &(*content_bucket)->content_bucket_next;
+    *content_bucket = entry->content_bucket_next;
+
+    _picture_cache_lru_unlink(cache, entry);
+
+    // entries sharing the picture have the same content hash, so they are all in the same content bucket
+    if (entry->is_memory_counted) {
+        id3_picture_cache_entry* iter_entry = *_picture_cache_content_bucket(cache, entry->content_hash);
+        while (iter_entry != NULL && iter_entry->picture != entry->picture)
+            iter_entry = iter_entry->content_bucket_next;
+
+        if (iter_entry != NULL)
+            iter_entry->is_memory_counted = 1;
+        else
+            cache->stats.memory_bytes -= entry->picture->data_bytes;
+    }
+
+    id3_shared_picture_release(entry->picture);
+    ID3_FREE(entry->path);
+    ID3_FREE(entry);
+}
@@ -1,28 +1,84 @@
+#include <sys/stat.h>
+
+#ifdef ID3_WITH_ZLIB
+#include <zlib.h>
+#endif
+
 #include "../include/id3_process.h"
+#include "../include/id3_trace.h"
 
-#define _NUM_TEXT_TAGS 38
 #define _TAG_NAME_LENGTH 5
 #define _COMMENT_LANGUAGE_LENGTH 3
 
+// Buckets of a user frame list's index when first allocated, the index doubles whenever it gets over 3/4 full.
+#define _USER_INDEX_INITIAL_BUCKETS 16
+
 #define _ENCODING_BYTE_LENGTH 1
+#define _COMPRESSION_SIZE_LENGTH 4
 #define _ENCODING_UNICODE_BOM_LENGTH 2
 #define _ENCODING_UNICODE_NULL_LENGTH 2
 #define _ENCODING_ISO_NULL_LENGTH 1
 #define _ENCODING_APIC_PICTURE_TYPE_LENGTH 1
 
-#define _NODE_TYPE_TEXT 0
-#define _NODE_TYPE_COMMENT 1
-#define _NODE_TYPE_APIC 2
+#define _ENCODING_ISO_8859_1 0x00
+#define _ENCODING_UTF_16 0x01
+
+/*
+ * [INTERNAL STRUCT]
+ * A string checked and measured ahead of being written into a payload, so that the payload size is known before it is allocated.
+ *
+ * string: Original UTF-8 string, it must stay valid until written.
+ * validation: What utf8_validate() found out about string, used to choose the encoding and size it without looking at string again.
+ * is_utf16: Whether string is to be transcoded to UTF-16, it is transcoded to ISO-8859-1 (copied as is if ASCII only) otherwise.
+ * num_bytes: Bytes the string will take up in the payload, including BOM and terminator.
+ */
+typedef struct {
+    const char* string;
+    utf8_validation validation;
+    int is_utf16;
+    unsigned int num_bytes;
+} _payload_string;
 
 // ["PRIVATE" FUNCTIONS] /////////////////////////////////////////////
 
-unsigned int _node_generate_metadata(int node_type, void** node);
-unsigned int _text_node_generate_metadata(id3_text_tag_node** node);
-unsigned int _comment_node_generate_metadata(id3_comment_tag_node** node);
-unsigned int _picture_node_generate_metadata(id3_picture_tag_node** node);
+unsigned int _text_node_encode(id3_text_tag_node* node);
+unsigned int _comment_node_encode(id3_comment_tag_node* node);
+unsigned int _user_node_encode(id3_user_tag_node* node);
+unsigned int _picture_node_encode(id3_picture_tag_node* node);
+unsigned int _picture_file_bytes(const char* picture_file_path, unsigned int* picture_bytes);
+unsigned int _payload_string_prepare(_payload_string* prepared, const char* string);
+int _payload_choose_encoding(_payload_string* first, _payload_string* second);
+void _payload_string_set_encoding(_payload_string* prepared, int is_utf16);
+uint8_t* _payload_string_write(uint8_t* write_ptr, const _payload_string* prepared);
+unsigned int _described_payload_encode(id3_arena* arena, uint8_t* inline_buffer, uint8_t** payload, const char* language, const char* description,
+                                       const char* value, int is_value_iso_8859_1, unsigned int* num_bytes, int* is_utf8);
+unsigned int _payload_compress(id3_arena* arena, const uint8_t* payload, unsigned int num_bytes, unsigned int threshold_bytes,
+                               uint8_t** compressed_payload, unsigned int* compressed_bytes);
+unsigned int _payload_set_pending(id3_arena* arena, uint8_t* inline_buffer, uint8_t** payload, const char* string);
+const char* _payload_pending_value(uint8_t* payload, uint8_t* inline_buffer, char* copy_buffer);
+unsigned int _pending_value_copy(const char* pending_value, char* string, unsigned int string_bytes);
+unsigned int _payload_string_decode(const uint8_t* encoded, int is_utf8, char* string, unsigned int string_bytes, unsigned int* num_encoded_bytes);
+uint8_t* _payload_allocate(id3_arena* arena, uint8_t* inline_buffer, unsigned int num_bytes);
+void _payload_free(id3_arena* arena, uint8_t* inline_buffer, uint8_t* payload);
+unsigned int _text_tag_node_add_update(id3_text_tag_node** head, id3_arena* arena, uint32_t frame_id, const char* tag_value);
+unsigned int _comment_tag_node_add_update(id3_comment_tag_node** head, id3_arena* arena, char* language, char* short_content_description, char* comment);
+unsigned int _user_tag_node_add_update(id3_user_tag_list* list, id3_arena* arena, uint32_t frame_id, char* description, char* value);
+uint32_t _user_tag_hash(uint32_t frame_id, const char* description);
+id3_user_tag_node** _user_tag_list_find_link(const id3_user_tag_list* list, uint32_t frame_id, const char* description, uint32_t description_hash);
+int _user_tag_list_reserve(id3_user_tag_list* list, unsigned int num_nodes);
 void _free_text_tag_node(id3_text_tag_node* node);
 void _free_comment_tag_node(id3_comment_tag_node* node);
+void _free_user_tag_node(id3_user_tag_node* node);
 void _free_picture_tag_node(id3_picture_tag_node* node);
+unsigned int _picture_tag_node_add_update(id3_picture_tag_node** head, id3_arena* arena, char* mime_type, uint8_t picture_type, char* description,
+                                          char* picture_file_path, uint8_t* picture_binary_data, unsigned int picture_binary_data_bytes,
+                                          uint8_t picture_data_ownership, id3_shared_picture* shared_picture);
+void _picture_data_release(uint8_t picture_data_ownership, uint8_t* picture_binary_data, id3_shared_picture* shared_picture);
+void* _node_alloc(id3_arena* arena, size_t bytes);
+void _node_free(id3_arena* arena, void* ptr);
+char* _node_strdup(id3_arena* arena, const char* string);
+char* _node_string_store(id3_arena* arena, char* inline_buffer, const char* string);
+void _node_string_free(id3_arena* arena, char* inline_buffer, char* string);
 //////////////////////////////////////////////////////////////////////
 
 /*
@@ -32,23 +88,35 @@ void _free_picture_tag_node(id3_picture_tag_node* node);
  * iter_node->tag_value = (char*)malloc(strlen(tag_value) + 1);
  * if (iter_node->tag_value == NULL)
  *     free(iter_node->tag_value);
+ *
+ * Nodes created with an arena (see id3_arena.h) take all of their memory from it instead, and every free of such memory is skipped.
+ * All allocations and frees below therefore go through _node_alloc() and _node_free(), with the arena owning the node being updated.
+ * Values replaced during an update stay in the arena until it is reset.
+ *
+ * Short strings and payloads are kept inside the node itself (see ID3_NODE_INLINE_STRING_BYTES and ID3_NODE_INLINE_PAYLOAD_BYTES),
+ * those go through _node_string_store()/_node_string_free() and _payload_allocate()/_payload_free().
+ *
+ * Payloads are encoded by the _*_node_encode() functions, which either replace the node's payload entirely or leave the node untouched.
+ * Every step that can fail happens before the payload is allocated, so an inline payload can be overwritten in place.
+ *
+ * Adding or updating a node does not encode anything, it only stores the new value and marks the node as dirty.
+ * Dirty nodes are encoded once, when the tag is sized or written (see id3_*_tag_list_encode()), so a node updated several times
+ * before being written is only transcoded once. Picture files are the exception: they are stat()ed every time a tag is sized,
+ * clean nodes included, so that a file changed since the last write is never written with a stale size.
  */
 
 /*
  * The text information frames are the most important frames, containing information like artist, album and more.
  * There may only be one text information frame of its kind in an tag, with the exception of "TXXX", which may be present more than once.
- * All text frame identifiers begin with "T".
+ * "TXXX" frames are kept apart from the others, in a id3_user_tag_list (see id3_user_tag_node_add_update()).
+ * All text frame identifiers begin with "T", valid ones are those registered as ID3_FRAME_CATEGORY_TEXT in id3_frames.h.
  */
-char TEXT_TAGS[_NUM_TEXT_TAGS][_TAG_NAME_LENGTH] = {
-    "TALB", "TBPM", "TCOM", "TCON", "TCOP", "TDAT", "TDLY", "TENC", "TEXT",
-    "TFLT", "TIME", "TIT1", "TIT2", "TIT3", "TKEY", "TLAN", "TLEN", "TMED",
-    "TOAL", "TOFN", "TOLY", "TOPE", "TORY", "TOWN", "TPE1", "TPE2", "TPE3",
-    "TPE4", "TPOS", "TPUB", "TRCK", "TRDA", "TRSN", "TRSO", "TSIZ", "TSRC", "TSSE", "TYER"};
 
 /*
  * Adds a new node to the end of a text tag linked list if the tag_name doesn't already exist in it.
- * If a matching tag is found, it replaces that node's tag_value with the provided tag_value and refreshes the utf8 and utf16 metadata fields.
+ * If a matching tag is found, it replaces that node's value with the provided tag_value.
  * - This function requires tag_value to be a non-zero length string.
+ * - tag_value is only checked and encoded when the tag is written, see id3_text_tag_list_encode().
  * - If the operation fails, the provided linked list remains unchanged.
  * - See id3_write.c's _write_text_tag() for more information on the format of the tag.
  *
@@ -57,17 +125,54 @@ char TEXT_TAGS[_NUM_TEXT_TAGS][_TAG_NAME_LENGTH] = {
  * id3_text_tag_node_add_update(&text_tag_list, "TALB", "Selection 3"); // repeat as many times as needed
  *
  * Returns (success): NODE_ADD_SUCCESS, NODE_UPDATE_SUCCESS
- * Returns (failure): NODE_FILE_ERROR, NODE_INVALID_TAG_VALUE, NODE_MEMORY_ERROR, UTF8_PARSE_MALFORMED, UTF16_PARSE_NO_MEM, UTF16_PARSE_UTF8_MALFORMED
+ * Returns (failure): NODE_INVALID_TAG_NAME, NODE_INVALID_TAG_VALUE, NODE_MEMORY_ERROR
  */
 unsigned int id3_text_tag_node_add_update(id3_text_tag_node** head, char* tag_name, char* tag_value) {
-    unsigned int is_valid_text_tag = 0;
-    for (int i = 0; i < _NUM_TEXT_TAGS; i++) {
-        if (!strcmp(tag_name, TEXT_TAGS[i])) {
-            is_valid_text_tag = 1;
-            break;
-        }
-    }
-    if (!is_valid_text_tag)
+    return id3_text_tag_node_add_update_in_arena(head, NULL, tag_name, tag_value);
+}
+
+/*
+ * Same as id3_text_tag_node_add_update(), but a newly created node takes all of its memory from arena.
+ * - Passing NULL as arena is equivalent to calling id3_text_tag_node_add_update().
+ * - An updated node keeps using the arena (or heap) it was created with.
+ * - Do not mix nodes from different arenas, or arena and heap nodes, in one list if the list will be destroyed with id3_destroy_master_tag().
+ *
+ * Usage:
+ * id3_arena arena;
+ * id3_arena_init(&arena, 0);
+ * id3_text_tag_node* text_tag_list = NULL;
+ * id3_text_tag_node_add_update_in_arena(&text_tag_list, &arena, "TALB", "Selection 3");
+ *
+ * Returns: see id3_text_tag_node_add_update()
+ */
+unsigned int id3_text_tag_node_add_update_in_arena(id3_text_tag_node** head, id3_arena* arena, char* tag_name, char* tag_value) {
+    return id3_text_tag_node_add_update_by_id(head, arena, id3_frame_id_from_string(tag_name), tag_value);
+}
+
+/*
+ * Same as id3_text_tag_node_add_update_in_arena(), but the frame is given as a fourcc (e.g. ID3_FRAME_TALB) instead of a string.
+ * - arena can be NULL.
+ *
+ * Usage:
+ * id3_text_tag_node* text_tag_list = NULL;
+ * id3_text_tag_node_add_update_by_id(&text_tag_list, NULL, ID3_FRAME_TALB, "Selection 3");
+ *
+ * Returns: see id3_text_tag_node_add_update()
+ */
+unsigned int id3_text_tag_node_add_update_by_id(id3_text_tag_node** head, id3_arena* arena, uint32_t frame_id, const char* tag_value) {
+    unsigned int add_update_outcome;
+    ID3_TRACE_SPAN("text_add_update", add_update_outcome = _text_tag_node_add_update(head, arena, frame_id, tag_value));
+
+    return add_update_outcome;
+}
+
+/*
+ * [INTERNAL FUNCTION]
+ * Does the work of id3_text_tag_node_add_update_by_id().
+ */
+unsigned int _text_tag_node_add_update(id3_text_tag_node** head, id3_arena* arena, uint32_t frame_id, const char* tag_value) {
+    const id3_frame_info* frame_info = id3_frame_lookup(frame_id);
+    if (frame_info == NULL || frame_info->category != ID3_FRAME_CATEGORY_TEXT)
         return NODE_INVALID_TAG_NAME;
 
     if (strlen(tag_value) == 0)
@@ -81,35 +186,12 @@ unsigned int id3_text_tag_node_add_update(id3_text_tag_node** head, char* tag_na
         id3_text_tag_node* iter_node = *head;
 
         while (1) {
-            if (!strcmp(iter_node->tag_name, tag_name)) {
-                // checkpointing previous values
-                char* old_tag_value = iter_node->tag_value;
-
-                iter_node->tag_value = (char*)malloc(strlen(tag_value) + 1);
-
-                // malloc check
-                if (iter_node->tag_value == NULL) {
-                    free(iter_node->tag_value);
-
-                    iter_node->tag_value = old_tag_value;
-
+            if (iter_node->frame_id == frame_id) {
+                // storing the new value either succeeds or leaves the node as it was
+                if (_payload_set_pending(iter_node->arena, iter_node->payload_inline, &iter_node->payload, tag_value) != UTF8_PARSE_SUCCESS)
                     return NODE_MEMORY_ERROR;
-                }
-
-                strncpy(iter_node->tag_value, tag_value, strlen(tag_value) + 1);
-
-                // in event of parse failure, revert to old values
-                unsigned int metadata_parse_outcome = _node_generate_metadata(_NODE_TYPE_TEXT, (void**)&iter_node);
-                if (metadata_parse_outcome != UTF8_PARSE_SUCCESS) {
-                    free(iter_node->tag_value);
-
-                    iter_node->tag_value = old_tag_value;
-
-                    return metadata_parse_outcome;
-                }
 
-                // cleanup old values once new assignments complete
-                free(old_tag_value);
+                iter_node->is_dirty = 1;
 
                 return NODE_UPDATE_SUCCESS;
             }
@@ -124,36 +206,22 @@ unsigned int id3_text_tag_node_add_update(id3_text_tag_node** head, char* tag_na
     }
 
     // create a new node
-    id3_text_tag_node* new_node = (id3_text_tag_node*)malloc(sizeof(id3_text_tag_node));
+    id3_text_tag_node* new_node = (id3_text_tag_node*)_node_alloc(arena, sizeof(id3_text_tag_node));
 
     // malloc check -> struct
     if (new_node == NULL)
         return NODE_MEMORY_ERROR;
 
-    *new_node = (id3_text_tag_node){.next = NULL, .num_id3_bytes = 0, .is_utf8 = 0, .tag_value_utf16 = NULL};
-
-    new_node->tag_value = (char*)malloc(strlen(tag_value) + 1);
+    *new_node = (id3_text_tag_node){.next = NULL, .frame_id = frame_id, .payload = NULL, .num_id3_bytes = 0, .compressed_payload = NULL, .compressed_bytes = 0, .is_utf8 = 0, .is_dirty = 1, .arena = arena};
+    strncpy(new_node->tag_name, frame_info->name, _TAG_NAME_LENGTH);
 
     // malloc check -> struct members
-    if (new_node->tag_value == NULL) {
-        free(new_node->tag_value);
-        free(new_node);
+    if (_payload_set_pending(arena, new_node->payload_inline, &new_node->payload, tag_value) != UTF8_PARSE_SUCCESS) {
+        _node_free(arena, new_node);
 
         return NODE_MEMORY_ERROR;
     }
 
-    strncpy(new_node->tag_name, tag_name, _TAG_NAME_LENGTH);
-    strncpy(new_node->tag_value, tag_value, strlen(tag_value) + 1);
-
-    // in event of parse failure, revert to old values
-    unsigned int metadata_parse_outcome = _node_generate_metadata(_NODE_TYPE_TEXT, (void**)&new_node);
-    if (metadata_parse_outcome != UTF8_PARSE_SUCCESS) {
-        free(new_node->tag_value);
-        free(new_node);
-
-        return metadata_parse_outcome;
-    }
-
     if (*head == NULL)
         *head = new_node;
     else
@@ -162,9 +230,27 @@ unsigned int id3_text_tag_node_add_update(id3_text_tag_node** head, char* tag_na
     return NODE_ADD_SUCCESS;
 }
 
+/*
+ * Recovers the UTF-8 value of a text tag node from its encoded payload, or returns the pending value if the node is dirty.
+ * Works like snprintf: at most tag_value_bytes bytes (including the null terminator) are written to tag_value,
+ * and the full length of the value is returned regardless.
+ *
+ * Usage:
+ * char tag_value[64];
+ * if (id3_text_tag_node_get_value(text_tag_list, tag_value, sizeof(tag_value)) >= sizeof(tag_value)) ... // value was cut short
+ *
+ * Returns: length in bytes of the UTF-8 value, not including the null terminator
+ */
+unsigned int id3_text_tag_node_get_value(id3_text_tag_node* node, char* tag_value, unsigned int tag_value_bytes) {
+    if (node->is_dirty)
+        return _pending_value_copy((const char*)node->payload, tag_value, tag_value_bytes);
+
+    return _payload_string_decode(node->payload + _ENCODING_BYTE_LENGTH, node->is_utf8, tag_value, tag_value_bytes, NULL);
+}
+
 /*
  * Deletes a specified node of a text tag linked list.
- * - If you want to delete a "TXXX" tag, use id3_txxx_tag_node_delete() instead.
+ * - "TXXX" frames are not text tag nodes, see id3_user_tag_node_delete().
  * - If a node with a matching tag_name is not found, the linked list remains unchanged.
  *
  * Usage:
@@ -176,6 +262,7 @@ unsigned int id3_text_tag_node_add_update(id3_text_tag_node** head, char* tag_na
  * Returns (failure): NODE_NOT_FOUND, NODE_INVALID_HEAD
  */
 unsigned int id3_text_tag_node_delete(id3_text_tag_node** head, char* tag_name) {
+    uint32_t frame_id = id3_frame_id_from_string(tag_name);
     id3_text_tag_node* iter_node = *head;
     id3_text_tag_node* iter_node_prev = NULL;
 
@@ -184,7 +271,7 @@ unsigned int id3_text_tag_node_delete(id3_text_tag_node** head, char* tag_name)
         return NODE_INVALID_HEAD;
 
     do {
-        if (!strcmp(iter_node->tag_name, tag_name)) {
+        if (iter_node->frame_id == frame_id) {
             // node is not head, either joins the previous node to the next node or sets the previous node's next to NULL
             if (iter_node_prev != NULL)
                 iter_node_prev->next = iter_node->next;
@@ -227,12 +314,65 @@ void id3_text_tag_list_destroy(id3_text_tag_node** head) {
     *head = NULL;
 }
 
+/*
+ * Encodes the payload of every dirty node in a text tag linked list, the payload of other nodes is left as it is.
+ * - Called by id3_write_tag() and id3_master_tag_size(), call it directly only to find out about malformed values early.
+ * - A node that fails to encode stays dirty and keeps its value, encoding stops at that node.
+ * - stats, if not NULL, counts the frames encoded (see id3_stats.h).
+ *
+ * Usage:
+ * id3_text_tag_node* text_tag_list = NULL;
+ * id3_text_tag_node_add_update(&text_tag_list, "TALB", "Selection 3");
+ * id3_text_tag_list_encode(&text_tag_list, NULL);
+ *
+ * Returns (success): TAG_ENCODE_SUCCESS
+ * Returns (failure): NODE_MEMORY_ERROR, UTF8_PARSE_MALFORMED
+ */
+unsigned int id3_text_tag_list_encode(id3_text_tag_node** head, id3_stats* stats) {
+    for (id3_text_tag_node* iter_node = *head; iter_node != NULL; iter_node = iter_node->next) {
+        int is_encoded = iter_node->is_dirty;
+
+        unsigned int encode_outcome = _text_node_encode(iter_node);
+        if (encode_outcome != UTF8_PARSE_SUCCESS)
+            return encode_outcome;
+
+        if (is_encoded && stats != NULL) {
+            ID3_STATS_ADD(stats, text_frames_encoded, 1);
+            ID3_STATS_ADD(stats, utf16_frames_encoded, iter_node->payload[0] == _ENCODING_UTF_16);
+        }
+    }
+
+    return TAG_ENCODE_SUCCESS;
+}
+
+/*
+ * Compresses the payload of every node in an encoded text tag linked list that is at least threshold_bytes long, if that makes it smaller.
+ * (https://id3.org/id3v2.3.0#Frame_header_flags) The node then gets written with the compression flag set, see compressed_payload in id3_process.h.
+ * - Called by id3_master_tag_size() with id3_master_tag_struct.compression_threshold_bytes, after encoding the list.
+ * - Compressed payloads are kept until the node is encoded again, a threshold of 0 or a node shorter than threshold_bytes drops them.
+ * - Without ID3_WITH_ZLIB, nothing is ever compressed.
+ *
+ * Returns (success): TAG_ENCODE_SUCCESS
+ * Returns (failure): NODE_MEMORY_ERROR
+ */
+unsigned int id3_text_tag_list_compress(id3_text_tag_node** head, unsigned int threshold_bytes) {
+    for (id3_text_tag_node* iter_node = *head; iter_node != NULL; iter_node = iter_node->next) {
+        unsigned int compress_outcome = _payload_compress(iter_node->arena, iter_node->payload, iter_node->num_id3_bytes, threshold_bytes,
+                                                          &iter_node->compressed_payload, &iter_node->compressed_bytes);
+        if (compress_outcome != TAG_ENCODE_SUCCESS)
+            return compress_outcome;
+    }
+
+    return TAG_ENCODE_SUCCESS;
+}
+
 /*
  * Adds a new node to the end of a comment tag linked list if a node with a matching language and short_content_description doesn't already exist in it.
- * If a matching tag is found, it replaces that node's comment value with the provided comment value and refreshes the utf8 and utf16 metadata fields.
+ * If a matching tag is found, it replaces that node's comment value with the provided comment value.
  * - This function requires the language value to be exactly 3 characters and the comment value to be a non-zero length string.
  * - short_content_description can be an empty string.
  * - [Mp3tag] If the resulting header is to be read by Mp3tag, short_content_description must be an empty string or the tag will be deemed corrupt.
+ * - Both strings are only checked and encoded when the tag is written, see id3_comment_tag_list_encode().
  * - If the operation fails, the provided linked list remains unchanged.
  * - See id3_write.c's _write_comment_tag() for more information on the format of the tag.
  *
@@ -241,9 +381,30 @@ void id3_text_tag_list_destroy(id3_text_tag_node** head) {
  * id3_comment_tag_node_add_update(&comment_tag_list, "eng", "", "Tag, you're it!"); // repeat as many times as needed
  *
  * Returns (success): NODE_ADD_SUCCESS, NODE_UPDATE_SUCCESS
- * Returns (failure): NODE_FILE_ERROR, NODE_INVALID_TAG_VALUE, NODE_MEMORY_ERROR, UTF8_PARSE_MALFORMED, UTF16_PARSE_NO_MEM, UTF16_PARSE_UTF8_MALFORMED
+ * Returns (failure): NODE_INVALID_TAG_VALUE, NODE_MEMORY_ERROR
  */
 unsigned int id3_comment_tag_node_add_update(id3_comment_tag_node** head, char* language, char* short_content_description, char* comment) {
+    return id3_comment_tag_node_add_update_in_arena(head, NULL, language, short_content_description, comment);
+}
+
+/*
+ * Same as id3_comment_tag_node_add_update(), but a newly created node takes all of its memory from arena.
+ * - See id3_text_tag_node_add_update_in_arena() for details.
+ *
+ * Returns: see id3_comment_tag_node_add_update()
+ */
+unsigned int id3_comment_tag_node_add_update_in_arena(id3_comment_tag_node** head, id3_arena* arena, char* language, char* short_content_description, char* comment) {
+    unsigned int add_update_outcome;
+    ID3_TRACE_SPAN("comment_add_update", add_update_outcome = _comment_tag_node_add_update(head, arena, language, short_content_description, comment));
+
+    return add_update_outcome;
+}
+
+/*
+ * [INTERNAL FUNCTION]
+ * Does the work of id3_comment_tag_node_add_update_in_arena().
+ */
+unsigned int _comment_tag_node_add_update(id3_comment_tag_node** head, id3_arena* arena, char* language, char* short_content_description, char* comment) {
     if (strlen(language) != _COMMENT_LANGUAGE_LENGTH || strlen(comment) == 0)
         return NODE_INVALID_TAG_VALUE;
 
@@ -256,34 +417,11 @@ unsigned int id3_comment_tag_node_add_update(id3_comment_tag_node** head, char*
 
         while (1) {
             if (!strcmp(iter_node->language, language) && !strcmp(iter_node->short_content_description, short_content_description)) {
-                // checkpointing previous values
-                char* old_comment = iter_node->comment;
-
-                iter_node->comment = (char*)malloc(strlen(comment) + 1);
-
-                // malloc check
-                if (iter_node->comment == NULL) {
-                    free(iter_node->comment);
-
-                    iter_node->comment = old_comment;
-
+                // storing the new value either succeeds or leaves the node as it was
+                if (_payload_set_pending(iter_node->arena, iter_node->payload_inline, &iter_node->payload, comment) != UTF8_PARSE_SUCCESS)
                     return NODE_MEMORY_ERROR;
-                }
-
-                strncpy(iter_node->comment, comment, strlen(comment) + 1);
-
-                // in event of parse failure, revert to old values
-                unsigned int metadata_parse_outcome = _node_generate_metadata(_NODE_TYPE_COMMENT, (void**)&iter_node);
-                if (metadata_parse_outcome != UTF8_PARSE_SUCCESS) {
-                    free(iter_node->comment);
-
-                    iter_node->comment = old_comment;
 
-                    return NODE_INVALID_TAG_VALUE;
-                }
-
-                // cleanup old values once new assignments complete
-                free(old_comment);
+                iter_node->is_dirty = 1;
 
                 return NODE_UPDATE_SUCCESS;
             }
@@ -298,40 +436,32 @@ unsigned int id3_comment_tag_node_add_update(id3_comment_tag_node** head, char*
     }
 
     // create a new node
-    id3_comment_tag_node* new_node = (id3_comment_tag_node*)malloc(sizeof(id3_comment_tag_node));
+    id3_comment_tag_node* new_node = (id3_comment_tag_node*)_node_alloc(arena, sizeof(id3_comment_tag_node));
 
     // malloc check -> struct
     if (new_node == NULL)
         return NODE_MEMORY_ERROR;
 
-    *new_node = (id3_comment_tag_node){.next = NULL, .num_id3_bytes = 0, .is_utf8 = 0, .short_content_description_utf16 = NULL, .comment_utf16 = NULL};
+    *new_node = (id3_comment_tag_node){.next = NULL, .payload = NULL, .num_id3_bytes = 0, .compressed_payload = NULL, .compressed_bytes = 0, .is_utf8 = 0, .is_dirty = 1, .arena = arena};
 
-    new_node->short_content_description = (char*)malloc(strlen(short_content_description) + 1);
-    new_node->comment = (char*)malloc(strlen(comment) + 1);
+    new_node->short_content_description = _node_string_store(arena, new_node->short_content_description_inline, short_content_description);
 
     // malloc check -> struct members
-    if (new_node->short_content_description == NULL || new_node->comment == NULL) {
-        free(new_node->short_content_description);
-        free(new_node->comment);
-        free(new_node);
+    if (new_node->short_content_description == NULL) {
+        _node_free(arena, new_node);
 
         return NODE_MEMORY_ERROR;
     }
 
-    strncpy(new_node->language, language, _COMMENT_LANGUAGE_LENGTH + 1);
-    strncpy(new_node->short_content_description, short_content_description, strlen(short_content_description) + 1);
-    strncpy(new_node->comment, comment, strlen(comment) + 1);
-
-    // in event of parse failure, revert to old values
-    unsigned int metadata_parse_outcome = _node_generate_metadata(_NODE_TYPE_COMMENT, (void**)&new_node);
-    if (metadata_parse_outcome != UTF8_PARSE_SUCCESS) {
-        free(new_node->short_content_description);
-        free(new_node->comment);
-        free(new_node);
+    if (_payload_set_pending(arena, new_node->payload_inline, &new_node->payload, comment) != UTF8_PARSE_SUCCESS) {
+        _node_string_free(arena, new_node->short_content_description_inline, new_node->short_content_description);
+        _node_free(arena, new_node);
 
-        return metadata_parse_outcome;
+        return NODE_MEMORY_ERROR;
     }
 
+    strncpy(new_node->language, language, _COMMENT_LANGUAGE_LENGTH + 1);
+
     if (*head == NULL)
         *head = new_node;
     else
@@ -340,6 +470,25 @@ unsigned int id3_comment_tag_node_add_update(id3_comment_tag_node** head, char*
     return NODE_ADD_SUCCESS;
 }
 
+/*
+ * Recovers the UTF-8 comment of a comment tag node from its encoded payload, or returns the pending comment if the node is dirty.
+ * Same output semantics as id3_text_tag_node_get_value().
+ *
+ * Returns: length in bytes of the UTF-8 comment, not including the null terminator
+ */
+unsigned int id3_comment_tag_node_get_comment(id3_comment_tag_node* node, char* comment, unsigned int comment_bytes) {
+    if (node->is_dirty)
+        return _pending_value_copy((const char*)node->payload, comment, comment_bytes);
+
+    unsigned int description_bytes = 0;
+    const uint8_t* description_start = node->payload + _ENCODING_BYTE_LENGTH + _COMMENT_LANGUAGE_LENGTH;
+
+    // skip over the encoded short content description
+    _payload_string_decode(description_start, node->is_utf8, NULL, 0, &description_bytes);
+
+    return _payload_string_decode(description_start + description_bytes, node->is_utf8, comment, comment_bytes, NULL);
+}
+
 /*
  * Deletes a specified node of a comment tag linked list.
  * - If a node with a matching language and short_content_description is not found, the linked list remains unchanged.
@@ -405,210 +554,640 @@ void id3_comment_tag_list_destroy(id3_comment_tag_node** head) {
 }
 
 /*
- * Modifies an existing node or adds a new node to the end of a picture tag linked list.
- * - If picture type is specified to be APIC_TYPE_FILE_ICON (0x01) or APIC_TYPE_OTHER_FILE_ICON (0x02), the function will attempt
- *   to locate a node with a matching picture type and replace its mime_type, description and (picture_file_path or binary_data) with the provided values.
- * - For any other picture type, the function will attempt to locate a node with a matching description and replace its
- *   mime_type, picture_type, and (picture_file_path or binary_data) with the provided values.
- * - This implements the specification that there may only be one picture with the picture type declared as picture type $01 and $02 respectively.
- * - Provide EITHER picture_file_path OR (picture_binary_data AND picture_binary_data_bytes), not both.
- * - mime_type and picture_type are mandatory. picture_type must be between 0x00 and 0x14 inclusive (can use APIC_TYPE constants).
- * - description can be an empty string.
- * - If the operation fails, the provided linked list remains unchanged.
- * - See id3_write.c's _write_picture_tag() for more information on the format of the tag.
- *
- * Usage:
- * id3_picture_tag_node *picture_tag_list = NULL;
- * id3_picture_tag_node_add_update(&picture_tag_list, "image/jpeg", APIC_TYPE_COVER_FRONT, "FRONT", "./folder.jpg", NULL, 0);
- * id3_picture_tag_node_add_update(&picture_tag_list, "image/jpeg", APIC_TYPE_COVER_BACK, "", NULL, buffer, buffer_size); // repeat as many times as needed
+ * Encodes the payload of every dirty node in a comment tag linked list.
+ * - See id3_text_tag_list_encode() for details.
  *
- * Returns (success): NODE_ADD_SUCCESS, NODE_UPDATE_SUCCESS
- * Returns (failure): NODE_FILE_ERROR, NODE_INVALID_TAG_VALUE, NODE_MEMORY_ERROR, UTF8_PARSE_MALFORMED, UTF16_PARSE_NO_MEM, UTF16_PARSE_UTF8_MALFORMED, NODE_FILE_ERROR
+ * Returns (success): TAG_ENCODE_SUCCESS
+ * Returns (failure): NODE_MEMORY_ERROR, UTF8_PARSE_MALFORMED
  */
-unsigned int id3_picture_tag_node_add_update(id3_picture_tag_node** head, char* mime_type, uint8_t picture_type, char* description,
-                                             char* picture_file_path, uint8_t* picture_binary_data, unsigned int picture_binary_data_bytes) {
-    enum enum_update_operation {
-        UPDATE_NONE,
-        UPDATE_TYPE_FILE_ICON,
-        UPDATE_TYPE_STANDARD
-    };
+unsigned int id3_comment_tag_list_encode(id3_comment_tag_node** head, id3_stats* stats) {
+    for (id3_comment_tag_node* iter_node = *head; iter_node != NULL; iter_node = iter_node->next) {
+        int is_encoded = iter_node->is_dirty;
 
-    if (strlen(mime_type) == 0 || picture_type > APIC_TYPE_PUBLISHER_STUDIO_LOGOTYPE)
-        return NODE_INVALID_TAG_VALUE;
-
-    if (picture_file_path != NULL && picture_binary_data != NULL)
-        return NODE_INVALID_TAG_VALUE;
+        unsigned int encode_outcome = _comment_node_encode(iter_node);
+        if (encode_outcome != UTF8_PARSE_SUCCESS)
+            return encode_outcome;
 
-    // below, we iterate to find node that matches update criteria, update values as appropriate if found
-    // if no matching node found, add a new node after the last node
-    id3_picture_tag_node* last_node = NULL;
+        if (is_encoded && stats != NULL) {
+            ID3_STATS_ADD(stats, comment_frames_encoded, 1);
+            ID3_STATS_ADD(stats, utf16_frames_encoded, iter_node->payload[0] == _ENCODING_UTF_16);
+        }
+    }
 
-    if (*head != NULL) {
-        enum enum_update_operation update_operation = UPDATE_NONE;
-        id3_picture_tag_node* iter_node = *head;
+    return TAG_ENCODE_SUCCESS;
+}
 
-        while (1) {
-            if ((picture_type == APIC_TYPE_FILE_ICON || picture_type == APIC_TYPE_OTHER_FILE_ICON) && iter_node->picture_type == picture_type) {
-                // there may only be one picture with the picture type declared as picture type $01 and $02 respectively.
-                // we update mime_type, description, and picture path or picture binary data.
-                update_operation = UPDATE_TYPE_FILE_ICON;
-            } else if (iter_node->picture_type == picture_type && !strcmp(iter_node->description, description)) {
-                // there may be several pictures attached to one file, each in their individual "APIC" frame, but only one with the same content descriptor.
-                //  we update mime_type, and picture path or picture binary data.
-                update_operation = UPDATE_TYPE_STANDARD;
-            }
+/*
+ * Compresses the payload of every node in an encoded comment tag linked list that is at least threshold_bytes long, if that makes it smaller.
+ * - See id3_text_tag_list_compress() for details.
+ *
+ * Returns (success): TAG_ENCODE_SUCCESS
+ * Returns (failure): NODE_MEMORY_ERROR
+ */
+unsigned int id3_comment_tag_list_compress(id3_comment_tag_node** head, unsigned int threshold_bytes) {
+    for (id3_comment_tag_node* iter_node = *head; iter_node != NULL; iter_node = iter_node->next) {
+        unsigned int compress_outcome = _payload_compress(iter_node->arena, iter_node->payload, iter_node->num_id3_bytes, threshold_bytes,
+                                                          &iter_node->compressed_payload, &iter_node->compressed_bytes);
+        if (compress_outcome != TAG_ENCODE_SUCCESS)
+            return compress_outcome;
+    }
 
-            if (update_operation != UPDATE_NONE) {
-                // checkpointing previous values
-                char* old_mime_type = iter_node->mime_type;
-                char* old_description = update_operation == UPDATE_TYPE_FILE_ICON ? iter_node->description : NULL;
-                char* old_picture_file_path = iter_node->picture_file_path;
+    return TAG_ENCODE_SUCCESS;
+}
 
-                iter_node->mime_type = (char*)malloc(strlen(mime_type) + 1);
-                if (update_operation == UPDATE_TYPE_FILE_ICON) iter_node->description = (char*)malloc(strlen(description) + 1);
-                if (picture_file_path != NULL) iter_node->picture_file_path = (char*)malloc(strlen(picture_file_path) + 1);
+/*
+ * User defined text information frames (TXXX) and user defined URL link frames (WXXX) hold a value under a description of the user's choosing,
+ * e.g. MusicBrainz IDs, ReplayGain values or links to a release page.
+ * There may be several of each in a tag, but no two of the same kind with the same description. (https://id3.org/id3v2.3.0#User_defined_text_information_frame)
+ */
 
-                // malloc check
-                if (iter_node->mime_type == NULL || iter_node->description == NULL || (picture_file_path != NULL && iter_node->picture_file_path == NULL)) {
-                    free(iter_node->mime_type);
-                    free(iter_node->description);
-                    free(iter_node->picture_file_path);
+/*
+ * Adds a new node to the end of a user frame list if a node with a matching frame_id and description doesn't already exist in it.
+ * If a matching node is found, it replaces that node's value with the provided value, a list therefore never holds two frames with the same key.
+ * - frame_id must be ID3_FRAME_TXXX or ID3_FRAME_WXXX.
+ * - This function requires value to be a non-zero length string. description can be an empty string.
+ * - The value of a WXXX frame is a URL, it is always written as ISO-8859-1 whatever the encoding of its description.
+ * - Both strings are only checked and encoded when the tag is written, see id3_user_tag_list_encode().
+ * - The matching node is found through the list's index, in constant time however many nodes the list holds.
+ * - If the operation fails, the provided list remains unchanged.
+ * - See id3_write.c's _write_user_tag() for more information on the format of the tag.
+ *
+ * Usage:
+ * id3_user_tag_list user_tag_list;
+ * id3_user_tag_list_init(&user_tag_list);
+ * id3_user_tag_node_add_update(&user_tag_list, ID3_FRAME_TXXX, "REPLAYGAIN_TRACK_GAIN", "-6.48 dB"); // repeat as many times as needed
+ *
+ * Returns (success): NODE_ADD_SUCCESS, NODE_UPDATE_SUCCESS
+ * Returns (failure): NODE_INVALID_TAG_NAME, NODE_INVALID_TAG_VALUE, NODE_MEMORY_ERROR
+ */
+unsigned int id3_user_tag_node_add_update(id3_user_tag_list* list, uint32_t frame_id, char* description, char* value) {
+    return id3_user_tag_node_add_update_in_arena(list, NULL, frame_id, description, value);
+}
 
-                    iter_node->mime_type = old_mime_type;
-                    if (update_operation == UPDATE_TYPE_FILE_ICON) iter_node->description = old_description;
-                    iter_node->picture_file_path = old_picture_file_path;
+/*
+ * Same as id3_user_tag_node_add_update(), but a newly created node takes all of its memory from arena.
+ * - See id3_text_tag_node_add_update_in_arena() for details. The list's index never lives in the arena.
+ *
+ * Returns: see id3_user_tag_node_add_update()
+ */
+unsigned int id3_user_tag_node_add_update_in_arena(id3_user_tag_list* list, id3_arena* arena, uint32_t frame_id, char* description, char* value) {
+    unsigned int add_update_outcome;
+    ID3_TRACE_SPAN("user_add_update", add_update_outcome = _user_tag_node_add_update(list, arena, frame_id, description, value));
 
-                    return NODE_MEMORY_ERROR;
-                }
+    return add_update_outcome;
+}
 
-                strncpy(iter_node->mime_type, mime_type, strlen(mime_type) + 1);
-                if (update_operation == UPDATE_TYPE_FILE_ICON) strncpy(iter_node->description, description, strlen(description) + 1);
-                if (picture_file_path != NULL) {
-                    strncpy(iter_node->picture_file_path, picture_file_path, strlen(picture_file_path) + 1);
-                    iter_node->is_picture_stored_as_file = 1;
-                }
-                if (picture_binary_data != NULL) {
-                    iter_node->picture_binary_data = picture_binary_data;
-                    iter_node->is_picture_stored_as_file = 0;
-                }
+/*
+ * [INTERNAL FUNCTION]
+ * Does the work of id3_user_tag_node_add_update_in_arena().
+ */
+unsigned int _user_tag_node_add_update(id3_user_tag_list* list, id3_arena* arena, uint32_t frame_id, char* description, char* value) {
+    if (frame_id != ID3_FRAME_TXXX && frame_id != ID3_FRAME_WXXX)
+        return NODE_INVALID_TAG_NAME;
 
-                // in event of parse failure, revert to old values
-                unsigned int metadata_parse_outcome = _node_generate_metadata(_NODE_TYPE_APIC, (void**)&iter_node);
-                if (metadata_parse_outcome != UTF8_PARSE_SUCCESS) {
-                    free(iter_node->mime_type);
-                    free(iter_node->description);
-                    free(iter_node->picture_file_path);
+    if (strlen(value) == 0)
+        return NODE_INVALID_TAG_VALUE;
 
-                    iter_node->mime_type = old_mime_type;
-                    if (update_operation == UPDATE_TYPE_FILE_ICON) iter_node->description = old_description;
-                    iter_node->picture_file_path = old_picture_file_path;
+    uint32_t description_hash = _user_tag_hash(frame_id, description);
 
-                    return metadata_parse_outcome;
-                }
+    id3_user_tag_node** found_link = _user_tag_list_find_link(list, frame_id, description, description_hash);
+    if (found_link != NULL) {
+        id3_user_tag_node* found_node = *found_link;
 
-                // cleanup old values once new assignments complete
-                free(old_mime_type);
-                free(old_description);
-                free(old_picture_file_path);
+        // storing the new value either succeeds or leaves the node as it was
+        if (_payload_set_pending(found_node->arena, found_node->payload_inline, &found_node->payload, value) != UTF8_PARSE_SUCCESS)
+            return NODE_MEMORY_ERROR;
 
-                return NODE_UPDATE_SUCCESS;
-            }
+        found_node->is_dirty = 1;
 
-            if (iter_node->next != NULL) {
-                iter_node = iter_node->next;
-            } else {
-                last_node = iter_node;
-                break;
-            }
-        }
+        return NODE_UPDATE_SUCCESS;
     }
 
+    // grow the index first, so that nothing has to be undone once the node exists
+    if (!_user_tag_list_reserve(list, list->num_nodes + 1))
+        return NODE_MEMORY_ERROR;
+
     // create a new node
-    id3_picture_tag_node* new_node = (id3_picture_tag_node*)malloc(sizeof(id3_picture_tag_node));
+    id3_user_tag_node* new_node = (id3_user_tag_node*)_node_alloc(arena, sizeof(id3_user_tag_node));
 
     // malloc check -> struct
     if (new_node == NULL)
         return NODE_MEMORY_ERROR;
 
-    *new_node = (id3_picture_tag_node){.next = NULL, .mime_type = NULL, .picture_type = 0x00, .description = NULL, .num_id3_bytes = 0, .is_utf8 = 0, .description_utf16 = NULL, .is_picture_stored_as_file = 0, .picture_file_path = NULL, .picture_binary_data = NULL, .picture_binary_data_bytes = 0};
+    *new_node = (id3_user_tag_node){.frame_id = frame_id, .description_hash = description_hash, .payload = NULL, .num_id3_bytes = 0, .compressed_payload = NULL,
+                                    .compressed_bytes = 0, .is_utf8 = 0, .is_dirty = 1, .arena = arena, .prev = NULL, .next = NULL, .next_in_bucket = NULL};
 
-    new_node->mime_type = (char*)malloc(strlen(mime_type) + 1);
-    new_node->description = (char*)malloc(strlen(description) + 1);
-    if (picture_file_path != NULL) new_node->picture_file_path = (char*)malloc(strlen(picture_file_path) + 1);
+    new_node->description = _node_string_store(arena, new_node->description_inline, description);
 
     // malloc check -> struct members
-    if (new_node->mime_type == NULL || new_node->description == NULL || (picture_file_path != NULL && new_node->picture_file_path == NULL)) {
-        free(new_node->mime_type);
-        free(new_node->description);
-        free(new_node->picture_file_path);
-        free(new_node);
+    if (new_node->description == NULL) {
+        _node_free(arena, new_node);
 
         return NODE_MEMORY_ERROR;
     }
 
-    new_node->picture_type = picture_type;
-    strncpy(new_node->mime_type, mime_type, strlen(mime_type) + 1);
-    strncpy(new_node->description, description, strlen(description) + 1);
-    if (picture_file_path != NULL) {
-        strncpy(new_node->picture_file_path, picture_file_path, strlen(picture_file_path) + 1);
-        new_node->is_picture_stored_as_file = 1;
-    } else {
-        new_node->picture_binary_data = picture_binary_data;
-        new_node->picture_binary_data_bytes = picture_binary_data_bytes;
-        new_node->is_picture_stored_as_file = 0;
-    }
-
-    // in event of parse failure, revert to old values
-    unsigned int metadata_parse_outcome = _node_generate_metadata(_NODE_TYPE_APIC, (void**)&new_node);
-    if (metadata_parse_outcome != UTF8_PARSE_SUCCESS) {
-        free(new_node->mime_type);
-        free(new_node->description);
-        free(new_node->picture_file_path);
-        free(new_node);
+    if (_payload_set_pending(arena, new_node->payload_inline, &new_node->payload, value) != UTF8_PARSE_SUCCESS) {
+        _node_string_free(arena, new_node->description_inline, new_node->description);
+        _node_free(arena, new_node);
 
-        return NODE_INVALID_TAG_VALUE;
+        return NODE_MEMORY_ERROR;
     }
 
-    if (*head == NULL)
-        *head = new_node;
+    // append to the list and file it in the index
+    new_node->prev = list->tail;
+    if (list->tail == NULL)
+        list->head = new_node;
     else
-        last_node->next = new_node;
+        list->tail->next = new_node;
+    list->tail = new_node;
+
+    id3_user_tag_node** bucket = &list->buckets[description_hash & (list->num_buckets - 1)];
+    new_node->next_in_bucket = *bucket;
+    *bucket = new_node;
+    list->num_nodes++;
 
     return NODE_ADD_SUCCESS;
 }
 
 /*
- * Deletes a specified node of a picture tag linked list.
- * - If a node with a matching picture_type and description is not found, the linked list remains unchanged.
+ * Looks up the node of a user frame list with a matching frame_id and description, in constant time.
  *
  * Usage:
- * id3_picture_tag_node* picture_tag_list = NULL;
- * id3_picture_tag_node_add_update(&picture_tag_list, "image/jpeg", APIC_TYPE_COVER_FRONT, "FRONT", "./folder.jpg", NULL, 0);
- * id3_picture_tag_node_delete(&picture_tag_list, APIC_TYPE_COVER_FRONT, "FRONT");
+ * char gain[16];
+ * id3_user_tag_node* node = id3_user_tag_node_find(&user_tag_list, ID3_FRAME_TXXX, "REPLAYGAIN_TRACK_GAIN");
+ * if (node != NULL)
+ *     id3_user_tag_node_get_value(node, gain, sizeof(gain));
  *
- * Returns (success): NODE_DELETE_SUCCESS
- * Returns (failure): NODE_NOT_FOUND, NODE_INVALID_HEAD
+ * Returns (success): the matching node
+ * Returns (failure): NULL if there is none
  */
-unsigned int id3_picture_tag_node_delete(id3_picture_tag_node** head, uint8_t picture_type, char* description) {
-    id3_picture_tag_node* iter_node = *head;
-    id3_picture_tag_node* iter_node_prev = NULL;
+id3_user_tag_node* id3_user_tag_node_find(const id3_user_tag_list* list, uint32_t frame_id, const char* description) {
+    id3_user_tag_node** found_link = _user_tag_list_find_link(list, frame_id, description, _user_tag_hash(frame_id, description));
 
-    // Empty linked list given
-    if (iter_node == NULL)
-        return NODE_INVALID_HEAD;
+    return found_link != NULL ? *found_link : NULL;
+}
 
-    do {
-        if (iter_node->picture_type == picture_type && !strcmp(iter_node->description, description)) {
-            // node is not head, either joins the previous node to the next node or sets the previous node's next to NULL
-            if (iter_node_prev != NULL)
-                iter_node_prev->next = iter_node->next;
-            // node is head, make the next node the new head
-            else
-                *head = iter_node->next;
+/*
+ * Recovers the UTF-8 value of a user frame node from its encoded payload, or returns the pending value if the node is dirty.
+ * Same output semantics as id3_text_tag_node_get_value().
+ *
+ * Returns: length in bytes of the UTF-8 value, not including the null terminator
+ */
+unsigned int id3_user_tag_node_get_value(id3_user_tag_node* node, char* value, unsigned int value_bytes) {
+    if (node->is_dirty)
+        return _pending_value_copy((const char*)node->payload, value, value_bytes);
 
-            _free_picture_tag_node(iter_node);
+    unsigned int description_bytes = 0;
+    const uint8_t* description_start = node->payload + _ENCODING_BYTE_LENGTH;
 
-            return NODE_DELETE_SUCCESS;
+    // skip over the encoded description
+    _payload_string_decode(description_start, node->is_utf8, NULL, 0, &description_bytes);
+
+    // URLs are always ISO-8859-1
+    int is_value_utf8 = node->frame_id == ID3_FRAME_WXXX ? 0 : node->is_utf8;
+
+    return _payload_string_decode(description_start + description_bytes, is_value_utf8, value, value_bytes, NULL);
+}
+
+/*
+ * Deletes the node of a user frame list with a matching frame_id and description, in constant time.
+ * - If a matching node is not found, the list remains unchanged.
+ *
+ * Usage:
+ * id3_user_tag_node_delete(&user_tag_list, ID3_FRAME_TXXX, "REPLAYGAIN_TRACK_GAIN");
+ *
+ * Returns (success): NODE_DELETE_SUCCESS
+ * Returns (failure): NODE_NOT_FOUND, NODE_INVALID_HEAD
+ */
+unsigned int id3_user_tag_node_delete(id3_user_tag_list* list, uint32_t frame_id, const char* description) {
+    // Empty list given
+    if (list->head == NULL)
+        return NODE_INVALID_HEAD;
+
+    id3_user_tag_node** found_link = _user_tag_list_find_link(list, frame_id, description, _user_tag_hash(frame_id, description));
+    if (found_link == NULL)
+        return NODE_NOT_FOUND;
+
+    id3_user_tag_node* found_node = *found_link;
+
+    // take the node out of its bucket, then out of the list
+    *found_link = found_node->next_in_bucket;
+
+    if (found_node->prev != NULL)
+        found_node->prev->next = found_node->next;
+    else
+        list->head = found_node->next;
+
+    if (found_node->next != NULL)
+        found_node->next->prev = found_node->prev;
+    else
+        list->tail = found_node->prev;
+
+    list->num_nodes--;
+
+    _free_user_tag_node(found_node);
+
+    return NODE_DELETE_SUCCESS;
+}
+
+/*
+ * Initialises an empty user frame list. Its index is only allocated once the first node is added.
+ *
+ * Usage:
+ * id3_user_tag_list user_tag_list;
+ * id3_user_tag_list_init(&user_tag_list);
+ */
+void id3_user_tag_list_init(id3_user_tag_list* list) {
+    *list = (id3_user_tag_list){.head = NULL, .tail = NULL, .buckets = NULL, .num_buckets = 0, .num_nodes = 0};
+}
+
+/*
+ * Empties a user frame list without freeing its nodes, which must all live in an arena that is about to be reset (see id3_destroy_master_tag()).
+ * - The index is kept for the next tag, free it with id3_user_tag_list_destroy() once the list is no longer needed.
+ */
+void id3_user_tag_list_reset(id3_user_tag_list* list) {
+    if (list->buckets != NULL)
+        memset(list->buckets, 0, list->num_buckets * sizeof(id3_user_tag_node*));
+
+    list->head = NULL;
+    list->tail = NULL;
+    list->num_nodes = 0;
+}
+
+/*
+ * Frees every node of a user frame list and its index, leaving it empty. The list can be used again afterwards, as if freshly initialised.
+ *
+ * Usage:
+ * id3_user_tag_node_add_update(&user_tag_list, ID3_FRAME_WXXX, "Release", "https://example.com/release/1");
+ * id3_user_tag_list_destroy(&user_tag_list);
+ */
+void id3_user_tag_list_destroy(id3_user_tag_list* list) {
+    id3_user_tag_node* iter_node = list->head;
+    id3_user_tag_node* free_node = NULL;
+
+    while (iter_node != NULL) {
+        free_node = iter_node;
+        iter_node = iter_node->next;
+
+        _free_user_tag_node(free_node);
+    }
+
+    ID3_FREE(list->buckets);
+
+    id3_user_tag_list_init(list);
+}
+
+/*
+ * Encodes the payload of every dirty node in a user frame list.
+ * - See id3_text_tag_list_encode() for details.
+ *
+ * Returns (success): TAG_ENCODE_SUCCESS
+ * Returns (failure): NODE_MEMORY_ERROR, UTF8_PARSE_MALFORMED (also for a WXXX URL that cannot be written as ISO-8859-1)
+ */
+unsigned int id3_user_tag_list_encode(id3_user_tag_list* list, id3_stats* stats) {
+    for (id3_user_tag_node* iter_node = list->head; iter_node != NULL; iter_node = iter_node->next) {
+        int is_encoded = iter_node->is_dirty;
+
+        unsigned int encode_outcome = _user_node_encode(iter_node);
+        if (encode_outcome != UTF8_PARSE_SUCCESS)
+            return encode_outcome;
+
+        if (is_encoded && stats != NULL) {
+            ID3_STATS_ADD(stats, user_frames_encoded, 1);
+            ID3_STATS_ADD(stats, utf16_frames_encoded, iter_node->payload[0] == _ENCODING_UTF_16);
+        }
+    }
+
+    return TAG_ENCODE_SUCCESS;
+}
+
+/*
+ * Compresses the payload of every node in an encoded user frame list that is at least threshold_bytes long, if that makes it smaller.
+ * - See id3_text_tag_list_compress() for details.
+ *
+ * Returns (success): TAG_ENCODE_SUCCESS
+ * Returns (failure): NODE_MEMORY_ERROR
+ */
+unsigned int id3_user_tag_list_compress(id3_user_tag_list* list, unsigned int threshold_bytes) {
+    for (id3_user_tag_node* iter_node = list->head; iter_node != NULL; iter_node = iter_node->next) {
+        unsigned int compress_outcome = _payload_compress(iter_node->arena, iter_node->payload, iter_node->num_id3_bytes, threshold_bytes,
+                                                          &iter_node->compressed_payload, &iter_node->compressed_bytes);
+        if (compress_outcome != TAG_ENCODE_SUCCESS)
+            return compress_outcome;
+    }
+
+    return TAG_ENCODE_SUCCESS;
+}
+
+/*
+ * Modifies an existing node or adds a new node to the end of a picture tag linked list.
+ * - If picture type is specified to be APIC_TYPE_FILE_ICON (0x01) or APIC_TYPE_OTHER_FILE_ICON (0x02), the function will attempt
+ *   to locate a node with a matching picture type and replace its mime_type, description and (picture_file_path or binary_data) with the provided values.
+ * - For any other picture type, the function will attempt to locate a node with a matching description and replace its
+ *   mime_type, picture_type, and (picture_file_path or binary_data) with the provided values.
+ * - This implements the specification that there may only be one picture with the picture type declared as picture type $01 and $02 respectively.
+ * - Provide EITHER picture_file_path OR (picture_binary_data AND picture_binary_data_bytes), not both.
+ * - picture_binary_data must come from ID3_MALLOC() (see id3_alloc.h), the node takes ownership of it and frees it (ID3_PICTURE_DATA_OWNED).
+ *   See id3_picture_tag_node_add_update_borrowed() and id3_picture_tag_node_add_update_shared() for data the node must not free.
+ * - mime_type and picture_type are mandatory. picture_type must be between 0x00 and 0x14 inclusive (can use APIC_TYPE constants).
+ * - description can be an empty string.
+ * - description is only checked and encoded, and picture_file_path only opened, when the tag is written, see id3_picture_tag_list_encode().
+ * - If the operation fails, the provided linked list remains unchanged.
+ * - See id3_write.c's _write_picture_tag() for more information on the format of the tag.
+ *
+ * Usage:
+ * id3_picture_tag_node *picture_tag_list = NULL;
+ * id3_picture_tag_node_add_update(&picture_tag_list, "image/jpeg", APIC_TYPE_COVER_FRONT, "FRONT", "./folder.jpg", NULL, 0);
+ * id3_picture_tag_node_add_update(&picture_tag_list, "image/jpeg", APIC_TYPE_COVER_BACK, "", NULL, buffer, buffer_size); // repeat as many times as needed
+ *
+ * Returns (success): NODE_ADD_SUCCESS, NODE_UPDATE_SUCCESS
+ * Returns (failure): NODE_INVALID_TAG_VALUE, NODE_MEMORY_ERROR
+ */
+unsigned int id3_picture_tag_node_add_update(id3_picture_tag_node** head, char* mime_type, uint8_t picture_type, char* description,
+                                             char* picture_file_path, uint8_t* picture_binary_data, unsigned int picture_binary_data_bytes) {
+    return id3_picture_tag_node_add_update_in_arena(head, NULL, mime_type, picture_type, description, picture_file_path, picture_binary_data, picture_binary_data_bytes);
+}
+
+/*
+ * Same as id3_picture_tag_node_add_update(), but a newly created node takes all of its memory from arena.
+ * - See id3_text_tag_node_add_update_in_arena() for details.
+ * - picture_binary_data is never copied into the arena, it is still freed with ID3_FREE() when the node is freed.
+ *
+ * Returns: see id3_picture_tag_node_add_update()
+ */
+unsigned int id3_picture_tag_node_add_update_in_arena(id3_picture_tag_node** head, id3_arena* arena, char* mime_type, uint8_t picture_type, char* description,
+                                                      char* picture_file_path, uint8_t* picture_binary_data, unsigned int picture_binary_data_bytes) {
+    unsigned int add_update_outcome;
+    ID3_TRACE_SPAN("picture_add_update", add_update_outcome = _picture_tag_node_add_update(head, arena, mime_type, picture_type, description, picture_file_path,
+                                                                                           picture_binary_data, picture_binary_data_bytes, ID3_PICTURE_DATA_OWNED, NULL));
+
+    return add_update_outcome;
+}
+
+/*
+ * Same as id3_picture_tag_node_add_update_in_arena() for pictures held in memory, but the node never frees picture_binary_data (ID3_PICTURE_DATA_BORROWED).
+ * - picture_binary_data must stay valid until the node is freed or its picture replaced, and the tag has been written.
+ * - arena can be NULL.
+ *
+ * Usage:
+ * static uint8_t cover[] = {...};
+ * id3_picture_tag_node_add_update_borrowed(&picture_tag_list, NULL, "image/jpeg", APIC_TYPE_COVER_FRONT, "", cover, sizeof(cover));
+ *
+ * Returns: see id3_picture_tag_node_add_update()
+ */
+unsigned int id3_picture_tag_node_add_update_borrowed(id3_picture_tag_node** head, id3_arena* arena, char* mime_type, uint8_t picture_type, char* description,
+                                                      uint8_t* picture_binary_data, unsigned int picture_binary_data_bytes) {
+    unsigned int add_update_outcome;
+    ID3_TRACE_SPAN("picture_add_update", add_update_outcome = _picture_tag_node_add_update(head, arena, mime_type, picture_type, description, NULL,
+                                                                                           picture_binary_data, picture_binary_data_bytes, ID3_PICTURE_DATA_BORROWED, NULL));
+
+    return add_update_outcome;
+}
+
+/*
+ * Same as id3_picture_tag_node_add_update_in_arena() for a picture shared between many tags (ID3_PICTURE_DATA_SHARED).
+ * - The node takes a reference to shared_picture, which is released when the node is freed or its picture replaced.
+ *   The caller keeps its own reference and releases it as usual once it no longer adds the picture to new tags.
+ * - arena can be NULL.
+ *
+ * Usage:
+ * id3_shared_picture* cover = id3_shared_picture_create(buffer, buffer_size);
+ * for each track:
+ *     id3_picture_tag_node_add_update_shared(&picture_tag_list, NULL, "image/jpeg", APIC_TYPE_COVER_FRONT, "", cover);
+ * id3_shared_picture_release(cover); // buffer is freed once the last tag using it is destroyed
+ *
+ * Returns: see id3_picture_tag_node_add_update()
+ */
+unsigned int id3_picture_tag_node_add_update_shared(id3_picture_tag_node** head, id3_arena* arena, char* mime_type, uint8_t picture_type, char* description,
+                                                    id3_shared_picture* shared_picture) {
+    unsigned int add_update_outcome;
+    ID3_TRACE_SPAN("picture_add_update", add_update_outcome = _picture_tag_node_add_update(head, arena, mime_type, picture_type, description, NULL,
+                                                                                           shared_picture->data, shared_picture->data_bytes, ID3_PICTURE_DATA_SHARED, shared_picture));
+
+    return add_update_outcome;
+}
+
+/*
+ * Wraps picture data in a reference counted id3_shared_picture, holding a single reference for the caller.
+ * - data must come from ID3_MALLOC() (see id3_alloc.h), it is freed together with the id3_shared_picture when the last reference is released.
+ * - References may be taken and released from several threads at once.
+ *
+ * Returns (success): pointer to the id3_shared_picture
+ * Returns (failure): NULL, data is not freed
+ */
+id3_shared_picture* id3_shared_picture_create(uint8_t* data, unsigned int data_bytes) {
+    id3_shared_picture* shared_picture = (id3_shared_picture*)ID3_MALLOC(sizeof(id3_shared_picture));
+
+    // malloc check -> struct
+    if (shared_picture == NULL)
+        return NULL;
+
+    shared_picture->data = data;
+    shared_picture->data_bytes = data_bytes;
+    atomic_init(&shared_picture->reference_count, 1);
+
+    return shared_picture;
+}
+
+// Takes a reference to a shared picture.
+void id3_shared_picture_retain(id3_shared_picture* shared_picture) {
+    atomic_fetch_add_explicit(&shared_picture->reference_count, 1, memory_order_relaxed);
+}
+
+// Releases a reference to a shared picture, freeing it and its data if it was the last one.
+void id3_shared_picture_release(id3_shared_picture* shared_picture) {
+    if (shared_picture == NULL)
+        return;
+
+    if (atomic_fetch_sub_explicit(&shared_picture->reference_count, 1, memory_order_acq_rel) == 1) {
+        ID3_FREE(shared_picture->data);
+        ID3_FREE(shared_picture);
+    }
+}
+
+/*
+ * Releases the picture data of every node of a picture tag linked list according to its ownership, without freeing the nodes.
+ * - Used for lists whose nodes live in an arena, see id3_destroy_master_tag(). Do not use the list afterwards except to reset its arena.
+ */
+void id3_picture_tag_list_release_data(id3_picture_tag_node** head) {
+    for (id3_picture_tag_node* iter_node = *head; iter_node != NULL; iter_node = iter_node->next)
+        _picture_data_release(iter_node->picture_data_ownership, iter_node->picture_binary_data, iter_node->shared_picture);
+}
+
+/*
+ * [INTERNAL FUNCTION]
+ * Does the work of the id3_picture_tag_node_add_update*() functions, picture_data_ownership telling what the node may do with picture_binary_data.
+ * - shared_picture is only used (and retained) with ID3_PICTURE_DATA_SHARED, picture_binary_data must then be its data.
+ *
+ * Returns: see id3_picture_tag_node_add_update()
+ */
+unsigned int _picture_tag_node_add_update(id3_picture_tag_node** head, id3_arena* arena, char* mime_type, uint8_t picture_type, char* description,
+                                          char* picture_file_path, uint8_t* picture_binary_data, unsigned int picture_binary_data_bytes,
+                                          uint8_t picture_data_ownership, id3_shared_picture* shared_picture) {
+    enum enum_update_operation {
+        UPDATE_NONE,
+        UPDATE_TYPE_FILE_ICON,
+        UPDATE_TYPE_STANDARD
+    };
+
+    if (strlen(mime_type) == 0 || picture_type > APIC_TYPE_PUBLISHER_STUDIO_LOGOTYPE)
+        return NODE_INVALID_TAG_VALUE;
+
+    if (picture_file_path != NULL && picture_binary_data != NULL)
+        return NODE_INVALID_TAG_VALUE;
+
+    // below, we iterate to find node that matches update criteria, update values as appropriate if found
+    // if no matching node found, add a new node after the last node
+    id3_picture_tag_node* last_node = NULL;
+
+    if (*head != NULL) {
+        enum enum_update_operation update_operation = UPDATE_NONE;
+        id3_picture_tag_node* iter_node = *head;
+
+        while (1) {
+            if ((picture_type == APIC_TYPE_FILE_ICON || picture_type == APIC_TYPE_OTHER_FILE_ICON) && iter_node->picture_type == picture_type) {
+                // there may only be one picture with the picture type declared as picture type $01 and $02 respectively.
+                // we update mime_type, description, and picture path or picture binary data.
+                update_operation = UPDATE_TYPE_FILE_ICON;
+            } else if (iter_node->picture_type == picture_type && !strcmp(iter_node->description, description)) {
+                // there may be several pictures attached to one file, each in their individual "APIC" frame, but only one with the same content descriptor.
+                //  we update mime_type, and picture path or picture binary data.
+                update_operation = UPDATE_TYPE_STANDARD;
+            }
+
+            if (update_operation != UPDATE_NONE) {
+                id3_arena* node_arena = iter_node->arena;
+
+                // checkpointing previous values
+                char* old_mime_type = iter_node->mime_type;
+                char* old_description = iter_node->description;
+                char* old_picture_file_path = iter_node->picture_file_path;
+                uint8_t* old_picture_binary_data = iter_node->picture_binary_data;
+                uint8_t old_picture_data_ownership = iter_node->picture_data_ownership;
+                id3_shared_picture* old_shared_picture = iter_node->shared_picture;
+
+                char* new_mime_type = _node_strdup(node_arena, mime_type);
+                char* new_description = update_operation == UPDATE_TYPE_FILE_ICON ? _node_strdup(node_arena, description) : old_description;
+                char* new_picture_file_path = picture_file_path != NULL ? _node_strdup(node_arena, picture_file_path) : NULL;
+
+                // malloc check
+                if (new_mime_type == NULL || new_description == NULL || (picture_file_path != NULL && new_picture_file_path == NULL)) {
+                    _node_free(node_arena, new_mime_type);
+                    if (update_operation == UPDATE_TYPE_FILE_ICON) _node_free(node_arena, new_description);
+                    _node_free(node_arena, new_picture_file_path);
+
+                    return NODE_MEMORY_ERROR;
+                }
+
+                iter_node->mime_type = new_mime_type;
+                iter_node->description = new_description;
+                iter_node->picture_file_path = new_picture_file_path;
+                iter_node->is_picture_stored_as_file = picture_file_path != NULL;
+                iter_node->picture_binary_data = picture_binary_data;
+                iter_node->picture_binary_data_bytes = picture_file_path != NULL ? 0 : picture_binary_data_bytes;
+                iter_node->picture_data_ownership = picture_file_path != NULL ? ID3_PICTURE_DATA_BORROWED : picture_data_ownership;
+                iter_node->shared_picture = picture_data_ownership == ID3_PICTURE_DATA_SHARED ? shared_picture : NULL;
+                if (iter_node->shared_picture != NULL) id3_shared_picture_retain(iter_node->shared_picture);
+                iter_node->is_dirty = 1;
+
+                // cleanup old values once new assignments complete
+                _node_free(node_arena, old_mime_type);
+                if (update_operation == UPDATE_TYPE_FILE_ICON) _node_free(node_arena, old_description);
+                _node_free(node_arena, old_picture_file_path);
+                // handing the same owned buffer in again must not free it
+                if (old_picture_data_ownership != ID3_PICTURE_DATA_OWNED || old_picture_binary_data != picture_binary_data)
+                    _picture_data_release(old_picture_data_ownership, old_picture_binary_data, old_shared_picture);
+
+                return NODE_UPDATE_SUCCESS;
+            }
+
+            if (iter_node->next != NULL) {
+                iter_node = iter_node->next;
+            } else {
+                last_node = iter_node;
+                break;
+            }
+        }
+    }
+
+    // create a new node
+    id3_picture_tag_node* new_node = (id3_picture_tag_node*)_node_alloc(arena, sizeof(id3_picture_tag_node));
+
+    // malloc check -> struct
+    if (new_node == NULL)
+        return NODE_MEMORY_ERROR;
+
+    *new_node = (id3_picture_tag_node){.next = NULL, .mime_type = NULL, .picture_type = 0x00, .description = NULL, .payload = NULL, .payload_bytes = 0, .num_id3_bytes = 0, .is_utf8 = 0, .is_picture_stored_as_file = 0, .picture_file_path = NULL, .picture_binary_data = NULL, .picture_binary_data_bytes = 0, .picture_data_ownership = ID3_PICTURE_DATA_BORROWED, .shared_picture = NULL, .picture_file_bytes = 0, .is_dirty = 1, .arena = arena};
+
+    new_node->mime_type = _node_strdup(arena, mime_type);
+    new_node->description = _node_strdup(arena, description);
+    if (picture_file_path != NULL) new_node->picture_file_path = _node_strdup(arena, picture_file_path);
+
+    // malloc check -> struct members
+    if (new_node->mime_type == NULL || new_node->description == NULL || (picture_file_path != NULL && new_node->picture_file_path == NULL)) {
+        _node_free(arena, new_node->mime_type);
+        _node_free(arena, new_node->description);
+        _node_free(arena, new_node->picture_file_path);
+        _node_free(arena, new_node);
+
+        return NODE_MEMORY_ERROR;
+    }
+
+    new_node->picture_type = picture_type;
+    if (picture_file_path != NULL) {
+        new_node->is_picture_stored_as_file = 1;
+    } else {
+        new_node->picture_binary_data = picture_binary_data;
+        new_node->picture_binary_data_bytes = picture_binary_data_bytes;
+        new_node->picture_data_ownership = picture_data_ownership;
+        new_node->is_picture_stored_as_file = 0;
+
+        if (picture_data_ownership == ID3_PICTURE_DATA_SHARED) {
+            new_node->shared_picture = shared_picture;
+            id3_shared_picture_retain(shared_picture);
+        }
+    }
+
+    if (*head == NULL)
+        *head = new_node;
+    else
+        last_node->next = new_node;
+
+    return NODE_ADD_SUCCESS;
+}
+
+/*
+ * Deletes a specified node of a picture tag linked list.
+ * - If a node with a matching picture_type and description is not found, the linked list remains unchanged.
+ *
+ * Usage:
+ * id3_picture_tag_node* picture_tag_list = NULL;
+ * id3_picture_tag_node_add_update(&picture_tag_list, "image/jpeg", APIC_TYPE_COVER_FRONT, "FRONT", "./folder.jpg", NULL, 0);
+ * id3_picture_tag_node_delete(&picture_tag_list, APIC_TYPE_COVER_FRONT, "FRONT");
+ *
+ * Returns (success): NODE_DELETE_SUCCESS
+ * Returns (failure): NODE_NOT_FOUND, NODE_INVALID_HEAD
+ */
+unsigned int id3_picture_tag_node_delete(id3_picture_tag_node** head, uint8_t picture_type, char* description) {
+    id3_picture_tag_node* iter_node = *head;
+    id3_picture_tag_node* iter_node_prev = NULL;
+
+    // Empty linked list given
+    if (iter_node == NULL)
+        return NODE_INVALID_HEAD;
+
+    do {
+        if (iter_node->picture_type == picture_type && !strcmp(iter_node->description, description)) {
+            // node is not head, either joins the previous node to the next node or sets the previous node's next to NULL
+            if (iter_node_prev != NULL)
+                iter_node_prev->next = iter_node->next;
+            // node is head, make the next node the new head
+            else
+                *head = iter_node->next;
+
+            _free_picture_tag_node(iter_node);
+
+            return NODE_DELETE_SUCCESS;
         }
 
         iter_node_prev = iter_node;
@@ -641,224 +1220,629 @@ void id3_picture_tag_list_destroy(id3_picture_tag_node** head) {
     *head = NULL;
 }
 
+/*
+ * Encodes the payload of every dirty node in a picture tag linked list, looking up the size of picture files not yet looked at.
+ * - See id3_text_tag_list_encode() for details.
+ *
+ * Returns (success): TAG_ENCODE_SUCCESS
+ * Returns (failure): NODE_FILE_ERROR, NODE_MEMORY_ERROR, UTF8_PARSE_MALFORMED
+ */
+unsigned int id3_picture_tag_list_encode(id3_picture_tag_node** head, id3_stats* stats) {
+    for (id3_picture_tag_node* iter_node = *head; iter_node != NULL; iter_node = iter_node->next) {
+        int is_encoded = iter_node->is_dirty;
+
+        unsigned int encode_outcome = _picture_node_encode(iter_node);
+        if (encode_outcome != UTF8_PARSE_SUCCESS)
+            return encode_outcome;
+
+        if (is_encoded && stats != NULL) {
+            ID3_STATS_ADD(stats, picture_frames_encoded, 1);
+            ID3_STATS_ADD(stats, utf16_frames_encoded, iter_node->payload[0] == _ENCODING_UTF_16);
+        }
+    }
+
+    return TAG_ENCODE_SUCCESS;
+}
+
 /*
  * [INTERNAL FUNCTION]
- * Generates UTF-8/16 metadata for a text tag node.
- * - Checks if the tag_value contains multibyte sequences, then populates tag_value_utf16 if necessary.
- * - Also sets is_utf8 to 0 or 1, depending on if multibytes were found.
- * - Sets num_id3_bytes to expected text content size when written to an ID3 header.
- * - If anything other that UTF8_PARSE_SUCCESS is returned, is_utf8 and any 16bit variables will retain their old values.
+ * Encodes the pending value of a dirty text tag node into its payload. (https://id3.org/id3v2.3.0#ID3v2_frame_overview, https://id3.org/id3v2.3.0#Text_information_frames)
+ * - Encodes the value as ISO-8859-1 if every codepoint in it is U+00FF or less, as UTF-16 otherwise.
+ * - Sets payload, is_utf8 and num_id3_bytes and clears is_dirty. Nodes that are not dirty are left alone.
+ * - If anything other than UTF8_PARSE_SUCCESS is returned, the node retains its old values.
  *
  * Returns (success): UTF8_PARSE_SUCCESS
- * Returns (failure) (_NODE_TYPE_TEXT): UTF8_PARSE_MALFORMED, UTF16_PARSE_NO_MEM, UTF16_PARSE_UTF8_MALFORMED
- * Returns (failure) (_NODE_TYPE_COMMENT): UTF8_PARSE_MALFORMED, UTF16_PARSE_NO_MEM, UTF16_PARSE_UTF8_MALFORMED
- * Returns (failure) (_NODE_TYPE_APIC): UTF8_PARSE_MALFORMED, UTF16_PARSE_NO_MEM, UTF16_PARSE_UTF8_MALFORMED, NODE_FILE_ERROR
- * Returns (failure) (<other>): NODE_INVALID_TAG_NAME
- */
-unsigned int _node_generate_metadata(int node_type, void** node) {
-    switch (node_type) {
-        case _NODE_TYPE_TEXT:
-            return _text_node_generate_metadata((id3_text_tag_node**)node);
-        case _NODE_TYPE_COMMENT:
-            return _comment_node_generate_metadata((id3_comment_tag_node**)node);
-        case _NODE_TYPE_APIC:
-            return _picture_node_generate_metadata((id3_picture_tag_node**)node);
-        default:
-            return NODE_INVALID_TAG_NAME;
-    }
+ * Returns (failure): UTF8_PARSE_MALFORMED, NODE_MEMORY_ERROR
+ */
+unsigned int _text_node_encode(id3_text_tag_node* node) {
+    if (!node->is_dirty)
+        return UTF8_PARSE_SUCCESS;
+
+    char pending_copy[ID3_NODE_INLINE_PAYLOAD_BYTES];
+    const char* tag_value = _payload_pending_value(node->payload, node->payload_inline, pending_copy);
+
+    _payload_string prepared_value;
+    if (_payload_string_prepare(&prepared_value, tag_value) != UTF8_PARSE_SUCCESS)
+        return UTF8_PARSE_MALFORMED;
+
+    int is_utf8 = _payload_choose_encoding(&prepared_value, NULL);
+
+    unsigned int num_bytes = _ENCODING_BYTE_LENGTH + prepared_value.num_bytes;
+
+    uint8_t* payload = _payload_allocate(node->arena, node->payload_inline, num_bytes);
+    if (payload == NULL)
+        return NODE_MEMORY_ERROR;
+
+    // no more failure points, payload may now overwrite the old inline payload
+    payload[0] = is_utf8 ? _ENCODING_UTF_16 : _ENCODING_ISO_8859_1;
+    _payload_string_write(payload + _ENCODING_BYTE_LENGTH, &prepared_value);
+
+    if (node->payload != payload)
+        _payload_free(node->arena, node->payload_inline, node->payload);
+
+    _node_free(node->arena, node->compressed_payload);
+    node->compressed_payload = NULL;
+    node->compressed_bytes = 0;
+
+    node->payload = payload;
+    node->is_utf8 = is_utf8;
+    node->num_id3_bytes = num_bytes;
+    node->is_dirty = 0;
+
+    return UTF8_PARSE_SUCCESS;
 }
 
 /*
  * [INTERNAL FUNCTION]
- * Generates UTF-8/16 metadata for a text tag node.
- * - Checks if the tag_value contains multibyte sequences, then populates tag_value_utf16 if necessary.
- * - Also sets is_utf8 to 0 or 1, depending on if multibytes were found.
- * - Sets num_id3_bytes to expected text content size when written to an ID3 header. (https://id3.org/id3v2.3.0#ID3v2_frame_overview, https://id3.org/id3v2.3.0#Text_information_frames)
- * - If anything other that UTF8_PARSE_SUCCESS is returned, is_utf8 and tag_value_utf16 will retain their old values.
+ * Encodes the payload of a dirty comment tag node from its language, its short_content_description and pending comment. (https://id3.org/id3v2.3.0#Comments)
+ * - Both strings are encoded as UTF-16 if either contains a codepoint above U+00FF, as ISO-8859-1 otherwise.
+ * - Sets payload, is_utf8 and num_id3_bytes and clears is_dirty. Nodes that are not dirty are left alone.
+ * - If anything other than UTF8_PARSE_SUCCESS is returned, the node retains its old values.
  *
  * Returns (success): UTF8_PARSE_SUCCESS
- * Returns (failure): UTF8_PARSE_MALFORMED, UTF16_PARSE_NO_MEM, UTF16_PARSE_UTF8_MALFORMED
+ * Returns (failure): UTF8_PARSE_MALFORMED, NODE_MEMORY_ERROR
  */
-unsigned int _text_node_generate_metadata(id3_text_tag_node** node) {
-    id3_text_tag_node* node_dereferenced = *node;
+unsigned int _comment_node_encode(id3_comment_tag_node* node) {
+    if (!node->is_dirty)
+        return UTF8_PARSE_SUCCESS;
 
-    unsigned int has_multibytes = utf8_contains_multibyte_sequence(node_dereferenced->tag_value);
+    char pending_copy[ID3_NODE_INLINE_PAYLOAD_BYTES];
+    const char* comment = _payload_pending_value(node->payload, node->payload_inline, pending_copy);
 
-    unsigned int previous_utf8_val = node_dereferenced->is_utf8;
-    uint16_t* old_tag_value_utf16 = node_dereferenced->tag_value_utf16;
+    unsigned int num_bytes = 0;
+    int is_utf8 = 0;
+    unsigned int encode_outcome = _described_payload_encode(node->arena, node->payload_inline, &node->payload, node->language,
+                                                            node->short_content_description, comment, 0, &num_bytes, &is_utf8);
+    if (encode_outcome != UTF8_PARSE_SUCCESS)
+        return encode_outcome;
 
-    if (has_multibytes == -1)
-        return UTF8_PARSE_MALFORMED;
+    _node_free(node->arena, node->compressed_payload);
+    node->compressed_payload = NULL;
+    node->compressed_bytes = 0;
+
+    node->is_utf8 = is_utf8;
+    node->num_id3_bytes = num_bytes;
+    node->is_dirty = 0;
 
-    else if (has_multibytes == 1) {
-        node_dereferenced->is_utf8 = 1;
+    return UTF8_PARSE_SUCCESS;
+}
 
-        unsigned int utf16_length = 0;
+/*
+ * [INTERNAL FUNCTION]
+ * Encodes the payload of a dirty user frame node from its description and pending value, the same way as a comment without its language.
+ * (https://id3.org/id3v2.3.0#User_defined_text_information_frame, https://id3.org/id3v2.3.0#User_defined_URL_link_frame)
+ * - TXXX: both strings are encoded as UTF-16 if either contains a codepoint above U+00FF, as ISO-8859-1 otherwise.
+ * - WXXX: the description is encoded as UTF-16 if it contains a codepoint above U+00FF, the URL is always ISO-8859-1.
+ * - Sets payload, is_utf8 and num_id3_bytes and clears is_dirty. Nodes that are not dirty are left alone.
+ * - If anything other than UTF8_PARSE_SUCCESS is returned, the node retains its old values.
+ *
+ * Returns (success): UTF8_PARSE_SUCCESS
+ * Returns (failure): UTF8_PARSE_MALFORMED, NODE_MEMORY_ERROR
+ */
+unsigned int _user_node_encode(id3_user_tag_node* node) {
+    if (!node->is_dirty)
+        return UTF8_PARSE_SUCCESS;
 
-        int utf16_fication_outcome = utf8_to_utf16_le(node_dereferenced->tag_value, &node_dereferenced->tag_value_utf16, &utf16_length);
-        if (utf16_fication_outcome != UTF16_PARSE_SUCCESS) {
-            node_dereferenced->is_utf8 = previous_utf8_val;
-            node_dereferenced->tag_value_utf16 = old_tag_value_utf16;
-            return utf16_fication_outcome;
-        }
+    char pending_copy[ID3_NODE_INLINE_PAYLOAD_BYTES];
+    const char* value = _payload_pending_value(node->payload, node->payload_inline, pending_copy);
 
-        node_dereferenced->num_id3_bytes = _ENCODING_BYTE_LENGTH + _ENCODING_UNICODE_BOM_LENGTH + (utf16_length * 2) + _ENCODING_UNICODE_NULL_LENGTH;
-    } else {
-        node_dereferenced->is_utf8 = 0;
-        node_dereferenced->tag_value_utf16 = NULL;
-        node_dereferenced->num_id3_bytes = _ENCODING_BYTE_LENGTH + strlen(node_dereferenced->tag_value) + _ENCODING_ISO_NULL_LENGTH;
-    }
+    unsigned int num_bytes = 0;
+    int is_utf8 = 0;
+    unsigned int encode_outcome = _described_payload_encode(node->arena, node->payload_inline, &node->payload, NULL,
+                                                            node->description, value, node->frame_id == ID3_FRAME_WXXX, &num_bytes, &is_utf8);
+    if (encode_outcome != UTF8_PARSE_SUCCESS)
+        return encode_outcome;
 
-    // cleanup old values once new assignments complete, if previous tag was utf8, resolves to nothing
-    free(old_tag_value_utf16);
+    _node_free(node->arena, node->compressed_payload);
+    node->compressed_payload = NULL;
+    node->compressed_bytes = 0;
+
+    node->is_utf8 = is_utf8;
+    node->num_id3_bytes = num_bytes;
+    node->is_dirty = 0;
 
     return UTF8_PARSE_SUCCESS;
 }
 
 /*
  * [INTERNAL FUNCTION]
- * Generates UTF-8/16 metadata for a comment tag node.
- * - Checks if either short_content_description or comment contains multibyte sequences,
- *   then populates short_content_description_utf16 and comment_utf16 if necessary.
- * - Also sets is_utf8 to 0 or 1, depending on if multibytes were found.
- * - Sets num_id3_bytes to expected text content size when written to an ID3 header. (https://id3.org/id3v2.3.0#ID3v2_frame_overview, https://id3.org/id3v2.3.0#Comments)
- * - If anything other that UTF8_PARSE_SUCCESS is returned, is_utf8, short_content_description_utf16 and comment_utf16 will retain their old values.
+ * Encodes the part of a dirty picture tag node's payload before the picture data. (https://id3.org/id3v2.3.0#Attached_picture)
+ * - description is encoded as UTF-16 if it contains a codepoint above U+00FF, as ISO-8859-1 otherwise. mime_type is always copied as is.
+ * - The size of a picture file is looked up every time, even if the node is not dirty: the file may have changed since the last tag was written.
+ * - Sets payload, payload_bytes, is_utf8 and num_id3_bytes and clears is_dirty. Nodes that are not dirty only get their picture file size updated.
+ * - If anything other than UTF8_PARSE_SUCCESS is returned, the node retains its old values.
  *
  * Returns (success): UTF8_PARSE_SUCCESS
- * Returns (failure): UTF8_PARSE_MALFORMED, UTF16_PARSE_NO_MEM, UTF16_PARSE_UTF8_MALFORMED
+ * Returns (failure): NODE_FILE_ERROR, UTF8_PARSE_MALFORMED, NODE_MEMORY_ERROR
  */
-unsigned int _comment_node_generate_metadata(id3_comment_tag_node** node) {
-    id3_comment_tag_node* node_dereferenced = *node;
+unsigned int _picture_node_encode(id3_picture_tag_node* node) {
+    if (node->is_picture_stored_as_file) {
+        if (_picture_file_bytes(node->picture_file_path, &node->picture_file_bytes) != UTF8_PARSE_SUCCESS)
+            return NODE_FILE_ERROR;
 
-    unsigned int scd_has_multibytes = utf8_contains_multibyte_sequence(node_dereferenced->short_content_description);
-    unsigned int cmt_has_multibytes = utf8_contains_multibyte_sequence(node_dereferenced->comment);
+        if (!node->is_dirty)
+            node->num_id3_bytes = node->payload_bytes + node->picture_file_bytes;
+    }
+
+    if (!node->is_dirty)
+        return UTF8_PARSE_SUCCESS;
 
-    unsigned int previous_utf8_val = node_dereferenced->is_utf8;
-    uint16_t* old_scd_utf16 = node_dereferenced->short_content_description_utf16;
-    uint16_t* old_cmt_utf16 = node_dereferenced->comment_utf16;
+    const char* mime_type = node->mime_type;
+    const char* description = node->description;
 
-    if (scd_has_multibytes == -1 || cmt_has_multibytes == -1)
+    _payload_string prepared_description;
+    if (_payload_string_prepare(&prepared_description, description) != UTF8_PARSE_SUCCESS)
         return UTF8_PARSE_MALFORMED;
 
-    else if (scd_has_multibytes == 1 || cmt_has_multibytes == 1) {
-        node_dereferenced->is_utf8 = 1;
+    int is_utf8 = _payload_choose_encoding(&prepared_description, NULL);
 
-        unsigned int scd_len = 0, cmt_len = 0;
+    // mime_type is always copied as is
+    _payload_string prepared_mime_type = {.string = mime_type, .is_utf16 = 0, .num_bytes = strlen(mime_type) + _ENCODING_ISO_NULL_LENGTH};
 
-        int utf16_fication_outcome = utf8_to_utf16_le(node_dereferenced->short_content_description, &node_dereferenced->short_content_description_utf16, &scd_len);
-        if (utf16_fication_outcome != UTF16_PARSE_SUCCESS) {
-            node_dereferenced->is_utf8 = previous_utf8_val;
-            node_dereferenced->short_content_description_utf16 = old_scd_utf16;
-            return utf16_fication_outcome;
-        }
+    unsigned int num_bytes = _ENCODING_BYTE_LENGTH + prepared_mime_type.num_bytes + _ENCODING_APIC_PICTURE_TYPE_LENGTH + prepared_description.num_bytes;
 
-        utf16_fication_outcome = utf8_to_utf16_le(node_dereferenced->comment, &node_dereferenced->comment_utf16, &cmt_len);
-        if (utf16_fication_outcome != UTF16_PARSE_SUCCESS) {
-            free(node_dereferenced->short_content_description_utf16);
-            node_dereferenced->is_utf8 = previous_utf8_val;
-            node_dereferenced->short_content_description_utf16 = old_scd_utf16;
-            node_dereferenced->comment_utf16 = old_cmt_utf16;
-            return utf16_fication_outcome;
-        }
+    uint8_t* payload = _payload_allocate(node->arena, node->payload_inline, num_bytes);
+    if (payload == NULL)
+        return NODE_MEMORY_ERROR;
 
-        node_dereferenced->num_id3_bytes = _ENCODING_BYTE_LENGTH + _COMMENT_LANGUAGE_LENGTH +
-                                           _ENCODING_UNICODE_BOM_LENGTH + (scd_len * 2) + _ENCODING_UNICODE_NULL_LENGTH +
-                                           _ENCODING_UNICODE_BOM_LENGTH + (cmt_len * 2) + _ENCODING_UNICODE_NULL_LENGTH;
-    } else {
-        node_dereferenced->is_utf8 = 0;
-        node_dereferenced->short_content_description_utf16 = NULL;
-        node_dereferenced->comment_utf16 = NULL;
-        node_dereferenced->num_id3_bytes = _ENCODING_BYTE_LENGTH + _COMMENT_LANGUAGE_LENGTH +
-                                           strlen(node_dereferenced->short_content_description) + _ENCODING_ISO_NULL_LENGTH +
-                                           strlen(node_dereferenced->comment) + _ENCODING_ISO_NULL_LENGTH;
-    }
+    // no more failure points, payload may now overwrite the old inline payload
+    uint8_t* write_ptr = payload;
+    *write_ptr++ = is_utf8 ? _ENCODING_UTF_16 : _ENCODING_ISO_8859_1;
+    write_ptr = _payload_string_write(write_ptr, &prepared_mime_type);
+    *write_ptr++ = node->picture_type;
+    _payload_string_write(write_ptr, &prepared_description);
+
+    if (node->payload != payload)
+        _payload_free(node->arena, node->payload_inline, node->payload);
 
-    // cleanup old values once new assignments complete, if previous tag was utf8, resolves to nothing
-    free(old_scd_utf16);
-    free(old_cmt_utf16);
+    node->payload = payload;
+    node->payload_bytes = num_bytes;
+    node->is_utf8 = is_utf8;
+    node->num_id3_bytes = num_bytes + (node->is_picture_stored_as_file ? node->picture_file_bytes : node->picture_binary_data_bytes);
+    node->is_dirty = 0;
 
     return UTF8_PARSE_SUCCESS;
 }
 
 /*
  * [INTERNAL FUNCTION]
- * Generates UTF-8/16 metadata for a picture tag node.
- * - Checks if description contains multibyte sequences, then populates description_utf16 if necessary.
- * - Also sets is_utf8 to 0 or 1, depending on if multibytes were found.
- * - Sets num_id3_bytes to expected text and picture binary content size when written to an ID3 header. (https://id3.org/id3v2.3.0#ID3v2_frame_overview, https://id3.org/id3v2.3.0#Attached_picture)
- * - If the picture is stored as a file, the function will calculate the size of the file and add it to num_id3_bytes.
- * - If the picture is provided as binary data, the function will add the size of the binary data to num_id3_bytes.
- * - If anything other that UTF8_PARSE_SUCCESS is returned, is_utf8 and description_utf16 will retain their old values.
+ * Determines the size of the file at picture_file_path with a single stat() call.
  *
  * Returns (success): UTF8_PARSE_SUCCESS
- * Returns (failure): UTF8_PARSE_MALFORMED, UTF16_PARSE_NO_MEM, UTF16_PARSE_UTF8_MALFORMED, NODE_FILE_ERROR
+ * Returns (failure): NODE_FILE_ERROR
  */
-unsigned int _picture_node_generate_metadata(id3_picture_tag_node** node) {
-    id3_picture_tag_node* node_dereferenced = *node;
+unsigned int _picture_file_bytes(const char* picture_file_path, unsigned int* picture_bytes) {
+    struct stat picture_file_stat;
 
-    unsigned int has_multibytes = utf8_contains_multibyte_sequence(node_dereferenced->description);
+    if (stat(picture_file_path, &picture_file_stat) != 0 || !S_ISREG(picture_file_stat.st_mode))
+        return NODE_FILE_ERROR;
 
-    unsigned int previous_utf8_val = node_dereferenced->is_utf8;
-    uint16_t* old_description_utf16 = node_dereferenced->description_utf16;
+    *picture_bytes = (unsigned int)picture_file_stat.st_size;
 
-    if (has_multibytes == -1)
-        return UTF8_PARSE_MALFORMED;
+    return UTF8_PARSE_SUCCESS;
+}
 
-    else if (has_multibytes == 1) {
-        node_dereferenced->is_utf8 = 1;
+/*
+ * [INTERNAL FUNCTION]
+ * Prepares a string for _payload_string_write(), checking and measuring it in a single pass. Nothing is allocated.
+ * - The encoding is decided afterwards by _payload_choose_encoding().
+ *
+ * Returns (success): UTF8_PARSE_SUCCESS
+ * Returns (failure): UTF8_PARSE_MALFORMED
+ */
+unsigned int _payload_string_prepare(_payload_string* prepared, const char* string) {
+    prepared->string = string;
+    prepared->is_utf16 = 0;
+    prepared->num_bytes = 0;
 
-        unsigned int utf16_length = 0;
+    return utf8_validate(string, &prepared->validation);
+}
 
-        int utf16_fication_outcome = utf8_to_utf16_le(node_dereferenced->description, &node_dereferenced->description_utf16, &utf16_length);
-        if (utf16_fication_outcome != UTF16_PARSE_SUCCESS) {
-            node_dereferenced->is_utf8 = previous_utf8_val;
-            node_dereferenced->description_utf16 = old_description_utf16;
-            return utf16_fication_outcome;
-        }
+/*
+ * [INTERNAL FUNCTION]
+ * Decides the encoding shared by one or two prepared strings of a frame and sizes them accordingly, second may be NULL.
+ *
+ * ISO-8859-1 takes one byte per character where UTF-16 takes two plus BOM and terminator, so it is used whenever every codepoint fits in it.
+ *
+ * Returns: 1 if UTF-16 is needed, 0 if ISO-8859-1 suffices
+ */
+int _payload_choose_encoding(_payload_string* first, _payload_string* second) {
+    int is_utf8 = first->validation.max_codepoint > 0xFF || (second != NULL && second->validation.max_codepoint > 0xFF);
 
-        node_dereferenced->num_id3_bytes = _ENCODING_BYTE_LENGTH + strlen(node_dereferenced->mime_type) +
-                                           _ENCODING_ISO_NULL_LENGTH + _ENCODING_APIC_PICTURE_TYPE_LENGTH +
-                                           _ENCODING_UNICODE_BOM_LENGTH + (utf16_length * 2) + _ENCODING_UNICODE_NULL_LENGTH;
-    } else {
-        node_dereferenced->is_utf8 = 0;
-        node_dereferenced->description_utf16 = NULL;
-        node_dereferenced->num_id3_bytes = _ENCODING_BYTE_LENGTH + strlen(node_dereferenced->mime_type) +
-                                           _ENCODING_ISO_NULL_LENGTH + _ENCODING_APIC_PICTURE_TYPE_LENGTH +
-                                           strlen(node_dereferenced->description) + _ENCODING_ISO_NULL_LENGTH;
+    _payload_string_set_encoding(first, is_utf8);
+    if (second != NULL)
+        _payload_string_set_encoding(second, is_utf8);
+
+    return is_utf8;
+}
+
+/*
+ * [INTERNAL FUNCTION]
+ * Sets the encoding of a prepared string and the number of bytes it will take up in the payload.
+ */
+void _payload_string_set_encoding(_payload_string* prepared, int is_utf16) {
+    prepared->is_utf16 = is_utf16;
+    prepared->num_bytes = is_utf16 ? _ENCODING_UNICODE_BOM_LENGTH + prepared->validation.utf16_bytes + _ENCODING_UNICODE_NULL_LENGTH
+                                   : prepared->validation.utf16_bytes / 2 + _ENCODING_ISO_NULL_LENGTH;  // one byte per character
+}
+
+/*
+ * [INTERNAL FUNCTION]
+ * Writes a prepared string into a payload, preceded by a BOM and followed by a 2 byte null if UTF-16, followed by a 1 byte null otherwise.
+ * - ASCII only strings are copied as is, other ISO-8859-1 strings are transcoded straight into the payload.
+ * - UTF-16 is transcoded straight into the payload, the string was already checked by _payload_string_prepare() so this cannot fail.
+ *   This is the only time the string is looked at after being prepared.
+ *
+ * Returns: write_ptr advanced past the written string
+ */
+uint8_t* _payload_string_write(uint8_t* write_ptr, const _payload_string* prepared) {
+    if (!prepared->is_utf16 && prepared->validation.max_codepoint == 0) {
+        memcpy(write_ptr, prepared->string, prepared->num_bytes);
+        return write_ptr + prepared->num_bytes;
     }
 
-    // note: since we are passing binary data as a pointer, do not nullify it like the tags, let programmer settle their own image buffer
-    if (node_dereferenced->is_picture_stored_as_file) {
-        FILE* fptr;
-        fptr = fopen(node_dereferenced->picture_file_path, "rb");
+    if (!prepared->is_utf16) {
+        unsigned int iso_bytes = prepared->num_bytes - _ENCODING_ISO_NULL_LENGTH;
 
-        if (fptr == NULL) {
-            node_dereferenced->is_utf8 = previous_utf8_val;
-            node_dereferenced->description_utf16 = old_description_utf16;
-            return NODE_FILE_ERROR;
-        }
+        utf8_to_iso_8859_1(prepared->string, write_ptr, iso_bytes, &iso_bytes);
+        write_ptr += iso_bytes;
+        *write_ptr++ = 0x00;
+
+        return write_ptr;
+    }
+
+    unsigned int utf16_bytes = prepared->num_bytes - _ENCODING_UNICODE_BOM_LENGTH - _ENCODING_UNICODE_NULL_LENGTH;
+
+    *write_ptr++ = 0xFF;  // BOM (LE)
+    *write_ptr++ = 0xFE;
+    utf8_to_utf16_bytes(prepared->string, write_ptr, utf16_bytes, UTF16_LITTLE_ENDIAN, &utf16_bytes);
+    write_ptr += utf16_bytes;
+    *write_ptr++ = 0x00;
+    *write_ptr++ = 0x00;
+
+    return write_ptr;
+}
+
+/*
+ * [INTERNAL FUNCTION]
+ * Encodes the payload of a frame made of an encoding byte, an optional 3 byte language, a description and a value, i.e. COMM, TXXX and WXXX,
+ * replacing *payload (inline_buffer if it fits) with it.
+ * - language is NULL for frames without one.
+ * - Both strings share one encoding, UTF-16 if either contains a codepoint above U+00FF, ISO-8859-1 otherwise.
+ *   If is_value_iso_8859_1 is set (URLs), value is always ISO-8859-1 and only description decides the encoding.
+ * - value may point into the old payload only if it was copied out of inline_buffer first (see _payload_pending_value()).
+ * - num_bytes and is_utf8 receive the payload size and encoding. If anything other than UTF8_PARSE_SUCCESS is returned, *payload is left as it was.
+ *
+ * Returns (success): UTF8_PARSE_SUCCESS
+ * Returns (failure): UTF8_PARSE_MALFORMED (also for a value with codepoints above U+00FF if is_value_iso_8859_1 is set), NODE_MEMORY_ERROR
+ */
+unsigned int _described_payload_encode(id3_arena* arena, uint8_t* inline_buffer, uint8_t** payload, const char* language, const char* description,
+                                       const char* value, int is_value_iso_8859_1, unsigned int* num_bytes, int* is_utf8) {
+    _payload_string prepared_description, prepared_value;
+    if (_payload_string_prepare(&prepared_description, description) != UTF8_PARSE_SUCCESS ||
+        _payload_string_prepare(&prepared_value, value) != UTF8_PARSE_SUCCESS)
+        return UTF8_PARSE_MALFORMED;
+
+    int is_utf16;
+    if (is_value_iso_8859_1) {
+        if (prepared_value.validation.max_codepoint > 0xFF)
+            return UTF8_PARSE_MALFORMED;
 
-        fseek(fptr, 0, SEEK_END);
-        node_dereferenced->num_id3_bytes += ftell(fptr);
-        fclose(fptr);
+        is_utf16 = _payload_choose_encoding(&prepared_description, NULL);
+        _payload_string_set_encoding(&prepared_value, 0);
     } else {
-        node_dereferenced->num_id3_bytes += node_dereferenced->picture_binary_data_bytes;
+        is_utf16 = _payload_choose_encoding(&prepared_description, &prepared_value);
     }
 
-    // cleanup old values once new assignments complete, if previous tag was utf8, resolves to nothing
-    free(old_description_utf16);
+    unsigned int language_bytes = language != NULL ? _COMMENT_LANGUAGE_LENGTH : 0;
+    unsigned int payload_bytes = _ENCODING_BYTE_LENGTH + language_bytes + prepared_description.num_bytes + prepared_value.num_bytes;
+
+    uint8_t* new_payload = _payload_allocate(arena, inline_buffer, payload_bytes);
+    if (new_payload == NULL)
+        return NODE_MEMORY_ERROR;
+
+    // no more failure points, the new payload may now overwrite the old inline payload
+    uint8_t* write_ptr = new_payload;
+    *write_ptr++ = is_utf16 ? _ENCODING_UTF_16 : _ENCODING_ISO_8859_1;
+    if (language != NULL) {
+        memcpy(write_ptr, language, _COMMENT_LANGUAGE_LENGTH);
+        write_ptr += _COMMENT_LANGUAGE_LENGTH;
+    }
+    write_ptr = _payload_string_write(write_ptr, &prepared_description);
+    _payload_string_write(write_ptr, &prepared_value);
+
+    if (*payload != new_payload)
+        _payload_free(arena, inline_buffer, *payload);
+
+    *payload = new_payload;
+    *num_bytes = payload_bytes;
+    *is_utf8 = is_utf16;
+
+    return UTF8_PARSE_SUCCESS;
+}
+
+/*
+ * [INTERNAL FUNCTION]
+ * Compresses an encoded payload with zlib into compressed_payload, preceded by its decompressed size, as a frame with the compression flag holds it.
+ * (https://id3.org/id3v2.3.0#Frame_header_flags)
+ * - compressed_payload is left NULL if payload is shorter than threshold_bytes (or threshold_bytes is 0),
+ *   or if compressing it would not make it smaller, in which case the frame is written uncompressed.
+ * - A compressed_payload that is already set is kept, it is only dropped by the node being encoded again.
+ *
+ * Returns (success): TAG_ENCODE_SUCCESS
+ * Returns (failure): NODE_MEMORY_ERROR
+ */
+unsigned int _payload_compress(id3_arena* arena, const uint8_t* payload, unsigned int num_bytes, unsigned int threshold_bytes,
+                               uint8_t** compressed_payload, unsigned int* compressed_bytes) {
+    if (threshold_bytes == 0 || num_bytes < threshold_bytes) {
+        _node_free(arena, *compressed_payload);
+        *compressed_payload = NULL;
+        *compressed_bytes = 0;
+        return TAG_ENCODE_SUCCESS;
+    }
+
+    if (*compressed_payload != NULL)
+        return TAG_ENCODE_SUCCESS;
+
+#ifdef ID3_WITH_ZLIB
+    // compress into a worst case sized buffer first, only the exact result is kept with the node
+    uLongf deflated_bytes = compressBound(num_bytes);
+    uint8_t* deflated = (uint8_t*)ID3_MALLOC(deflated_bytes);
+    if (deflated == NULL)
+        return NODE_MEMORY_ERROR;
+
+    // with a compressBound() sized buffer, running out of memory is the only way to fail
+    if (compress2(deflated, &deflated_bytes, payload, num_bytes, Z_DEFAULT_COMPRESSION) != Z_OK) {
+        ID3_FREE(deflated);
+        return NODE_MEMORY_ERROR;
+    }
+
+    // not worth it, e.g. short or already dense content
+    if (_COMPRESSION_SIZE_LENGTH + deflated_bytes >= num_bytes) {
+        ID3_FREE(deflated);
+        return TAG_ENCODE_SUCCESS;
+    }
+
+    unsigned int total_bytes = _COMPRESSION_SIZE_LENGTH + (unsigned int)deflated_bytes;
+    uint8_t* stored = (uint8_t*)_node_alloc(arena, total_bytes);
+    if (stored == NULL) {
+        ID3_FREE(deflated);
+        return NODE_MEMORY_ERROR;
+    }
+
+    // decompressed size, big endian
+    stored[0] = (num_bytes >> 24) & 0xFF;
+    stored[1] = (num_bytes >> 16) & 0xFF;
+    stored[2] = (num_bytes >> 8) & 0xFF;
+    stored[3] = num_bytes & 0xFF;
+    memcpy(stored + _COMPRESSION_SIZE_LENGTH, deflated, deflated_bytes);
+    ID3_FREE(deflated);
+
+    *compressed_payload = stored;
+    *compressed_bytes = total_bytes;
+#else
+    (void)payload;
+#endif
+
+    return TAG_ENCODE_SUCCESS;
+}
+
+/*
+ * [INTERNAL FUNCTION]
+ * Stores the pending UTF-8 value of a dirty node in its payload, inline_buffer if it fits, replacing whatever the payload held.
+ * - If anything other than UTF8_PARSE_SUCCESS is returned, the payload is left as it was.
+ *
+ * Returns (success): UTF8_PARSE_SUCCESS
+ * Returns (failure): NODE_MEMORY_ERROR
+ */
+unsigned int _payload_set_pending(id3_arena* arena, uint8_t* inline_buffer, uint8_t** payload, const char* string) {
+    unsigned int num_bytes = strlen(string) + 1;
+
+    uint8_t* pending = _payload_allocate(arena, inline_buffer, num_bytes);
+    if (pending == NULL)
+        return NODE_MEMORY_ERROR;
+
+    memcpy(pending, string, num_bytes);
+
+    if (*payload != pending)
+        _payload_free(arena, inline_buffer, *payload);
+
+    *payload = pending;
 
     return UTF8_PARSE_SUCCESS;
 }
 
+/*
+ * [INTERNAL FUNCTION]
+ * Gets the pending value out of a dirty node's payload ahead of encoding it.
+ * A value stored inline is first copied into copy_buffer (ID3_NODE_INLINE_PAYLOAD_BYTES long), as the encoded payload may overwrite it.
+ *
+ * Returns: pointer to the pending value
+ */
+const char* _payload_pending_value(uint8_t* payload, uint8_t* inline_buffer, char* copy_buffer) {
+    if (payload != inline_buffer)
+        return (const char*)payload;
+
+    memcpy(copy_buffer, inline_buffer, ID3_NODE_INLINE_PAYLOAD_BYTES);
+    return copy_buffer;
+}
+
+/*
+ * [INTERNAL FUNCTION]
+ * Copies the pending UTF-8 value of a dirty node, with the output semantics of utf16_le_to_utf8(), only whole characters are copied.
+ *
+ * Returns: length in bytes of pending_value, not including the null terminator
+ */
+unsigned int _pending_value_copy(const char* pending_value, char* string, unsigned int string_bytes) {
+    unsigned int pending_length = strlen(pending_value);
+
+    if (string_bytes == 0)
+        return pending_length;
+
+    unsigned int copy_length = pending_length < string_bytes - 1 ? pending_length : string_bytes - 1;
+
+    // back off to the start of a character that was cut short
+    while (copy_length < pending_length && copy_length > 0 && ((uint8_t)pending_value[copy_length] & 0xC0) == 0x80)
+        copy_length--;
+
+    memcpy(string, pending_value, copy_length);
+    string[copy_length] = '\0';
+
+    return pending_length;
+}
+
+/*
+ * [INTERNAL FUNCTION]
+ * Decodes a string written by _payload_string_write() back into UTF-8, with the output semantics of utf16_le_to_utf8().
+ * - If num_encoded_bytes is not NULL, it receives the number of payload bytes taken up by the encoded string.
+ *
+ * Returns: length in bytes of the UTF-8 string, not including the null terminator
+ */
+unsigned int _payload_string_decode(const uint8_t* encoded, int is_utf8, char* string, unsigned int string_bytes, unsigned int* num_encoded_bytes) {
+    if (!is_utf8) {
+        if (num_encoded_bytes != NULL)
+            *num_encoded_bytes = strlen((const char*)encoded) + _ENCODING_ISO_NULL_LENGTH;
+        return iso_8859_1_to_utf8((const char*)encoded, string, string_bytes);
+    }
+
+    if (num_encoded_bytes != NULL) {
+        const uint8_t* read_ptr = encoded + _ENCODING_UNICODE_BOM_LENGTH;
+        while (read_ptr[0] != 0x00 || read_ptr[1] != 0x00)
+            read_ptr += 2;
+        *num_encoded_bytes = (read_ptr - encoded) + _ENCODING_UNICODE_NULL_LENGTH;
+    }
+
+    return utf16_le_to_utf8(encoded + _ENCODING_UNICODE_BOM_LENGTH, string, string_bytes);
+}
+
+/*
+ * [INTERNAL FUNCTION]
+ * Obtains space for a payload of num_bytes, inline_buffer if it fits (see ID3_NODE_INLINE_PAYLOAD_BYTES), otherwise from _node_alloc().
+ *
+ * Returns (success): inline_buffer or pointer to the allocated space
+ * Returns (failure): NULL
+ */
+uint8_t* _payload_allocate(id3_arena* arena, uint8_t* inline_buffer, unsigned int num_bytes) {
+    if (num_bytes <= ID3_NODE_INLINE_PAYLOAD_BYTES)
+        return inline_buffer;
+
+    return (uint8_t*)_node_alloc(arena, num_bytes);
+}
+
+/*
+ * [INTERNAL FUNCTION]
+ * Frees a payload obtained from _payload_allocate(). Inline payloads are left alone.
+ */
+void _payload_free(id3_arena* arena, uint8_t* inline_buffer, uint8_t* payload) {
+    if (payload != inline_buffer)
+        _node_free(arena, payload);
+}
+
+/*
+ * [INTERNAL FUNCTION]
+ * Hashes the key of a user frame node, its frame ID and UTF-8 description, with 32 bit FNV-1a.
+ */
+uint32_t _user_tag_hash(uint32_t frame_id, const char* description) {
+    uint32_t hash = 2166136261u;
+
+    for (int i = 24; i >= 0; i -= 8)
+        hash = (hash ^ ((frame_id >> i) & 0xFF)) * 16777619u;
+
+    for (const uint8_t* iter_ptr = (const uint8_t*)description; *iter_ptr != '\0'; iter_ptr++)
+        hash = (hash ^ *iter_ptr) * 16777619u;
+
+    return hash;
+}
+
+/*
+ * [INTERNAL FUNCTION]
+ * Looks up a node of a user frame list by its key through the list's index, description_hash being _user_tag_hash() of the key.
+ *
+ * Returns (success): the link (bucket or next_in_bucket of the previous node) pointing to the matching node, to unlink it from its bucket in place
+ * Returns (failure): NULL if there is no matching node
+ */
+id3_user_tag_node** _user_tag_list_find_link(const id3_user_tag_list* list, uint32_t frame_id, const char* description, uint32_t description_hash) {
+    if (list->num_buckets == 0)
+        return NULL;
+
+    id3_user_tag_node** iter_link = &list->buckets[description_hash & (list->num_buckets - 1)];
+
+    while (*iter_link != NULL) {
+        id3_user_tag_node* iter_node = *iter_link;
+
+        if (iter_node->description_hash == description_hash && iter_node->frame_id == frame_id && !strcmp(iter_node->description, description))
+            return iter_link;
+
+        iter_link = &iter_node->next_in_bucket;
+    }
+
+    return NULL;
+}
+
+/*
+ * [INTERNAL FUNCTION]
+ * Grows the index of a user frame list if needed so that it can hold num_nodes nodes while at most 3/4 full, refiling every node in it.
+ * - Nodes are refiled from their cached description_hash, no description is hashed again.
+ * - If the index cannot be grown, it is left as it was.
+ *
+ * Returns (success): 1
+ * Returns (failure): 0
+ */
+int _user_tag_list_reserve(id3_user_tag_list* list, unsigned int num_nodes) {
+    if (num_nodes <= list->num_buckets / 4 * 3)
+        return 1;
+
+    unsigned int num_buckets = list->num_buckets > 0 ? list->num_buckets * 2 : _USER_INDEX_INITIAL_BUCKETS;
+    while (num_nodes > num_buckets / 4 * 3)
+        num_buckets *= 2;
+
+    id3_user_tag_node** buckets = (id3_user_tag_node**)ID3_MALLOC(num_buckets * sizeof(id3_user_tag_node*));
+    if (buckets == NULL)
+        return 0;
+
+    memset(buckets, 0, num_buckets * sizeof(id3_user_tag_node*));
+
+    for (id3_user_tag_node* iter_node = list->head; iter_node != NULL; iter_node = iter_node->next) {
+        id3_user_tag_node** bucket = &buckets[iter_node->description_hash & (num_buckets - 1)];
+        iter_node->next_in_bucket = *bucket;
+        *bucket = iter_node;
+    }
+
+    ID3_FREE(list->buckets);
+    list->buckets = buckets;
+    list->num_buckets = num_buckets;
+
+    return 1;
+}
+
 /*
  * [INTERNAL FUNCTION]
  * This function frees a text tag node.
  */
 void _free_text_tag_node(id3_text_tag_node* node) {
-    free(node->tag_value);
-    free(node->tag_value_utf16);
-    free(node);
+    _payload_free(node->arena, node->payload_inline, node->payload);
+    _node_free(node->arena, node->compressed_payload);
+    _node_free(node->arena, node);
 }
 
 /*
@@ -866,22 +1850,111 @@ void _free_text_tag_node(id3_text_tag_node* node) {
  * This function frees a comment tag node.
  */
 void _free_comment_tag_node(id3_comment_tag_node* node) {
-    free(node->short_content_description);
-    free(node->comment);
-    free(node->short_content_description_utf16);
-    free(node->comment_utf16);
-    free(node);
+    _node_string_free(node->arena, node->short_content_description_inline, node->short_content_description);
+    _payload_free(node->arena, node->payload_inline, node->payload);
+    _node_free(node->arena, node->compressed_payload);
+    _node_free(node->arena, node);
+}
+
+/*
+ * [INTERNAL FUNCTION]
+ * This function frees a user frame node. The node must already be out of its list and index.
+ */
+void _free_user_tag_node(id3_user_tag_node* node) {
+    _node_string_free(node->arena, node->description_inline, node->description);
+    _payload_free(node->arena, node->payload_inline, node->payload);
+    _node_free(node->arena, node->compressed_payload);
+    _node_free(node->arena, node);
 }
 
 /*
  * [INTERNAL FUNCTION]
  * This function frees a picture tag node.
+ * - picture_binary_data is released according to its ownership, it never lives in the arena.
  */
 void _free_picture_tag_node(id3_picture_tag_node* node) {
-    free(node->mime_type);
-    free(node->description);
-    free(node->description_utf16);
-    free(node->picture_file_path);
-    free(node->picture_binary_data);
-    free(node);
+    _picture_data_release(node->picture_data_ownership, node->picture_binary_data, node->shared_picture);
+    _node_free(node->arena, node->mime_type);
+    _node_free(node->arena, node->description);
+    _node_free(node->arena, node->picture_file_path);
+    _payload_free(node->arena, node->payload_inline, node->payload);
+    _node_free(node->arena, node);
+}
+
+/*
+ * [INTERNAL FUNCTION]
+ * Releases picture data according to its ownership: freed if owned, a reference dropped if shared, left alone if borrowed.
+ */
+void _picture_data_release(uint8_t picture_data_ownership, uint8_t* picture_binary_data, id3_shared_picture* shared_picture) {
+    switch (picture_data_ownership) {
+        case ID3_PICTURE_DATA_OWNED:
+            ID3_FREE(picture_binary_data);
+            break;
+        case ID3_PICTURE_DATA_SHARED:
+            id3_shared_picture_release(shared_picture);
+            break;
+        default:
+            break;
+    }
+}
+
+/*
+ * [INTERNAL FUNCTION]
+ * Allocates node memory from arena, or from the heap if arena is NULL.
+ */
+void* _node_alloc(id3_arena* arena, size_t bytes) {
+    return arena != NULL ? id3_arena_alloc(arena, bytes) : ID3_MALLOC(bytes);
+}
+
+/*
+ * [INTERNAL FUNCTION]
+ * Frees node memory obtained from _node_alloc(). Arena memory is left alone, it is reclaimed when the arena is reset.
+ */
+void _node_free(id3_arena* arena, void* ptr) {
+    if (arena == NULL)
+        ID3_FREE(ptr);
+}
+
+/*
+ * [INTERNAL FUNCTION]
+ * Copies a string into memory obtained from _node_alloc().
+ *
+ * Returns (success): pointer to the copy
+ * Returns (failure): NULL
+ */
+char* _node_strdup(id3_arena* arena, const char* string) {
+    size_t string_bytes = strlen(string) + 1;
+
+    char* copy = (char*)_node_alloc(arena, string_bytes);
+    if (copy == NULL)
+        return NULL;
+
+    memcpy(copy, string, string_bytes);
+    return copy;
+}
+
+/*
+ * [INTERNAL FUNCTION]
+ * Stores a string inside inline_buffer if it fits (see ID3_NODE_INLINE_STRING_BYTES), otherwise copies it into memory obtained from _node_alloc().
+ *
+ * Returns (success): inline_buffer or pointer to the copy
+ * Returns (failure): NULL
+ */
+char* _node_string_store(id3_arena* arena, char* inline_buffer, const char* string) {
+    size_t string_bytes = strlen(string) + 1;
+
+    if (string_bytes > ID3_NODE_INLINE_STRING_BYTES)
+        return _node_strdup(arena, string);
+
+    memcpy(inline_buffer, string, string_bytes);
+    return inline_buffer;
+}
+
+/*
+ * [INTERNAL FUNCTION]
+ * Frees a string obtained from _node_string_store(). Strings stored inline are left alone.
+ */
+void _node_string_free(id3_arena* arena, char* inline_buffer, char* string) {
+    if (string != inline_buffer)
+        _node_free(arena, string);
 }
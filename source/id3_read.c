@@ -0,0 +1,337 @@
+#include <stdio.h>
+
+#include "../include/id3_alloc.h"
+#include "../include/id3_crc32.h"
+#include "../include/id3_read.h"
+
+#define _HEADER_LENGTH 10
+#define _EXTENDED_HEADER_SIZE_LENGTH 4
+#define _FRAME_HEADER_LENGTH 10
+
+#define _HEADER_FLAG_UNSYNCHRONISATION 0x80
+#define _HEADER_FLAG_EXTENDED_HEADER 0x40
+
+#define _EXTENDED_HEADER_MINIMUM_LENGTH 6
+#define _EXTENDED_HEADER_FLAG_CRC 0x80  // first of the 2 extended flag bytes
+
+// Bytes id3_read_tag() reads first, enough for the leading frames of a read optimised tag.
+#define _READ_INITIAL_BYTES 4096
+
+// ["PRIVATE" FUNCTIONS] /////////////////////////////////////////////
+
+unsigned int _tag_reader_read_header(id3_reader* reader, const uint8_t* bytes, size_t num_bytes, size_t* bytes_needed);
+uint64_t _tag_reader_wanted_mask(const id3_reader* reader, uint32_t frame_id);
+unsigned int _four_byte_to_integer(const uint8_t* bytes, int is_syncsafe);
+//////////////////////////////////////////////////////////////////////
+
+/*
+ * Sets up a reader to read a tag from its start (see id3_read.h).
+ * - frame_ids is not copied, it must outlive the reader.
+ *
+ * Usage:
+ * const uint32_t wanted[] = {ID3_FRAME_TIT2, ID3_FRAME_TPE1};
+ * id3_reader reader;
+ * id3_reader_init(&reader, wanted, 2, 1);
+ *
+ * Returns (success): TAG_CREATE_SUCCESS
+ * Returns (failure): TAG_INVALID_VALUE if more than ID3_READ_MAX_FRAME_IDS frame IDs are given
+ */
+unsigned int id3_reader_init(id3_reader* reader, const uint32_t* frame_ids, unsigned int num_frame_ids, int is_early_exit) {
+    if (num_frame_ids > ID3_READ_MAX_FRAME_IDS)
+        return TAG_INVALID_VALUE;
+
+    if (frame_ids == NULL)
+        num_frame_ids = 0;
+
+    *reader = (id3_reader){.frame_ids = frame_ids, .num_frame_ids = num_frame_ids, .is_early_exit = is_early_exit && num_frame_ids > 0,
+                           .found_mask = 0, .offset = 0, .tag_end = 0, .frames_end = 0, .is_crc_checked = 0, .expected_crc = 0, .crc = 0, .is_done = 0};
+
+    return TAG_CREATE_SUCCESS;
+}
+
+/*
+ * Returns the next frame looked for, given the first num_bytes bytes of the file (always from its very start, every call).
+ * - If bytes does not reach far enough, bytes_needed receives how many bytes from the start of the file the next call needs at least.
+ * - frame->content points into bytes.
+ *
+ * Usage:
+ * while ((outcome = id3_reader_next(&reader, bytes, num_bytes, &frame, &bytes_needed)) != TAG_READ_SUCCESS) {
+ *     if (outcome == TAG_READ_FRAME) ... use frame ...
+ *     else if (outcome == TAG_READ_NEED_MORE) ... fetch up to bytes_needed (or more) into bytes ...
+ *     else ... not an ID3v2.3 tag ...
+ * }
+ *
+ * Returns (success): TAG_READ_FRAME with frame filled in, TAG_READ_NEED_MORE with bytes_needed filled in,
+ *                    TAG_READ_SUCCESS once every frame looked for is found (is_early_exit) or the end of the frames is reached
+ * Returns (failure): TAG_INVALID_VALUE if bytes does not start with an ID3v2.3 tag, the tag is unsynchronised or a frame runs past its end,
+ *                    TAG_CRC_MISMATCH once the end of the frames is reached if their CRC is not the one in the extended header
+ */
+unsigned int id3_reader_next(id3_reader* reader, const uint8_t* bytes, size_t num_bytes, id3_read_frame* frame, size_t* bytes_needed) {
+    if (reader->is_done)
+        return TAG_READ_SUCCESS;
+
+    if (reader->offset == 0) {
+        unsigned int header_outcome = _tag_reader_read_header(reader, bytes, num_bytes, bytes_needed);
+        if (header_outcome != TAG_READ_SUCCESS)
+            return header_outcome;
+    }
+
+    while (reader->offset <= reader->frames_end && reader->frames_end - reader->offset >= _FRAME_HEADER_LENGTH) {
+        if (num_bytes < (size_t)reader->offset + _FRAME_HEADER_LENGTH) {
+            *bytes_needed = (size_t)reader->offset + _FRAME_HEADER_LENGTH;
+            return TAG_READ_NEED_MORE;
+        }
+
+        // padding, no frame ID starts with 0x00
+        const uint8_t* frame_header = bytes + reader->offset;
+        if (frame_header[0] == 0x00)
+            break;
+
+        uint32_t frame_id = ID3_FOURCC(frame_header[0], frame_header[1], frame_header[2], frame_header[3]);
+        unsigned int content_bytes = _four_byte_to_integer(frame_header + 4, 0);
+        if (content_bytes > reader->frames_end - reader->offset - _FRAME_HEADER_LENGTH)
+            return TAG_INVALID_VALUE;
+
+        unsigned int frame_end = reader->offset + _FRAME_HEADER_LENGTH + content_bytes;
+
+        uint64_t wanted_mask = _tag_reader_wanted_mask(reader, frame_id);
+        int is_wanted = reader->num_frame_ids == 0 || wanted_mask != 0;
+
+        if (num_bytes < frame_end && (is_wanted || reader->is_crc_checked)) {
+            *bytes_needed = frame_end;
+            return TAG_READ_NEED_MORE;
+        }
+
+        if (reader->is_crc_checked)
+            reader->crc = id3_crc32(reader->crc, frame_header, frame_end - reader->offset);
+
+        if (!is_wanted) {
+            reader->offset = frame_end;
+            continue;
+        }
+
+        *frame = (id3_read_frame){.frame_id = frame_id,
+                                  .flags = (uint16_t)((frame_header[8] << 8) | frame_header[9]),
+                                  .content = frame_header + _FRAME_HEADER_LENGTH,
+                                  .content_bytes = content_bytes};
+        reader->offset = frame_end;
+        reader->found_mask |= wanted_mask;
+
+        uint64_t all_mask = reader->num_frame_ids == 64 ? ~(uint64_t)0 : ((uint64_t)1 << reader->num_frame_ids) - 1;
+        if (reader->is_early_exit && reader->found_mask == all_mask)
+            reader->is_done = 1;
+
+        return TAG_READ_FRAME;
+    }
+
+    // whatever lies between the last frame and the padding is checksummed as well
+    if (reader->is_crc_checked) {
+        if (reader->offset > reader->frames_end)
+            return TAG_INVALID_VALUE;
+        if (num_bytes < reader->frames_end) {
+            *bytes_needed = reader->frames_end;
+            return TAG_READ_NEED_MORE;
+        }
+
+        reader->crc = id3_crc32(reader->crc, bytes + reader->offset, reader->frames_end - reader->offset);
+        reader->offset = reader->frames_end;
+    }
+
+    reader->is_done = 1;
+
+    if (reader->is_crc_checked && reader->crc != reader->expected_crc)
+        return TAG_CRC_MISMATCH;
+
+    return TAG_READ_SUCCESS;
+}
+
+/*
+ * Reads the frames looked for from the tag at the start of a file, passing each to on_frame, reading no further into the file than needed.
+ * - The file is read in growing chunks, with is_early_exit usually just the first one for tags written with ID3_FRAME_LAYOUT_READ_OPTIMIZED.
+ * - frame->content is only valid during the call to on_frame.
+ * - bytes_read, if not NULL, receives how many bytes of the file were read.
+ *
+ * Usage:
+ * const uint32_t wanted[] = {ID3_FRAME_TIT2, ID3_FRAME_TPE1, ID3_FRAME_TALB};
+ * id3_read_tag("./song.mp3", wanted, 3, 1, print_frame, NULL, NULL);
+ *
+ * Returns (success): TAG_READ_SUCCESS
+ * Returns (failure): TAG_FILE_ERROR, NODE_MEMORY_ERROR, TAG_INVALID_VALUE if the file does not start with a complete ID3v2.3 tag,
+ *                    TAG_CRC_MISMATCH, see id3_reader_next()
+ */
+unsigned int id3_read_tag(const char* file_path, const uint32_t* frame_ids, unsigned int num_frame_ids, int is_early_exit,
+                          void (*on_frame)(const id3_read_frame* frame, void* user_data), void* user_data, size_t* bytes_read) {
+    if (bytes_read != NULL)
+        *bytes_read = 0;
+
+    id3_reader reader;
+    if (id3_reader_init(&reader, frame_ids, num_frame_ids, is_early_exit) != TAG_CREATE_SUCCESS)
+        return TAG_INVALID_VALUE;
+
+    FILE* file_ptr = fopen(file_path, "rb");
+    if (file_ptr == NULL)
+        return TAG_FILE_ERROR;
+
+    size_t buffer_bytes = _READ_INITIAL_BYTES;
+    uint8_t* buffer = (uint8_t*)ID3_MALLOC(buffer_bytes);
+    if (buffer == NULL) {
+        fclose(file_ptr);
+        return NODE_MEMORY_ERROR;
+    }
+
+    size_t num_bytes = 0;
+    int is_end_of_file = 0;
+    unsigned int outcome;
+
+    while (1) {
+        id3_read_frame frame;
+        size_t bytes_needed;
+
+        outcome = id3_reader_next(&reader, buffer, num_bytes, &frame, &bytes_needed);
+        if (outcome == TAG_READ_FRAME) {
+            on_frame(&frame, user_data);
+            continue;
+        }
+        if (outcome != TAG_READ_NEED_MORE)
+            break;
+
+        // the file ends before the tag does
+        if (is_end_of_file) {
+            outcome = TAG_INVALID_VALUE;
+            break;
+        }
+
+        // grow geometrically, but never past the end of the tag once known
+        if (bytes_needed > buffer_bytes) {
+            size_t grown_bytes = buffer_bytes * 2;
+            if (reader.tag_end != 0 && grown_bytes > reader.tag_end)
+                grown_bytes = reader.tag_end;
+            if (grown_bytes < bytes_needed)
+                grown_bytes = bytes_needed;
+
+            uint8_t* grown_buffer = (uint8_t*)ID3_REALLOC(buffer, grown_bytes);
+            if (grown_buffer == NULL) {
+                outcome = NODE_MEMORY_ERROR;
+                break;
+            }
+
+            buffer = grown_buffer;
+            buffer_bytes = grown_bytes;
+        }
+
+        num_bytes += fread(buffer + num_bytes, 1, buffer_bytes - num_bytes, file_ptr);
+        if (num_bytes < bytes_needed)
+            is_end_of_file = 1;
+    }
+
+    ID3_FREE(buffer);
+    fclose(file_ptr);
+
+    if (bytes_read != NULL)
+        *bytes_read = num_bytes;
+
+    return outcome;
+}
+
+/*
+ * [INTERNAL FUNCTION]
+ * Reads the tag header and the extended header, if any, setting up the reader to read the frames.
+ *
+ * Returns (success): TAG_READ_SUCCESS
+ * Returns (failure): TAG_READ_NEED_MORE with bytes_needed filled in, TAG_INVALID_VALUE
+ */
+unsigned int _tag_reader_read_header(id3_reader* reader, const uint8_t* bytes, size_t num_bytes, size_t* bytes_needed) {
+    /*
+     * [ID3v2 main header overview]
+     * File Identifier	"ID3" (0x49, 0x44, 0x33)
+     * Version			$03 00
+     * Flags			% abc00000
+     * Size				4 * %0xxxxxxx (with 28bit technology)
+     */
+    if (num_bytes < _HEADER_LENGTH) {
+        *bytes_needed = _HEADER_LENGTH;
+        return TAG_READ_NEED_MORE;
+    }
+
+    if (bytes[0] != 0x49 || bytes[1] != 0x44 || bytes[2] != 0x33 || bytes[3] != 0x03 || (bytes[5] & _HEADER_FLAG_UNSYNCHRONISATION))
+        return TAG_INVALID_VALUE;
+    if ((bytes[6] | bytes[7] | bytes[8] | bytes[9]) & 0x80)
+        return TAG_INVALID_VALUE;
+
+    unsigned int tag_end = _HEADER_LENGTH + _four_byte_to_integer(bytes + 6, 1);
+    unsigned int frames_offset = _HEADER_LENGTH;
+    unsigned int padding_bytes = 0;
+
+    /*
+     * [ID3v2 extended header overview]
+     * Extended header size	$xx xx xx xx (6 or 10, excluding itself)
+     * Extended flags		$xx xx (0x8000: CRC data present)
+     * Size of padding		$xx xx xx xx
+     * Total frame CRC		$xx xx xx xx (only if CRC data present)
+     */
+    if (bytes[5] & _HEADER_FLAG_EXTENDED_HEADER) {
+        if (num_bytes < _HEADER_LENGTH + _EXTENDED_HEADER_SIZE_LENGTH) {
+            *bytes_needed = _HEADER_LENGTH + _EXTENDED_HEADER_SIZE_LENGTH;
+            return TAG_READ_NEED_MORE;
+        }
+
+        // compared without subtracting, a tag too small for its extended header must not wrap around
+        unsigned int extended_header_bytes = _four_byte_to_integer(bytes + _HEADER_LENGTH, 0);
+        if (extended_header_bytes < _EXTENDED_HEADER_MINIMUM_LENGTH || extended_header_bytes > tag_end ||
+            tag_end < _HEADER_LENGTH + _EXTENDED_HEADER_SIZE_LENGTH + extended_header_bytes)
+            return TAG_INVALID_VALUE;
+
+        frames_offset += _EXTENDED_HEADER_SIZE_LENGTH + extended_header_bytes;
+        if (num_bytes < frames_offset) {
+            *bytes_needed = frames_offset;
+            return TAG_READ_NEED_MORE;
+        }
+
+        const uint8_t* extended_header = bytes + _HEADER_LENGTH + _EXTENDED_HEADER_SIZE_LENGTH;
+        padding_bytes = _four_byte_to_integer(extended_header + 2, 0);
+        if (padding_bytes > tag_end || frames_offset + padding_bytes > tag_end)
+            return TAG_INVALID_VALUE;
+
+        // only worth checking if every frame is going to be passed
+        if ((extended_header[0] & _EXTENDED_HEADER_FLAG_CRC) && !reader->is_early_exit) {
+            if (extended_header_bytes < _EXTENDED_HEADER_MINIMUM_LENGTH + 4)
+                return TAG_INVALID_VALUE;
+
+            reader->is_crc_checked = 1;
+            reader->expected_crc = _four_byte_to_integer(extended_header + 6, 0);
+        }
+    }
+
+    reader->offset = frames_offset;
+    reader->tag_end = tag_end;
+    reader->frames_end = tag_end - padding_bytes;
+
+    return TAG_READ_SUCCESS;
+}
+
+/*
+ * [INTERNAL FUNCTION]
+ * Finds which of the frames looked for a frame is.
+ *
+ * Returns: bit i set if frame_ids[i] is frame_id, 0 if not looked for
+ */
+uint64_t _tag_reader_wanted_mask(const id3_reader* reader, uint32_t frame_id) {
+    uint64_t wanted_mask = 0;
+
+    for (unsigned int i = 0; i < reader->num_frame_ids; i++) {
+        if (reader->frame_ids[i] == frame_id)
+            wanted_mask |= (uint64_t)1 << i;
+    }
+
+    return wanted_mask;
+}
+
+/*
+ * [INTERNAL FUNCTION]
+ * Reads 4 big endian bytes, 7 bits each if is_syncsafe (tag size), 8 bits each otherwise (frame sizes).
+ */
+unsigned int _four_byte_to_integer(const uint8_t* bytes, int is_syncsafe) {
+    unsigned int shift = is_syncsafe ? 7 : 8;
+
+    return ((unsigned int)bytes[0] << (3 * shift)) | ((unsigned int)bytes[1] << (2 * shift)) | ((unsigned int)bytes[2] << shift) | (unsigned int)bytes[3];
+}
@@ -0,0 +1,71 @@
+// clock_gettime() is POSIX
+#define _POSIX_C_SOURCE 200809L
+
+#include <stddef.h>
+#include <time.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#include "../include/id3_stats.h"
+
+/*
+ * Sets every counter of stats to 0.
+ *
+ * Usage:
+ * id3_stats stats;
+ * id3_stats_init(&stats);
+ * master_tag_collection.stats = &stats;
+ */
+void id3_stats_init(id3_stats* stats) {
+#define _STATS_INIT_COUNTER(name) atomic_init(&stats->name, 0);
+    ID3_STATS_COUNTERS(_STATS_INIT_COUNTER)
+#undef _STATS_INIT_COUNTER
+}
+
+/*
+ * Reads every counter of stats into snapshot. Counters are read one by one, tags being written meanwhile may show up in some counters only.
+ *
+ * Usage:
+ * id3_stats_snapshot snapshot;
+ * id3_stats_read(&context.stats, &snapshot);
+ * printf("%llu tags, %llu ns\n", snapshot.tags_written, snapshot.write_ns);
+ */
+void id3_stats_read(id3_stats* stats, id3_stats_snapshot* snapshot) {
+#define _STATS_LOAD_COUNTER(name) snapshot->name = atomic_load_explicit(&stats->name, memory_order_relaxed);
+    ID3_STATS_COUNTERS(_STATS_LOAD_COUNTER)
+#undef _STATS_LOAD_COUNTER
+}
+
+/*
+ * Sets every counter of stats back to 0.
+ * - snapshot, if not NULL, receives the values replaced, so that scraping and resetting together loses no counts.
+ */
+void id3_stats_reset(id3_stats* stats, id3_stats_snapshot* snapshot) {
+    id3_stats_snapshot discarded;
+    if (snapshot == NULL)
+        snapshot = &discarded;
+
+#define _STATS_EXCHANGE_COUNTER(name) snapshot->name = atomic_exchange_explicit(&stats->name, 0, memory_order_relaxed);
+    ID3_STATS_COUNTERS(_STATS_EXCHANGE_COUNTER)
+#undef _STATS_EXCHANGE_COUNTER
+}
+
+/*
+ * Reads a monotonic clock, in nanoseconds from an arbitrary starting point.
+ */
+uint64_t id3_stats_clock_ns() {
+#ifdef _WIN32
+    LARGE_INTEGER counter, frequency;
+    QueryPerformanceCounter(&counter);
+    QueryPerformanceFrequency(&frequency);
+
+    return (uint64_t)(counter.QuadPart / frequency.QuadPart) * 1000000000ULL + (uint64_t)(counter.QuadPart % frequency.QuadPart) * 1000000000ULL / frequency.QuadPart;
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+#endif
+}
@@ -0,0 +1,249 @@
+#include <stdio.h>
+#include <string.h>
+
+#ifdef ID3_ENABLE_TRACING
+#include <pthread.h>
+#include <stdatomic.h>
+#endif
+
+#include "../include/id3_alloc.h"
+#include "../include/id3_stats.h"
+#include "../include/id3_trace.h"
+
+#ifdef ID3_ENABLE_TRACING
+
+/*
+ * A span, as a Chrome "complete" event.
+ *
+ * name: Span name, a string literal.
+ */
+typedef struct {
+    const char* name;
+    uint64_t start_ns;
+    uint64_t duration_ns;
+} _trace_event;
+
+/*
+ * Spans recorded by one thread.
+ *
+ * num_recorded: Spans recorded so far, the last ID3_TRACE_RING_EVENTS of them are in events.
+ * thread_number: Trace thread ID, in the order threads started recording.
+ */
+typedef struct _trace_ring {
+    _trace_event events[ID3_TRACE_RING_EVENTS];
+    uint64_t num_recorded;
+    unsigned int thread_number;
+    struct _trace_ring* next;
+} _trace_ring;
+
+/*
+ * _trace_is_active: Whether spans are being recorded.
+ * _trace_generation: Incremented by id3_trace_stop(), rings of an older generation have been freed.
+ * _trace_mutex: Guards everything below, only taken when a thread records its first span and when starting or stopping.
+ */
+static atomic_int _trace_is_active = 0;
+static atomic_uint _trace_generation = 0;
+static pthread_mutex_t _trace_mutex = PTHREAD_MUTEX_INITIALIZER;
+static _trace_ring* _trace_rings = NULL;
+static unsigned int _trace_num_threads = 0;
+static char* _trace_file_path = NULL;
+static uint64_t _trace_origin_ns = 0;
+
+static _Thread_local _trace_ring* _trace_thread_ring = NULL;
+static _Thread_local unsigned int _trace_thread_generation = 0;
+
+// ["PRIVATE" FUNCTIONS] /////////////////////////////////////////////
+
+_trace_ring* _trace_ring_for_thread();
+int _trace_write_json(FILE* file_ptr);
+//////////////////////////////////////////////////////////////////////
+
+#endif
+
+/*
+ * Starts recording spans, to be written to json_file_path by id3_trace_stop().
+ *
+ * Usage:
+ * id3_trace_start("./id3_trace.json");
+ * ... tag files, on any number of threads ...
+ * id3_trace_stop();
+ *
+ * Returns (success): 1
+ * Returns (failure): 0 if already started, memory runs out or the library was built without ID3_ENABLE_TRACING
+ */
+int id3_trace_start(const char* json_file_path) {
+#ifdef ID3_ENABLE_TRACING
+    pthread_mutex_lock(&_trace_mutex);
+
+    if (atomic_load(&_trace_is_active)) {
+        pthread_mutex_unlock(&_trace_mutex);
+        return 0;
+    }
+
+    _trace_file_path = (char*)ID3_MALLOC(strlen(json_file_path) + 1);
+    if (_trace_file_path == NULL) {
+        pthread_mutex_unlock(&_trace_mutex);
+        return 0;
+    }
+
+    strcpy(_trace_file_path, json_file_path);
+    _trace_origin_ns = id3_stats_clock_ns();
+    _trace_num_threads = 0;
+    atomic_store(&_trace_is_active, 1);
+
+    pthread_mutex_unlock(&_trace_mutex);
+
+    return 1;
+#else
+    (void)json_file_path;
+    return 0;
+#endif
+}
+
+/*
+ * Stops recording spans and writes those recorded since id3_trace_start() to its file, then frees every ring buffer.
+ *
+ * Returns (success): 1
+ * Returns (failure): 0 if not started or the file cannot be written
+ */
+int id3_trace_stop() {
+#ifdef ID3_ENABLE_TRACING
+    pthread_mutex_lock(&_trace_mutex);
+
+    if (!atomic_load(&_trace_is_active)) {
+        pthread_mutex_unlock(&_trace_mutex);
+        return 0;
+    }
+
+    atomic_store(&_trace_is_active, 0);
+    atomic_fetch_add(&_trace_generation, 1);
+
+    FILE* file_ptr = fopen(_trace_file_path, "wb");
+    int is_written = file_ptr != NULL && _trace_write_json(file_ptr);
+    if (file_ptr != NULL && fclose(file_ptr) != 0)
+        is_written = 0;
+
+    while (_trace_rings != NULL) {
+        _trace_ring* free_ring = _trace_rings;
+        _trace_rings = _trace_rings->next;
+        ID3_FREE(free_ring);
+    }
+
+    ID3_FREE(_trace_file_path);
+    _trace_file_path = NULL;
+
+    pthread_mutex_unlock(&_trace_mutex);
+
+    return is_written;
+#else
+    return 0;
+#endif
+}
+
+/*
+ * Starts a span, see ID3_TRACE_SPAN().
+ *
+ * Returns: start time to pass to id3_trace_end(), 0 if not tracing
+ */
+uint64_t id3_trace_begin() {
+#ifdef ID3_ENABLE_TRACING
+    if (!atomic_load_explicit(&_trace_is_active, memory_order_relaxed))
+        return 0;
+
+    return id3_stats_clock_ns();
+#else
+    return 0;
+#endif
+}
+
+/*
+ * Ends a span started with id3_trace_begin(), recording it into the calling thread's ring buffer.
+ * - name must be a string literal (or otherwise outlive id3_trace_stop()) without characters that need escaping in JSON.
+ */
+void id3_trace_end(const char* name, uint64_t start_ns) {
+#ifdef ID3_ENABLE_TRACING
+    if (start_ns == 0)
+        return;
+
+    uint64_t end_ns = id3_stats_clock_ns();
+
+    _trace_ring* ring = _trace_ring_for_thread();
+    if (ring == NULL)
+        return;
+
+    ring->events[ring->num_recorded % ID3_TRACE_RING_EVENTS] = (_trace_event){.name = name, .start_ns = start_ns, .duration_ns = end_ns - start_ns};
+    ring->num_recorded++;
+#else
+    (void)name;
+    (void)start_ns;
+#endif
+}
+
+#ifdef ID3_ENABLE_TRACING
+
+/*
+ * [INTERNAL FUNCTION]
+ * Gets the calling thread's ring buffer for the current trace, creating it on first use.
+ *
+ * Returns (success): the ring buffer
+ * Returns (failure): NULL if tracing stopped meanwhile or memory runs out
+ */
+_trace_ring* _trace_ring_for_thread() {
+    unsigned int generation = atomic_load_explicit(&_trace_generation, memory_order_relaxed);
+    if (_trace_thread_ring != NULL && _trace_thread_generation == generation)
+        return _trace_thread_ring;
+
+    pthread_mutex_lock(&_trace_mutex);
+
+    _trace_ring* ring = NULL;
+    if (atomic_load(&_trace_is_active))
+        ring = (_trace_ring*)ID3_MALLOC(sizeof(_trace_ring));
+
+    if (ring != NULL) {
+        ring->num_recorded = 0;
+        ring->thread_number = ++_trace_num_threads;
+        ring->next = _trace_rings;
+        _trace_rings = ring;
+    }
+
+    pthread_mutex_unlock(&_trace_mutex);
+
+    _trace_thread_ring = ring;
+    _trace_thread_generation = generation;
+
+    return ring;
+}
+
+/*
+ * [INTERNAL FUNCTION]
+ * Writes every recorded span as Chrome trace-event JSON, times in microseconds since id3_trace_start().
+ *
+ * Returns (success): 1
+ * Returns (failure): 0
+ */
+int _trace_write_json(FILE* file_ptr) {
+    int is_first_event = 1;
+
+    fputs("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[", file_ptr);
+
+    for (_trace_ring* iter_ring = _trace_rings; iter_ring != NULL; iter_ring = iter_ring->next) {
+        uint64_t first_event = iter_ring->num_recorded > ID3_TRACE_RING_EVENTS ? iter_ring->num_recorded - ID3_TRACE_RING_EVENTS : 0;
+
+        for (uint64_t i = first_event; i < iter_ring->num_recorded; i++) {
+            const _trace_event* event = &iter_ring->events[i % ID3_TRACE_RING_EVENTS];
+            uint64_t since_origin_ns = event->start_ns > _trace_origin_ns ? event->start_ns - _trace_origin_ns : 0;
+
+            fprintf(file_ptr, "%s\n{\"name\":\"%s\",\"cat\":\"id3\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%llu.%03u,\"dur\":%llu.%03u}",
+                    is_first_event ? "" : ",", event->name, iter_ring->thread_number,
+                    (unsigned long long)(since_origin_ns / 1000), (unsigned int)(since_origin_ns % 1000),
+                    (unsigned long long)(event->duration_ns / 1000), (unsigned int)(event->duration_ns % 1000));
+            is_first_event = 0;
+        }
+    }
+
+    fputs("\n]}\n", file_ptr);
+
+    return !ferror(file_ptr);
+}
+
+#endif
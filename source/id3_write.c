@@ -1,16 +1,76 @@
+#include "../include/id3_crc32.h"
+#include "../include/id3_trace.h"
 #include "../include/id3_write.h"
 
 #define _USE_28BIT_FORMAT_SIZE 0
 #define _USE_32BIT_FORMAT_SIZE 1
 
-uint8_t default_flags[2] = {0x00, 0x00};
+#define _HEADER_FLAG_EXTENDED_HEADER 0x40
+
+// Offset of the CRC in a tag with an extended header: main header, then extended header size, flags and padding size.
+#define _EXTENDED_HEADER_CRC_OFFSET 20
+
+// Bytes of a picture file read and written at a time.
+#define _PICTURE_COPY_CHUNK_BYTES 16384
+
+#define _FRAME_KIND_BASE 0
+#define _FRAME_KIND_TEXT 1
+#define _FRAME_KIND_COMMENT 2
+#define _FRAME_KIND_USER 3
+#define _FRAME_KIND_PICTURE 4
+
+/*
+ * [INTERNAL STRUCT]
+ * A frame to be written with ID3_FRAME_LAYOUT_READ_OPTIMIZED, sorted by rank, then frame_bytes, then sequence.
+ *
+ * frame: Node of the kind given by frame_kind, or id3_base_tag_frame of a base frame.
+ * frame_bytes: Size of the frame including its header.
+ * rank: Position in the leading frames, number of leading frames for other frames, one more than that for pictures.
+ * sequence: Position in list order, keeps sorting stable.
+ */
+typedef struct {
+    uint8_t frame_kind;
+    const void* frame;
+    unsigned int frame_bytes;
+    unsigned int rank;
+    unsigned int sequence;
+} _frame_ref;
+
+/*
+ * [INTERNAL STRUCT]
+ * A tag being written, passed to every function writing part of it.
+ *
+ * stats: Statistics to update, NULL for none.
+ * crc: CRC-32 of everything written since is_crc_enabled was set, see id3_crc32().
+ */
+typedef struct {
+    FILE* file_ptr;
+    id3_stats* stats;
+    int is_crc_enabled;
+    uint32_t crc;
+} _tag_writer;
+
+// Leading frames of ID3_FRAME_LAYOUT_READ_OPTIMIZED unless given, those players and file browsers show first.
+static const uint32_t _DEFAULT_LEADING_FRAME_IDS[] = {ID3_FRAME_TIT2, ID3_FRAME_TPE1, ID3_FRAME_TALB, ID3_FRAME_TRCK, ID3_FRAME_TPOS,
+                                                      ID3_FRAME_TYER, ID3_FRAME_TCON, ID3_FRAME_TPE2, ID3_FRAME_TLEN};
 
 // ["PRIVATE" FUNCTIONS] /////////////////////////////////////////////
 
-void _write_text_tag(FILE* file_ptr, id3_text_tag_node* node);
-void _write_comment_tag(FILE* file_ptr, id3_comment_tag_node* node);
-void _write_picture_tag(FILE* file_ptr, id3_picture_tag_node* node);
+unsigned int _write_tag(char* file_path, const id3_base_tag* base_tag, id3_master_tag_struct overlay_tag_collection, char* io_buffer, size_t io_buffer_bytes);
+void _write_text_tag(_tag_writer* writer, id3_text_tag_node* node);
+void _write_comment_tag(_tag_writer* writer, id3_comment_tag_node* node);
+void _write_user_tag(_tag_writer* writer, id3_user_tag_node* node);
+unsigned int _write_picture_tag(_tag_writer* writer, id3_picture_tag_node* node);
+unsigned int _write_picture_data(_tag_writer* writer, id3_picture_tag_node* node);
+unsigned int _write_frames_in_list_order(_tag_writer* writer, const id3_base_tag* base_tag, id3_master_tag_struct overlay_tag_collection);
+unsigned int _write_frames_in_layout_order(_tag_writer* writer, const id3_base_tag* base_tag, const _frame_ref* frame_order, unsigned int num_frames);
+_frame_ref* _frame_order_create(const id3_base_tag* base_tag, id3_master_tag_struct overlay_tag_collection, unsigned int* num_frames);
+void _frame_order_add(_frame_ref* frame_ref, uint8_t frame_kind, const void* frame, uint32_t frame_id, unsigned int frame_bytes, unsigned int sequence,
+                      id3_master_tag_struct overlay_tag_collection);
+int _frame_ref_compare(const void* first, const void* second);
 void _integer_to_four_byte(unsigned int convertee, unsigned char* converted, int format_as);
+void _write_frame_header(_tag_writer* writer, uint32_t frame_id, unsigned int frame_size, uint16_t frame_flags);
+void _write_bytes(_tag_writer* writer, const void* bytes, size_t num_bytes);
 //////////////////////////////////////////////////////////////////////
 
 /*
@@ -18,43 +78,62 @@ void _integer_to_four_byte(unsigned int convertee, unsigned char* converted, int
  * [UTF-16]
  * 0xFF 0xFE (Unicode BOM) + <string> + 0x00 0x00 (Unicode NULL)
  *
- * [ISO-8859-1 aka ASCII]
+ * [ISO-8859-1 aka Latin-1, ASCII plus U+0080 to U+00FF]
  * <string> + 0x00 (NULL terminator)
  */
 
 /*
- * Writes tags to a file specified at file_path. Overwrites existing file if it exists.
- * - Pass in a id3_master_tag_struct which is initialised with the addresses of tag pointers.
- * - If any pointer to the id3_master_tag_struct is NULL, no tags of that type will be written.
+ * Encodes every dirty node referenced by a id3_master_tag_struct and computes the size of the resulting tag.
+ * - tag_bytes receives the size stored in the ID3v2 header, i.e. every frame including its header, but not the 10 byte ID3v2 header itself
+ *   (nor the 14 byte extended header written with is_crc_enabled).
+ * - Nodes are only encoded once, id3_write_tag() will not encode them again unless they are updated in between.
+ * - Text, comment and user frames are then compressed according to compression_threshold_bytes, see id3_text_tag_list_compress().
+ * - Frames encoded and time spent are added to stats, if set.
  *
  * Usage:
- * id3_text_tag_node *tag_list = NULL;
- * id3_text_tag_node_add_update(&text_tag_list, "TALB", "Selection 3"); // repeat as many times as needed
- *
- * id3_master_tag_struct master_tag_collection;
- * id3_init_master_tag(&master_tag_collection);
- * master_tag_collection.text_tag_list = &tag_list;
+ * unsigned int tag_bytes;
+ * if (id3_master_tag_size(master_tag_collection, &tag_bytes) == TAG_ENCODE_SUCCESS) ...
  *
- * id3_write_tag("./song.mp3", master_tag_collection)
+ * Returns (success): TAG_ENCODE_SUCCESS
+ * Returns (failure): see id3_*_tag_list_encode(), id3_*_tag_list_compress()
  */
-void id3_write_tag(char* file_path, id3_master_tag_struct master_tag_collection) {
-    /*
-     * [ID3v2 main header overview]
-     * File Identifier	"ID3" (0x49, 0x44, 0x33)
-     * Version			$03 00
-     * Flags			% abc00000 (tldr 0b00000000)
-     * Size				4 * %0xxxxxxx (with 28bit technology)
-     */
-    uint8_t id3v2_header_without_size[6] = {0x49, 0x44, 0x33, 0x03, 0x00, 0x00};
-    uint8_t id3v2_header_size_hex[4] = {0x00, 0x00, 0x00, 0x00};
+unsigned int id3_master_tag_size(id3_master_tag_struct master_tag_collection, unsigned int* tag_bytes) {
+    id3_stats* stats = master_tag_collection.stats;
+    uint64_t start_ns = stats != NULL ? id3_stats_clock_ns() : 0;
+    unsigned int encode_outcome = TAG_ENCODE_SUCCESS;
     unsigned int id3v2_header_size = 0;
 
+    // encode (and compress) dirty nodes
+    if (master_tag_collection.text_tag_list != NULL) {
+        encode_outcome = id3_text_tag_list_encode(master_tag_collection.text_tag_list, stats);
+        if (encode_outcome == TAG_ENCODE_SUCCESS)
+            encode_outcome = id3_text_tag_list_compress(master_tag_collection.text_tag_list, master_tag_collection.compression_threshold_bytes);
+    }
+    if (encode_outcome == TAG_ENCODE_SUCCESS && master_tag_collection.comment_tag_list != NULL) {
+        encode_outcome = id3_comment_tag_list_encode(master_tag_collection.comment_tag_list, stats);
+        if (encode_outcome == TAG_ENCODE_SUCCESS)
+            encode_outcome = id3_comment_tag_list_compress(master_tag_collection.comment_tag_list, master_tag_collection.compression_threshold_bytes);
+    }
+    if (encode_outcome == TAG_ENCODE_SUCCESS && master_tag_collection.user_tag_list != NULL) {
+        encode_outcome = id3_user_tag_list_encode(master_tag_collection.user_tag_list, stats);
+        if (encode_outcome == TAG_ENCODE_SUCCESS)
+            encode_outcome = id3_user_tag_list_compress(master_tag_collection.user_tag_list, master_tag_collection.compression_threshold_bytes);
+    }
+    if (encode_outcome == TAG_ENCODE_SUCCESS && master_tag_collection.picture_tag_list != NULL)
+        encode_outcome = id3_picture_tag_list_encode(master_tag_collection.picture_tag_list, stats);
+
+    uint64_t encoded_ns = stats != NULL ? id3_stats_clock_ns() : 0;
+    ID3_STATS_ADD(stats, encode_ns, encoded_ns - start_ns);
+
+    if (encode_outcome != TAG_ENCODE_SUCCESS)
+        return encode_outcome;
+
     // count size of text tags
     if (master_tag_collection.text_tag_list != NULL) {
         id3_text_tag_node* iter_node = *(master_tag_collection.text_tag_list);
-        // size of each text tag is 10 (frame size) + string content
+        // size of each text tag is 10 (frame size) + string content, or its compressed form
         while (iter_node != NULL) {
-            id3v2_header_size += 10 + iter_node->num_id3_bytes;
+            id3v2_header_size += 10 + (iter_node->compressed_payload != NULL ? iter_node->compressed_bytes : iter_node->num_id3_bytes);
             iter_node = iter_node->next;
         }
     }
@@ -62,9 +141,19 @@ void id3_write_tag(char* file_path, id3_master_tag_struct master_tag_collection)
     // count size of comment tags
     if (master_tag_collection.comment_tag_list != NULL) {
         id3_comment_tag_node* iter_node = *(master_tag_collection.comment_tag_list);
-        // size of each comment tag is 10 (frame size) + string content
+        // size of each comment tag is 10 (frame size) + string content, or its compressed form
         while (iter_node != NULL) {
-            id3v2_header_size += 10 + iter_node->num_id3_bytes;
+            id3v2_header_size += 10 + (iter_node->compressed_payload != NULL ? iter_node->compressed_bytes : iter_node->num_id3_bytes);
+            iter_node = iter_node->next;
+        }
+    }
+
+    // count size of user tags
+    if (master_tag_collection.user_tag_list != NULL) {
+        id3_user_tag_node* iter_node = master_tag_collection.user_tag_list->head;
+        // size of each user tag is 10 (frame size) + string content, or its compressed form
+        while (iter_node != NULL) {
+            id3v2_header_size += 10 + (iter_node->compressed_payload != NULL ? iter_node->compressed_bytes : iter_node->num_id3_bytes);
             iter_node = iter_node->next;
         }
     }
@@ -79,44 +168,426 @@ void id3_write_tag(char* file_path, id3_master_tag_struct master_tag_collection)
         }
     }
 
+    *tag_bytes = id3v2_header_size;
+
+    if (stats != NULL)
+        ID3_STATS_ADD(stats, size_ns, id3_stats_clock_ns() - encoded_ns);
+
+    return TAG_ENCODE_SUCCESS;
+}
+
+/*
+ * Writes tags to a file specified at file_path. Overwrites existing file if it exists.
+ * - Pass in a id3_master_tag_struct which is initialised with the addresses of tag pointers.
+ * - If any pointer to the id3_master_tag_struct is NULL, no tags of that type will be written.
+ * - Dirty nodes are encoded first (see id3_master_tag_size()), if any fails to encode nothing is written.
+ *
+ * Usage:
+ * id3_text_tag_node *tag_list = NULL;
+ * id3_text_tag_node_add_update(&text_tag_list, "TALB", "Selection 3"); // repeat as many times as needed
+ *
+ * id3_master_tag_struct master_tag_collection;
+ * id3_init_master_tag(&master_tag_collection);
+ * master_tag_collection.text_tag_list = &tag_list;
+ *
+ * id3_write_tag("./song.mp3", master_tag_collection)
+ *
+ * Returns (success): TAG_WRITE_SUCCESS
+ * Returns (failure): TAG_FILE_ERROR if the file cannot be opened or written in full, NODE_FILE_ERROR, see id3_master_tag_size()
+ */
+unsigned int id3_write_tag(char* file_path, id3_master_tag_struct master_tag_collection) {
+    return id3_write_tag_with_base(file_path, NULL, master_tag_collection);
+}
+
+/*
+ * Writes the frames of a base tag (see id3_base_tag.h) together with the frames of an overlay to a file specified at file_path.
+ * - Base frames are copied as they are, except for those replaced by an overlay frame with the same key, which are left out.
+ * - Base frames come first, in the order they were serialized in, followed by the overlay frames.
+ * - base_tag may be NULL, in which case this is the same as id3_write_tag().
+ *
+ * Usage:
+ * id3_text_tag_node_add_update(&track_text_tag_list, "TIT2", "Track 1");
+ * id3_write_tag_with_base("./01.mp3", &album_tag, track_tag_collection);
+ *
+ * Returns: see id3_write_tag()
+ */
+unsigned int id3_write_tag_with_base(char* file_path, const id3_base_tag* base_tag, id3_master_tag_struct overlay_tag_collection) {
+    return id3_write_tag_buffered(file_path, base_tag, overlay_tag_collection, NULL, 0);
+}
+
+/*
+ * Same as id3_write_tag_with_base(), with io_buffer (io_buffer_bytes long) used as the file's stdio buffer instead of one allocated by stdio.
+ * A buffer large enough for the whole tag (picture data aside) means the tag goes out in a handful of write calls and nothing is allocated per file.
+ * - io_buffer may be NULL, in which case stdio buffers the file as usual.
+ * - The buffer is only used during the call, reuse it for the next file.
+ *
+ * Returns: see id3_write_tag()
+ */
+unsigned int id3_write_tag_buffered(char* file_path, const id3_base_tag* base_tag, id3_master_tag_struct overlay_tag_collection, char* io_buffer, size_t io_buffer_bytes) {
+    id3_stats* stats = overlay_tag_collection.stats;
+    uint64_t start_ns = stats != NULL ? id3_stats_clock_ns() : 0;
+
+    unsigned int write_outcome;
+    ID3_TRACE_SPAN("write_tag", write_outcome = _write_tag(file_path, base_tag, overlay_tag_collection, io_buffer, io_buffer_bytes));
+
+    if (stats == NULL)
+        return write_outcome;
+
+    ID3_STATS_ADD(stats, tags_written, write_outcome == TAG_WRITE_SUCCESS);
+    ID3_STATS_ADD(stats, write_ns, id3_stats_clock_ns() - start_ns);
+
+    return write_outcome;
+}
+
+/*
+ * [INTERNAL FUNCTION]
+ * Does the work of id3_write_tag_buffered().
+ */
+unsigned int _write_tag(char* file_path, const id3_base_tag* base_tag, id3_master_tag_struct overlay_tag_collection, char* io_buffer, size_t io_buffer_bytes) {
+    /*
+     * [ID3v2 main header overview]
+     * File Identifier	"ID3" (0x49, 0x44, 0x33)
+     * Version			$03 00
+     * Flags			% abc00000 (tldr 0b00000000)
+     * Size				4 * %0xxxxxxx (with 28bit technology)
+     */
+    uint8_t id3v2_header_without_size[6] = {0x49, 0x44, 0x33, 0x03, 0x00, 0x00};
+    uint8_t id3v2_header_size_hex[4] = {0x00, 0x00, 0x00, 0x00};
+    unsigned int id3v2_header_size = 0;
+
+    /*
+     * [ID3v2 extended header overview]
+     * Extended header size	$xx xx xx xx (10, excluding itself)
+     * Extended flags		$xx xx (0x8000: CRC data present)
+     * Size of padding		$xx xx xx xx (no padding is written)
+     * Total frame CRC		$xx xx xx xx (filled in once every frame is written)
+     */
+    uint8_t extended_header[14] = {0x00, 0x00, 0x00, 0x0A, 0x80, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+    id3_stats* stats = overlay_tag_collection.stats;
+
+    // encode dirty nodes and count size of all overlay tags
+    unsigned int size_outcome;
+    ID3_TRACE_SPAN("size_tag", size_outcome = id3_master_tag_size(overlay_tag_collection, &id3v2_header_size));
+    if (size_outcome != TAG_ENCODE_SUCCESS)
+        return size_outcome;
+
+    // count size of base frames that are kept
+    if (base_tag != NULL) {
+        for (unsigned int i = 0; i < base_tag->num_frames; i++) {
+            if (!id3_base_tag_frame_is_overridden(&base_tag->frame_index[i], overlay_tag_collection))
+                id3v2_header_size += base_tag->frame_index[i].num_bytes;
+        }
+    }
+
+    // the extended header counts towards the tag size
+    if (overlay_tag_collection.is_crc_enabled) {
+        id3v2_header_without_size[5] |= _HEADER_FLAG_EXTENDED_HEADER;
+        id3v2_header_size += sizeof(extended_header);
+    }
+
     // compute total size
     _integer_to_four_byte(id3v2_header_size, id3v2_header_size_hex, _USE_28BIT_FORMAT_SIZE);
 
+    // the read optimised layout is decided before the file is touched, so running out of memory leaves it alone
+    _frame_ref* frame_order = NULL;
+    unsigned int num_ordered_frames = 0;
+    if (overlay_tag_collection.frame_layout == ID3_FRAME_LAYOUT_READ_OPTIMIZED) {
+        frame_order = _frame_order_create(base_tag, overlay_tag_collection, &num_ordered_frames);
+        if (frame_order == NULL)
+            return NODE_MEMORY_ERROR;
+    }
+
     FILE* file_ptr;
-    file_ptr = fopen(file_path, "wb");
+    ID3_TRACE_SPAN("file_open", file_ptr = fopen(file_path, "wb"));
+
+    if (file_ptr == NULL) {
+        ID3_FREE(frame_order);
+        return TAG_FILE_ERROR;
+    }
+
+    ID3_STATS_ADD(stats, files_opened, 1);
+
+    if (io_buffer != NULL)
+        setvbuf(file_ptr, io_buffer, _IOFBF, io_buffer_bytes);
+
+    _tag_writer writer = {.file_ptr = file_ptr, .stats = stats, .is_crc_enabled = 0, .crc = 0};
 
     // write main header
-    fwrite(id3v2_header_without_size, sizeof(id3v2_header_without_size), 1, file_ptr);
-    fwrite(id3v2_header_size_hex, sizeof(id3v2_header_size_hex), 1, file_ptr);
+    _write_bytes(&writer, id3v2_header_without_size, sizeof(id3v2_header_without_size));
+    _write_bytes(&writer, id3v2_header_size_hex, sizeof(id3v2_header_size_hex));
+    ID3_STATS_ADD(stats, header_bytes_written, sizeof(id3v2_header_without_size) + sizeof(id3v2_header_size_hex));
+
+    // write extended header, the CRC covers the frames only
+    if (overlay_tag_collection.is_crc_enabled) {
+        _write_bytes(&writer, extended_header, sizeof(extended_header));
+        ID3_STATS_ADD(stats, header_bytes_written, sizeof(extended_header));
+        writer.is_crc_enabled = 1;
+    }
+
+    unsigned int frames_outcome;
+    if (frame_order != NULL)
+        frames_outcome = _write_frames_in_layout_order(&writer, base_tag, frame_order, num_ordered_frames);
+    else
+        frames_outcome = _write_frames_in_list_order(&writer, base_tag, overlay_tag_collection);
+
+    ID3_FREE(frame_order);
+
+    if (frames_outcome != TAG_WRITE_SUCCESS) {
+        fclose(file_ptr);
+        return frames_outcome;
+    }
+
+    // go back and fill in the CRC
+    if (writer.is_crc_enabled) {
+        uint8_t crc_bytes[4];
+        _integer_to_four_byte(writer.crc, crc_bytes, _USE_32BIT_FORMAT_SIZE);
+        writer.is_crc_enabled = 0;
+
+        if (fseek(file_ptr, _EXTENDED_HEADER_CRC_OFFSET, SEEK_SET) != 0) {
+            fclose(file_ptr);
+            return TAG_FILE_ERROR;
+        }
+
+        _write_bytes(&writer, crc_bytes, sizeof(crc_bytes));
+    }
+
+    // a write that failed along the way (e.g. a full disk) leaves the error flag set, buffered bytes can still fail to go out on close
+    int is_write_failed = ferror(file_ptr);
+
+    int close_outcome;
+    ID3_TRACE_SPAN("file_close", close_outcome = fclose(file_ptr));
+
+    if (is_write_failed || close_outcome != 0)
+        return TAG_FILE_ERROR;
+
+    return TAG_WRITE_SUCCESS;
+}
+
+/*
+ * [INTERNAL FUNCTION]
+ * Writes every frame with ID3_FRAME_LAYOUT_LIST_ORDER: base frames that are kept, then text, comment, user and picture frames in list order.
+ *
+ * Returns (success): TAG_WRITE_SUCCESS
+ * Returns (failure): NODE_FILE_ERROR if a picture file can no longer be opened
+ */
+unsigned int _write_frames_in_list_order(_tag_writer* writer, const id3_base_tag* base_tag, id3_master_tag_struct overlay_tag_collection) {
+    // write base frames, consecutive frames that are kept are written in one go
+    if (base_tag != NULL) {
+        unsigned int run_offset = 0;
+        unsigned int run_bytes = 0;
+
+        for (unsigned int i = 0; i < base_tag->num_frames; i++) {
+            const id3_base_tag_frame* frame = &base_tag->frame_index[i];
+
+            if (id3_base_tag_frame_is_overridden(frame, overlay_tag_collection)) {
+                if (run_bytes > 0)
+                    _write_bytes(writer, base_tag->frames + run_offset, run_bytes);
+                ID3_STATS_ADD(writer->stats, base_bytes_written, run_bytes);
+                run_bytes = 0;
+                continue;
+            }
+
+            if (run_bytes == 0)
+                run_offset = frame->offset;
+            run_bytes += frame->num_bytes;
+        }
+
+        if (run_bytes > 0)
+            _write_bytes(writer, base_tag->frames + run_offset, run_bytes);
+        ID3_STATS_ADD(writer->stats, base_bytes_written, run_bytes);
+    }
 
     // write text tags
-    if (master_tag_collection.text_tag_list != NULL) {
-        id3_text_tag_node* iter_node = *(master_tag_collection.text_tag_list);
+    if (overlay_tag_collection.text_tag_list != NULL) {
+        id3_text_tag_node* iter_node = *(overlay_tag_collection.text_tag_list);
         while (iter_node != NULL) {
-            _write_text_tag(file_ptr, iter_node);
+            ID3_TRACE_SPAN("write_text_tag", _write_text_tag(writer, iter_node));
             iter_node = iter_node->next;
         }
     }
 
     // write comment tags
-    if (master_tag_collection.comment_tag_list != NULL) {
-        id3_comment_tag_node* iter_node = *(master_tag_collection.comment_tag_list);
+    if (overlay_tag_collection.comment_tag_list != NULL) {
+        id3_comment_tag_node* iter_node = *(overlay_tag_collection.comment_tag_list);
         while (iter_node != NULL) {
-            _write_comment_tag(file_ptr, iter_node);
+            ID3_TRACE_SPAN("write_comment_tag", _write_comment_tag(writer, iter_node));
+            iter_node = iter_node->next;
+        }
+    }
+
+    // write user tags
+    if (overlay_tag_collection.user_tag_list != NULL) {
+        id3_user_tag_node* iter_node = overlay_tag_collection.user_tag_list->head;
+        while (iter_node != NULL) {
+            ID3_TRACE_SPAN("write_user_tag", _write_user_tag(writer, iter_node));
             iter_node = iter_node->next;
         }
     }
 
     // write picture tags
-    if (master_tag_collection.picture_tag_list != NULL) {
-        id3_picture_tag_node* iter_node = *(master_tag_collection.picture_tag_list);
+    if (overlay_tag_collection.picture_tag_list != NULL) {
+        id3_picture_tag_node* iter_node = *(overlay_tag_collection.picture_tag_list);
         while (iter_node != NULL) {
-            _write_picture_tag(file_ptr, iter_node);
+            unsigned int picture_outcome;
+            ID3_TRACE_SPAN("write_picture_tag", picture_outcome = _write_picture_tag(writer, iter_node));
+
+            if (picture_outcome != TAG_WRITE_SUCCESS)
+                return NODE_FILE_ERROR;
             iter_node = iter_node->next;
         }
     }
 
-    fclose(file_ptr);
+    return TAG_WRITE_SUCCESS;
+}
+
+/*
+ * [INTERNAL FUNCTION]
+ * Writes every frame in the order decided by _frame_order_create().
+ *
+ * Returns (success): TAG_WRITE_SUCCESS
+ * Returns (failure): NODE_FILE_ERROR if a picture file can no longer be opened
+ */
+unsigned int _write_frames_in_layout_order(_tag_writer* writer, const id3_base_tag* base_tag, const _frame_ref* frame_order, unsigned int num_frames) {
+    for (unsigned int i = 0; i < num_frames; i++) {
+        const _frame_ref* frame_ref = &frame_order[i];
+
+        switch (frame_ref->frame_kind) {
+            case _FRAME_KIND_BASE: {
+                const id3_base_tag_frame* frame = (const id3_base_tag_frame*)frame_ref->frame;
+                _write_bytes(writer, base_tag->frames + frame->offset, frame->num_bytes);
+                ID3_STATS_ADD(writer->stats, base_bytes_written, frame->num_bytes);
+                break;
+            }
+            case _FRAME_KIND_TEXT:
+                ID3_TRACE_SPAN("write_text_tag", _write_text_tag(writer, (id3_text_tag_node*)frame_ref->frame));
+                break;
+            case _FRAME_KIND_COMMENT:
+                ID3_TRACE_SPAN("write_comment_tag", _write_comment_tag(writer, (id3_comment_tag_node*)frame_ref->frame));
+                break;
+            case _FRAME_KIND_USER:
+                ID3_TRACE_SPAN("write_user_tag", _write_user_tag(writer, (id3_user_tag_node*)frame_ref->frame));
+                break;
+            case _FRAME_KIND_PICTURE: {
+                unsigned int picture_outcome;
+                ID3_TRACE_SPAN("write_picture_tag", picture_outcome = _write_picture_tag(writer, (id3_picture_tag_node*)frame_ref->frame));
+
+                if (picture_outcome != TAG_WRITE_SUCCESS)
+                    return NODE_FILE_ERROR;
+                break;
+            }
+        }
+    }
+
+    return TAG_WRITE_SUCCESS;
+}
+
+/*
+ * [INTERNAL FUNCTION]
+ * Lists every frame of a tag (kept base frames and overlay nodes, already encoded) in ID3_FRAME_LAYOUT_READ_OPTIMIZED order.
+ * - Frames with the same rank keep their list order when of the same size.
+ *
+ * Returns (success): frames in the order to write them (num_frames long), free with ID3_FREE()
+ * Returns (failure): NULL
+ */
+_frame_ref* _frame_order_create(const id3_base_tag* base_tag, id3_master_tag_struct overlay_tag_collection, unsigned int* num_frames) {
+    unsigned int max_frames = base_tag != NULL ? base_tag->num_frames : 0;
+
+    if (overlay_tag_collection.text_tag_list != NULL)
+        for (id3_text_tag_node* iter_node = *(overlay_tag_collection.text_tag_list); iter_node != NULL; iter_node = iter_node->next) max_frames++;
+    if (overlay_tag_collection.comment_tag_list != NULL)
+        for (id3_comment_tag_node* iter_node = *(overlay_tag_collection.comment_tag_list); iter_node != NULL; iter_node = iter_node->next) max_frames++;
+    if (overlay_tag_collection.user_tag_list != NULL)
+        max_frames += overlay_tag_collection.user_tag_list->num_nodes;
+    if (overlay_tag_collection.picture_tag_list != NULL)
+        for (id3_picture_tag_node* iter_node = *(overlay_tag_collection.picture_tag_list); iter_node != NULL; iter_node = iter_node->next) max_frames++;
+
+    _frame_ref* frame_order = (_frame_ref*)ID3_MALLOC((max_frames > 0 ? max_frames : 1) * sizeof(_frame_ref));
+    if (frame_order == NULL)
+        return NULL;
+
+    unsigned int count = 0;
+
+    if (base_tag != NULL) {
+        for (unsigned int i = 0; i < base_tag->num_frames; i++) {
+            const id3_base_tag_frame* frame = &base_tag->frame_index[i];
+            if (!id3_base_tag_frame_is_overridden(frame, overlay_tag_collection)) {
+                _frame_order_add(&frame_order[count], _FRAME_KIND_BASE, frame, frame->frame_id, frame->num_bytes, count, overlay_tag_collection);
+                count++;
+            }
+        }
+    }
+
+    // sizes below are those id3_master_tag_size() counted
+    if (overlay_tag_collection.text_tag_list != NULL) {
+        for (id3_text_tag_node* iter_node = *(overlay_tag_collection.text_tag_list); iter_node != NULL; iter_node = iter_node->next, count++)
+            _frame_order_add(&frame_order[count], _FRAME_KIND_TEXT, iter_node, iter_node->frame_id,
+                             10 + (iter_node->compressed_payload != NULL ? iter_node->compressed_bytes : iter_node->num_id3_bytes), count, overlay_tag_collection);
+    }
+
+    if (overlay_tag_collection.comment_tag_list != NULL) {
+        for (id3_comment_tag_node* iter_node = *(overlay_tag_collection.comment_tag_list); iter_node != NULL; iter_node = iter_node->next, count++)
+            _frame_order_add(&frame_order[count], _FRAME_KIND_COMMENT, iter_node, ID3_FRAME_COMM,
+                             10 + (iter_node->compressed_payload != NULL ? iter_node->compressed_bytes : iter_node->num_id3_bytes), count, overlay_tag_collection);
+    }
+
+    if (overlay_tag_collection.user_tag_list != NULL) {
+        for (id3_user_tag_node* iter_node = overlay_tag_collection.user_tag_list->head; iter_node != NULL; iter_node = iter_node->next, count++)
+            _frame_order_add(&frame_order[count], _FRAME_KIND_USER, iter_node, iter_node->frame_id,
+                             10 + (iter_node->compressed_payload != NULL ? iter_node->compressed_bytes : iter_node->num_id3_bytes), count, overlay_tag_collection);
+    }
+
+    if (overlay_tag_collection.picture_tag_list != NULL) {
+        for (id3_picture_tag_node* iter_node = *(overlay_tag_collection.picture_tag_list); iter_node != NULL; iter_node = iter_node->next, count++)
+            _frame_order_add(&frame_order[count], _FRAME_KIND_PICTURE, iter_node, ID3_FRAME_APIC, 10 + iter_node->num_id3_bytes, count, overlay_tag_collection);
+    }
+
+    qsort(frame_order, count, sizeof(_frame_ref), _frame_ref_compare);
+
+    *num_frames = count;
+
+    return frame_order;
+}
+
+/*
+ * [INTERNAL FUNCTION]
+ * Fills in a _frame_ref, ranking the frame by the leading frames of overlay_tag_collection (or the default ones).
+ */
+void _frame_order_add(_frame_ref* frame_ref, uint8_t frame_kind, const void* frame, uint32_t frame_id, unsigned int frame_bytes, unsigned int sequence,
+                      id3_master_tag_struct overlay_tag_collection) {
+    const uint32_t* leading_frame_ids = overlay_tag_collection.leading_frame_ids;
+    unsigned int num_leading_frame_ids = overlay_tag_collection.num_leading_frame_ids;
+    if (leading_frame_ids == NULL) {
+        leading_frame_ids = _DEFAULT_LEADING_FRAME_IDS;
+        num_leading_frame_ids = sizeof(_DEFAULT_LEADING_FRAME_IDS) / sizeof(_DEFAULT_LEADING_FRAME_IDS[0]);
+    }
+
+    unsigned int rank = frame_id == ID3_FRAME_APIC ? num_leading_frame_ids + 1 : num_leading_frame_ids;
+    for (unsigned int i = 0; i < num_leading_frame_ids; i++) {
+        if (leading_frame_ids[i] == frame_id) {
+            rank = i;
+            break;
+        }
+    }
+
+    *frame_ref = (_frame_ref){.frame_kind = frame_kind, .frame = frame, .frame_bytes = frame_bytes, .rank = rank, .sequence = sequence};
+}
+
+/*
+ * [INTERNAL FUNCTION]
+ * qsort() comparator of _frame_ref, by rank, then frame_bytes, then sequence.
+ */
+int _frame_ref_compare(const void* first, const void* second) {
+    const _frame_ref* first_ref = (const _frame_ref*)first;
+    const _frame_ref* second_ref = (const _frame_ref*)second;
+
+    if (first_ref->rank != second_ref->rank)
+        return first_ref->rank < second_ref->rank ? -1 : 1;
+    if (first_ref->frame_bytes != second_ref->frame_bytes)
+        return first_ref->frame_bytes < second_ref->frame_bytes ? -1 : 1;
+    if (first_ref->sequence != second_ref->sequence)
+        return first_ref->sequence < second_ref->sequence ? -1 : 1;
+
+    return 0;
 }
 
 /*
@@ -131,6 +602,55 @@ void id3_init_master_tag(id3_master_tag_struct* master_tag_collection) {
     master_tag_collection->comment_tag_list = NULL;
     master_tag_collection->picture_tag_list = NULL;
     master_tag_collection->text_tag_list = NULL;
+    master_tag_collection->user_tag_list = NULL;
+    master_tag_collection->arena = NULL;
+    master_tag_collection->compression_threshold_bytes = 0;
+    master_tag_collection->stats = NULL;
+    master_tag_collection->frame_layout = ID3_FRAME_LAYOUT_LIST_ORDER;
+    master_tag_collection->leading_frame_ids = NULL;
+    master_tag_collection->num_leading_frame_ids = 0;
+    master_tag_collection->is_crc_enabled = 0;
+}
+
+/*
+ * Frees every list referenced by a id3_master_tag_struct, setting the referenced head pointers to NULL.
+ * - If arena is set, all nodes are assumed to have been added with the *_add_update_in_arena() functions using that arena.
+ *   No node is walked except for picture nodes (to release their binary data), the arena is reset instead, keeping its chunks for the next tag.
+ *   A user frame list is emptied with id3_user_tag_list_reset(), keeping its index, call id3_user_tag_list_destroy() once it is no longer needed.
+ *   Call id3_arena_release() once the arena is no longer needed.
+ * - If arena is NULL, this is equivalent to calling each *_list_destroy() function.
+ *
+ * Usage:
+ * id3_arena arena;
+ * id3_arena_init(&arena, 0);
+ *
+ * id3_master_tag_struct master_tag_collection;
+ * id3_init_master_tag(&master_tag_collection);
+ * master_tag_collection.text_tag_list = &tag_list;
+ * master_tag_collection.arena = &arena;
+ *
+ * id3_text_tag_node_add_update_in_arena(master_tag_collection.text_tag_list, master_tag_collection.arena, "TALB", "Selection 3");
+ * id3_write_tag("./song.mp3", master_tag_collection);
+ * id3_destroy_master_tag(&master_tag_collection); // arena is ready for the next tag
+ */
+void id3_destroy_master_tag(id3_master_tag_struct* master_tag_collection) {
+    if (master_tag_collection->arena == NULL) {
+        if (master_tag_collection->text_tag_list != NULL) id3_text_tag_list_destroy(master_tag_collection->text_tag_list);
+        if (master_tag_collection->comment_tag_list != NULL) id3_comment_tag_list_destroy(master_tag_collection->comment_tag_list);
+        if (master_tag_collection->picture_tag_list != NULL) id3_picture_tag_list_destroy(master_tag_collection->picture_tag_list);
+        if (master_tag_collection->user_tag_list != NULL) id3_user_tag_list_destroy(master_tag_collection->user_tag_list);
+        return;
+    }
+
+    // picture binary data never lives in the arena
+    if (master_tag_collection->picture_tag_list != NULL) id3_picture_tag_list_release_data(master_tag_collection->picture_tag_list);
+
+    if (master_tag_collection->text_tag_list != NULL) *(master_tag_collection->text_tag_list) = NULL;
+    if (master_tag_collection->comment_tag_list != NULL) *(master_tag_collection->comment_tag_list) = NULL;
+    if (master_tag_collection->picture_tag_list != NULL) *(master_tag_collection->picture_tag_list) = NULL;
+    if (master_tag_collection->user_tag_list != NULL) id3_user_tag_list_reset(master_tag_collection->user_tag_list);
+
+    id3_arena_reset(master_tag_collection->arena);
 }
 
 /*
@@ -139,7 +659,7 @@ void id3_init_master_tag(id3_master_tag_struct* master_tag_collection) {
  * - Frame Header: https://id3.org/id3v2.3.0#ID3v2_frame_overview
  * - Frame Content: https://id3.org/id3v2.3.0#Text_information_frames
  */
-void _write_text_tag(FILE* file_ptr, id3_text_tag_node* node) {
+void _write_text_tag(_tag_writer* writer, id3_text_tag_node* node) {
     /*
      * [Text frame overview]
      * Frame ID			$xx xx xx xx (four characters)
@@ -149,26 +669,17 @@ void _write_text_tag(FILE* file_ptr, id3_text_tag_node* node) {
      * Text				 <full text string according to encoding>
      */
 
-    uint8_t id3v2_tag_size_hex[4] = {0x00, 0x00, 0x00, 0x00};
-    _integer_to_four_byte(node->num_id3_bytes, id3v2_tag_size_hex, _USE_32BIT_FORMAT_SIZE);
-
-    fprintf(file_ptr, node->tag_name);
-    fwrite(id3v2_tag_size_hex, sizeof(id3v2_tag_size_hex), 1, file_ptr);
-    fwrite(default_flags, sizeof(default_flags), 1, file_ptr);
-
-    if (node->is_utf8) {
-        fwrite("\x01\xFF\xFE", 3, 1, file_ptr);  // UTF-16 encoding indicator + BOM
-        uint16_t* utf16_writer = node->tag_value_utf16;
-        while (*utf16_writer != '\0') {
-            fwrite(utf16_writer, 2, 1, file_ptr);
-            utf16_writer++;
-        }
-        fwrite("\x00\x00", 2, 1, file_ptr);
-    } else {
-        fwrite("\x00", 1, 1, file_ptr);  // ISO-8859-1 encoding indicator
-        fprintf(file_ptr, node->tag_value);
-        fwrite("\x00", 1, 1, file_ptr);
+    // everything after the frame header was encoded (and possibly compressed) by id3_master_tag_size()
+    if (node->compressed_payload != NULL) {
+        _write_frame_header(writer, node->frame_id, node->compressed_bytes, ID3_FRAME_FLAG_COMPRESSION);
+        _write_bytes(writer, node->compressed_payload, node->compressed_bytes);
+        ID3_STATS_ADD(writer->stats, text_bytes_written, node->compressed_bytes);
+        return;
     }
+
+    _write_frame_header(writer, node->frame_id, node->num_id3_bytes, 0);
+    _write_bytes(writer, node->payload, node->num_id3_bytes);
+    ID3_STATS_ADD(writer->stats, text_bytes_written, node->num_id3_bytes);
 }
 
 /*
@@ -177,7 +688,7 @@ void _write_text_tag(FILE* file_ptr, id3_text_tag_node* node) {
  * - Frame Header: https://id3.org/id3v2.3.0#ID3v2_frame_overview
  * - Frame Content: https://id3.org/id3v2.3.0#Comments
  */
-void _write_comment_tag(FILE* file_ptr, id3_comment_tag_node* node) {
+void _write_comment_tag(_tag_writer* writer, id3_comment_tag_node* node) {
     /*
      * [Comment frame overview]
      * Frame ID			$xx xx xx xx (four characters)
@@ -189,44 +700,45 @@ void _write_comment_tag(FILE* file_ptr, id3_comment_tag_node* node) {
      * Text             <full text string according to encoding>
      */
 
-    unsigned char id3v2_tag_size_hex[4] = {0x00, 0x00, 0x00, 0x00};
-    _integer_to_four_byte(node->num_id3_bytes, id3v2_tag_size_hex, _USE_32BIT_FORMAT_SIZE);
-
-    fprintf(file_ptr, _TAG_NAME_COMMENT);
-    fwrite(id3v2_tag_size_hex, sizeof(id3v2_tag_size_hex), 1, file_ptr);
-    fwrite(default_flags, sizeof(default_flags), 1, file_ptr);
-
-    if (node->is_utf8) {
-        fwrite("\x01", 1, 1, file_ptr);          // UTF-16 encoding indicator
-        fwrite(node->language, 3, 1, file_ptr);  // language
+    if (node->compressed_payload != NULL) {
+        _write_frame_header(writer, ID3_FRAME_COMM, node->compressed_bytes, ID3_FRAME_FLAG_COMPRESSION);
+        _write_bytes(writer, node->compressed_payload, node->compressed_bytes);
+        ID3_STATS_ADD(writer->stats, text_bytes_written, node->compressed_bytes);
+        return;
+    }
 
-        // short content description
-        fwrite("\xFF\xFE", 2, 1, file_ptr);  // BOM
-        uint16_t* utf16_writer = node->short_content_description_utf16;
-        while (*utf16_writer != '\0') {
-            fwrite(utf16_writer, 2, 1, file_ptr);
-            utf16_writer++;
-        }
-        fwrite("\x00\x00", 2, 1, file_ptr);
-
-        // comment
-        fwrite("\xFF\xFE", 2, 1, file_ptr);  // BOM
-        utf16_writer = node->comment_utf16;
-        while (*utf16_writer != '\0') {
-            fwrite(utf16_writer, 2, 1, file_ptr);
-            utf16_writer++;
-        }
-        fwrite("\x00\x00", 2, 1, file_ptr);
-    } else {
-        fwrite("\x00", 1, 1, file_ptr);          // ISO-8859-1 encoding indicator
-        fwrite(node->language, 3, 1, file_ptr);  // language
+    _write_frame_header(writer, ID3_FRAME_COMM, node->num_id3_bytes, 0);
+    _write_bytes(writer, node->payload, node->num_id3_bytes);
+    ID3_STATS_ADD(writer->stats, text_bytes_written, node->num_id3_bytes);
+}
 
-        fprintf(file_ptr, node->short_content_description);  // short content description
-        fwrite("\x00", 1, 1, file_ptr);
+/*
+ * [INTERNAL FUNCTION]
+ * Writes a single user defined text (TXXX) or URL (WXXX) tag to a file.
+ * - Frame Header: https://id3.org/id3v2.3.0#ID3v2_frame_overview
+ * - Frame Content: https://id3.org/id3v2.3.0#User_defined_text_information_frame, https://id3.org/id3v2.3.0#User_defined_URL_link_frame
+ */
+void _write_user_tag(_tag_writer* writer, id3_user_tag_node* node) {
+    /*
+     * [User defined frame overview]
+     * Frame ID			$xx xx xx xx ("TXXX" or "WXXX")
+     * Size				$xx xx xx xx
+     * Flags			$xx xx
+     * Encoding			$xx (00: ISO-8859-1, 01: UTF-16)
+     * Description      <text string according to encoding> $00 (00)
+     * Value            <full text string according to encoding> (TXXX), <text string> in ISO-8859-1 (WXXX URL)
+     */
 
-        fprintf(file_ptr, node->comment);  // comment
-        fwrite("\x00", 1, 1, file_ptr);
+    if (node->compressed_payload != NULL) {
+        _write_frame_header(writer, node->frame_id, node->compressed_bytes, ID3_FRAME_FLAG_COMPRESSION);
+        _write_bytes(writer, node->compressed_payload, node->compressed_bytes);
+        ID3_STATS_ADD(writer->stats, text_bytes_written, node->compressed_bytes);
+        return;
     }
+
+    _write_frame_header(writer, node->frame_id, node->num_id3_bytes, 0);
+    _write_bytes(writer, node->payload, node->num_id3_bytes);
+    ID3_STATS_ADD(writer->stats, text_bytes_written, node->num_id3_bytes);
 }
 
 /*
@@ -234,8 +746,11 @@ void _write_comment_tag(FILE* file_ptr, id3_comment_tag_node* node) {
  * Writes a single picture tag to a file.
  * - Frame Header: https://id3.org/id3v2.3.0#ID3v2_frame_overview
  * - Frame Content: https://id3.org/id3v2.3.0#Attached_picture
+ *
+ * Returns (success): TAG_WRITE_SUCCESS
+ * Returns (failure): NODE_FILE_ERROR if the picture file can no longer be opened
  */
-void _write_picture_tag(FILE* file_ptr, id3_picture_tag_node* node) {
+unsigned int _write_picture_tag(_tag_writer* writer, id3_picture_tag_node* node) {
     /*
      * [Picture Frame overview]
      * Text encoding   $xx
@@ -245,50 +760,100 @@ void _write_picture_tag(FILE* file_ptr, id3_picture_tag_node* node) {
      * Picture data    <binary data>
      */
 
-    unsigned char id3v2_tag_size_hex[4] = {0x00, 0x00, 0x00, 0x00};
-    _integer_to_four_byte(node->num_id3_bytes, id3v2_tag_size_hex, _USE_32BIT_FORMAT_SIZE);
-
-    fprintf(file_ptr, _TAG_NAME_PICTURE);
-    fwrite(id3v2_tag_size_hex, sizeof(id3v2_tag_size_hex), 1, file_ptr);
-    fwrite(default_flags, sizeof(default_flags), 1, file_ptr);
-
-    if (node->is_utf8) {
-        fwrite("\x01", 1, 1, file_ptr);      // UTF-16 encoding indicator
-        fprintf(file_ptr, node->mime_type);  // mime type
-        fwrite("\x00", 1, 1, file_ptr);
-        fwrite(&node->picture_type, 1, 1, file_ptr);  // picture type (fwrite needs pointer so we &)
-
-        // description
-        fwrite("\xFF\xFE", 2, 1, file_ptr);  // BOM
-        uint16_t* utf16_writer = node->description_utf16;
-        while (*utf16_writer != '\0') {
-            fwrite(utf16_writer, 2, 1, file_ptr);
-            utf16_writer++;
-        }
-        fwrite("\x00\x00", 2, 1, file_ptr);
-    } else {
-        fwrite("\x00", 1, 1, file_ptr);      // ISO-8859-1 encoding indicator
-        fprintf(file_ptr, node->mime_type);  // mime type
-        fwrite("\x00", 1, 1, file_ptr);
-        fwrite(&node->picture_type, 1, 1, file_ptr);  // picture type (fwrite needs pointer so we &)
+    // payload holds everything up to the picture data
+    _write_frame_header(writer, ID3_FRAME_APIC, node->num_id3_bytes, 0);
+    _write_bytes(writer, node->payload, node->payload_bytes);
+    ID3_STATS_ADD(writer->stats, picture_bytes_written, node->num_id3_bytes);
 
-        fprintf(file_ptr, node->description);  //  description
-        fwrite("\x00", 1, 1, file_ptr);
-    }
+    uint64_t start_ns = writer->stats != NULL ? id3_stats_clock_ns() : 0;
+
+    unsigned int copy_outcome;
+    ID3_TRACE_SPAN("picture_copy", copy_outcome = _write_picture_data(writer, node));
+
+    if (writer->stats != NULL)
+        ID3_STATS_ADD(writer->stats, picture_copy_ns, id3_stats_clock_ns() - start_ns);
+
+    return copy_outcome;
+}
 
+/*
+ * [INTERNAL FUNCTION]
+ * Writes the picture data of a picture frame, from its file or from memory.
+ *
+ * Returns (success): TAG_WRITE_SUCCESS
+ * Returns (failure): NODE_FILE_ERROR if the picture file can no longer be opened or has shrunk
+ */
+unsigned int _write_picture_data(_tag_writer* writer, id3_picture_tag_node* node) {
     if (node->is_picture_stored_as_file) {
         FILE* picture_file_ptr;
         picture_file_ptr = fopen(node->picture_file_path, "rb");
 
-        // picture guaranteed to have been opened before during processing
-        int a;
-        while ((a = fgetc(picture_file_ptr)) != EOF)
-            fputc(a, file_ptr);
+        // the picture's size was looked up while encoding, but the file may have gone away since
+        if (picture_file_ptr == NULL)
+            return NODE_FILE_ERROR;
+
+        ID3_STATS_ADD(writer->stats, files_opened, 1);
+
+        // exactly as many bytes as the frame header states, a file that has shrunk since it was sized cannot fill the frame
+        uint8_t chunk[_PICTURE_COPY_CHUNK_BYTES];
+        unsigned int remaining_bytes = node->picture_file_bytes;
+        while (remaining_bytes > 0) {
+            size_t chunk_bytes = fread(chunk, 1, remaining_bytes < sizeof(chunk) ? remaining_bytes : sizeof(chunk), picture_file_ptr);
+            if (chunk_bytes == 0) {
+                fclose(picture_file_ptr);
+                return NODE_FILE_ERROR;
+            }
+
+            _write_bytes(writer, chunk, chunk_bytes);
+            remaining_bytes -= chunk_bytes;
+        }
 
         fclose(picture_file_ptr);
     } else {
-        fwrite(node->picture_binary_data, node->picture_binary_data_bytes, 1, file_ptr);
+        _write_bytes(writer, node->picture_binary_data, node->picture_binary_data_bytes);
     }
+
+    return TAG_WRITE_SUCCESS;
+}
+
+/*
+ * Fills in the 10 byte frame header of a frame whose content is frame_size bytes long. (https://id3.org/id3v2.3.0#ID3v2_frame_overview)
+ * - Used to serialize frames into memory, see id3_base_tag_create().
+ */
+void id3_frame_header_to_bytes(uint8_t* frame_header, uint32_t frame_id, unsigned int frame_size, uint16_t frame_flags) {
+    id3_frame_id_to_bytes(frame_id, frame_header);
+    _integer_to_four_byte(frame_size, frame_header + 4, _USE_32BIT_FORMAT_SIZE);
+    frame_header[8] = frame_flags >> 8;  // status flags
+    frame_header[9] = frame_flags & 0xFF;  // format flags
+}
+
+/*
+ * [INTERNAL FUNCTION]
+ * Writes a 10 byte frame header. (https://id3.org/id3v2.3.0#ID3v2_frame_overview)
+ * Frame ID       $xx xx xx xx  (four characters)
+ * Size           $xx xx xx xx
+ * Flags          $xx xx
+ */
+void _write_frame_header(_tag_writer* writer, uint32_t frame_id, unsigned int frame_size, uint16_t frame_flags) {
+    uint8_t frame_header[10];
+
+    id3_frame_header_to_bytes(frame_header, frame_id, frame_size, frame_flags);
+
+    _write_bytes(writer, frame_header, sizeof(frame_header));
+    ID3_STATS_ADD(writer->stats, header_bytes_written, sizeof(frame_header));
+}
+
+/*
+ * [INTERNAL FUNCTION]
+ * Writes num_bytes of bytes to the tag's file, counting the write call in stats if set.
+ * - Every byte of a tag goes through here, the CRC of the frames is updated on the way rather than in a pass of its own.
+ */
+void _write_bytes(_tag_writer* writer, const void* bytes, size_t num_bytes) {
+    fwrite(bytes, num_bytes, 1, writer->file_ptr);
+    ID3_STATS_ADD(writer->stats, write_calls, 1);
+
+    if (writer->is_crc_enabled)
+        writer->crc = id3_crc32(writer->crc, bytes, num_bytes);
 }
 
 void _integer_to_four_byte(unsigned int convertee, uint8_t* converted, int format_as) {
@@ -325,3 +890,4 @@ void _integer_to_four_byte(unsigned int convertee, uint8_t* converted, int forma
     converted[2] = (convertee >> 8) & 0xFF;
     converted[3] = convertee & 0xFF;
 }
+
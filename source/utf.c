@@ -1,41 +1,68 @@
 #include "../include/utf.h"
 
+// SIMD kernels are compiled in for x86 with GCC or Clang and picked at runtime, other platforms use the scalar ones
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define _UTF_X86_SIMD
+#endif
+
 /* Private */
 unsigned int _utf8_char_length(unsigned char val);
-#define _UTF8_ALLOCATED_BYTES 5
-#define _STARTING_MATRIX_LENGTH 16
+unsigned int _utf8_decode(const unsigned char *read_ptr, uint32_t *codepoint);
+size_t _utf8_ascii_run(const unsigned char *string, size_t num_bytes);
+size_t _utf8_ascii_run_scalar(const unsigned char *string, size_t num_bytes);
+void _utf8_widen_ascii(const unsigned char *string, size_t num_bytes, uint8_t *output, int byte_order);
+void _utf8_widen_ascii_scalar(const unsigned char *string, size_t num_bytes, uint8_t *output, int byte_order);
+#ifdef _UTF_X86_SIMD
+size_t _utf8_ascii_run_sse2(const unsigned char *string, size_t num_bytes);
+size_t _utf8_ascii_run_avx2(const unsigned char *string, size_t num_bytes);
+void _utf8_widen_ascii_sse2(const unsigned char *string, size_t num_bytes, uint8_t *output, int byte_order);
+void _utf8_widen_ascii_avx2(const unsigned char *string, size_t num_bytes, uint8_t *output, int byte_order);
+#endif
+unsigned int _utf8_encode_codepoint(uint32_t codepoint, uint8_t *encoded);
+int _utf8_to_utf16_alloc(const char *utf8_input_string, uint16_t **utf16_output_string, unsigned int *utf16_computed_length, int byte_order);
 #define _UTF8_LOCALE ".UTF-8"
 #define _UTF8_CODE_PAGE 65001
 #define _CMD_DEFAULT_CODE_PAGE 437
 
-static unsigned int _console_default_code_page = 0;
-utf8_matrix _failure_malformed_matrix = {UTF8_PARSE_MALFORMED, NULL, 0, 0};
-utf8_matrix _failure_no_mem_matrix = {UTF8_PARSE_NO_MEM, NULL, 0, 0};
+// Shared by every failed parse, never written to so that any number of threads can be handed them at once.
+static utf8_matrix _failure_malformed_matrix = {UTF8_PARSE_MALFORMED, NULL, NULL, 0, 0};
+static utf8_matrix _failure_no_mem_matrix = {UTF8_PARSE_NO_MEM, NULL, NULL, 0, 0};
 
 // Sets the locale of the program to UTF-8, overriding default code page usage for certain functions such as mkdir or fopen.
+// The locale is process wide, call this before starting any other thread.
 void utf8_set_locale() {
     setlocale(LC_ALL, _UTF8_LOCALE);
 }
 
-// Reverts locale to system defaults.
+// Reverts locale to system defaults. The locale is process wide, call this after joining every other thread.
 void utf8_unset_locale() {
     setlocale(LC_ALL, "");
 }
 
-// Gets the default code page of the console. If called after default code page is already initialised, does nothing.
-void utf8_get_cp() {
-    if (_console_default_code_page == 0) _console_default_code_page = GetConsoleCP();
-}
-
-// Sets the code page of the console to UTF-8, allowing for proper display of UTF-8 characters. Also obtains default code page if uninitialised.
-void utf8_set_cp() {
-    if (_console_default_code_page == 0) _console_default_code_page = GetConsoleCP();
+/*
+ * Sets the code page of the console to UTF-8, allowing for proper display of UTF-8 characters. Does nothing outside of Windows.
+ * Keep the returned default code page and pass it to utf8_unset_cp() to revert. The code page is process wide, call this from one thread only.
+ *
+ * Returns: code page of the console before the call, 0 outside of Windows
+ */
+unsigned int utf8_set_cp() {
+#ifdef _WIN32
+    unsigned int default_code_page = GetConsoleCP();
     SetConsoleOutputCP(_UTF8_CODE_PAGE);
+    return default_code_page;
+#else
+    return 0;
+#endif
 }
 
-// Reverts to default code page. Call after init_cp or utf8_set_cp; if called before, active code page will be set to "US".
-void utf8_unset_cp() {
-    SetConsoleOutputCP(_console_default_code_page != 0 ? _console_default_code_page : _CMD_DEFAULT_CODE_PAGE);
+// Reverts to the code page returned by utf8_set_cp(); if 0, active code page will be set to "US". Does nothing outside of Windows.
+void utf8_unset_cp(unsigned int default_code_page) {
+#ifdef _WIN32
+    SetConsoleOutputCP(default_code_page != 0 ? default_code_page : _CMD_DEFAULT_CODE_PAGE);
+#else
+    (void)default_code_page;
+#endif
 }
 
 /*
@@ -43,232 +70,395 @@ void utf8_unset_cp() {
  * Any return value of utf8_matrix_input->outcome which isn't UTF8_PARSE_SUCCESS indicates an error, see utf_8.h for error codes.
  * Failed matrixes do not need to be freed.
  * See definition of utf8_matrix struct for usage details.
+ *
+ * The string is walked twice, once to count and check its characters and once to copy it and fill in char_offsets,
+ * so that the struct, char_offsets and the copy of the string can share a single allocation whatever the length of the string.
  */
 utf8_matrix *utf8_parse_string(char *string) {
-    utf8_matrix *utf8_matrix_input = (utf8_matrix *)malloc(sizeof(utf8_matrix));
-    if (utf8_matrix_input == NULL)  // check if malloc succeeds
-        return &_failure_no_mem_matrix;
+    unsigned int num_chars = 0;
+    unsigned int num_bytes = 0;
+    unsigned int examined_index = 0;
 
-    utf8_matrix_input->outcome = UTF8_PARSE_WORKING;
-    utf8_matrix_input->num_chars = 0;
-    utf8_matrix_input->num_bytes = 0;
+    // first pass: count characters and bytes, checking that every character is complete
+    while (string[examined_index] != '\0') {
+        // carriage return is treated as one character, unintended as a standalone character, is part of newline sequence
+        if (string[examined_index] == '\r') {
+            examined_index++;
+            continue;
+        }
 
-    utf8_matrix_input->string_matrix = (char **)malloc(_STARTING_MATRIX_LENGTH * sizeof(char *));
-    if (utf8_matrix_input->string_matrix == NULL) {  // check if malloc succeeds
-        utf8_free_matrix(utf8_matrix_input);
-        return &_failure_no_mem_matrix;
-    }
+        uint32_t codepoint;
+        unsigned int current_utf8_length = _utf8_decode((unsigned char *)string + examined_index, &codepoint);
+        if (current_utf8_length == 0)
+            return &_failure_malformed_matrix;
 
-    for (int i = 0; i < _STARTING_MATRIX_LENGTH; i++) {
-        utf8_matrix_input->string_matrix[i] = (char *)malloc(_UTF8_ALLOCATED_BYTES * sizeof(char));
-        if (utf8_matrix_input->string_matrix[i] == NULL) {  // check if malloc succeeds
-            utf8_matrix_input->num_chars = i;               // free up to i already allocated memory
-            utf8_free_matrix(utf8_matrix_input);
-            return &_failure_no_mem_matrix;
-        }
+        examined_index += current_utf8_length;
+        num_bytes += current_utf8_length;
+        num_chars++;
     }
 
-    unsigned int malloc_space = _STARTING_MATRIX_LENGTH;
-    unsigned int examined_index = 0;
-    unsigned int num_new_lines = 0;
-
-    while (string[examined_index] != '\0') {
-        // double memory if limit reached
-        if (utf8_matrix_input->num_chars + 1 > malloc_space) {
-            char **old_ptr = utf8_matrix_input->string_matrix;
-            utf8_matrix_input->string_matrix = realloc(utf8_matrix_input->string_matrix, sizeof(char *) * (2 * malloc_space));
-            if (utf8_matrix_input->string_matrix == NULL) {  // check if realloc succeeds
-                utf8_matrix_input->string_matrix = old_ptr;
-                utf8_free_matrix(utf8_matrix_input);
-                return &_failure_no_mem_matrix;
-            }
+    // [utf8_matrix][char_offsets: num_chars + 1][string: num_bytes + 1]
+    size_t offsets_bytes = (num_chars + 1) * sizeof(uint32_t);
+    utf8_matrix *utf8_matrix_input = (utf8_matrix *)ID3_MALLOC(sizeof(utf8_matrix) + offsets_bytes + num_bytes + 1);
+    if (utf8_matrix_input == NULL)  // check if malloc succeeds
+        return &_failure_no_mem_matrix;
 
-            for (int i = malloc_space; i < 2 * malloc_space; i++) {
-                utf8_matrix_input->string_matrix[i] = (char *)malloc(_UTF8_ALLOCATED_BYTES * sizeof(char));
-                if (utf8_matrix_input->string_matrix[i] == NULL) {  // check if malloc succeeds
-                    utf8_matrix_input->num_chars = i;               // free up to i already allocated memory
-                    utf8_free_matrix(utf8_matrix_input);
-                    return &_failure_no_mem_matrix;
-                }
-            }
+    utf8_matrix_input->char_offsets = (uint32_t *)(utf8_matrix_input + 1);
+    utf8_matrix_input->string = (char *)utf8_matrix_input->char_offsets + offsets_bytes;
+    utf8_matrix_input->num_chars = num_chars;
+    utf8_matrix_input->num_bytes = num_bytes;
 
-            malloc_space *= 2;
-        }
+    // second pass: copy the string without carriage returns, noting where each character starts
+    unsigned int char_index = 0;
+    unsigned int write_index = 0;
+    examined_index = 0;
 
-        // carriage return is treated as one character, unintended as a standalone character, is part of newline sequence
+    while (string[examined_index] != '\0') {
         if (string[examined_index] == '\r') {
             examined_index++;
-            num_new_lines++;
             continue;
         }
 
         unsigned int current_utf8_length = _utf8_char_length((unsigned char)string[examined_index]);
 
-        if (current_utf8_length == 0) {
-            utf8_free_matrix(utf8_matrix_input);
-            return &_failure_malformed_matrix;
-        }
-
-        // at this point num_chars is 1 less than actual number of characters which corresponds to array index
-        for (int i = 0; i < current_utf8_length; i++)
-            utf8_matrix_input->string_matrix[utf8_matrix_input->num_chars][i] = string[examined_index++];
-        utf8_matrix_input->string_matrix[utf8_matrix_input->num_chars][current_utf8_length] = '\0';
+        utf8_matrix_input->char_offsets[char_index++] = write_index;
+        memcpy(utf8_matrix_input->string + write_index, string + examined_index, current_utf8_length);
 
-        utf8_matrix_input->num_chars++;
+        examined_index += current_utf8_length;
+        write_index += current_utf8_length;
     }
 
-    utf8_matrix_input->num_bytes = examined_index - num_new_lines;  // no need to minus one as examined_index is currently @ null terminator
-
-    // free unused allocated memory
-    for (int i = utf8_matrix_input->num_chars; i < malloc_space; i++)
-        free(utf8_matrix_input->string_matrix[i]);
+    utf8_matrix_input->char_offsets[num_chars] = num_bytes;
+    utf8_matrix_input->string[num_bytes] = '\0';
 
     utf8_matrix_input->outcome = UTF8_PARSE_SUCCESS;
 
     return utf8_matrix_input;
 }
 
+/*
+ * Gets a character of a successfully parsed utf8_matrix, index being between 0 and num_chars - 1.
+ * The character is not null terminated, char_bytes receives its length (1 to 4).
+ */
+const char *utf8_matrix_char_at(const utf8_matrix *matrix_instance, unsigned int index, unsigned int *char_bytes) {
+    *char_bytes = matrix_instance->char_offsets[index + 1] - matrix_instance->char_offsets[index];
+    return matrix_instance->string + matrix_instance->char_offsets[index];
+}
+
+/*
+ * Copies a character of a successfully parsed utf8_matrix into output as a null terminated string, output must be at least 5 bytes.
+ * Returns the length of the character in bytes.
+ */
+unsigned int utf8_matrix_copy_char(const utf8_matrix *matrix_instance, unsigned int index, char *output) {
+    unsigned int char_bytes;
+    const char *utf8_char = utf8_matrix_char_at(matrix_instance, index, &char_bytes);
+
+    memcpy(output, utf8_char, char_bytes);
+    output[char_bytes] = '\0';
+
+    return char_bytes;
+}
+
 // Frees memory allocated to a utf8_matrix.
 void utf8_free_matrix(utf8_matrix *matrix_instance) {
-    // calling free on NULL is safe!
-    for (int i = 0; i < matrix_instance->num_chars; i++)
-        free(matrix_instance->string_matrix[i]);
-    free(matrix_instance->string_matrix);
-    free(matrix_instance);
+    // char_offsets and string share the allocation of the struct
+    ID3_FREE(matrix_instance);
 }
 
 /*
  * Function that accepts a character sequence and returns whether or not it contains a multibyte UTF-8 sequence.
  * Returns 1 if a multibyte sequence is found, 0 otherwise.
- * Returns -1 if the string is an invalid UTF8 string.
+ * Returns -1 if the string is an invalid UTF8 string, anywhere in it (see utf8_validate()).
  */
 int utf8_contains_multibyte_sequence(char *string) {
-    unsigned int examined_index = 0;
-    while (string[examined_index] != '\0') {
-        unsigned int current_utf8_length = _utf8_char_length((unsigned char)string[examined_index]);
-        switch (current_utf8_length) {
-            case 0:
-                return -1;
-            case 1:
-                examined_index++;
-                break;
-            default:
-                return 1;
-        }
-    }
+    utf8_validation validation;
+    if (utf8_validate(string, &validation) != UTF8_PARSE_SUCCESS)
+        return -1;
 
-    return 0;
+    return validation.max_codepoint != 0;
 }
 
-// Function to convert UTF-8 to UTF-16 with LE encoding
-int utf8_to_utf16_le(const char *utf8_input_string, uint16_t **utf16_output_string, unsigned int *utf16_computed_length) {
-    // in worst case, utf16 string is as wide as utf8 string, impossible to be wider
-    *utf16_output_string = (uint16_t *)malloc((strlen(utf8_input_string) + 1) * sizeof(uint16_t));
-    if (utf16_output_string == NULL)  // check if malloc succeeds
-        return UTF16_PARSE_NO_MEM;
+/*
+ * Checks that a string is valid UTF-8 and measures it in a single pass, so that it can be encoded without being looked at again.
+ * Overlong forms, surrogate codepoints (U+D800 to U+DFFF) and codepoints above U+10FFFF are all rejected.
+ * - Runs of ASCII are skipped 16 or 32 bytes at a time on CPUs with SSE2 or AVX2.
+ *
+ * Usage:
+ * utf8_validation validation;
+ * if (utf8_validate(string, &validation) == UTF8_PARSE_SUCCESS && validation.max_codepoint == 0)
+ *     // string is ASCII only
+ *
+ * Returns (success): UTF8_PARSE_SUCCESS
+ * Returns (failure): UTF8_PARSE_MALFORMED
+ */
+int utf8_validate(const char *string, utf8_validation *validation) {
+    size_t num_bytes = strlen(string);
+    const unsigned char *read_ptr = (const unsigned char *)string;
+    const unsigned char *end_ptr = read_ptr + num_bytes;
+
+    size_t utf16_bytes = 0;
+    uint32_t max_codepoint = 0;
+
+    while (read_ptr < end_ptr) {
+        size_t ascii_bytes = _utf8_ascii_run(read_ptr, end_ptr - read_ptr);
+        read_ptr += ascii_bytes;
+        utf16_bytes += ascii_bytes * 2;
+
+        if (read_ptr == end_ptr)
+            break;
+
+        uint32_t codepoint;
+        unsigned int current_utf8_length = _utf8_decode(read_ptr, &codepoint);
+        if (current_utf8_length == 0)
+            return UTF8_PARSE_MALFORMED;
+
+        read_ptr += current_utf8_length;
+        utf16_bytes += codepoint > 0xFFFF ? 4 : 2;  // 4 byte characters become surrogate pairs
+        if (codepoint > max_codepoint)
+            max_codepoint = codepoint;
+    }
 
-    uint16_t *output_ptr = *utf16_output_string;
-    unsigned char *read_ptr = (unsigned char *)utf8_input_string;
-
-    while (*read_ptr != '\0') {
-        uint32_t codepoint = 0;
-        unsigned int current_utf8_char_num_bytes = _utf8_char_length(*read_ptr);
-
-        // determine the number of bytes in the UTF-8 character and extract the codepoint
-        // yes i could write codepoint = *read_ptr++ but it's confusing
-        switch (current_utf8_char_num_bytes) {
-            case 0:
-                free(*utf16_output_string);
-                *utf16_output_string = NULL;
-                return UTF16_PARSE_UTF8_MALFORMED;
-            case 1:
-                // in the case of 1 byte char, the whole char is the sequence
-                // save contents of whole byte to codepoint, advance pointer by 1
-                codepoint = *read_ptr;
-                read_ptr++;
-                break;
-            case 2:
-                // in the case of 2 byte char, the first 3 bytes of the first byte are encoding-related, mask them off
-                // save masked contents of byte to codepoint, advance pointer by 1
-                codepoint = *read_ptr & 0x1F;
-                read_ptr++;
-                break;
-            case 3:
-                // in the case of 3 byte char, the first 4 bytes of the first byte are encoding-related, mask them off
-                // save masked contents of byte to codepoint, advance pointer by 1
-                codepoint = *read_ptr & 0x0F;
-                read_ptr++;
-                break;
-            case 4:
-                // in the case of 4 byte char, the first 5 bytes of the first byte are encoding-related, mask them off
-                // save masked contents of byte to codepoint, advance pointer by 1
-                codepoint = *read_ptr & 0x07;
-                read_ptr++;
-                break;
-        }
+    validation->num_bytes = (unsigned int)num_bytes;
+    validation->utf16_bytes = (unsigned int)utf16_bytes;
+    validation->max_codepoint = max_codepoint;
 
-        // each time this loop iterates, the values currently in codepoint are shifted 6 bits to the right and
-        // 6 bits at the current read pointer is copied into codepoint
-        //
-        // e.g. for a 2 byte utf8 char, e.g. before shifting: 0x0003, after shifting: 0x00C0
-        //
-        // the useful part of the current read pointer's value is only the first 6 bits, as each continuation byte is guaranteed to have "10" in bits 7 and 6
-        // we mask off these bits then OR the output with codepoint to effectively add it in
-        // e.g. before OR: 0x00C0, 
-        // after: 0x00C0 | (0x83 & 0x3F)
-        // = 0x00C0 | 0x03 
-        // = 0x00C3
-        
-        // repeat until out of bytes
-        for (unsigned int i = 1; i < current_utf8_char_num_bytes; i++) {
-            // check if bits 7 and 6 are "10"
-            if ((*read_ptr & 0xC0) != 0x80) {
-                free(*utf16_output_string);
-                *utf16_output_string = NULL;
-                return UTF16_PARSE_UTF8_MALFORMED;
-            }
-            codepoint = (codepoint << 6) | (*read_ptr & 0x3F);
-            read_ptr++;
+    return UTF8_PARSE_SUCCESS;
+}
+
+/*
+ * Function to convert UTF-8 to UTF-16 straight into a caller supplied buffer, in either byte order, without any allocation.
+ * - utf16_output_bytes receives the code units in byte_order (UTF16_LITTLE_ENDIAN or UTF16_BIG_ENDIAN), no BOM and no null terminator are written.
+ * - utf16_output_length receives the number of bytes the converted string takes up, whether or not it fit.
+ * - Pass NULL as utf16_output_bytes (and 0 as utf16_output_capacity) to only query that length, the string is still fully checked.
+ *   utf8_validate() gives the same length (utf16_bytes) along with more information about the string.
+ * - Runs of ASCII are widened 16 or 32 bytes at a time on CPUs with SSE2 or AVX2.
+ * - If the output does not fit, UTF16_PARSE_BUFFER_TOO_SMALL is returned and the contents of utf16_output_bytes are unspecified.
+ *
+ * Usage:
+ * unsigned int utf16_length;
+ * if (utf8_to_utf16_bytes(string, NULL, 0, UTF16_LITTLE_ENDIAN, &utf16_length) == UTF16_PARSE_SUCCESS)
+ *     utf8_to_utf16_bytes(string, buffer, utf16_length, UTF16_LITTLE_ENDIAN, &utf16_length); // cannot fail anymore
+ *
+ * Returns (success): UTF16_PARSE_SUCCESS
+ * Returns (failure): UTF16_PARSE_UTF8_MALFORMED, UTF16_PARSE_BUFFER_TOO_SMALL
+ */
+int utf8_to_utf16_bytes(const char *utf8_input_string, uint8_t *utf16_output_bytes, unsigned int utf16_output_capacity, int byte_order, unsigned int *utf16_output_length) {
+    // shifts that put the high and low byte of a code unit at the right place in the output
+    unsigned int first_byte_shift = byte_order == UTF16_BIG_ENDIAN ? 8 : 0;
+    unsigned int second_byte_shift = byte_order == UTF16_BIG_ENDIAN ? 0 : 8;
+
+    size_t output_length = 0;
+    const unsigned char *read_ptr = (const unsigned char *)utf8_input_string;
+    const unsigned char *end_ptr = read_ptr + strlen(utf8_input_string);
+
+    while (read_ptr < end_ptr) {
+        // ASCII maps to UTF-16 by zero extension, runs of it are widened many bytes at a time
+        size_t ascii_bytes = _utf8_ascii_run(read_ptr, end_ptr - read_ptr);
+        if (ascii_bytes > 0) {
+            if (output_length + ascii_bytes * 2 <= utf16_output_capacity)
+                _utf8_widen_ascii(read_ptr, ascii_bytes, utf16_output_bytes + output_length, byte_order);
+
+            read_ptr += ascii_bytes;
+            output_length += ascii_bytes * 2;
+            continue;
         }
 
+        uint32_t codepoint;
+        unsigned int current_utf8_char_num_bytes = _utf8_decode(read_ptr, &codepoint);
+        if (current_utf8_char_num_bytes == 0)
+            return UTF16_PARSE_UTF8_MALFORMED;
+        read_ptr += current_utf8_char_num_bytes;
+
         // convert codepoint to utf16
+        uint16_t code_units[2];
+        unsigned int num_code_units;
+
         if (codepoint <= 0xFFFF) {
             // characters 1,2 or 3 bytes wide in utf8 encoded to utf16 fit into 16bits and can be written as is
-            // write to output, then increment output pointer to prepare for next write
-            *output_ptr = (uint16_t)codepoint;
-            output_ptr++;
+            code_units[0] = (uint16_t)codepoint;
+            num_code_units = 1;
         } else {
             // characters 4 bytes in utf8 require 32bits, encoded as two surrogate pairs
             
             // 0x10000 is subtracted from the code point (U), leaving a 20-bit number (U') in the hex number range 0x00000–0xFFFFF
             codepoint -= 0x10000;
             // the high ten bits(in the range 0x000–0x3FF) are added to 0xD800 to give the first 16-bit code unit or high surrogate
-            *output_ptr = (uint16_t)((codepoint >> 10) + 0xD800);
-            output_ptr++;
+            code_units[0] = (uint16_t)((codepoint >> 10) + 0xD800);
             // the low ten bits (also in the range 0x000–0x3FF) are added to 0xDC00 to give the second 16-bit code unit or low surrogate
-            *output_ptr = (uint16_t)((codepoint & 0x3FF) + 0xDC00);
-            output_ptr++;
+            code_units[1] = (uint16_t)((codepoint & 0x3FF) + 0xDC00);
+            num_code_units = 2;
+        }
+
+        // write in the requested byte order, or just keep counting once the output is full (or absent)
+        for (unsigned int i = 0; i < num_code_units; i++) {
+            if (output_length + 2 <= utf16_output_capacity) {
+                utf16_output_bytes[output_length] = (code_units[i] >> first_byte_shift) & 0xFF;
+                utf16_output_bytes[output_length + 1] = (code_units[i] >> second_byte_shift) & 0xFF;
+            }
+            output_length += 2;
         }
     }
 
-    *output_ptr = '\0';
-    *utf16_computed_length = output_ptr - *utf16_output_string;
+    *utf16_output_length = (unsigned int)output_length;
+
+    if (utf16_output_bytes != NULL && output_length > utf16_output_capacity)
+        return UTF16_PARSE_BUFFER_TOO_SMALL;
+
     return UTF16_PARSE_SUCCESS;
 }
 
+/*
+ * Function to convert UTF-8 to UTF-16 with LE encoding into a newly allocated, null terminated array, free it with ID3_FREE() (see id3_alloc.h).
+ * utf16_computed_length receives the number of code units, not including the null terminator.
+ * See utf8_to_utf16_bytes() to convert without allocating.
+ */
+int utf8_to_utf16_le(const char *utf8_input_string, uint16_t **utf16_output_string, unsigned int *utf16_computed_length) {
+    return _utf8_to_utf16_alloc(utf8_input_string, utf16_output_string, utf16_computed_length, UTF16_LITTLE_ENDIAN);
+}
+
+// Same as utf8_to_utf16_le(), with BE encoding.
 int utf8_to_utf16_be(const char *utf8_input_string, uint16_t **utf16_output_string, unsigned int *utf16_computed_length) {
-    int utf16_fication_outcome = utf8_to_utf16_le(utf8_input_string, utf16_output_string, utf16_computed_length);
-    if(utf16_fication_outcome != UTF16_PARSE_SUCCESS){
-        return utf16_fication_outcome;
+    return _utf8_to_utf16_alloc(utf8_input_string, utf16_output_string, utf16_computed_length, UTF16_BIG_ENDIAN);
+}
+
+/*
+ * Function to convert a null terminated (0x00 0x00) UTF-16 LE byte sequence back into UTF-8.
+ * Works like snprintf: at most utf8_output_bytes bytes (including the null terminator) are written to utf8_output_string,
+ * and the full length of the converted string is returned regardless. Characters are never cut in half.
+ * - utf8_output_string may be NULL if utf8_output_bytes is 0, to query the required length.
+ * - Unpaired surrogates are replaced by U+FFFD.
+ *
+ * Returns: length in bytes of the UTF-8 string, not including the null terminator
+ */
+unsigned int utf16_le_to_utf8(const uint8_t *utf16_input_bytes, char *utf8_output_string, unsigned int utf8_output_bytes) {
+    unsigned int utf8_length = 0, written_length = 0;
+    const uint8_t *read_ptr = utf16_input_bytes;
+
+    while (1) {
+        uint32_t codepoint = read_ptr[0] | (read_ptr[1] << 8);
+        if (codepoint == 0)
+            break;
+        read_ptr += 2;
+
+        // high surrogate followed by low surrogate forms one codepoint, reverse of utf8_to_utf16_le()
+        if (codepoint >= 0xD800 && codepoint <= 0xDBFF) {
+            uint32_t low_surrogate = read_ptr[0] | (read_ptr[1] << 8);
+            if (low_surrogate >= 0xDC00 && low_surrogate <= 0xDFFF) {
+                codepoint = 0x10000 + ((codepoint - 0xD800) << 10) + (low_surrogate - 0xDC00);
+                read_ptr += 2;
+            } else {
+                codepoint = 0xFFFD;
+            }
+        } else if (codepoint >= 0xDC00 && codepoint <= 0xDFFF) {
+            codepoint = 0xFFFD;
+        }
+
+        // only whole characters are written, once one doesn't fit nothing after it is written either
+        uint8_t encoded[4];
+        unsigned int encoded_length = _utf8_encode_codepoint(codepoint, encoded);
+        if (written_length == utf8_length && utf8_length + encoded_length < utf8_output_bytes) {
+            memcpy(utf8_output_string + written_length, encoded, encoded_length);
+            written_length += encoded_length;
+        }
+        utf8_length += encoded_length;
     }
 
-    uint16_t *read_ptr = *utf16_output_string;
-    // for LE encoding, the top and bottom 8 bits swap position
-    for (unsigned int i = 0; i < *utf16_computed_length; ++i) {
-        uint16_t value = read_ptr[i];
-        read_ptr[i] = (value >> 8) | (value << 8);  // Swap high and low bytes
+    if (utf8_output_bytes > 0)
+        utf8_output_string[written_length] = '\0';
+
+    return utf8_length;
+}
+
+/*
+ * Function to convert a null terminated ISO-8859-1 string into UTF-8. Every byte is taken as the codepoint of the same value.
+ * Same output semantics as utf16_le_to_utf8().
+ *
+ * Returns: length in bytes of the UTF-8 string, not including the null terminator
+ */
+unsigned int iso_8859_1_to_utf8(const char *iso_input_string, char *utf8_output_string, unsigned int utf8_output_bytes) {
+    unsigned int utf8_length = 0, written_length = 0;
+    const unsigned char *read_ptr = (const unsigned char *)iso_input_string;
+
+    for (; *read_ptr != '\0'; read_ptr++) {
+        uint8_t encoded[4];
+        unsigned int encoded_length = _utf8_encode_codepoint(*read_ptr, encoded);
+        if (written_length == utf8_length && utf8_length + encoded_length < utf8_output_bytes) {
+            memcpy(utf8_output_string + written_length, encoded, encoded_length);
+            written_length += encoded_length;
+        }
+        utf8_length += encoded_length;
     }
 
+    if (utf8_output_bytes > 0)
+        utf8_output_string[written_length] = '\0';
+
+    return utf8_length;
+}
+
+/*
+ * Function to convert UTF-8 to ISO-8859-1 (Latin-1) straight into a caller supplied buffer, each codepoint up to U+00FF becoming the byte of the same value.
+ * Same output semantics as utf8_to_utf16_bytes(): no null terminator is written, iso_output_length receives the number of bytes
+ * the converted string takes up whether or not it fit, and a NULL iso_output_bytes (with 0 as iso_output_capacity) only queries that length.
+ * - Runs of ASCII are copied as is.
+ *
+ * Returns (success): ISO_PARSE_SUCCESS
+ * Returns (failure): ISO_PARSE_UTF8_MALFORMED, ISO_PARSE_UNREPRESENTABLE if a codepoint is above U+00FF, ISO_PARSE_BUFFER_TOO_SMALL
+ */
+int utf8_to_iso_8859_1(const char *utf8_input_string, uint8_t *iso_output_bytes, unsigned int iso_output_capacity, unsigned int *iso_output_length) {
+    size_t output_length = 0;
+    const unsigned char *read_ptr = (const unsigned char *)utf8_input_string;
+    const unsigned char *end_ptr = read_ptr + strlen(utf8_input_string);
+
+    while (read_ptr < end_ptr) {
+        size_t ascii_bytes = _utf8_ascii_run(read_ptr, end_ptr - read_ptr);
+        if (ascii_bytes > 0) {
+            if (output_length + ascii_bytes <= iso_output_capacity)
+                memcpy(iso_output_bytes + output_length, read_ptr, ascii_bytes);
+
+            read_ptr += ascii_bytes;
+            output_length += ascii_bytes;
+            continue;
+        }
+
+        uint32_t codepoint;
+        unsigned int current_utf8_char_num_bytes = _utf8_decode(read_ptr, &codepoint);
+        if (current_utf8_char_num_bytes == 0)
+            return ISO_PARSE_UTF8_MALFORMED;
+        if (codepoint > 0xFF)
+            return ISO_PARSE_UNREPRESENTABLE;
+        read_ptr += current_utf8_char_num_bytes;
+
+        if (output_length + 1 <= iso_output_capacity)
+            iso_output_bytes[output_length] = (uint8_t)codepoint;
+        output_length++;
+    }
+
+    *iso_output_length = (unsigned int)output_length;
+
+    if (iso_output_bytes != NULL && output_length > iso_output_capacity)
+        return ISO_PARSE_BUFFER_TOO_SMALL;
+
+    return ISO_PARSE_SUCCESS;
+}
+
+// Internal function backing utf8_to_utf16_le() and utf8_to_utf16_be(): measures the string, then converts it into an array of exactly that size.
+int _utf8_to_utf16_alloc(const char *utf8_input_string, uint16_t **utf16_output_string, unsigned int *utf16_computed_length, int byte_order) {
+    unsigned int utf16_bytes = 0;
+    *utf16_output_string = NULL;
+
+    int utf16_fication_outcome = utf8_to_utf16_bytes(utf8_input_string, NULL, 0, byte_order, &utf16_bytes);
+    if (utf16_fication_outcome != UTF16_PARSE_SUCCESS)
+        return utf16_fication_outcome;
+
+    uint16_t *utf16_string = (uint16_t *)ID3_MALLOC(utf16_bytes + sizeof(uint16_t));
+    if (utf16_string == NULL)  // check if malloc succeeds
+        return UTF16_PARSE_NO_MEM;
+
+    utf8_to_utf16_bytes(utf8_input_string, (uint8_t *)utf16_string, utf16_bytes, byte_order, &utf16_bytes);
+    utf16_string[utf16_bytes / 2] = 0;
+
+    *utf16_output_string = utf16_string;
+    *utf16_computed_length = utf16_bytes / 2;
     return UTF16_PARSE_SUCCESS;
 }
 
@@ -276,8 +466,11 @@ int utf8_to_utf16_be(const char *utf8_input_string, uint16_t **utf16_output_stri
 unsigned int _utf8_char_length(unsigned char val) {
     // first byte of a UTF-8 character indicates how many bytes are in the character:
     // 0xxxxxxx - 1 byte character | 110xxxxx - 2 byte character | 1110xxxx - 3 byte character | 11110xxx - 4 byte character
+    // 10xxxxxx is a continuation byte, which cannot start a character
     if ((val & (1 << 7)) == 0)
         return 1;
+    else if ((val & (1 << 6)) == 0)
+        return 0;
     else if ((val & (1 << 5)) == 0)
         return 2;
     else if ((val & (1 << 4)) == 0)
@@ -287,3 +480,193 @@ unsigned int _utf8_char_length(unsigned char val) {
     else
         return 0;
 }
+
+/*
+ * Internal function to decode the UTF-8 character starting at read_ptr, checking that it is well formed:
+ * continuation bytes are all 10xxxxxx (which also catches a character cut short by the null terminator),
+ * the character is encoded in as few bytes as possible, and its codepoint is neither a surrogate nor above U+10FFFF.
+ * Returns the length of the character in bytes, 0 if it is malformed.
+ */
+unsigned int _utf8_decode(const unsigned char *read_ptr, uint32_t *codepoint) {
+    // smallest codepoint that needs a character of each length, anything below it is an overlong form
+    static const uint32_t min_codepoint[5] = {0, 0, 0x80, 0x800, 0x10000};
+
+    unsigned int current_utf8_char_num_bytes = _utf8_char_length(*read_ptr);
+
+    // the first 1, 3, 4 or 5 bits of the first byte are encoding-related, mask them off
+    switch (current_utf8_char_num_bytes) {
+        case 0:
+            return 0;
+        case 1:
+            *codepoint = *read_ptr;
+            return 1;
+        case 2:
+            *codepoint = *read_ptr & 0x1F;
+            break;
+        case 3:
+            *codepoint = *read_ptr & 0x0F;
+            break;
+        case 4:
+            *codepoint = *read_ptr & 0x07;
+            break;
+    }
+
+    // each continuation byte adds its 6 useful bits to the right of the codepoint
+    // e.g. 0xC3 0x83: 0x03, then (0x03 << 6) | (0x83 & 0x3F) = 0xC3
+    for (unsigned int i = 1; i < current_utf8_char_num_bytes; i++) {
+        if ((read_ptr[i] & 0xC0) != 0x80)
+            return 0;
+        *codepoint = (*codepoint << 6) | (read_ptr[i] & 0x3F);
+    }
+
+    if (*codepoint < min_codepoint[current_utf8_char_num_bytes] || *codepoint > 0x10FFFF || (*codepoint >= 0xD800 && *codepoint <= 0xDFFF))
+        return 0;
+
+    return current_utf8_char_num_bytes;
+}
+
+// Internal function to count how many bytes at the start of string (num_bytes long) are ASCII, using the widest kernel the CPU supports.
+size_t _utf8_ascii_run(const unsigned char *string, size_t num_bytes) {
+#ifdef _UTF_X86_SIMD
+    if (num_bytes >= 32 && __builtin_cpu_supports("avx2"))
+        return _utf8_ascii_run_avx2(string, num_bytes);
+    if (num_bytes >= 16 && __builtin_cpu_supports("sse2"))
+        return _utf8_ascii_run_sse2(string, num_bytes);
+#endif
+    return _utf8_ascii_run_scalar(string, num_bytes);
+}
+
+// Internal function, scalar _utf8_ascii_run(), 8 bytes at a time.
+size_t _utf8_ascii_run_scalar(const unsigned char *string, size_t num_bytes) {
+    size_t examined_index = 0;
+
+    // a byte is ASCII if its top bit is clear
+    for (; examined_index + 8 <= num_bytes; examined_index += 8) {
+        uint64_t block;
+        memcpy(&block, string + examined_index, sizeof(block));
+        if (block & 0x8080808080808080ULL)
+            break;
+    }
+
+    while (examined_index < num_bytes && string[examined_index] < 0x80)
+        examined_index++;
+
+    return examined_index;
+}
+
+// Internal function to write num_bytes of ASCII string as UTF-16 code units in byte_order, using the widest kernel the CPU supports.
+void _utf8_widen_ascii(const unsigned char *string, size_t num_bytes, uint8_t *output, int byte_order) {
+#ifdef _UTF_X86_SIMD
+    if (num_bytes >= 32 && __builtin_cpu_supports("avx2")) {
+        _utf8_widen_ascii_avx2(string, num_bytes, output, byte_order);
+        return;
+    }
+    if (num_bytes >= 16 && __builtin_cpu_supports("sse2")) {
+        _utf8_widen_ascii_sse2(string, num_bytes, output, byte_order);
+        return;
+    }
+#endif
+    _utf8_widen_ascii_scalar(string, num_bytes, output, byte_order);
+}
+
+// Internal function, scalar _utf8_widen_ascii().
+void _utf8_widen_ascii_scalar(const unsigned char *string, size_t num_bytes, uint8_t *output, int byte_order) {
+    unsigned int zero_index = byte_order == UTF16_BIG_ENDIAN ? 0 : 1;
+
+    for (size_t i = 0; i < num_bytes; i++) {
+        output[i * 2 + zero_index] = 0x00;
+        output[i * 2 + (1 - zero_index)] = string[i];
+    }
+}
+
+#ifdef _UTF_X86_SIMD
+// Internal function, SSE2 _utf8_ascii_run(), 16 bytes at a time.
+__attribute__((target("sse2"))) size_t _utf8_ascii_run_sse2(const unsigned char *string, size_t num_bytes) {
+    size_t examined_index = 0;
+
+    for (; examined_index + 16 <= num_bytes; examined_index += 16) {
+        // one bit per byte, set if its top bit is set
+        unsigned int non_ascii_mask = (unsigned int)_mm_movemask_epi8(_mm_loadu_si128((const __m128i *)(string + examined_index)));
+        if (non_ascii_mask != 0)
+            return examined_index + __builtin_ctz(non_ascii_mask);
+    }
+
+    return examined_index + _utf8_ascii_run_scalar(string + examined_index, num_bytes - examined_index);
+}
+
+// Internal function, AVX2 _utf8_ascii_run(), 32 bytes at a time.
+__attribute__((target("avx2"))) size_t _utf8_ascii_run_avx2(const unsigned char *string, size_t num_bytes) {
+    size_t examined_index = 0;
+
+    for (; examined_index + 32 <= num_bytes; examined_index += 32) {
+        unsigned int non_ascii_mask = (unsigned int)_mm256_movemask_epi8(_mm256_loadu_si256((const __m256i *)(string + examined_index)));
+        if (non_ascii_mask != 0)
+            return examined_index + __builtin_ctz(non_ascii_mask);
+    }
+
+    return examined_index + _utf8_ascii_run_scalar(string + examined_index, num_bytes - examined_index);
+}
+
+// Internal function, SSE2 _utf8_widen_ascii(), 16 bytes at a time.
+__attribute__((target("sse2"))) void _utf8_widen_ascii_sse2(const unsigned char *string, size_t num_bytes, uint8_t *output, int byte_order) {
+    const __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+
+    for (; i + 16 <= num_bytes; i += 16) {
+        __m128i ascii = _mm_loadu_si128((const __m128i *)(string + i));
+
+        // interleaving with zero bytes gives the code units, the zero byte goes first for BE
+        __m128i low_units = byte_order == UTF16_BIG_ENDIAN ? _mm_unpacklo_epi8(zero, ascii) : _mm_unpacklo_epi8(ascii, zero);
+        __m128i high_units = byte_order == UTF16_BIG_ENDIAN ? _mm_unpackhi_epi8(zero, ascii) : _mm_unpackhi_epi8(ascii, zero);
+
+        _mm_storeu_si128((__m128i *)(output + i * 2), low_units);
+        _mm_storeu_si128((__m128i *)(output + i * 2 + 16), high_units);
+    }
+
+    _utf8_widen_ascii_scalar(string + i, num_bytes - i, output + i * 2, byte_order);
+}
+
+// Internal function, AVX2 _utf8_widen_ascii(), 32 bytes at a time.
+__attribute__((target("avx2"))) void _utf8_widen_ascii_avx2(const unsigned char *string, size_t num_bytes, uint8_t *output, int byte_order) {
+    size_t i = 0;
+
+    for (; i + 32 <= num_bytes; i += 32) {
+        // zero extension gives LE code units, shifting each one left by 8 bits turns them into BE
+        __m256i low_units = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(string + i)));
+        __m256i high_units = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(string + i + 16)));
+
+        if (byte_order == UTF16_BIG_ENDIAN) {
+            low_units = _mm256_slli_epi16(low_units, 8);
+            high_units = _mm256_slli_epi16(high_units, 8);
+        }
+
+        _mm256_storeu_si256((__m256i *)(output + i * 2), low_units);
+        _mm256_storeu_si256((__m256i *)(output + i * 2 + 32), high_units);
+    }
+
+    _utf8_widen_ascii_scalar(string + i, num_bytes - i, output + i * 2, byte_order);
+}
+#endif
+
+// Internal function to write a codepoint as UTF-8 into encoded (at least 4 bytes). Returns the number of bytes written.
+unsigned int _utf8_encode_codepoint(uint32_t codepoint, uint8_t *encoded) {
+    if (codepoint <= 0x7F) {
+        encoded[0] = (uint8_t)codepoint;
+        return 1;
+    } else if (codepoint <= 0x7FF) {
+        encoded[0] = 0xC0 | (codepoint >> 6);
+        encoded[1] = 0x80 | (codepoint & 0x3F);
+        return 2;
+    } else if (codepoint <= 0xFFFF) {
+        encoded[0] = 0xE0 | (codepoint >> 12);
+        encoded[1] = 0x80 | ((codepoint >> 6) & 0x3F);
+        encoded[2] = 0x80 | (codepoint & 0x3F);
+        return 3;
+    } else {
+        encoded[0] = 0xF0 | (codepoint >> 18);
+        encoded[1] = 0x80 | ((codepoint >> 12) & 0x3F);
+        encoded[2] = 0x80 | ((codepoint >> 6) & 0x3F);
+        encoded[3] = 0x80 | (codepoint & 0x3F);
+        return 4;
+    }
+}
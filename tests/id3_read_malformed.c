@@ -0,0 +1,123 @@
+/*
+ * id3_read_malformed: feeds id3_reader tags whose headers lie about their sizes, every one must be rejected without reading out of bounds.
+ *
+ * Build and run (Linux, from the repository root):
+ * gcc -g -std=c11 -fsanitize=address,undefined -Iinclude tests/id3_read_malformed.c source/id3_*.c source/utf.c -pthread -o id3_read_malformed && ./id3_read_malformed
+ *
+ * Exit status: 0 if every case passed, 1 otherwise.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/id3.h"
+
+/*
+ * A tag to read, followed by zeroed "audio" bytes up to the size of bytes.
+ *
+ * name: Printed if the case fails.
+ * bytes: Start of the file, the first num_header_bytes of it given.
+ * expected_outcome: What reading every frame must end with.
+ */
+typedef struct {
+    const char* name;
+    uint8_t bytes[64];
+    size_t num_header_bytes;
+    unsigned int expected_outcome;
+} _malformed_case;
+
+static const _malformed_case _MALFORMED_CASES[] = {
+    // tag size 3 cannot even hold the 4 byte extended header size
+    {"tag smaller than extended header", {'I', 'D', '3', 0x03, 0x00, 0x40, 0x00, 0x00, 0x00, 0x03, 0x00, 0x00, 0x00, 0x0A, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}, 20,
+     TAG_INVALID_VALUE},
+    // tag size 8 holds the extended header size but not the 6 bytes it announces
+    {"extended header past tag end", {'I', 'D', '3', 0x03, 0x00, 0x40, 0x00, 0x00, 0x00, 0x08, 0x00, 0x00, 0x00, 0x06, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}, 20,
+     TAG_INVALID_VALUE},
+    // as above with the CRC flag set, the checksum of what lies past the last frame must not start past the frames
+    {"CRC over tag smaller than extended header", {'I', 'D', '3', 0x03, 0x00, 0x40, 0x00, 0x00, 0x00, 0x03, 0x00, 0x00, 0x00, 0x0A, 0x80, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}, 24,
+     TAG_INVALID_VALUE},
+    // extended header size near 2^32, the sum must not wrap
+    {"huge extended header", {'I', 'D', '3', 0x03, 0x00, 0x40, 0x00, 0x00, 0x00, 0x20, 0xFF, 0xFF, 0xFF, 0xFA, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}, 20,
+     TAG_INVALID_VALUE},
+    // 10 bytes of extended header leave no room for 0x20 bytes of padding in a tag of 0x10
+    {"padding past tag end", {'I', 'D', '3', 0x03, 0x00, 0x40, 0x00, 0x00, 0x00, 0x10, 0x00, 0x00, 0x00, 0x06, 0x00, 0x00, 0x00, 0x00, 0x00, 0x20}, 20,
+     TAG_INVALID_VALUE},
+    // a frame claiming more content than the tag holds
+    {"frame past tag end", {'I', 'D', '3', 0x03, 0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 'T', 'I', 'T', '2', 0x00, 0x00, 0x00, 0x08, 0x00, 0x00, 0x00, 'x'}, 22,
+     TAG_INVALID_VALUE},
+    // the smallest well formed tag with an extended header, as a baseline
+    {"empty tag with extended header", {'I', 'D', '3', 0x03, 0x00, 0x40, 0x00, 0x00, 0x00, 0x0A, 0x00, 0x00, 0x00, 0x06, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}, 20,
+     TAG_READ_SUCCESS},
+};
+
+// ["PRIVATE" FUNCTIONS] /////////////////////////////////////////////
+
+unsigned int _malformed_read(const _malformed_case* malformed_case);
+//////////////////////////////////////////////////////////////////////
+
+int main() {
+    int num_failed = 0;
+
+    for (size_t i = 0; i < sizeof(_MALFORMED_CASES) / sizeof(_MALFORMED_CASES[0]); i++) {
+        unsigned int outcome = _malformed_read(&_MALFORMED_CASES[i]);
+
+        if (outcome != _MALFORMED_CASES[i].expected_outcome) {
+            fprintf(stderr, "%s: got %u, expected %u\n", _MALFORMED_CASES[i].name, outcome, _MALFORMED_CASES[i].expected_outcome);
+            num_failed++;
+        }
+    }
+
+    printf("%d failed\n", num_failed);
+
+    return num_failed > 0;
+}
+
+/*
+ * [INTERNAL FUNCTION]
+ * Reads every frame of a case, handing the reader exactly as many bytes as it asks for so that any read past them is caught by ASan.
+ *
+ * Returns: the outcome reading ended with
+ */
+unsigned int _malformed_read(const _malformed_case* malformed_case) {
+    uint8_t file_bytes[sizeof(malformed_case->bytes)];
+    memset(file_bytes, 0x00, sizeof(file_bytes));
+    memcpy(file_bytes, malformed_case->bytes, malformed_case->num_header_bytes);
+
+    id3_reader reader;
+    id3_reader_init(&reader, NULL, 0, 0);
+
+    size_t num_bytes = 0;
+    uint8_t* available = NULL;
+    unsigned int outcome;
+
+    while (1) {
+        id3_read_frame frame;
+        size_t bytes_needed;
+
+        outcome = id3_reader_next(&reader, available, num_bytes, &frame, &bytes_needed);
+        if (outcome == TAG_READ_FRAME)
+            continue;
+        if (outcome != TAG_READ_NEED_MORE)
+            break;
+        if (bytes_needed > sizeof(file_bytes)) {
+            outcome = TAG_INVALID_VALUE;
+            break;
+        }
+
+        // sized exactly, so that reading a byte more is a heap overflow
+        uint8_t* grown_available = (uint8_t*)realloc(available, bytes_needed);
+        if (grown_available == NULL) {
+            outcome = NODE_MEMORY_ERROR;
+            break;
+        }
+
+        available = grown_available;
+        num_bytes = bytes_needed;
+        memcpy(available, file_bytes, num_bytes);
+    }
+
+    free(available);
+
+    return outcome;
+}
@@ -0,0 +1,941 @@
+/*
+ * id3_retag: retags many files from a manifest in one process.
+ *
+ * Build (Linux, from the repository root):
+ * gcc -O2 -std=c11 -Iinclude tools/id3_retag.c source/id3_*.c source/utf.c -pthread -o id3_retag
+ * Add -DID3_WITH_ZLIB and -lz for -z to have any effect.
+ *
+ * Usage: id3_retag [-f csv|jsonl] [-j threads] [-b files_per_batch] [-c picture_cache_mib] [-z compression_threshold_bytes] [-l] [-x] [-q] [manifest]
+ * The manifest is read from standard input if not given or "-". Its format is guessed from its extension (.jsonl, .ndjson: JSONL, else CSV)
+ * unless given with -f. -l writes frames in ID3_FRAME_LAYOUT_READ_OPTIMIZED order (title, artist, album... first, pictures last).
+ * -x writes an extended header with the CRC-32 of the frames.
+ *
+ * Each manifest row sets one frame of one file, through these fields:
+ * path, frame, value, language, description, mime_type, picture_type
+ * - Text frames (TIT2, TALB, ...): value is the text.
+ * - COMM: value is the comment, language defaults to "eng" and description to "".
+ * - TXXX, WXXX: value is the text or URL, description (default "") tells frames of the same kind apart.
+ * - APIC: value is the picture's file path, mime_type is required, picture_type defaults to 3 (front cover) and description to "".
+ * CSV rows list the fields in the order above, trailing ones can be left out. Fields follow RFC 4180 quoting (quoted fields may span lines),
+ * a header row starting with "path,frame" is skipped. JSONL rows are objects with the fields as keys, picture_type can be a number.
+ *
+ * Rows of a file are grouped into one tag, which replaces the file's ID3v2 tag while keeping the audio after it. Rows of a file should be
+ * consecutive: groups are tagged in batches of files, and a file that comes up again after its batch was written is tagged again with only
+ * its later rows. Memory use is bounded by the batch size and the picture cache cap, however long the manifest is.
+ * A row that cannot be used (unknown frame, missing value, unreadable picture) is reported with its line number, and its file is left untouched.
+ *
+ * Exit status: 0 if every file was retagged, 1 if some were not (or the run was interrupted), 2 on usage or manifest errors.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../include/id3.h"
+
+#define _RETAG_FORMAT_CSV 0
+#define _RETAG_FORMAT_JSONL 1
+
+#define _RETAG_FIELD_PATH 0
+#define _RETAG_FIELD_FRAME 1
+#define _RETAG_FIELD_VALUE 2
+#define _RETAG_FIELD_LANGUAGE 3
+#define _RETAG_FIELD_DESCRIPTION 4
+#define _RETAG_FIELD_MIME_TYPE 5
+#define _RETAG_FIELD_PICTURE_TYPE 6
+#define _RETAG_NUM_FIELDS 7
+
+#define _RETAG_ROW_READ 1
+#define _RETAG_ROW_END 0
+#define _RETAG_ROW_ERROR -1
+
+#define _RETAG_DEFAULT_FILES_PER_BATCH 1024
+#define _RETAG_DEFAULT_PICTURE_CACHE_MIB 64
+#define _RETAG_COPY_BUFFER_BYTES (64 * 1024)
+#define _RETAG_TEMP_SUFFIX ".id3-retag.tmp"
+
+static const char* const _retag_field_names[_RETAG_NUM_FIELDS] = {"path", "frame", "value", "language", "description", "mime_type", "picture_type"};
+
+/*
+ * Streams rows out of a manifest, one row in memory at a time.
+ *
+ * line, line_capacity: Current line, as read by getline().
+ * field_data: Decoded fields of the current row, each null terminated, field_offsets[i] is where field i starts (SIZE_MAX if absent).
+ * row_line_number: Line the current row starts on.
+ * error: Describes the last _RETAG_ROW_ERROR.
+ */
+typedef struct {
+    FILE* file;
+    int format;
+    char* line;
+    size_t line_capacity;
+    char* field_data;
+    size_t field_data_bytes;
+    size_t field_data_capacity;
+    size_t field_offsets[_RETAG_NUM_FIELDS];
+    unsigned long long line_number;
+    unsigned long long row_line_number;
+    const char* error;
+} _retag_reader;
+
+/*
+ * A file being retagged, built from its rows.
+ *
+ * path, temp_path: Live in the builder's arena. The tag is written to temp_path, the audio of path appended, then temp_path renamed to path.
+ * is_invalid: One of its rows could not be used, the file is skipped.
+ * outcome: TAG_WRITE_SUCCESS once renamed over path, see id3_write_tag() otherwise.
+ */
+typedef struct {
+    id3_tag_builder builder;
+    char* path;
+    char* temp_path;
+    int is_invalid;
+    unsigned int outcome;
+} _retag_file;
+
+/*
+ * files: One builder per file of a batch, reused from batch to batch.
+ * path_slots: Open addressing table of files of the current batch by path, holding index + 1 (0 for empty).
+ * job_files: File each batch job belongs to.
+ */
+typedef struct {
+    _retag_file* files;
+    size_t num_files;
+    size_t max_files;
+    size_t* path_slots;
+    size_t num_path_slots;
+    id3_batch_job* jobs;
+    _retag_file** job_files;
+    id3_picture_cache picture_cache;
+    id3_batch_options batch_options;
+    int is_quiet;
+    int is_progress_shown;
+    unsigned long long num_retagged;
+    unsigned long long num_failed;
+} _retag_state;
+
+static atomic_int _retag_cancel = 0;
+
+// ["PRIVATE" FUNCTIONS] /////////////////////////////////////////////
+
+void _retag_usage(const char* program_name);
+void _retag_on_signal(int signal_number);
+int _reader_append(_retag_reader* reader, const char* bytes, size_t num_bytes);
+int _reader_next_line(_retag_reader* reader);
+int _reader_read_row(_retag_reader* reader);
+int _reader_read_csv_row(_retag_reader* reader);
+int _reader_read_jsonl_row(_retag_reader* reader);
+int _json_read_string(_retag_reader* reader, const char** cursor);
+int _json_read_hex4(const char* cursor, uint32_t* code_unit);
+const char* _reader_field(_retag_reader* reader, int field);
+uint64_t _retag_hash(const char* string);
+_retag_file* _retag_file_for_path(_retag_state* state, const char* path, unsigned long long line_number);
+unsigned int _retag_add_row(_retag_state* state, _retag_file* file, _retag_reader* reader);
+const char* _retag_outcome_message(unsigned int outcome);
+void _retag_flush(_retag_state* state);
+void _retag_on_job_done(const id3_batch_job* job, size_t job_index, void* user_data);
+unsigned int _retag_finish_file(_retag_file* file);
+//////////////////////////////////////////////////////////////////////
+
+int main(int argc, char** argv) {
+    int format = -1;
+    unsigned int num_threads = 0;
+    size_t files_per_batch = _RETAG_DEFAULT_FILES_PER_BATCH;
+    size_t picture_cache_mib = _RETAG_DEFAULT_PICTURE_CACHE_MIB;
+    unsigned int compression_threshold_bytes = 0;
+    unsigned int frame_layout = ID3_FRAME_LAYOUT_LIST_ORDER;
+    int is_crc_enabled = 0;
+    int is_quiet = 0;
+    int option;
+
+    while ((option = getopt(argc, argv, "f:j:b:c:z:lxqh")) != -1) {
+        switch (option) {
+            case 'f':
+                if (!strcmp(optarg, "csv"))
+                    format = _RETAG_FORMAT_CSV;
+                else if (!strcmp(optarg, "jsonl"))
+                    format = _RETAG_FORMAT_JSONL;
+                else {
+                    _retag_usage(argv[0]);
+                    return 2;
+                }
+                break;
+            case 'j':
+                num_threads = (unsigned int)strtoul(optarg, NULL, 10);
+                break;
+            case 'b':
+                files_per_batch = (size_t)strtoul(optarg, NULL, 10);
+                break;
+            case 'c':
+                picture_cache_mib = (size_t)strtoul(optarg, NULL, 10);
+                break;
+            case 'z':
+                compression_threshold_bytes = (unsigned int)strtoul(optarg, NULL, 10);
+                break;
+            case 'l':
+                frame_layout = ID3_FRAME_LAYOUT_READ_OPTIMIZED;
+                break;
+            case 'x':
+                is_crc_enabled = 1;
+                break;
+            case 'q':
+                is_quiet = 1;
+                break;
+            default:
+                _retag_usage(argv[0]);
+                return option == 'h' ? 0 : 2;
+        }
+    }
+
+    if (optind + 1 < argc || files_per_batch == 0) {
+        _retag_usage(argv[0]);
+        return 2;
+    }
+
+    const char* manifest_path = optind < argc ? argv[optind] : "-";
+    _retag_reader reader = {.file = stdin, .format = format, .line = NULL, .line_capacity = 0, .field_data = NULL, .field_data_bytes = 0,
+                            .field_data_capacity = 0, .line_number = 0, .row_line_number = 0, .error = NULL};
+
+    if (strcmp(manifest_path, "-")) {
+        reader.file = fopen(manifest_path, "rb");
+        if (reader.file == NULL) {
+            fprintf(stderr, "%s: %s\n", manifest_path, strerror(errno));
+            return 2;
+        }
+
+        const char* extension = strrchr(manifest_path, '.');
+        if (reader.format == -1 && extension != NULL && (!strcmp(extension, ".jsonl") || !strcmp(extension, ".ndjson")))
+            reader.format = _RETAG_FORMAT_JSONL;
+    }
+    if (reader.format == -1)
+        reader.format = _RETAG_FORMAT_CSV;
+
+    _retag_state state = {.num_files = 0, .max_files = files_per_batch, .num_path_slots = 1, .is_quiet = is_quiet,
+                          .is_progress_shown = !is_quiet && isatty(STDERR_FILENO), .num_retagged = 0, .num_failed = 0};
+    while (state.num_path_slots < 2 * files_per_batch)
+        state.num_path_slots *= 2;
+
+    state.files = (_retag_file*)malloc(files_per_batch * sizeof(_retag_file));
+    state.path_slots = (size_t*)calloc(state.num_path_slots, sizeof(size_t));
+    state.jobs = (id3_batch_job*)malloc(files_per_batch * sizeof(id3_batch_job));
+    state.job_files = (_retag_file**)malloc(files_per_batch * sizeof(_retag_file*));
+
+    // malloc check
+    if (state.files == NULL || state.path_slots == NULL || state.jobs == NULL || state.job_files == NULL) {
+        fprintf(stderr, "out of memory\n");
+        return 2;
+    }
+
+    for (size_t i = 0; i < files_per_batch; i++) {
+        id3_tag_builder_init(&state.files[i].builder);
+        state.files[i].builder.master_tag.compression_threshold_bytes = compression_threshold_bytes;
+        state.files[i].builder.master_tag.frame_layout = frame_layout;
+        state.files[i].builder.master_tag.is_crc_enabled = is_crc_enabled;
+    }
+
+    id3_picture_cache_init(&state.picture_cache, picture_cache_mib * 1024 * 1024);
+    id3_batch_options_init(&state.batch_options);
+    state.batch_options.num_threads = num_threads;
+    state.batch_options.cancel = &_retag_cancel;
+    state.batch_options.on_job_done = _retag_on_job_done;
+    state.batch_options.user_data = &state;
+
+    struct sigaction cancel_action;
+    memset(&cancel_action, 0, sizeof(cancel_action));
+    cancel_action.sa_handler = _retag_on_signal;
+    sigaction(SIGINT, &cancel_action, NULL);
+    sigaction(SIGTERM, &cancel_action, NULL);
+
+    int exit_status = 0;
+    int read_outcome;
+
+    while (!atomic_load(&_retag_cancel) && (read_outcome = _reader_read_row(&reader)) != _RETAG_ROW_END) {
+        if (read_outcome == _RETAG_ROW_ERROR) {
+            fprintf(stderr, "%s:%llu: %s\n", manifest_path, reader.row_line_number, reader.error);
+            exit_status = 2;
+            break;
+        }
+
+        const char* path = _reader_field(&reader, _RETAG_FIELD_PATH);
+        if (path == NULL || path[0] == '\0') {
+            fprintf(stderr, "%s:%llu: missing path\n", manifest_path, reader.row_line_number);
+            state.num_failed++;
+            continue;
+        }
+
+        _retag_file* file = _retag_file_for_path(&state, path, reader.row_line_number);
+        if (file == NULL) {
+            fprintf(stderr, "out of memory\n");
+            exit_status = 2;
+            break;
+        }
+        if (file->is_invalid)
+            continue;
+
+        unsigned int add_outcome = _retag_add_row(&state, file, &reader);
+        if (add_outcome != NODE_ADD_SUCCESS && add_outcome != NODE_UPDATE_SUCCESS) {
+            const char* frame = _reader_field(&reader, _RETAG_FIELD_FRAME);
+            fprintf(stderr, "%s:%llu: %s %s: %s, file left untouched\n", manifest_path, reader.row_line_number, path,
+                    frame != NULL ? frame : "", _retag_outcome_message(add_outcome));
+            file->is_invalid = 1;
+        }
+    }
+
+    _retag_flush(&state);
+
+    if (state.is_progress_shown)
+        fprintf(stderr, "\n");
+    if (atomic_load(&_retag_cancel))
+        fprintf(stderr, "interrupted, files after the last batch were not read\n");
+    if (!is_quiet)
+        fprintf(stderr, "%llu files retagged, %llu failed\n", state.num_retagged, state.num_failed);
+
+    if (exit_status == 0 && (state.num_failed > 0 || atomic_load(&_retag_cancel)))
+        exit_status = 1;
+
+    for (size_t i = 0; i < files_per_batch; i++)
+        id3_tag_builder_release(&state.files[i].builder);
+    id3_picture_cache_destroy(&state.picture_cache);
+    free(state.files);
+    free(state.path_slots);
+    free(state.jobs);
+    free(state.job_files);
+    free(reader.line);
+    free(reader.field_data);
+    if (reader.file != stdin)
+        fclose(reader.file);
+
+    return exit_status;
+}
+
+/*
+ * [INTERNAL FUNCTION]
+ * Prints how to use the tool.
+ */
+void _retag_usage(const char* program_name) {
+    fprintf(stderr,
+            "Usage: %s [-f csv|jsonl] [-j threads] [-b files_per_batch] [-c picture_cache_mib] [-z compression_threshold_bytes] [-l] [-x] [-q] [manifest]\n"
+            "Rows: path, frame, value, language, description, mime_type, picture_type\n",
+            program_name);
+}
+
+/*
+ * [INTERNAL FUNCTION]
+ * SIGINT and SIGTERM: stop reading the manifest and starting files, files being written are finished.
+ */
+void _retag_on_signal(int signal_number) {
+    (void)signal_number;
+    atomic_store(&_retag_cancel, 1);
+}
+
+/*
+ * [INTERNAL FUNCTION]
+ * Appends num_bytes of bytes to the fields of the current row.
+ *
+ * Returns (success): 1
+ * Returns (failure): 0
+ */
+int _reader_append(_retag_reader* reader, const char* bytes, size_t num_bytes) {
+    if (reader->field_data_bytes + num_bytes > reader->field_data_capacity) {
+        size_t new_capacity = reader->field_data_capacity > 0 ? reader->field_data_capacity : 256;
+        while (new_capacity < reader->field_data_bytes + num_bytes)
+            new_capacity *= 2;
+
+        char* new_field_data = (char*)realloc(reader->field_data, new_capacity);
+        if (new_field_data == NULL)
+            return 0;
+
+        reader->field_data = new_field_data;
+        reader->field_data_capacity = new_capacity;
+    }
+
+    memcpy(reader->field_data + reader->field_data_bytes, bytes, num_bytes);
+    reader->field_data_bytes += num_bytes;
+
+    return 1;
+}
+
+/*
+ * [INTERNAL FUNCTION]
+ * Reads the next line of the manifest, without its line ending.
+ *
+ * Returns (success): 1
+ * Returns (failure): 0 at the end of the manifest
+ */
+int _reader_next_line(_retag_reader* reader) {
+    ssize_t line_bytes = getline(&reader->line, &reader->line_capacity, reader->file);
+    if (line_bytes < 0)
+        return 0;
+
+    while (line_bytes > 0 && (reader->line[line_bytes - 1] == '\n' || reader->line[line_bytes - 1] == '\r'))
+        reader->line[--line_bytes] = '\0';
+
+    reader->line_number++;
+
+    return 1;
+}
+
+/*
+ * [INTERNAL FUNCTION]
+ * Reads the next row of the manifest, skipping blank lines (and the CSV header).
+ *
+ * Returns: _RETAG_ROW_READ, _RETAG_ROW_END, _RETAG_ROW_ERROR (see reader->error)
+ */
+int _reader_read_row(_retag_reader* reader) {
+    for (;;) {
+        if (!_reader_next_line(reader))
+            return _RETAG_ROW_END;
+
+        if (reader->line[strspn(reader->line, " \t")] == '\0')
+            continue;
+
+        reader->row_line_number = reader->line_number;
+        reader->field_data_bytes = 0;
+        for (int i = 0; i < _RETAG_NUM_FIELDS; i++)
+            reader->field_offsets[i] = SIZE_MAX;
+
+        if (reader->format == _RETAG_FORMAT_JSONL)
+            return _reader_read_jsonl_row(reader);
+
+        int read_outcome = _reader_read_csv_row(reader);
+        if (read_outcome == _RETAG_ROW_READ && reader->row_line_number == 1 && !strcmp(_reader_field(reader, _RETAG_FIELD_PATH), "path") &&
+            _reader_field(reader, _RETAG_FIELD_FRAME) != NULL && !strcmp(_reader_field(reader, _RETAG_FIELD_FRAME), "frame"))
+            continue;
+
+        return read_outcome;
+    }
+}
+
+/*
+ * [INTERNAL FUNCTION]
+ * Splits the current line (and the following ones, for quoted fields spanning lines) into fields.
+ *
+ * Returns: see _reader_read_row()
+ */
+int _reader_read_csv_row(_retag_reader* reader) {
+    int num_fields = 0;
+    const char* cursor = reader->line;
+
+    for (;;) {
+        if (num_fields == _RETAG_NUM_FIELDS) {
+            reader->error = "too many fields";
+            return _RETAG_ROW_ERROR;
+        }
+        reader->field_offsets[num_fields++] = reader->field_data_bytes;
+
+        if (*cursor == '"') {
+            cursor++;
+
+            for (;;) {
+                size_t run_bytes = strcspn(cursor, "\"");
+                if (!_reader_append(reader, cursor, run_bytes))
+                    goto out_of_memory;
+                cursor += run_bytes;
+
+                if (*cursor == '\0') {
+                    // quoted field continues on the next line
+                    if (!_reader_next_line(reader)) {
+                        reader->error = "unterminated quoted field";
+                        return _RETAG_ROW_ERROR;
+                    }
+                    if (!_reader_append(reader, "\n", 1))
+                        goto out_of_memory;
+                    cursor = reader->line;
+                } else if (cursor[1] == '"') {
+                    if (!_reader_append(reader, "\"", 1))
+                        goto out_of_memory;
+                    cursor += 2;
+                } else {
+                    cursor++;
+                    break;
+                }
+            }
+
+            if (*cursor != ',' && *cursor != '\0') {
+                reader->error = "unexpected character after quoted field";
+                return _RETAG_ROW_ERROR;
+            }
+        } else {
+            size_t field_bytes = strcspn(cursor, ",");
+            if (!_reader_append(reader, cursor, field_bytes))
+                goto out_of_memory;
+            cursor += field_bytes;
+        }
+
+        if (!_reader_append(reader, "", 1))
+            goto out_of_memory;
+
+        if (*cursor == '\0')
+            return _RETAG_ROW_READ;
+        cursor++;
+    }
+
+out_of_memory:
+    reader->error = "out of memory";
+    return _RETAG_ROW_ERROR;
+}
+
+/*
+ * [INTERNAL FUNCTION]
+ * Parses the current line as a flat JSON object. Unknown keys are ignored, null values count as absent.
+ *
+ * Returns: see _reader_read_row()
+ */
+int _reader_read_jsonl_row(_retag_reader* reader) {
+    const char* cursor = reader->line + strspn(reader->line, " \t");
+
+    if (*cursor++ != '{') {
+        reader->error = "expected a JSON object";
+        return _RETAG_ROW_ERROR;
+    }
+
+    cursor += strspn(cursor, " \t");
+    if (*cursor == '}')
+        return _RETAG_ROW_READ;
+
+    for (;;) {
+        cursor += strspn(cursor, " \t");
+
+        // the key is decoded like any field, then dropped
+        size_t key_offset = reader->field_data_bytes;
+        if (*cursor != '"' || !_json_read_string(reader, &cursor))
+            goto malformed;
+
+        int field = -1;
+        for (int i = 0; i < _RETAG_NUM_FIELDS; i++) {
+            if (!strcmp(reader->field_data + key_offset, _retag_field_names[i]))
+                field = i;
+        }
+        reader->field_data_bytes = key_offset;
+
+        cursor += strspn(cursor, " \t");
+        if (*cursor++ != ':')
+            goto malformed;
+        cursor += strspn(cursor, " \t");
+
+        size_t value_offset = reader->field_data_bytes;
+        if (*cursor == '"') {
+            if (!_json_read_string(reader, &cursor))
+                goto malformed;
+        } else if (!strncmp(cursor, "null", 4)) {
+            cursor += 4;
+            value_offset = SIZE_MAX;
+        } else if (*cursor == '-' || (*cursor >= '0' && *cursor <= '9')) {
+            size_t number_bytes = strspn(cursor, "+-.0123456789eE");
+            if (!_reader_append(reader, cursor, number_bytes) || !_reader_append(reader, "", 1))
+                goto malformed;
+            cursor += number_bytes;
+        } else {
+            reader->error = "values must be strings, numbers or null";
+            return _RETAG_ROW_ERROR;
+        }
+
+        if (field != -1)
+            reader->field_offsets[field] = value_offset;
+
+        cursor += strspn(cursor, " \t");
+        if (*cursor == '}')
+            break;
+        if (*cursor++ != ',')
+            goto malformed;
+    }
+
+    cursor++;
+    if (cursor[strspn(cursor, " \t")] != '\0')
+        goto malformed;
+
+    return _RETAG_ROW_READ;
+
+malformed:
+    reader->error = "malformed JSON object";
+    return _RETAG_ROW_ERROR;
+}
+
+/*
+ * [INTERNAL FUNCTION]
+ * Decodes the JSON string starting at *cursor (on its opening quote) into the fields of the current row, null terminated.
+ * *cursor is moved past the closing quote.
+ *
+ * Returns (success): 1
+ * Returns (failure): 0 if the string is malformed or memory runs out
+ */
+int _json_read_string(_retag_reader* reader, const char** cursor) {
+    const char* iter = *cursor + 1;
+
+    for (;;) {
+        size_t run_bytes = strcspn(iter, "\"\\");
+        if (!_reader_append(reader, iter, run_bytes))
+            return 0;
+        iter += run_bytes;
+
+        if (*iter == '\0')
+            return 0;
+        if (*iter == '"')
+            break;
+
+        // escape sequence
+        char escaped;
+        switch (iter[1]) {
+            case '"': escaped = '"'; break;
+            case '\\': escaped = '\\'; break;
+            case '/': escaped = '/'; break;
+            case 'b': escaped = '\b'; break;
+            case 'f': escaped = '\f'; break;
+            case 'n': escaped = '\n'; break;
+            case 'r': escaped = '\r'; break;
+            case 't': escaped = '\t'; break;
+            case 'u': {
+                uint32_t codepoint;
+                if (!_json_read_hex4(iter + 2, &codepoint))
+                    return 0;
+                iter += 6;
+
+                if (codepoint >= 0xD800 && codepoint <= 0xDBFF) {
+                    uint32_t low_surrogate;
+                    if (iter[0] != '\\' || iter[1] != 'u' || !_json_read_hex4(iter + 2, &low_surrogate) || low_surrogate < 0xDC00 || low_surrogate > 0xDFFF)
+                        return 0;
+                    iter += 6;
+                    codepoint = 0x10000 + ((codepoint - 0xD800) << 10) + (low_surrogate - 0xDC00);
+                } else if (codepoint >= 0xDC00 && codepoint <= 0xDFFF) {
+                    return 0;
+                }
+
+                char utf8[4];
+                size_t utf8_bytes;
+                if (codepoint < 0x80) {
+                    utf8[0] = (char)codepoint;
+                    utf8_bytes = 1;
+                } else if (codepoint < 0x800) {
+                    utf8[0] = (char)(0xC0 | (codepoint >> 6));
+                    utf8[1] = (char)(0x80 | (codepoint & 0x3F));
+                    utf8_bytes = 2;
+                } else if (codepoint < 0x10000) {
+                    utf8[0] = (char)(0xE0 | (codepoint >> 12));
+                    utf8[1] = (char)(0x80 | ((codepoint >> 6) & 0x3F));
+                    utf8[2] = (char)(0x80 | (codepoint & 0x3F));
+                    utf8_bytes = 3;
+                } else {
+                    utf8[0] = (char)(0xF0 | (codepoint >> 18));
+                    utf8[1] = (char)(0x80 | ((codepoint >> 12) & 0x3F));
+                    utf8[2] = (char)(0x80 | ((codepoint >> 6) & 0x3F));
+                    utf8[3] = (char)(0x80 | (codepoint & 0x3F));
+                    utf8_bytes = 4;
+                }
+
+                if (!_reader_append(reader, utf8, utf8_bytes))
+                    return 0;
+                continue;
+            }
+            default:
+                return 0;
+        }
+
+        if (!_reader_append(reader, &escaped, 1))
+            return 0;
+        iter += 2;
+    }
+
+    *cursor = iter + 1;
+
+    return _reader_append(reader, "", 1);
+}
+
+/*
+ * [INTERNAL FUNCTION]
+ * Reads the 4 hex digits of a \u escape.
+ *
+ * Returns (success): 1
+ * Returns (failure): 0
+ */
+int _json_read_hex4(const char* cursor, uint32_t* code_unit) {
+    *code_unit = 0;
+
+    for (int i = 0; i < 4; i++) {
+        char digit = cursor[i];
+        *code_unit <<= 4;
+
+        if (digit >= '0' && digit <= '9')
+            *code_unit |= (uint32_t)(digit - '0');
+        else if (digit >= 'a' && digit <= 'f')
+            *code_unit |= (uint32_t)(digit - 'a' + 10);
+        else if (digit >= 'A' && digit <= 'F')
+            *code_unit |= (uint32_t)(digit - 'A' + 10);
+        else
+            return 0;
+    }
+
+    return 1;
+}
+
+/*
+ * [INTERNAL FUNCTION]
+ * Gets a field of the current row.
+ *
+ * Returns (success): the field
+ * Returns (failure): NULL if absent
+ */
+const char* _reader_field(_retag_reader* reader, int field) {
+    return reader->field_offsets[field] != SIZE_MAX ? reader->field_data + reader->field_offsets[field] : NULL;
+}
+
+/*
+ * [INTERNAL FUNCTION]
+ * 64 bit FNV-1a hash of a string.
+ */
+uint64_t _retag_hash(const char* string) {
+    uint64_t hash = 0xCBF29CE484222325ULL;
+
+    for (; *string != '\0'; string++) {
+        hash ^= (uint8_t)*string;
+        hash *= 0x100000001B3ULL;
+    }
+
+    return hash;
+}
+
+/*
+ * [INTERNAL FUNCTION]
+ * Finds the file of the current batch with this path, or starts a new one (writing the batch first if it is full).
+ *
+ * Returns (success): the file
+ * Returns (failure): NULL if memory runs out
+ */
+_retag_file* _retag_file_for_path(_retag_state* state, const char* path, unsigned long long line_number) {
+    size_t slot = (size_t)_retag_hash(path) & (state->num_path_slots - 1);
+
+    while (state->path_slots[slot] != 0) {
+        _retag_file* file = &state->files[state->path_slots[slot] - 1];
+        if (!strcmp(file->path, path))
+            return file;
+        slot = (slot + 1) & (state->num_path_slots - 1);
+    }
+
+    if (state->num_files == state->max_files) {
+        _retag_flush(state);
+        return _retag_file_for_path(state, path, line_number);
+    }
+
+    _retag_file* file = &state->files[state->num_files];
+    size_t path_bytes = strlen(path) + 1;
+
+    file->path = (char*)id3_arena_alloc(&file->builder.arena, path_bytes);
+    file->temp_path = (char*)id3_arena_alloc(&file->builder.arena, path_bytes + strlen(_RETAG_TEMP_SUFFIX));
+    if (file->path == NULL || file->temp_path == NULL)
+        return NULL;
+
+    memcpy(file->path, path, path_bytes);
+    memcpy(file->temp_path, path, path_bytes);
+    strcat(file->temp_path, _RETAG_TEMP_SUFFIX);
+    file->is_invalid = 0;
+    file->outcome = TAG_WRITE_CANCELLED;
+
+    state->path_slots[slot] = ++state->num_files;
+
+    return file;
+}
+
+/*
+ * [INTERNAL FUNCTION]
+ * Adds the frame described by the current row to a file's tag.
+ *
+ * Returns (success): NODE_ADD_SUCCESS, NODE_UPDATE_SUCCESS
+ * Returns (failure): NODE_INVALID_TAG_NAME, NODE_INVALID_TAG_VALUE, NODE_MEMORY_ERROR, NODE_FILE_ERROR
+ */
+unsigned int _retag_add_row(_retag_state* state, _retag_file* file, _retag_reader* reader) {
+    const char* frame = _reader_field(reader, _RETAG_FIELD_FRAME);
+    const char* value = _reader_field(reader, _RETAG_FIELD_VALUE);
+    const char* language = _reader_field(reader, _RETAG_FIELD_LANGUAGE);
+    const char* description = _reader_field(reader, _RETAG_FIELD_DESCRIPTION);
+    const char* mime_type = _reader_field(reader, _RETAG_FIELD_MIME_TYPE);
+    const char* picture_type = _reader_field(reader, _RETAG_FIELD_PICTURE_TYPE);
+
+    if (frame == NULL || strlen(frame) != 4)
+        return NODE_INVALID_TAG_NAME;
+    if (value == NULL || value[0] == '\0')
+        return NODE_INVALID_TAG_VALUE;
+
+    uint32_t frame_id = id3_frame_id_from_string(frame);
+    const id3_frame_info* frame_info = id3_frame_lookup(frame_id);
+    if (frame_info == NULL)
+        return NODE_INVALID_TAG_NAME;
+
+    id3_tag_builder* builder = &file->builder;
+
+    switch (frame_info->category) {
+        case ID3_FRAME_CATEGORY_TEXT:
+            return id3_text_tag_node_add_update_by_id(&builder->text_tag_list, &builder->arena, frame_id, value);
+
+        case ID3_FRAME_CATEGORY_COMMENT:
+            return id3_comment_tag_node_add_update_in_arena(&builder->comment_tag_list, &builder->arena, (char*)(language != NULL ? language : "eng"),
+                                                            (char*)(description != NULL ? description : ""), (char*)value);
+
+        case ID3_FRAME_CATEGORY_USER_TEXT:
+        case ID3_FRAME_CATEGORY_USER_URL:
+            return id3_user_tag_node_add_update_in_arena(&builder->user_tag_list, &builder->arena, frame_id,
+                                                         (char*)(description != NULL ? description : ""), (char*)value);
+
+        case ID3_FRAME_CATEGORY_PICTURE: {
+            if (mime_type == NULL || mime_type[0] == '\0')
+                return NODE_INVALID_TAG_VALUE;
+
+            unsigned long picture_type_value = APIC_TYPE_COVER_FRONT;
+            if (picture_type != NULL && picture_type[0] != '\0') {
+                char* picture_type_end;
+                picture_type_value = strtoul(picture_type, &picture_type_end, 10);
+                if (*picture_type_end != '\0' || picture_type_value > 0xFF)
+                    return NODE_INVALID_TAG_VALUE;
+            }
+
+            return id3_picture_tag_node_add_update_cached(&builder->picture_tag_list, &builder->arena, &state->picture_cache, (char*)mime_type,
+                                                          (uint8_t)picture_type_value, (char*)(description != NULL ? description : ""), value);
+        }
+
+        default:
+            return NODE_INVALID_TAG_NAME;
+    }
+}
+
+/*
+ * [INTERNAL FUNCTION]
+ * Describes a node or tag status code.
+ */
+const char* _retag_outcome_message(unsigned int outcome) {
+    switch (outcome) {
+        case NODE_INVALID_TAG_NAME:
+            return "unknown or unsupported frame";
+        case NODE_INVALID_TAG_VALUE:
+            return "missing or invalid value";
+        case NODE_MEMORY_ERROR:
+            return "out of memory";
+        case NODE_FILE_ERROR:
+            return "cannot read picture file";
+        case TAG_INVALID_VALUE:
+            return "invalid text (not UTF-8?)";
+        case TAG_FILE_ERROR:
+            return "cannot write file";
+        case TAG_WRITE_CANCELLED:
+            return "cancelled";
+        default:
+            return "failed";
+    }
+}
+
+/*
+ * [INTERNAL FUNCTION]
+ * Writes every valid file of the current batch, then empties the batch.
+ */
+void _retag_flush(_retag_state* state) {
+    size_t num_jobs = 0;
+
+    for (size_t i = 0; i < state->num_files; i++) {
+        _retag_file* file = &state->files[i];
+
+        if (file->is_invalid) {
+            state->num_failed++;
+            continue;
+        }
+
+        state->jobs[num_jobs] = (id3_batch_job){.file_path = file->temp_path, .base_tag = NULL, .master_tag = file->builder.master_tag};
+        state->job_files[num_jobs] = file;
+        num_jobs++;
+    }
+
+    if (num_jobs > 0)
+        id3_batch_write(state->jobs, num_jobs, &state->batch_options);
+
+    for (size_t i = 0; i < num_jobs; i++) {
+        if (state->job_files[i]->outcome == TAG_WRITE_SUCCESS)
+            state->num_retagged++;
+        else if (state->job_files[i]->outcome != TAG_WRITE_CANCELLED)
+            state->num_failed++;
+    }
+
+    for (size_t i = 0; i < state->num_files; i++)
+        id3_tag_builder_reset(&state->files[i].builder);
+    memset(state->path_slots, 0, state->num_path_slots * sizeof(size_t));
+    state->num_files = 0;
+
+    if (state->is_progress_shown)
+        fprintf(stderr, "\r%llu files retagged, %llu failed", state->num_retagged, state->num_failed);
+}
+
+/*
+ * [INTERNAL FUNCTION]
+ * Batch callback, on a worker thread: moves a written tag into place and reports failures.
+ */
+void _retag_on_job_done(const id3_batch_job* job, size_t job_index, void* user_data) {
+    _retag_state* state = (_retag_state*)user_data;
+    _retag_file* file = state->job_files[job_index];
+
+    if (job->outcome == TAG_WRITE_SUCCESS) {
+        file->outcome = _retag_finish_file(file);
+    } else {
+        remove(file->temp_path);
+        file->outcome = job->outcome;
+    }
+
+    if (file->outcome != TAG_WRITE_SUCCESS)
+        fprintf(stderr, "%s%s: %s\n", state->is_progress_shown ? "\n" : "", file->path, _retag_outcome_message(file->outcome));
+}
+
+/*
+ * [INTERNAL FUNCTION]
+ * Appends the audio of a file (everything after its ID3v2 tag, if any) to its freshly written tag, then replaces the file with the result
+ * once it is synced to disk.
+ *
+ * Returns (success): TAG_WRITE_SUCCESS
+ * Returns (failure): TAG_FILE_ERROR, the file is left as it was
+ */
+unsigned int _retag_finish_file(_retag_file* file) {
+    static _Thread_local char copy_buffer[_RETAG_COPY_BUFFER_BYTES];
+
+    FILE* original_file_ptr = fopen(file->path, "rb");
+    FILE* temp_file_ptr = fopen(file->temp_path, "ab");
+    int is_copied = original_file_ptr != NULL && temp_file_ptr != NULL;
+
+    if (is_copied) {
+        // skip an existing tag: "ID3", version, flags, 28 bit size (footer of v2.4 tags included)
+        uint8_t header[10];
+        long audio_offset = 0;
+
+        if (fread(header, 1, sizeof(header), original_file_ptr) == sizeof(header) && !memcmp(header, "ID3", 3) &&
+            !((header[6] | header[7] | header[8] | header[9]) & 0x80)) {
+            audio_offset = 10 + (((long)header[6] << 21) | ((long)header[7] << 14) | ((long)header[8] << 7) | (long)header[9]);
+            if (header[3] == 4 && (header[5] & 0x10))
+                audio_offset += 10;
+        }
+
+        is_copied = fseek(original_file_ptr, audio_offset, SEEK_SET) == 0;
+
+        size_t read_bytes;
+        while (is_copied && (read_bytes = fread(copy_buffer, 1, sizeof(copy_buffer), original_file_ptr)) > 0)
+            is_copied = fwrite(copy_buffer, 1, read_bytes, temp_file_ptr) == read_bytes;
+        is_copied = is_copied && !ferror(original_file_ptr);
+
+        struct stat original_file_stat;
+        if (is_copied && fstat(fileno(original_file_ptr), &original_file_stat) == 0)
+            fchmod(fileno(temp_file_ptr), original_file_stat.st_mode & 07777);
+
+        // the result must be on disk before it replaces the original, or a crash right after the rename can lose the audio
+        is_copied = is_copied && fflush(temp_file_ptr) == 0 && fsync(fileno(temp_file_ptr)) == 0;
+    }
+
+    if (original_file_ptr != NULL)
+        fclose(original_file_ptr);
+    if (temp_file_ptr != NULL && fclose(temp_file_ptr) != 0)
+        is_copied = 0;
+
+    if (!is_copied || rename(file->temp_path, file->path) != 0) {
+        remove(file->temp_path);
+        return TAG_FILE_ERROR;
+    }
+
+    return TAG_WRITE_SUCCESS;
+}